@@ -10,6 +10,14 @@ def signal_handler(signal, frame):
     interrupted = True
 
 
+def detected_callback():
+    # Opens the command at the hotword, with some pre-roll, before the ding:
+    # users often start speaking while it plays.
+    utterance = detector.open_utterance(seconds=4)
+    snowboydecoder.play_ding()
+    snowboydecoder.handle_command(utterance)
+
+
 def interrupt_callback():
     global interrupted
     return interrupted
@@ -28,7 +36,7 @@ detector = snowboydecoder.HotwordDetector(model, sensitivity=0.5)
 print('Listening... Press Ctrl+C to exit')
 
 # main loop
-detector.start(detected_callback=snowboydecoder.play_audio_file,
+detector.start(detected_callback=detected_callback,
                interrupt_check=interrupt_callback,
                sleep_time=0.03)
 
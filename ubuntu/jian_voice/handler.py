@@ -11,7 +11,7 @@ from voicetools import BaiduVoice, TuringRobot
 from .settings import BasicConfig as BC, BaiduAPIConfig as BAC
 from .utils import (
     AudioHandler, Keyword, cache, CacheHandler, timestamp, BaiduAPIClient,
-    generate_response, convert_to_wav)
+    generate_response, convert_to_wav, pcm_to_wav)
 
 logger = logging.getLogger()
 
@@ -55,11 +55,18 @@ class BaseHandler(object):
     def __repr__(self):
         return '<BaseHandler>'
 
-    def receive(self, sec=4):
-        self.feedback(generate_response())
-        self.audio_handler.arecord(sec)
+    def receive(self, sec=4, utterance=None):
+        """Recognizes a command. If `utterance` (an UtteranceStream from the
+        hotword detector) is given, the command is taken from the audio that
+        follows the hotword; otherwise it is prompted for and recorded."""
+        if utterance is None:
+            self.feedback(generate_response())
+            self.audio_handler.arecord(sec)
+            audio = 'record.wav'
+        else:
+            audio = pcm_to_wav(utterance.read_all())
         try:
-            return self.bv.asr('record.wav')
+            return self.bv.asr(audio)
         except Exception, e:
             logger.warn('======Baidu ASR failed, %s', traceback.format_exc())
 
@@ -88,9 +95,9 @@ class BaseHandler(object):
             else:
                 self.audio_handler.aplay()
 
-    def worker(self):
+    def worker(self, utterance=None):
         try:
-            results = self.receive()
+            results = self.receive(utterance=utterance)
             func, result = self.process(results)
 	    print "\033[33m ressult: %s \033[0m "%result
             content = self.execute(func, result)
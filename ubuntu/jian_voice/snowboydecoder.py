@@ -2,6 +2,7 @@
 
 import collections
 import pyaudio
+import threading
 import snowboydetect
 import time
 import wave
@@ -12,9 +13,12 @@ import sys
 
 HOME = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
 sys.path.append(HOME)
+# AudioHistory and UtteranceStream are shared with the snowboy examples.
+sys.path.append(os.path.join(HOME, "snowboy/examples/Python"))
 
 from jian_voice.utils import init_logging_handler
 from jian_voice.handler import BaseHandler
+from audio_history import AudioHistory, UtteranceStream
 
 logging.basicConfig()
 logger = logging.getLogger("snowboy")
@@ -42,9 +46,9 @@ class RingBuffer(object):
         return tmp
 
 
-def play_audio_file(fname=DETECT_DING):
-    """Simple callback function to play a wave file. By default it plays
-    a Ding sound.
+def play_ding(fname=DETECT_DING):
+    """Plays a wave file, by default a Ding sound, and returns once it is
+    over.
 
     :param str fname: wave file name
     :return: None
@@ -62,12 +66,35 @@ def play_audio_file(fname=DETECT_DING):
     stream_out.stop_stream()
     stream_out.close()
     audio.terminate()
+
+
+def handle_command(utterance=None):
+    """Recognizes and executes the command that follows the hotword.
+
+    :param utterance: UtteranceStream with the command, see
+                      HotwordDetector.open_utterance(). If None, the command
+                      is recorded separately.
+    :return: None
+    """
     handler = BaseHandler()
-    handler.worker()
+    handler.worker(utterance)
     print '-----play_audio_file Finished!-----'
     print ' '
 
 
+def play_audio_file(fname=DETECT_DING, utterance=None):
+    """Simple callback function to play a wave file. By default it plays
+    a Ding sound, then handles the command.
+
+    :param str fname: wave file name
+    :param utterance: see handle_command(). Open it before the ding, so that
+                      it keeps the audio from the hotword on.
+    :return: None
+    """
+    play_ding(fname)
+    handle_command(utterance)
+
+
 
 class HotwordDetector(object):
     """
@@ -81,14 +108,20 @@ class HotwordDetector(object):
                               decoder. If an empty list is provided, then the
                               default sensitivity in the model will be used.
     :param audio_gain: multiply input volume by this factor.
+    :param history_time: seconds of recent audio kept for open_utterance().
     """
     def __init__(self, decoder_model,
                  resource=RESOURCE_FILE,
                  sensitivity=[],
-                 audio_gain=1):
+                 audio_gain=1,
+                 history_time=5):
 
         def audio_callback(in_data, frame_count, time_info, status):
-            self.ring_buffer.extend(in_data)
+            with self._lock:
+                self.history.extend(in_data)
+                self.ring_buffer.extend(in_data)
+                self._utterances = [u for u in self._utterances
+                                    if u.feed(in_data)]
             play_data = chr(0) * len(in_data)
             return play_data, pyaudio.paContinue
 
@@ -118,6 +151,15 @@ class HotwordDetector(object):
 
         self.ring_buffer = RingBuffer(
             self.detector.NumChannels() * self.detector.SampleRate() * 5)
+        self._bytes_per_frame = \
+            self.detector.NumChannels() * self.detector.BitsPerSample() / 8
+        self._bytes_per_second = \
+            self.detector.SampleRate() * self._bytes_per_frame
+        self.history = AudioHistory(
+            int(self._bytes_per_second * history_time))
+        self.trigger_position = 0
+        self._utterances = []
+        self._lock = threading.Lock()
         self.audio = pyaudio.PyAudio()
         self.stream_in = self.audio.open(
             input=True, output=False,
@@ -170,7 +212,9 @@ class HotwordDetector(object):
             if interrupt_check():
                 logger.debug("detect voice break")
                 break
-            data = self.ring_buffer.get()
+            with self._lock:
+                data = self.ring_buffer.get()
+                position = self.history.total
             if len(data) == 0:
                 time.sleep(sleep_time)
                 continue
@@ -179,6 +223,7 @@ class HotwordDetector(object):
             if ans == -1:
                 logger.warning("Error initializing streams or reading audio data")
             elif ans > 0:
+                self.trigger_position = position
                 message = "Keyword " + str(ans) + " detected at time: "
                 message += time.strftime("%Y-%m-%d %H:%M:%S",
                                          time.localtime(time.time()))
@@ -189,6 +234,36 @@ class HotwordDetector(object):
 
         logger.debug("finished.")
 
+    def open_utterance(self, seconds=4, pre_roll=0.3):
+        """
+        Returns an UtteranceStream with the audio from `pre_roll` seconds
+        before the point where the last hotword was detected, up to `seconds`
+        after it. Call it from `detected_callback` to hand the command that
+        follows the hotword to a speech recognizer, without opening the
+        microphone again.
+
+        :param float seconds: duration of the utterance after the hotword.
+        :param float pre_roll: seconds of audio before the detection point.
+        :return: an UtteranceStream.
+        """
+        def to_bytes(t):
+            return int(t * self._bytes_per_second) // \
+                self._bytes_per_frame * self._bytes_per_frame
+
+        with self._lock:
+            # The pre-roll may reach back further than the history.
+            start = max(self.history.first,
+                        self.trigger_position - to_bytes(pre_roll))
+            stream = UtteranceStream(
+                start, self.trigger_position + to_bytes(seconds),
+                timeout=max(2, seconds))
+            complete = False
+            for view in self.history.view(start):
+                complete = not stream.feed(view)
+            if not complete:
+                self._utterances.append(stream)
+        return stream
+
     def terminate(self):
         """
         Terminate audio stream. Users cannot call start() again to detect.
@@ -197,3 +272,7 @@ class HotwordDetector(object):
         self.stream_in.stop_stream()
         self.stream_in.close()
         self.audio.terminate()
+        with self._lock:
+            for utterance in self._utterances:
+                utterance.close()
+            self._utterances = []
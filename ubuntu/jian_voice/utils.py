@@ -6,6 +6,7 @@ import random
 import base64
 from functools import wraps
 from hashlib import md5
+from StringIO import StringIO
 from subprocess import Popen, PIPE
 from tempfile import TemporaryFile
 
@@ -27,6 +28,19 @@ def convert_to_wav(file_):
     p.wait()
 
 
+def pcm_to_wav(pcm, rate=16000, channels=1, sampwidth=2):
+    """Wraps raw PCM audio in an in-memory WAV file"""
+    buf = StringIO()
+    wf = wave.open(buf, 'wb')
+    wf.setnchannels(channels)
+    wf.setsampwidth(sampwidth)
+    wf.setframerate(rate)
+    wf.writeframes(pcm)
+    wf.close()
+    buf.seek(0)
+    return buf
+
+
 def init_logging_handler():
     handler = TimedRotatingFileHandler(LC.LOGGING_LOCATION, when='MIDNIGHT')
     formatter = logging.Formatter(LC.LOGGING_FORMAT)
@@ -2,7 +2,8 @@
     'targets': [{
         'target_name': 'snowboy',
         'sources': [
-            'swig/Node/snowboy.cc'
+            'swig/Node/snowboy.cc',
+            'swig/C/snowboy-detect-c.cc'
         ],
         'conditions': [
             ['OS=="mac"', {
@@ -33,6 +34,9 @@
                 }
             }]
         ],
+        'defines': [
+            'NAPI_VERSION=<(napi_build_version)'
+        ],
         'cflags': [
             '-std=c++11',
             '-fexceptions',
@@ -46,8 +50,8 @@
             '-fno-exceptions'
         ],
         'include_dirs': [
-            "<!(node -e \"require('nan')\")",
-            "<!(pwd)/include"
+            "<!(pwd)/include",
+            "<!(pwd)"
         ],
         'libraries': [
             '-lcblas'
@@ -0,0 +1 @@
+../../../../../../../swig/Android/java/ai/kitt/snowboy/SWIGTYPE_p_snowboy_detect_t.java
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../../../swig/Android/java/ai/kitt/snowboy/snowboy.java
\ No newline at end of file
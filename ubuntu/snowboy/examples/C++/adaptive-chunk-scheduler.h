@@ -0,0 +1,133 @@
+// examples/C++/adaptive-chunk-scheduler.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_ADAPTIVE_CHUNK_SCHEDULER_H_
+#define SNOWBOY_EXAMPLES_CPP_ADAPTIVE_CHUNK_SCHEDULER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Chooses how much audio to accumulate before the next RunDetection() call.
+// While the detector keeps returning -2 (silence), the chunk grows, which cuts
+// the per-call overhead; as soon as it returns anything else (sound, a
+// hotword or an error), the chunk drops back to its minimum size. Example:
+//
+//   AdaptiveChunkScheduler scheduler(AdaptiveChunkScheduler::Options(),
+//                                    detector.SampleRate());
+//   while (true) {
+//     capture.SetMinReadSamples(scheduler.ChunkSamples());
+//     ... read <num_samples>, time RunDetection() ...
+//     scheduler.Update(result, num_samples, seconds);
+//   }
+//
+// The chunk only grows after <silence_calls_to_grow> silent calls in a row at
+// the current size, so that short pauses between words do not trigger it.
+//
+////////////////////////////////////////////////////////////////////////////////
+class AdaptiveChunkScheduler {
+ public:
+  struct Options {
+    // Chunk size used whenever there is sound, in milliseconds.
+    int min_chunk_ms;
+    // Largest chunk size during silence, in milliseconds. Setting it to
+    // <min_chunk_ms> disables the scheduler.
+    int max_chunk_ms;
+    // Number of consecutive -2 results at the current size before growing.
+    int silence_calls_to_grow;
+    // The chunk size is multiplied by this factor every time it grows.
+    float growth_factor;
+
+    Options() : min_chunk_ms(100), max_chunk_ms(500), silence_calls_to_grow(3),
+                growth_factor(2) {}
+  };
+
+  // <samples_per_second> is the sample rate times the number of channels.
+  AdaptiveChunkScheduler(const Options& options, int samples_per_second)
+      : options_(options), samples_per_second_(samples_per_second) {
+    options_.max_chunk_ms = std::max(options_.max_chunk_ms,
+                                     options_.min_chunk_ms);
+    options_.growth_factor = std::max(options_.growth_factor, 1.01f);
+    chunk_ms_ = options_.min_chunk_ms;
+    num_silent_calls_ = 0;
+    num_calls_ = 0;
+    num_grown_calls_ = 0;
+    num_samples_ = 0;
+    run_seconds_ = 0;
+    num_min_chunk_samples_ = 0;
+    min_chunk_run_seconds_ = 0;
+  }
+
+  // Number of samples to wait for before the next RunDetection() call.
+  int64_t ChunkSamples() const {
+    return static_cast<int64_t>(chunk_ms_) * samples_per_second_ / 1000;
+  }
+
+  int ChunkMs() const { return chunk_ms_; }
+
+  // Reports the <result> of RunDetection() on <num_samples> samples, which
+  // took <seconds>, and updates the chunk size. Returns true if the chunk
+  // size changed.
+  bool Update(int result, int64_t num_samples, double seconds) {
+    num_calls_++;
+    num_samples_ += num_samples;
+    run_seconds_ += seconds;
+    if (chunk_ms_ == options_.min_chunk_ms) {
+      num_min_chunk_samples_ += num_samples;
+      min_chunk_run_seconds_ += seconds;
+    } else {
+      num_grown_calls_++;
+    }
+
+    const int previous_chunk_ms = chunk_ms_;
+    if (result != -2) {
+      num_silent_calls_ = 0;
+      chunk_ms_ = options_.min_chunk_ms;
+    } else if (++num_silent_calls_ >= options_.silence_calls_to_grow) {
+      num_silent_calls_ = 0;
+      chunk_ms_ = std::min(options_.max_chunk_ms, std::max(
+          chunk_ms_ + 1, static_cast<int>(chunk_ms_ * options_.growth_factor)));
+    }
+    return chunk_ms_ != previous_chunk_ms;
+  }
+
+  // Prints the CPU time saved per hour of audio compared with always using
+  // <min_chunk_ms>, estimated from the cost per sample of the calls made at
+  // the minimum size, and the worst-case latency this adds: a hotword that
+  // starts right after a silent stretch waits for a full maximum-size chunk.
+  void PrintReport(std::ostream& os) const {
+    double audio_hours = static_cast<double>(num_samples_) /
+        samples_per_second_ / 3600;
+    os << "Adaptive chunk: " << num_calls_ << " RunDetection() calls, "
+        << num_grown_calls_ << " with a grown chunk, current chunk "
+        << chunk_ms_ << " ms." << std::endl;
+    if (audio_hours <= 0 || num_min_chunk_samples_ == 0) {
+      return;
+    }
+    double fixed_run_seconds = min_chunk_run_seconds_ /
+        num_min_chunk_samples_ * num_samples_;
+    os << "CPU per audio hour: " << run_seconds_ / audio_hours
+        << " s adaptive, " << fixed_run_seconds / audio_hours << " s with "
+        << options_.min_chunk_ms << " ms chunks, saving "
+        << (fixed_run_seconds - run_seconds_) / audio_hours << " s per hour, "
+        << "for up to " << options_.max_chunk_ms - options_.min_chunk_ms
+        << " ms added worst-case latency." << std::endl;
+  }
+
+ private:
+  Options options_;
+  int samples_per_second_;
+  int chunk_ms_;
+  int num_silent_calls_;
+
+  // Report statistics.
+  int64_t num_calls_;
+  int64_t num_grown_calls_;
+  int64_t num_samples_;
+  double run_seconds_;
+  int64_t num_min_chunk_samples_;
+  double min_chunk_run_seconds_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_ADAPTIVE_CHUNK_SCHEDULER_H_
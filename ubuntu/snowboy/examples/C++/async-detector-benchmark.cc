@@ -0,0 +1,239 @@
+// examples/C++/async-detector-benchmark.cc
+
+// Measures the throughput of AsyncDetector (async-detector.h) against calling
+// RunDetection() on the feeding thread, for several numbers of concurrent
+// sessions. Every session replays the same recording on its own detector;
+// the feeding thread submits one chunk per session in turn, as an event loop
+// would, and collects completions whenever a session's queue is full.
+//
+// Modes:
+//   sync:      RunDetection() on the feeding thread;
+//   unbatched: AsyncDetector taking one chunk of one session per wake-up;
+//   batched:   AsyncDetector with the default batching.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include "async-detector.h"
+#include "include/snowboy-detect.h"
+#include "latency-histogram.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+std::vector<int> ParseIntList(const std::string& str) {
+  std::vector<int> values;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+// Voluntary and involuntary context switches of the process so far.
+int64_t ContextSwitches() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+struct Run {
+  int64_t num_chunks;
+  int64_t num_detections;
+  double wall_seconds;
+  int64_t context_switches;
+  double sessions_per_batch;
+  LatencyHistogram latency;
+};
+
+// Feeds <repeat> replays of <samples> to each of the <detectors> in
+// <chunk_samples> chunks.
+Run Replay(const std::string& mode, int num_threads,
+           const std::vector<snowboy::SnowboyDetect*>& detectors,
+           const std::vector<int16_t>& samples, int chunk_samples,
+           int repeat) {
+  Run run;
+  run.num_chunks = 0;
+  run.num_detections = 0;
+  run.sessions_per_batch = 0;
+  const int64_t num_samples = samples.size();
+  for (size_t i = 0; i < detectors.size(); ++i) {
+    detectors[i]->Reset();
+  }
+
+  std::unique_ptr<AsyncDetector> async;
+  std::vector<int64_t> sessions;
+  if (mode != "sync") {
+    AsyncDetector::Options options;
+    options.num_threads = num_threads;
+    if (mode == "unbatched") {
+      options.max_sessions_per_batch = 1;
+      options.max_chunks_per_session = 1;
+    }
+    async.reset(new AsyncDetector(options));
+    for (size_t i = 0; i < detectors.size(); ++i) {
+      sessions.push_back(async->AddSession(detectors[i]));
+    }
+  }
+
+  std::vector<AsyncDetector::Completion> completions;
+  int64_t num_submitted = 0;
+  int64_t switches_start = ContextSwitches();
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; ++r) {
+    for (int64_t offset = 0; offset < num_samples; offset += chunk_samples) {
+      const int size = static_cast<int>(
+          std::min<int64_t>(chunk_samples, num_samples - offset));
+      for (size_t s = 0; s < detectors.size(); ++s) {
+        if (!async) {
+          std::chrono::steady_clock::time_point call_start =
+              std::chrono::steady_clock::now();
+          if (detectors[s]->RunDetection(samples.data() + offset, size) > 0) {
+            run.num_detections++;
+          }
+          run.latency.Record(std::chrono::duration<double, std::micro>(
+              std::chrono::steady_clock::now() - call_start).count());
+          run.num_chunks++;
+          continue;
+        }
+        while (!async->Submit(sessions[s], samples.data() + offset, size)) {
+          async->WaitCompletions(&completions, 100);
+        }
+        num_submitted++;
+      }
+      // Collects what is ready without waiting, as an event loop would.
+      if (async) {
+        async->PollCompletions(&completions);
+      }
+      for (size_t i = 0; i < completions.size(); ++i) {
+        run.latency.Record(completions[i].latency_us);
+        run.num_detections += completions[i].result > 0;
+      }
+      run.num_chunks += completions.size();
+      completions.clear();
+    }
+  }
+  while (async && run.num_chunks < num_submitted) {
+    async->WaitCompletions(&completions, 100);
+    for (size_t i = 0; i < completions.size(); ++i) {
+      run.latency.Record(completions[i].latency_us);
+      run.num_detections += completions[i].result > 0;
+    }
+    run.num_chunks += completions.size();
+    completions.clear();
+  }
+  run.wall_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  run.context_switches = ContextSwitches() - switches_start;
+  if (async) {
+    AsyncDetector::Stats stats = async->GetStats();
+    run.sessions_per_batch = stats.num_batches > 0 ?
+        stats.num_batched_sessions * 1.0 / stats.num_batches : 0;
+  }
+  return run;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Benchmarks AsyncDetector throughput against synchronous calls.\n"
+      "Prints one CSV line per (mode, sessions) to stdout:\n"
+      "  mode,sessions,threads,chunks,realtime_x,chunks_per_s,p50_us,p99_us,\n"
+      "  sessions_per_batch,switches_per_1k_chunks,detections\n"
+      "realtime_x is the seconds of audio processed per wall second, over all\n"
+      "sessions; p50_us and p99_us are the submit-to-completion latencies.\n"
+      "\n"
+      "Usage: ./async-detector-benchmark [options]\n"
+      "e.g.: ./async-detector-benchmark --sessions=1,8,64 --threads=4\n";
+
+  std::string resource_filename = "resources/common.res";
+  std::string model_filename = "resources/snowboy.umdl";
+  std::string sensitivity_str = "0.5";
+  std::string wave_filename = "resources/snowboy.wav";
+  std::string sessions_str = "1,8,64";
+  int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  int chunk_ms = 20;
+  int repeat = 4;
+
+  ParseOptions po(usage);
+  po.Register("resource", &resource_filename, "Resource file.");
+  po.Register("model", &model_filename, "Hotword model(s).");
+  po.Register("sensitivity", &sensitivity_str, "Sensitivity string.");
+  po.Register("wav", &wave_filename, "Recording replayed by every session.");
+  po.Register("sessions", &sessions_str,
+              "Comma separated numbers of concurrent sessions.");
+  po.Register("threads", &num_threads, "Worker threads of AsyncDetector.");
+  po.Register("chunk-ms", &chunk_ms, "Chunk size in milliseconds.");
+  po.Register("repeat", &repeat, "Number of times --wav is replayed.");
+  po.Read(argc, argv);
+
+  std::vector<int> num_sessions = ParseIntList(sessions_str);
+  if (num_sessions.empty() || *std::min_element(num_sessions.begin(),
+                                                num_sessions.end()) <= 0 ||
+      num_threads <= 0 || chunk_ms <= 0 || repeat <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  MappedWaveFile wave;
+  std::string error;
+  if (!wave.Open(wave_filename, &error)) {
+    std::cerr << "Fail to read " << wave_filename << ": " << error << std::endl;
+    exit(1);
+  }
+  std::vector<int16_t> samples(wave.Info().data_size / sizeof(int16_t));
+  memcpy(samples.data(), wave.Data(), samples.size() * sizeof(int16_t));
+
+  const int max_sessions = *std::max_element(num_sessions.begin(),
+                                             num_sessions.end());
+  std::vector<std::unique_ptr<snowboy::SnowboyDetect> > owned;
+  std::vector<snowboy::SnowboyDetect*> detectors;
+  for (int i = 0; i < max_sessions; ++i) {
+    owned.push_back(std::unique_ptr<snowboy::SnowboyDetect>(
+        new snowboy::SnowboyDetect(resource_filename, model_filename)));
+    owned.back()->SetSensitivity(sensitivity_str);
+    detectors.push_back(owned.back().get());
+  }
+  if (wave.Info().sample_rate != detectors[0]->SampleRate() ||
+      wave.Info().num_channels != detectors[0]->NumChannels() ||
+      wave.Info().bits_per_sample != detectors[0]->BitsPerSample()) {
+    std::cerr << wave_filename << " does not match the detector format."
+        << std::endl;
+    exit(1);
+  }
+  const int sample_rate = detectors[0]->SampleRate() *
+      detectors[0]->NumChannels();
+  const int chunk_samples = std::max(1, chunk_ms * sample_rate / 1000);
+
+  std::cout << "mode,sessions,threads,chunks,realtime_x,chunks_per_s,p50_us,"
+      << "p99_us,sessions_per_batch,switches_per_1k_chunks,detections"
+      << std::endl;
+  const char* modes[] = {"sync", "unbatched", "batched"};
+  for (size_t n = 0; n < num_sessions.size(); ++n) {
+    std::vector<snowboy::SnowboyDetect*> session_detectors(
+        detectors.begin(), detectors.begin() + num_sessions[n]);
+    for (size_t m = 0; m < 3; ++m) {
+      Run run = Replay(modes[m], num_threads, session_detectors, samples,
+                       chunk_samples, repeat);
+      double audio_seconds =
+          static_cast<double>(samples.size()) * repeat * num_sessions[n] /
+          sample_rate;
+      std::cout << modes[m] << "," << num_sessions[n] << ","
+          << (m == 0 ? 1 : num_threads) << "," << run.num_chunks << ","
+          << audio_seconds / run.wall_seconds << ","
+          << run.num_chunks / run.wall_seconds << ","
+          << run.latency.Percentile(50) << ","
+          << run.latency.Percentile(99) << "," << run.sessions_per_batch
+          << "," << run.context_switches * 1000.0 / run.num_chunks << ","
+          << run.num_detections << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,407 @@
+// examples/C++/async-detector.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_ASYNC_DETECTOR_H_
+#define SNOWBOY_EXAMPLES_CPP_ASYNC_DETECTOR_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+#include "latency-histogram.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Runs detection for many streams ("sessions") on a pool of worker threads,
+// so that the thread feeding the audio, e.g., the event loop of a binding,
+// never blocks in RunDetection(). Callers Submit() chunks and collect one
+// Completion per chunk, either from a callback run on the workers or from a
+// completion queue whose notify_fd() can be polled next to other file
+// descriptors. Example:
+//
+//   AsyncDetector async(AsyncDetector::Options());
+//   int64_t session = async.AddSession(&detector);
+//   async.Submit(session, data, num_samples);
+//   ...
+//   std::vector<AsyncDetector::Completion> completions;
+//   async.WaitCompletions(&completions, 100);
+//
+// Work is batched to cut context switches: a worker wakes up once for up to
+// <max_sessions_per_batch> ready sessions, runs all the queued chunks of one
+// session back to back, so that its detector stays in cache, and hands the
+// results of the whole batch over at once. Chunks of a session are processed
+// in order, by one worker at a time.
+//
+// Thread-safe. Detectors are owned by the caller and must stay alive until
+// their session is removed.
+//
+////////////////////////////////////////////////////////////////////////////////
+class AsyncDetector {
+ public:
+  struct Completion {
+    int64_t session;
+    // Tag given to Submit().
+    uint64_t tag;
+    // Return value of RunDetection().
+    int result;
+    int num_samples;
+    // Time from Submit() to the end of RunDetection(), and of RunDetection()
+    // alone.
+    double latency_us;
+    double run_us;
+  };
+
+  typedef std::function<void(const Completion&)> Callback;
+
+  struct Options {
+    int num_threads;
+    // Ready sessions taken by a worker per wake-up.
+    int max_sessions_per_batch;
+    // Chunks of one session run before moving on to the next session.
+    int max_chunks_per_session;
+    // Submit() fails when a session has that many chunks queued.
+    int max_pending_chunks;
+    // If set, called on a worker thread for every completion, in batch
+    // order, instead of queuing it. Must not call RemoveSession().
+    Callback callback;
+
+    Options() : num_threads(std::max(1u, std::thread::hardware_concurrency())),
+                max_sessions_per_batch(16), max_chunks_per_session(8),
+                max_pending_chunks(64) {}
+  };
+
+  struct Stats {
+    int64_t num_chunks;
+    int64_t num_batches;
+    // Sessions served by all batches; over <num_batches>, the batch size.
+    int64_t num_batched_sessions;
+    int64_t num_rejected;
+  };
+
+  explicit AsyncDetector(const Options& options)
+      : options_(options), stopping_(false), next_session_(1),
+        num_idle_workers_(0), num_chunks_(0), num_batches_(0),
+        num_batched_sessions_(0), num_rejected_(0) {
+    notify_fds_[0] = notify_fds_[1] = -1;
+    if (pipe(notify_fds_) != 0) {
+      std::cerr << "Fail to create the completion pipe." << std::endl;
+      notify_fds_[0] = notify_fds_[1] = -1;
+    } else {
+      for (int i = 0; i < 2; ++i) {
+        fcntl(notify_fds_[i], F_SETFL,
+              fcntl(notify_fds_[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(notify_fds_[i], F_SETFD, FD_CLOEXEC);
+      }
+    }
+    for (int i = 0; i < std::max(1, options_.num_threads); ++i) {
+      workers_.push_back(std::thread(&AsyncDetector::WorkerLoop, this));
+    }
+  }
+
+  // Stops the workers after their current batch. Chunks still queued are
+  // dropped without a completion.
+  ~AsyncDetector() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].join();
+    }
+    for (int i = 0; i < 2; ++i) {
+      if (notify_fds_[i] >= 0) {
+        close(notify_fds_[i]);
+      }
+    }
+  }
+
+  // Starts a session on <detector> and returns its id.
+  int64_t AddSession(snowboy::SnowboyDetect* detector) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t id = next_session_++;
+    std::unique_ptr<Session>& session = sessions_[id];
+    session.reset(new Session());
+    session->id = id;
+    session->detector = detector;
+    session->queued = false;
+    session->running = false;
+    return id;
+  }
+
+  // Ends <session>, waiting for a chunk being processed to finish. Queued
+  // chunks are dropped without a completion; returns their number, or -1 if
+  // the session does not exist. The detector can be reused afterwards.
+  int RemoveSession(int64_t session_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::map<int64_t, std::unique_ptr<Session> >::iterator it =
+        sessions_.find(session_id);
+    if (it == sessions_.end()) {
+      return -1;
+    }
+    Session* session = it->second.get();
+    while (session->running) {
+      idle_cv_.wait(lock);
+    }
+    if (session->queued) {
+      ready_.erase(std::find(ready_.begin(), ready_.end(), session));
+    }
+    int num_dropped = session->pending.size();
+    sessions_.erase(it);
+    return num_dropped;
+  }
+
+  // Queues <num_samples> samples of <data> (copied) for <session>. Returns
+  // false if the chunk is empty, the session does not exist or it already
+  // has <max_pending_chunks> chunks queued; in the last case, the caller
+  // should collect completions and retry.
+  bool Submit(int64_t session, const int16_t* data, int num_samples,
+              bool is_end = false, uint64_t tag = 0) {
+    return Submit(session, std::vector<int16_t>(data, data + num_samples),
+                  is_end, tag);
+  }
+
+  // Same as above, taking over <samples> without a copy.
+  bool Submit(int64_t session_id, std::vector<int16_t>&& samples,
+              bool is_end = false, uint64_t tag = 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<int64_t, std::unique_ptr<Session> >::iterator it =
+        sessions_.find(session_id);
+    if (samples.empty() || it == sessions_.end() ||
+        static_cast<int>(it->second->pending.size()) >=
+        options_.max_pending_chunks) {
+      num_rejected_++;
+      return false;
+    }
+    Session* session = it->second.get();
+    session->pending.push_back(Chunk());
+    Chunk& chunk = session->pending.back();
+    chunk.samples = std::move(samples);
+    chunk.is_end = is_end;
+    chunk.tag = tag;
+    chunk.submitted = std::chrono::steady_clock::now();
+    if (!session->queued) {
+      session->queued = true;
+      ready_.push_back(session);
+      // Busy workers come back for the ready queue on their own; only wake
+      // an idle one.
+      if (num_idle_workers_ > 0) {
+        work_cv_.notify_one();
+      }
+    }
+    return true;
+  }
+
+  // Moves up to <max> queued completions to <completions>, without blocking.
+  // Returns their number.
+  size_t PollCompletions(std::vector<Completion>* completions,
+                         size_t max = std::numeric_limits<size_t>::max()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return TakeCompletions(completions, max);
+  }
+
+  // Same as PollCompletions(), but waits up to <timeout_ms> for at least one
+  // completion.
+  size_t WaitCompletions(std::vector<Completion>* completions, int timeout_ms,
+                         size_t max = std::numeric_limits<size_t>::max()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    completion_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                            [this] { return !completions_.empty(); });
+    return TakeCompletions(completions, max);
+  }
+
+  // Readable while completions are queued; for select(), poll(), epoll or an
+  // event loop of a binding. -1 if it could not be created.
+  int notify_fd() const { return notify_fds_[0]; }
+
+  Stats GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.num_chunks = num_chunks_;
+    stats.num_batches = num_batches_;
+    stats.num_batched_sessions = num_batched_sessions_;
+    stats.num_rejected = num_rejected_;
+    return stats;
+  }
+
+  void PrintReport(std::ostream& os) const {
+    Stats stats = GetStats();
+    os << "Async detector: " << stats.num_chunks << " chunks in "
+        << stats.num_batches << " batches ("
+        << (stats.num_batches > 0 ?
+            stats.num_batched_sessions * 1.0 / stats.num_batches : 0)
+        << " sessions per batch), " << stats.num_rejected
+        << " submits rejected." << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    latency_.Print("Submit to completion", os);
+    run_time_.Print("RunDetection()", os);
+  }
+
+ private:
+  struct Chunk {
+    std::vector<int16_t> samples;
+    bool is_end;
+    uint64_t tag;
+    std::chrono::steady_clock::time_point submitted;
+  };
+
+  struct Session {
+    int64_t id;
+    snowboy::SnowboyDetect* detector;
+    std::deque<Chunk> pending;
+    // Chunks taken by a worker.
+    std::vector<Chunk> running_chunks;
+    // In <ready_> or held by a worker.
+    bool queued;
+    bool running;
+  };
+
+  AsyncDetector(const AsyncDetector&);
+  AsyncDetector& operator=(const AsyncDetector&);
+
+  // Called with <mutex_> held.
+  size_t TakeCompletions(std::vector<Completion>* completions, size_t max) {
+    size_t n = std::min(max, completions_.size());
+    completions->insert(completions->end(), completions_.begin(),
+                        completions_.begin() + n);
+    completions_.erase(completions_.begin(), completions_.begin() + n);
+    if (completions_.empty() && notify_fds_[0] >= 0) {
+      char buffer[64];
+      while (read(notify_fds_[0], buffer, sizeof(buffer)) > 0) {
+      }
+    }
+    return n;
+  }
+
+  void WorkerLoop() {
+    std::vector<Session*> batch;
+    std::vector<Completion> results;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!stopping_ && ready_.empty()) {
+        num_idle_workers_++;
+        work_cv_.wait(lock);
+        num_idle_workers_--;
+      }
+      if (stopping_) {
+        return;
+      }
+
+      batch.clear();
+      while (!ready_.empty() &&
+             static_cast<int>(batch.size()) < options_.max_sessions_per_batch) {
+        Session* session = ready_.front();
+        ready_.pop_front();
+        session->running = true;
+        session->running_chunks.clear();
+        while (!session->pending.empty() &&
+               static_cast<int>(session->running_chunks.size()) <
+               options_.max_chunks_per_session) {
+          session->running_chunks.push_back(
+              std::move(session->pending.front()));
+          session->pending.pop_front();
+        }
+        batch.push_back(session);
+      }
+      num_batches_++;
+      num_batched_sessions_ += batch.size();
+      lock.unlock();
+
+      results.clear();
+      for (size_t i = 0; i < batch.size(); ++i) {
+        Session* session = batch[i];
+        for (size_t c = 0; c < session->running_chunks.size(); ++c) {
+          const Chunk& chunk = session->running_chunks[c];
+          std::chrono::steady_clock::time_point start =
+              std::chrono::steady_clock::now();
+          Completion completion;
+          completion.session = session->id;
+          completion.tag = chunk.tag;
+          completion.num_samples = chunk.samples.size();
+          completion.result = session->detector->RunDetection(
+              chunk.samples.data(), completion.num_samples, chunk.is_end);
+          std::chrono::steady_clock::time_point end =
+              std::chrono::steady_clock::now();
+          completion.run_us =
+              std::chrono::duration<double, std::micro>(end - start).count();
+          completion.latency_us = std::chrono::duration<double, std::micro>(
+              end - chunk.submitted).count();
+          results.push_back(completion);
+        }
+      }
+      if (options_.callback) {
+        for (size_t i = 0; i < results.size(); ++i) {
+          options_.callback(results[i]);
+        }
+      }
+
+      lock.lock();
+      for (size_t i = 0; i < batch.size(); ++i) {
+        Session* session = batch[i];
+        session->running = false;
+        session->running_chunks.clear();
+        if (session->pending.empty()) {
+          session->queued = false;
+        } else {
+          ready_.push_back(session);
+        }
+      }
+      for (size_t i = 0; i < results.size(); ++i) {
+        latency_.Record(results[i].latency_us);
+        run_time_.Record(results[i].run_us);
+      }
+      num_chunks_ += results.size();
+      if (!options_.callback && !results.empty()) {
+        if (completions_.empty() && notify_fds_[1] >= 0) {
+          char byte = 0;
+          if (write(notify_fds_[1], &byte, 1) < 0) {
+            // Full: the reader has been notified already.
+          }
+        }
+        completions_.insert(completions_.end(), results.begin(),
+                            results.end());
+        completion_cv_.notify_all();
+      }
+      idle_cv_.notify_all();
+    }
+  }
+
+  const Options options_;
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable completion_cv_;
+  // Signaled when a batch is done, for RemoveSession().
+  std::condition_variable idle_cv_;
+  bool stopping_;
+  int64_t next_session_;
+  int num_idle_workers_;
+  std::map<int64_t, std::unique_ptr<Session> > sessions_;
+  // Sessions with queued chunks that no worker holds, oldest first.
+  std::deque<Session*> ready_;
+  std::deque<Completion> completions_;
+  int notify_fds_[2];
+  std::vector<std::thread> workers_;
+
+  int64_t num_chunks_;
+  int64_t num_batches_;
+  int64_t num_batched_sessions_;
+  int64_t num_rejected_;
+  LatencyHistogram latency_;
+  LatencyHistogram run_time_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_ASYNC_DETECTOR_H_
@@ -0,0 +1,289 @@
+// examples/C++/audio-converter-benchmark.cc
+
+// Measures the CPU cost per stream of converting capture formats to the
+// detector format with AudioConverter, with and without SIMD, against the
+// conversion ALSA's "plug" device does by default: scalar format conversion
+// and channel averaging followed by its "linear" rate converter, re-created
+// here in process so that no sound card is needed. For every input format,
+// the pass-band gain (1 kHz tone) and the aliasing of a 12 kHz tone, which
+// folds down to 4 kHz at 16 kHz, are reported next to the CPU cost.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "audio-converter.h"
+#include "parse-options.h"
+
+// Input format of one benchmark case.
+struct InputFormat {
+  int sample_rate;
+  int num_channels;
+  SampleFormat format;
+  std::string name;
+};
+
+// The equivalent of ALSA's default "rate" plugin: linear interpolation on
+// int16 with a 16.16 fixed-point position.
+class LinearResampler {
+ public:
+  LinearResampler(int input_rate, int output_rate)
+      : pitch_((static_cast<int64_t>(input_rate) << 16) / output_rate),
+        position_(0), previous_(0) {}
+
+  int64_t Process(const int16_t* input, int64_t num_samples, int16_t* output) {
+    // <position_> is relative to the sample before <input>, i.e.,
+    // <previous_>.
+    int64_t num_output = 0;
+    while ((position_ >> 16) < num_samples) {
+      int64_t index = position_ >> 16;
+      int32_t frac = static_cast<int32_t>(position_ & 0xffff);
+      int32_t x0 = index == 0 ? previous_ : input[index - 1];
+      int32_t x1 = input[index];
+      output[num_output++] = static_cast<int16_t>(
+          x0 + (((x1 - x0) * frac) >> 16));
+      position_ += pitch_;
+    }
+    position_ -= num_samples << 16;
+    if (num_samples > 0) {
+      previous_ = input[num_samples - 1];
+    }
+    return num_output;
+  }
+
+ private:
+  int64_t pitch_;
+  int64_t position_;
+  int16_t previous_;
+};
+
+// Scalar format conversion, channel averaging and linear resampling, as in
+// ALSA's plug chain.
+class PlugConverter {
+ public:
+  PlugConverter(const InputFormat& input, int output_rate)
+      : input_(input), resampler_(input.sample_rate, output_rate) {}
+
+  int64_t Convert(const void* data, int64_t num_frames, int16_t* output) {
+    mixed_.resize(num_frames);
+    mixed_int16_.resize(num_frames);
+    DownmixToFloat(data, input_.format, input_.num_channels, num_frames,
+                   false, mixed_.data());
+    FloatToInt16(mixed_.data(), num_frames, false, mixed_int16_.data());
+    return resampler_.Process(mixed_int16_.data(), num_frames, output);
+  }
+
+ private:
+  InputFormat input_;
+  LinearResampler resampler_;
+  std::vector<float> mixed_;
+  std::vector<int16_t> mixed_int16_;
+};
+
+// Interleaved input buffer holding <seconds> of a sine tone of <frequency> Hz
+// at half of full scale, on every channel.
+std::vector<char> MakeTone(const InputFormat& input, double frequency,
+                           double seconds) {
+  const int64_t num_frames = static_cast<int64_t>(seconds * input.sample_rate);
+  const int bytes = BytesPerSample(input.format);
+  const double pi = 3.14159265358979323846;
+  std::vector<char> buffer(num_frames * input.num_channels * bytes);
+  for (int64_t i = 0; i < num_frames; ++i) {
+    double x = 0.5 * std::sin(2 * pi * frequency * i / input.sample_rate);
+    for (int c = 0; c < input.num_channels; ++c) {
+      char* sample = buffer.data() + (i * input.num_channels + c) * bytes;
+      switch (input.format) {
+        case kSampleInt16: {
+          int16_t value = static_cast<int16_t>(lrint(x * 32767));
+          memcpy(sample, &value, sizeof(value));
+          break;
+        }
+        case kSampleInt24: {
+          int32_t value = static_cast<int32_t>(lrint(x * 8388607));
+          sample[0] = static_cast<char>(value & 0xff);
+          sample[1] = static_cast<char>((value >> 8) & 0xff);
+          sample[2] = static_cast<char>((value >> 16) & 0xff);
+          break;
+        }
+        case kSampleInt32: {
+          int32_t value = static_cast<int32_t>(lrint(x * 2147483647.0));
+          memcpy(sample, &value, sizeof(value));
+          break;
+        }
+        case kSampleFloat32: {
+          float value = static_cast<float>(x);
+          memcpy(sample, &value, sizeof(value));
+          break;
+        }
+      }
+    }
+  }
+  return buffer;
+}
+
+double ThreadCpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Converts <buffer> in blocks of <block_frames> frames, as an audio callback
+// would, and returns the output.
+template<typename Converter>
+std::vector<int16_t> ConvertAll(Converter* converter, const InputFormat& input,
+                                const std::vector<char>& buffer,
+                                int block_frames, double* cpu_seconds) {
+  const int frame_bytes = BytesPerSample(input.format) * input.num_channels;
+  const int64_t num_frames = buffer.size() / frame_bytes;
+  std::vector<int16_t> output(num_frames + 1024);
+  int64_t num_output = 0;
+  double start = ThreadCpuSeconds();
+  for (int64_t offset = 0; offset < num_frames; offset += block_frames) {
+    int64_t size = std::min<int64_t>(block_frames, num_frames - offset);
+    num_output += converter->Convert(buffer.data() + offset * frame_bytes,
+                                     size, output.data() + num_output);
+  }
+  *cpu_seconds = ThreadCpuSeconds() - start;
+  output.resize(num_output);
+  return output;
+}
+
+// RMS level of <samples>, skipping the first 100 ms of filter settling, in dB
+// relative to the level of the half-scale input tone.
+double LevelDb(const std::vector<int16_t>& samples, int sample_rate) {
+  size_t start = std::min<size_t>(samples.size(), sample_rate / 10);
+  double sum = 0;
+  for (size_t i = start; i < samples.size(); ++i) {
+    sum += static_cast<double>(samples[i]) * samples[i];
+  }
+  double rms = std::sqrt(sum / std::max<size_t>(1, samples.size() - start));
+  double reference = 0.5 * 32767 / std::sqrt(2.0);
+  return 20 * std::log10(std::max(rms, 1e-3) / reference);
+}
+
+// Prints the CSV line of one (input format, converter) pair; <make_converter>
+// returns a new converter from <input> to <output_rate>.
+template<typename Converter>
+void RunCase(const std::string& mode,
+             Converter* (*make_converter)(const InputFormat&, int),
+             const InputFormat& input, int output_rate, int block_frames,
+             double seconds) {
+  double cpu_seconds = 0, unused = 0;
+  Converter* converter = make_converter(input, output_rate);
+  std::vector<int16_t> output = ConvertAll(
+      converter, input, MakeTone(input, 1000, seconds), block_frames,
+      &cpu_seconds);
+  delete converter;
+  double pass_band_db = LevelDb(output, output_rate);
+
+  converter = make_converter(input, output_rate);
+  output = ConvertAll(converter, input, MakeTone(input, 12000, 1),
+                      block_frames, &unused);
+  delete converter;
+  double alias_db = LevelDb(output, output_rate);
+
+  std::cout << input.name << "," << mode << ","
+      << cpu_seconds / seconds * 3600 << "," << cpu_seconds / seconds << ","
+      << seconds / std::max(cpu_seconds, 1e-9) << "," << pass_band_db << ","
+      << alias_db << std::endl;
+}
+
+// Factories for RunCase().
+bool use_simd = true;
+int taps_per_phase = 128;
+
+AudioConverter* NewAudioConverter(const InputFormat& input, int output_rate) {
+  AudioConverter::Options options;
+  options.input_rate = input.sample_rate;
+  options.input_channels = input.num_channels;
+  options.input_format = input.format;
+  options.output_rate = output_rate;
+  options.taps_per_phase = taps_per_phase;
+  options.use_simd = use_simd;
+  return new AudioConverter(options);
+}
+
+PlugConverter* NewPlugConverter(const InputFormat& input, int output_rate) {
+  return new PlugConverter(input, output_rate);
+}
+
+// Parses "<rate>:<channels>:<format>", e.g., "48000:2:int16".
+bool ParseInputFormat(const std::string& str, InputFormat* input) {
+  std::stringstream ss(str);
+  std::string rate, channels, format;
+  if (!std::getline(ss, rate, ':') || !std::getline(ss, channels, ':') ||
+      !std::getline(ss, format)) {
+    return false;
+  }
+  input->sample_rate = atoi(rate.c_str());
+  input->num_channels = atoi(channels.c_str());
+  input->name = str;
+  return input->sample_rate > 0 && input->num_channels > 0 &&
+      ParseSampleFormat(format, &input->format);
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Benchmarks the conversion of capture formats to 16 kHz mono int16.\n"
+      "Prints one CSV line per (input format, converter) to stdout:\n"
+      "  input,converter,cpu_s_per_audio_hour,realtime_factor,\n"
+      "  streams_per_core,pass_band_db,alias_db\n"
+      "pass_band_db is the level of a 1 kHz tone after conversion (0 is\n"
+      "ideal); alias_db is the level a 12 kHz tone leaks into the output.\n"
+      "\n"
+      "Usage: ./audio-converter-benchmark [options]\n"
+      "e.g.: ./audio-converter-benchmark --inputs=48000:2:int16\n";
+
+  std::string inputs_str =
+      "48000:2:int16,44100:2:int16,48000:1:float32,48000:2:float32,"
+      "48000:4:int32,44100:2:int24";
+  int block_frames = 1024;
+  float seconds = 60;
+
+  ParseOptions po(usage);
+  po.Register("inputs", &inputs_str,
+              "Comma separated input formats, as <rate>:<channels>:<format> "
+              "with format int16, int24, int32 or float32.");
+  po.Register("block-frames", &block_frames,
+              "Frames per Convert() call, i.e., the callback block size.");
+  po.Register("seconds", &seconds, "Seconds of audio per measurement.");
+  po.Register("taps-per-phase", &taps_per_phase,
+              "Polyphase filter length, in input samples.");
+  po.Read(argc, argv);
+
+  std::vector<InputFormat> inputs;
+  std::stringstream ss(inputs_str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    InputFormat input;
+    if (!ParseInputFormat(item, &input)) {
+      std::cerr << "Invalid input format " << item << std::endl;
+      exit(1);
+    }
+    inputs.push_back(input);
+  }
+  if (inputs.empty() || block_frames <= 0 || seconds <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  const int output_rate = 16000;
+  std::cout << "input,converter,cpu_s_per_audio_hour,realtime_factor,"
+      << "streams_per_core,pass_band_db,alias_db" << std::endl;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    use_simd = true;
+    RunCase<AudioConverter>("polyphase-simd", NewAudioConverter, inputs[i],
+                            output_rate, block_frames, seconds);
+    use_simd = false;
+    RunCase<AudioConverter>("polyphase-scalar", NewAudioConverter, inputs[i],
+                            output_rate, block_frames, seconds);
+    RunCase<PlugConverter>("alsa-plug-linear", NewPlugConverter, inputs[i],
+                           output_rate, block_frames, seconds);
+  }
+  return 0;
+}
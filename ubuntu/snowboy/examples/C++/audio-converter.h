@@ -0,0 +1,461 @@
+// examples/C++/audio-converter.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_AUDIO_CONVERTER_H_
+#define SNOWBOY_EXAMPLES_CPP_AUDIO_CONVERTER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SNOWBOY_AUDIO_CONVERTER_NEON
+#endif
+
+// Sample formats of capture devices. kSampleInt24 is packed little-endian 3
+// byte samples, as delivered by PortAudio's paInt24.
+enum SampleFormat {
+  kSampleInt16,
+  kSampleInt24,
+  kSampleInt32,
+  kSampleFloat32
+};
+
+inline int BytesPerSample(SampleFormat format) {
+  switch (format) {
+    case kSampleInt16: return 2;
+    case kSampleInt24: return 3;
+    case kSampleInt32: return 4;
+    case kSampleFloat32: return 4;
+  }
+  return 0;
+}
+
+// Parses "int16", "int24", "int32" or "float32". Returns false otherwise.
+inline bool ParseSampleFormat(const std::string& name, SampleFormat* format) {
+  if (name == "int16") {
+    *format = kSampleInt16;
+  } else if (name == "int24") {
+    *format = kSampleInt24;
+  } else if (name == "int32") {
+    *format = kSampleInt32;
+  } else if (name == "float32") {
+    *format = kSampleFloat32;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Decodes <num_frames> interleaved frames of <num_channels> channels and
+// averages the channels into <output>, as floats on the int16 scale. The
+// SIMD paths cover int16 and float32 with one or two channels, which is what
+// capture devices usually deliver; other layouts, and all layouts when
+// <use_simd> is false, go through the scalar loop, which the compiler may
+// still vectorize.
+inline void DownmixToFloat(const void* input, SampleFormat format,
+                           int num_channels, int64_t num_frames,
+                           bool use_simd, float* output) {
+  int64_t i = 0;
+  if (use_simd && format == kSampleInt16 && num_channels <= 2) {
+    const int16_t* data = static_cast<const int16_t*>(input);
+#if defined(__SSE2__)
+    if (num_channels == 1) {
+      for (; i + 8 <= num_frames; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // Sign-extends by moving each sample to the top half and shifting.
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(output + i, _mm_cvtepi32_ps(lo));
+        _mm_storeu_ps(output + i + 4, _mm_cvtepi32_ps(hi));
+      }
+    } else {
+      // Multiplying adjacent pairs by 1 sums left and right exactly.
+      const __m128i ones = _mm_set1_epi16(1);
+      const __m128 half = _mm_set1_ps(0.5f);
+      for (; i + 4 <= num_frames; i += 4) {
+        __m128i x =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 2 * i));
+        _mm_storeu_ps(output + i, _mm_mul_ps(
+            _mm_cvtepi32_ps(_mm_madd_epi16(x, ones)), half));
+      }
+    }
+#elif defined(SNOWBOY_AUDIO_CONVERTER_NEON)
+    if (num_channels == 1) {
+      for (; i + 8 <= num_frames; i += 8) {
+        int16x8_t x = vld1q_s16(data + i);
+        vst1q_f32(output + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))));
+        vst1q_f32(output + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))));
+      }
+    } else {
+      for (; i + 8 <= num_frames; i += 8) {
+        int16x8x2_t x = vld2q_s16(data + 2 * i);
+        int32x4_t lo = vaddl_s16(vget_low_s16(x.val[0]),
+                                 vget_low_s16(x.val[1]));
+        int32x4_t hi = vaddl_s16(vget_high_s16(x.val[0]),
+                                 vget_high_s16(x.val[1]));
+        vst1q_f32(output + i, vmulq_n_f32(vcvtq_f32_s32(lo), 0.5f));
+        vst1q_f32(output + i + 4, vmulq_n_f32(vcvtq_f32_s32(hi), 0.5f));
+      }
+    }
+#endif
+  } else if (use_simd && format == kSampleFloat32 && num_channels <= 2) {
+    const float* data = static_cast<const float*>(input);
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(32768.0f / num_channels);
+    if (num_channels == 1) {
+      for (; i + 4 <= num_frames; i += 4) {
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_loadu_ps(data + i), scale));
+      }
+    } else {
+      for (; i + 4 <= num_frames; i += 4) {
+        __m128 a = _mm_loadu_ps(data + 2 * i);
+        __m128 b = _mm_loadu_ps(data + 2 * i + 4);
+        __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_add_ps(left, right), scale));
+      }
+    }
+#elif defined(SNOWBOY_AUDIO_CONVERTER_NEON)
+    const float scale = 32768.0f / num_channels;
+    if (num_channels == 1) {
+      for (; i + 4 <= num_frames; i += 4) {
+        vst1q_f32(output + i, vmulq_n_f32(vld1q_f32(data + i), scale));
+      }
+    } else {
+      for (; i + 4 <= num_frames; i += 4) {
+        float32x4x2_t x = vld2q_f32(data + 2 * i);
+        vst1q_f32(output + i,
+                  vmulq_n_f32(vaddq_f32(x.val[0], x.val[1]), scale));
+      }
+    }
+#endif
+  }
+
+  // Scalar path, and the tail of the SIMD paths.
+  const float inverse_channels = 1.0f / num_channels;
+  for (; i < num_frames; ++i) {
+    float sum = 0;
+    for (int c = 0; c < num_channels; ++c) {
+      int64_t k = i * num_channels + c;
+      switch (format) {
+        case kSampleInt16:
+          sum += static_cast<const int16_t*>(input)[k];
+          break;
+        case kSampleInt24: {
+          const uint8_t* bytes = static_cast<const uint8_t*>(input) + 3 * k;
+          // Assembles the sample in the top 24 bits, then shifts it down
+          // arithmetically to sign-extend it.
+          int32_t value = static_cast<int32_t>(
+              (static_cast<uint32_t>(bytes[0]) << 8) |
+              (static_cast<uint32_t>(bytes[1]) << 16) |
+              (static_cast<uint32_t>(bytes[2]) << 24)) >> 8;
+          sum += value * (1.0f / 256);
+          break;
+        }
+        case kSampleInt32:
+          sum += static_cast<const int32_t*>(input)[k] * (1.0f / 65536);
+          break;
+        case kSampleFloat32:
+          sum += static_cast<const float*>(input)[k] * 32768.0f;
+          break;
+      }
+    }
+    output[i] = sum * inverse_channels;
+  }
+}
+
+// Rounds <num_samples> floats on the int16 scale to int16, with saturation.
+inline void FloatToInt16(const float* input, int64_t num_samples,
+                         bool use_simd, int16_t* output) {
+  int64_t i = 0;
+  if (use_simd) {
+#if defined(__SSE2__)
+    // _mm_cvtps_epi32 rounds to nearest; _mm_packs_epi32 saturates.
+    for (; i + 8 <= num_samples; i += 8) {
+      __m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(input + i));
+      __m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(input + i + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i),
+                       _mm_packs_epi32(lo, hi));
+    }
+#elif defined(SNOWBOY_AUDIO_CONVERTER_NEON)
+    for (; i + 8 <= num_samples; i += 8) {
+      // vcvtq_s32_f32 truncates, so 0.5 is added away from zero first.
+      float32x4_t a = vld1q_f32(input + i);
+      float32x4_t b = vld1q_f32(input + i + 4);
+      float32x4_t half = vdupq_n_f32(0.5f);
+      a = vaddq_f32(a, vbslq_f32(vcltq_f32(a, vdupq_n_f32(0)),
+                                 vnegq_f32(half), half));
+      b = vaddq_f32(b, vbslq_f32(vcltq_f32(b, vdupq_n_f32(0)),
+                                 vnegq_f32(half), half));
+      vst1q_s16(output + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)),
+                                         vqmovn_s32(vcvtq_s32_f32(b))));
+    }
+#endif
+  }
+  for (; i < num_samples; ++i) {
+    float x = std::max(-32768.0f, std::min(32767.0f, input[i]));
+    output[i] = static_cast<int16_t>(lrintf(x));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Rational-ratio resampler (e.g., 48 kHz -> 16 kHz is 1/3, 44.1 kHz -> 16 kHz
+// is 160/441) with a Kaiser-windowed sinc low-pass filter split into one
+// polyphase branch per output phase, so that only the taps that meet real
+// input samples are computed. Input is streamed in chunks of any size; the
+// filter history is carried across calls.
+//
+////////////////////////////////////////////////////////////////////////////////
+class PolyphaseResampler {
+ public:
+  // <taps_per_phase> is rounded up to a multiple of 8 so that the dot products
+  // need no scalar tail. The pass band ends at 90% of the output Nyquist
+  // frequency (or of the input one, when upsampling).
+  PolyphaseResampler(int input_rate, int output_rate, int taps_per_phase,
+                     bool use_simd)
+      : use_simd_(use_simd) {
+    int divisor = Gcd(input_rate, output_rate);
+    up_ = output_rate / divisor;
+    down_ = input_rate / divisor;
+    taps_ = std::max(8, (taps_per_phase + 7) / 8 * 8);
+
+    // Prototype filter at the upsampled rate, <up_> times <taps_> long.
+    const int length = up_ * taps_;
+    const double cutoff = 0.45 * std::min(1.0, static_cast<double>(up_) /
+                                          down_) / up_;
+    const double beta = 8.6;
+    const double pi = 3.14159265358979323846;
+    std::vector<double> prototype(length);
+    double sum = 0;
+    for (int n = 0; n < length; ++n) {
+      double t = n - (length - 1) / 2.0;
+      double x = 2 * cutoff * t;
+      double sinc = std::fabs(x) < 1e-12 ? 1 : std::sin(pi * x) / (pi * x);
+      double r = 2.0 * n / (length - 1) - 1;
+      double window = BesselI0(beta * std::sqrt(std::max(0.0, 1 - r * r))) /
+          BesselI0(beta);
+      prototype[n] = sinc * window;
+      sum += prototype[n];
+    }
+    // Branch p holds h[p], h[p + up], h[p + 2 up], ..., reversed so that it
+    // lines up with the input in increasing time order. The gain is <up_>,
+    // which compensates for the zeros implied by upsampling.
+    coefficients_.resize(length);
+    for (int p = 0; p < up_; ++p) {
+      for (int k = 0; k < taps_; ++k) {
+        coefficients_[p * taps_ + taps_ - 1 - k] =
+            static_cast<float>(prototype[p + k * up_] * up_ / sum);
+      }
+    }
+    Reset();
+  }
+
+  void Reset() {
+    buffer_.assign(taps_ - 1, 0.0f);
+    time_ = 0;
+  }
+
+  // Upper bound of the number of samples Process() outputs for <num_samples>
+  // input samples.
+  int64_t MaxOutputSamples(int64_t num_samples) const {
+    return num_samples * up_ / down_ + 2;
+  }
+
+  // Resamples <num_samples> samples into <output>, which must have room for
+  // MaxOutputSamples(num_samples). Returns the number of output samples.
+  int64_t Process(const float* input, int64_t num_samples, float* output) {
+    // <buffer_> holds the last <taps_> - 1 input samples followed by the new
+    // ones; <time_> is the position of the next output on the upsampled time
+    // axis, relative to the first new sample.
+    const int64_t history = taps_ - 1;
+    buffer_.insert(buffer_.end(), input, input + num_samples);
+    int64_t num_output = 0;
+    while (time_ / up_ < num_samples) {
+      const int64_t index = time_ / up_;
+      const int phase = static_cast<int>(time_ % up_);
+      output[num_output++] = Dot(&coefficients_[phase * taps_],
+                                 buffer_.data() + index);
+      time_ += down_;
+    }
+    time_ -= num_samples * up_;
+    buffer_.erase(buffer_.begin(), buffer_.end() - history);
+    return num_output;
+  }
+
+  // Reserves room for processing chunks of up to <num_samples> samples, so
+  // that Process() does not allocate, e.g., in an audio callback.
+  void Reserve(int64_t num_samples) {
+    buffer_.reserve(taps_ - 1 + num_samples);
+  }
+
+ private:
+  static int Gcd(int a, int b) { return b == 0 ? a : Gcd(b, a % b); }
+
+  // Zeroth-order modified Bessel function of the first kind, for the Kaiser
+  // window.
+  static double BesselI0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50; ++k) {
+      term *= (x / (2 * k)) * (x / (2 * k));
+      sum += term;
+      if (term < 1e-12 * sum) {
+        break;
+      }
+    }
+    return sum;
+  }
+
+  float Dot(const float* coefficients, const float* data) const {
+    int i = 0;
+    float result = 0;
+    if (use_simd_) {
+#if defined(__SSE2__)
+      __m128 acc0 = _mm_setzero_ps();
+      __m128 acc1 = _mm_setzero_ps();
+      for (; i < taps_; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(coefficients + i),
+                                           _mm_loadu_ps(data + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(coefficients + i + 4),
+                                           _mm_loadu_ps(data + i + 4)));
+      }
+      float lanes[4];
+      _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+      result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(SNOWBOY_AUDIO_CONVERTER_NEON)
+      float32x4_t acc0 = vdupq_n_f32(0);
+      float32x4_t acc1 = vdupq_n_f32(0);
+      for (; i < taps_; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(coefficients + i),
+                         vld1q_f32(data + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(coefficients + i + 4),
+                         vld1q_f32(data + i + 4));
+      }
+      float lanes[4];
+      vst1q_f32(lanes, vaddq_f32(acc0, acc1));
+      result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    }
+    for (; i < taps_; ++i) {
+      result += coefficients[i] * data[i];
+    }
+    return result;
+  }
+
+  bool use_simd_;
+  int up_;
+  int down_;
+  int taps_;
+  std::vector<float> coefficients_;
+  std::vector<float> buffer_;
+  int64_t time_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Input conditioning in front of SnowboyDetect: converts audio from a capture
+// device in any common format (44.1/48 kHz, stereo or multichannel,
+// int16/int24/int32/float32) to the detector format (16 kHz mono int16), i.e.,
+// what ALSA's "plug" device would otherwise do. Channels are averaged, then
+// resampled with a PolyphaseResampler. State is kept across chunks, so the
+// output of consecutive Convert() calls is one continuous stream. Example:
+//
+//   AudioConverter::Options options;
+//   options.input_rate = 48000;
+//   options.input_channels = 2;
+//   AudioConverter converter(options);
+//   std::vector<int16_t> pcm(converter.MaxOutputSamples(frames));
+//   pcm.resize(converter.Convert(block, frames, pcm.data()));
+//   detector.RunDetection(pcm.data(), pcm.size());
+//
+// Convert() does not allocate, so it can run in an audio callback.
+//
+////////////////////////////////////////////////////////////////////////////////
+class AudioConverter {
+ public:
+  struct Options {
+    int input_rate;
+    int input_channels;
+    SampleFormat input_format;
+    // Sample rate of the detector.
+    int output_rate;
+    // Filter length per polyphase branch, in input samples. Longer filters
+    // have a sharper cutoff, at a proportional CPU cost.
+    int taps_per_phase;
+    // Set to false to benchmark the scalar code paths.
+    bool use_simd;
+
+    Options() : input_rate(16000), input_channels(1),
+                input_format(kSampleInt16), output_rate(16000),
+                taps_per_phase(128), use_simd(true) {}
+  };
+
+  explicit AudioConverter(const Options& options)
+      : options_(options),
+        resampler_(options.input_rate, options.output_rate,
+                   options.taps_per_phase, options.use_simd),
+        mixed_(kBlockFrames),
+        resampled_(resampler_.MaxOutputSamples(kBlockFrames)) {
+    resampler_.Reserve(kBlockFrames);
+  }
+
+  // Upper bound of the number of samples Convert() outputs for <num_frames>
+  // input frames.
+  int64_t MaxOutputSamples(int64_t num_frames) const {
+    return resampler_.MaxOutputSamples(num_frames) +
+        num_frames / kBlockFrames * 2;
+  }
+
+  // Converts <num_frames> interleaved frames into <output>, which must have
+  // room for MaxOutputSamples(num_frames). Returns the number of samples
+  // written.
+  int64_t Convert(const void* input, int64_t num_frames, int16_t* output) {
+    const int frame_bytes =
+        BytesPerSample(options_.input_format) * options_.input_channels;
+    const char* data = static_cast<const char*>(input);
+    const bool resample = options_.input_rate != options_.output_rate;
+    int64_t num_output = 0;
+    while (num_frames > 0) {
+      int64_t size = std::min<int64_t>(num_frames, kBlockFrames);
+      DownmixToFloat(data, options_.input_format, options_.input_channels,
+                     size, options_.use_simd, mixed_.data());
+      if (resample) {
+        int64_t num_resampled =
+            resampler_.Process(mixed_.data(), size, resampled_.data());
+        FloatToInt16(resampled_.data(), num_resampled, options_.use_simd,
+                     output + num_output);
+        num_output += num_resampled;
+      } else {
+        FloatToInt16(mixed_.data(), size, options_.use_simd,
+                     output + num_output);
+        num_output += size;
+      }
+      data += size * frame_bytes;
+      num_frames -= size;
+    }
+    return num_output;
+  }
+
+  // Drops the filter history, e.g., when the capture stream restarts.
+  void Reset() { resampler_.Reset(); }
+
+  const Options& GetOptions() const { return options_; }
+
+ private:
+  // Input is processed in blocks of at most this many frames, so that the
+  // scratch buffers have a fixed size.
+  static const int kBlockFrames = 1024;
+
+  Options options_;
+  PolyphaseResampler resampler_;
+  std::vector<float> mixed_;
+  std::vector<float> resampled_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_AUDIO_CONVERTER_H_
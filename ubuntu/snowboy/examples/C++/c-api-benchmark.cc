@@ -0,0 +1,230 @@
+// examples/C++/c-api-benchmark.cc
+
+// Measures the per-call cost of the ways a language binding can hand a chunk
+// of audio to the detector:
+//   string: the chunk is copied into a std::string for
+//           RunDetection(const std::string&), as the SWIG and Node bindings
+//           did before they moved to the C interface;
+//   int16:  RunDetection(const int16_t*, ...) on the caller's buffer, the
+//           floor for any binding;
+//   c-int16: snowboy_detect_run_int16() of include/snowboy-detect-c.h, which
+//           the bindings now call with the buffer of the host language;
+//   c-float: snowboy_detect_run_float(), which the Node binding calls on a
+//           Float32Array.
+// Paths are interleaved chunk by chunk, so that they see the same cache and
+// frequency conditions, and overhead_us is reported against int16. Heap
+// allocations per call, inside the library included, are counted by replacing
+// operator new. The
+// bindings themselves add their own call cost on top; see
+// examples/Python/binding_benchmark.py and examples/Node/benchmark.js.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+#include "include/snowboy-detect-c.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+// Number of operator new calls so far. The benchmark is single-threaded.
+int64_t num_allocations = 0;
+
+void* operator new(size_t size) {
+  num_allocations++;
+  void* ptr = malloc(size > 0 ? size : 1);
+  if (ptr == NULL) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) throw() {
+  free(ptr);
+}
+
+enum Path { kString, kInt16, kCInt16, kCFloat };
+const int kNumPaths = 4;
+
+const char* PathName(Path path) {
+  switch (path) {
+    case kString: return "string";
+    case kInt16: return "int16";
+    case kCInt16: return "c-int16";
+    case kCFloat: return "c-float";
+  }
+  return "";
+}
+
+double Percentile(std::vector<double>* values, double p) {
+  if (values->empty()) {
+    return 0;
+  }
+  size_t k = std::min(values->size() - 1,
+                      static_cast<size_t>(p / 100 * values->size()));
+  std::nth_element(values->begin(), values->begin() + k, values->end());
+  return (*values)[k];
+}
+
+std::vector<int> ParseIntList(const std::string& str) {
+  std::vector<int> values;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Benchmarks the per-call cost of the C interface against the C++ one.\n"
+      "Prints one CSV line per (path, chunk size) to stdout:\n"
+      "  path,chunk_ms,calls,mean_us,p50_us,p99_us,overhead_us,\n"
+      "  allocs_per_call,detections\n"
+      "overhead_us is the mean difference to the int16 path.\n"
+      "\n"
+      "Usage: ./c-api-benchmark [options]\n"
+      "e.g.: ./c-api-benchmark --chunk-ms=1,10,100 > results.csv\n";
+
+  std::string resource_filename = "resources/common.res";
+  std::string model_filename = "resources/snowboy.umdl";
+  std::string sensitivity_str = "0.5";
+  std::string wave_filename = "resources/snowboy.wav";
+  std::string chunk_ms_str = "1,10,20,100";
+  int repeat = 20;
+
+  ParseOptions po(usage);
+  po.Register("resource", &resource_filename, "Resource file.");
+  po.Register("model", &model_filename, "Hotword model(s).");
+  po.Register("sensitivity", &sensitivity_str, "Sensitivity string.");
+  po.Register("wav", &wave_filename, "Recording to replay.");
+  po.Register("chunk-ms", &chunk_ms_str,
+              "Comma separated chunk sizes in milliseconds.");
+  po.Register("repeat", &repeat, "Number of times --wav is replayed.");
+  po.Read(argc, argv);
+
+  std::vector<int> chunk_ms = ParseIntList(chunk_ms_str);
+  if (chunk_ms.empty() || *std::min_element(chunk_ms.begin(),
+                                            chunk_ms.end()) <= 0 ||
+      repeat <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  // One detector per path, so that none of them sees the audio in pieces.
+  snowboy::SnowboyDetect string_detector(resource_filename, model_filename);
+  snowboy::SnowboyDetect int16_detector(resource_filename, model_filename);
+  snowboy_detect_t* c_detectors[2] = {NULL, NULL};
+  for (int i = 0; i < 2; ++i) {
+    char error[512];
+    if (snowboy_detect_create_with_error(
+            resource_filename.c_str(), model_filename.c_str(),
+            &c_detectors[i], error, sizeof(error)) != SNOWBOY_OK) {
+      std::cerr << "Fail to create the detector: " << error << std::endl;
+      exit(1);
+    }
+    snowboy_detect_set_sensitivity(c_detectors[i], sensitivity_str.c_str());
+  }
+  snowboy_detect_t* c_detector = c_detectors[0];
+  snowboy_detect_t* c_float_detector = c_detectors[1];
+  string_detector.SetSensitivity(sensitivity_str);
+  int16_detector.SetSensitivity(sensitivity_str);
+  const int sample_rate =
+      int16_detector.SampleRate() * int16_detector.NumChannels();
+
+  MappedWaveFile wave;
+  std::string wave_error;
+  if (!wave.Open(wave_filename, &wave_error)) {
+    std::cerr << "Fail to read " << wave_filename << ": " << wave_error
+        << std::endl;
+    exit(1);
+  }
+  if (wave.Info().sample_rate != int16_detector.SampleRate() ||
+      wave.Info().num_channels != int16_detector.NumChannels() ||
+      wave.Info().bits_per_sample != int16_detector.BitsPerSample()) {
+    std::cerr << wave_filename << " does not match the detector format."
+        << std::endl;
+    exit(1);
+  }
+  std::vector<int16_t> samples(wave.Info().data_size / sizeof(int16_t));
+  memcpy(samples.data(), wave.Data(), samples.size() * sizeof(int16_t));
+  const int64_t num_samples = samples.size();
+  std::vector<float> float_samples(samples.begin(), samples.end());
+
+  std::cout << "path,chunk_ms,calls,mean_us,p50_us,p99_us,overhead_us,"
+      << "allocs_per_call,detections" << std::endl;
+  const Path paths[] = {kString, kInt16, kCInt16, kCFloat};
+  for (size_t c = 0; c < chunk_ms.size(); ++c) {
+    const int chunk_samples = std::max(1, chunk_ms[c] * sample_rate / 1000);
+    std::vector<double> call_us[kNumPaths];
+    double sum_us[kNumPaths] = {0, 0, 0, 0};
+    int64_t allocations[kNumPaths] = {0, 0, 0, 0};
+    int detections[kNumPaths] = {0, 0, 0, 0};
+    for (int p = 0; p < kNumPaths; ++p) {
+      call_us[p].reserve(repeat * (num_samples / chunk_samples + 1));
+    }
+    for (int r = 0; r < repeat; ++r) {
+      string_detector.Reset();
+      int16_detector.Reset();
+      snowboy_detect_reset(c_detector);
+      snowboy_detect_reset(c_float_detector);
+      for (int64_t offset = 0; offset < num_samples; offset += chunk_samples) {
+        const int size = static_cast<int>(
+            std::min<int64_t>(chunk_samples, num_samples - offset));
+        const int16_t* data = samples.data() + offset;
+        for (int p = 0; p < kNumPaths; ++p) {
+          const int64_t allocations_start = num_allocations;
+          std::chrono::steady_clock::time_point start =
+              std::chrono::steady_clock::now();
+          int ans = -1;
+          switch (paths[p]) {
+            case kString:
+              ans = string_detector.RunDetection(
+                  std::string(reinterpret_cast<const char*>(data),
+                              size * sizeof(int16_t)));
+              break;
+            case kInt16:
+              ans = int16_detector.RunDetection(data, size);
+              break;
+            case kCInt16:
+              ans = snowboy_detect_run_int16(c_detector, data, size, 0);
+              break;
+            case kCFloat:
+              ans = snowboy_detect_run_float(
+                  c_float_detector, float_samples.data() + offset, size, 0);
+              break;
+          }
+          double us = std::chrono::duration<double, std::micro>(
+              std::chrono::steady_clock::now() - start).count();
+          allocations[p] += num_allocations - allocations_start;
+          call_us[p].push_back(us);
+          sum_us[p] += us;
+          if (ans > 0) {
+            detections[p]++;
+          }
+        }
+      }
+    }
+    const double baseline_us = sum_us[kInt16] / call_us[kInt16].size();
+    for (int p = 0; p < kNumPaths; ++p) {
+      const double mean_us = sum_us[p] / call_us[p].size();
+      std::cout << PathName(paths[p]) << "," << chunk_ms[c] << ","
+          << call_us[p].size() << "," << mean_us << ","
+          << Percentile(&call_us[p], 50) << ","
+          << Percentile(&call_us[p], 99) << "," << mean_us - baseline_us
+          << "," << static_cast<double>(allocations[p]) / call_us[p].size()
+          << "," << detections[p] << std::endl;
+    }
+  }
+
+  snowboy_detect_destroy(c_detector);
+  snowboy_detect_destroy(c_float_detector);
+  return 0;
+}
@@ -0,0 +1,253 @@
+// examples/C++/corpus-scanner.cc
+
+// Runs hotword detection over a corpus of recorded WAVE files, in parallel.
+// Each worker thread owns one SnowboyDetect instance and pulls files from a
+// shared queue; files are memory mapped and fed to the detector in fixed-size
+// chunks straight from the mapping.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "energy-gate.h"
+#include "include/snowboy-detect.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+// A hotword hit, with its position in the file.
+struct Hit {
+  int hotword;
+  double seconds;
+  int64_t byte_offset;
+};
+
+// Shared state of all workers.
+struct ScanState {
+  std::vector<std::string> files;
+  std::atomic<size_t> next_file;
+
+  std::mutex output_mutex;
+  std::atomic<int64_t> num_hits;
+  std::atomic<int64_t> num_failed_files;
+  // Total scanned audio, in milliseconds.
+  std::atomic<int64_t> audio_ms;
+
+  ScanState() : next_file(0), num_hits(0), num_failed_files(0), audio_ms(0) {}
+};
+
+struct ScanOptions {
+  std::string resource_filename;
+  std::string model_filename;
+  std::string sensitivity_str;
+  float audio_gain;
+  bool apply_frontend;
+  float chunk_seconds;
+  bool energy_gate;
+};
+
+// Feeds the PCM data of <wave> to <detector> in chunks of <chunk_samples>
+// samples, through <gate> if it is not NULL, and collects the hits. Returns
+// false on a detector error.
+bool ScanFile(const MappedWaveFile& wave, int chunk_samples, EnergyGate* gate,
+              snowboy::SnowboyDetect* detector, std::vector<Hit>* hits) {
+  const WaveInfo& info = wave.Info();
+  const int64_t num_samples = wave.NumSamples();
+  const int64_t samples_per_second =
+      static_cast<int64_t>(info.sample_rate) * info.num_channels;
+  std::vector<int16_t> aligned;
+  const int16_t* samples = wave.Samples(&aligned);
+
+  detector->Reset();
+  std::vector<int16_t> gated;
+  int64_t size = 0;
+  for (int64_t offset = 0; offset < num_samples; offset += size) {
+    size = std::min<int64_t>(chunk_samples, num_samples - offset);
+    int result = 0;
+    if (gate == NULL) {
+      bool is_end = offset + size == num_samples;
+      result = detector->RunDetection(samples + offset, size, is_end);
+    } else {
+      // The gate stops after the frame that closes it, so that the detector
+      // can be reset there; <size> becomes the amount of audio consumed.
+      bool closed = false;
+      size = gate->Process(samples + offset, size, &gated, &closed);
+      if (!gated.empty()) {
+        result = detector->RunDetection(gated.data(), gated.size());
+      }
+      if (closed) {
+        detector->Reset();
+      }
+    }
+    if (result == -1) {
+      return false;
+    } else if (result > 0) {
+      // Detection happens at the end of the chunk that completes the hotword.
+      Hit hit;
+      hit.hotword = result;
+      hit.seconds = static_cast<double>(offset + size) / samples_per_second;
+      hit.byte_offset = info.data_offset + (offset + size) * sizeof(int16_t);
+      hits->push_back(hit);
+    }
+  }
+  return true;
+}
+
+void Worker(const ScanOptions& options, ScanState* state) {
+  snowboy::SnowboyDetect detector(options.resource_filename,
+                                  options.model_filename);
+  if (!options.sensitivity_str.empty()) {
+    detector.SetSensitivity(options.sensitivity_str);
+  }
+  detector.SetAudioGain(options.audio_gain);
+  detector.ApplyFrontend(options.apply_frontend);
+  const int chunk_samples = std::max(1, static_cast<int>(
+      options.chunk_seconds * detector.SampleRate() * detector.NumChannels()));
+
+  MappedWaveFile wave;
+  std::vector<Hit> hits;
+  while (true) {
+    size_t index = state->next_file++;
+    if (index >= state->files.size()) {
+      break;
+    }
+    const std::string& filename = state->files[index];
+
+    std::string error;
+    bool ok = wave.Open(filename, &error);
+    if (ok && (wave.Info().sample_rate != detector.SampleRate() ||
+               wave.Info().num_channels != detector.NumChannels() ||
+               wave.Info().bits_per_sample != detector.BitsPerSample())) {
+      error = "format does not match the detector";
+      ok = false;
+    }
+    hits.clear();
+    // Each file starts with a fresh noise floor.
+    std::unique_ptr<EnergyGate> gate;
+    if (options.energy_gate) {
+      gate.reset(new EnergyGate(EnergyGate::Options(),
+                                detector.SampleRate() * detector.NumChannels()));
+    }
+    if (ok && !ScanFile(wave, chunk_samples, gate.get(), &detector, &hits)) {
+      error = "detector returned an error";
+      ok = false;
+    }
+
+    std::lock_guard<std::mutex> lock(state->output_mutex);
+    if (!ok) {
+      std::cerr << "Skipping " << filename << ": " << error << std::endl;
+      state->num_failed_files++;
+      continue;
+    }
+    for (size_t i = 0; i < hits.size(); ++i) {
+      std::cout << filename << "\t" << hits[i].hotword << "\t"
+          << std::fixed << std::setprecision(3) << hits[i].seconds << "\t"
+          << hits[i].byte_offset << "\n";
+    }
+    std::cout.flush();
+    state->num_hits += hits.size();
+    state->audio_ms += static_cast<int64_t>(wave.Info().Seconds() * 1000);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Scans WAVE files for hotwords using one detector per worker thread.\n"
+      "Files must match the detector format (16 kHz, mono, 16 bits). Each\n"
+      "hit is printed to stdout as\n"
+      "  <file> <hotword index> <seconds> <byte offset in file>\n"
+      "and a throughput summary is printed to stderr.\n"
+      "\n"
+      "Usage: ./corpus-scanner [options] <wav-file>...\n"
+      "e.g.: ./corpus-scanner --num-threads=4 --file-list=corpus.txt\n";
+
+  ScanOptions options;
+  options.resource_filename = "resources/common.res";
+  options.model_filename = "resources/snowboy.umdl";
+  options.audio_gain = 1;
+  options.apply_frontend = false;
+  options.chunk_seconds = 0.1;
+  options.energy_gate = false;
+  int num_threads = std::thread::hardware_concurrency();
+  std::string file_list;
+
+  ParseOptions po(usage);
+  po.Register("resource", &options.resource_filename, "Resource file.");
+  po.Register("model", &options.model_filename,
+              "Comma separated list of hotword models.");
+  po.Register("sensitivity", &options.sensitivity_str,
+              "Comma separated sensitivities; empty uses the model defaults.");
+  po.Register("audio-gain", &options.audio_gain, "Audio gain.");
+  po.Register("apply-frontend", &options.apply_frontend,
+              "Apply frontend audio processing.");
+  po.Register("chunk-seconds", &options.chunk_seconds,
+              "Seconds of audio per RunDetection() call.");
+  po.Register("energy-gate", &options.energy_gate,
+              "Only pass audio above the noise floor to the detector, see "
+              "energy-gate.h. Compare the hits with and without it to check "
+              "the effect on the hit rate.");
+  po.Register("num-threads", &num_threads, "Number of worker threads.");
+  po.Register("file-list", &file_list,
+              "File with one WAVE filename per line, in addition to the "
+              "positional arguments.");
+  po.Read(argc, argv);
+
+  ScanState state;
+  for (int i = 0; i < po.NumArgs(); ++i) {
+    state.files.push_back(po.GetArg(i));
+  }
+  if (!file_list.empty()) {
+    std::ifstream list(file_list.c_str());
+    if (!list) {
+      std::cerr << "Fail to open file list " << file_list << std::endl;
+      exit(1);
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+      if (!line.empty()) {
+        state.files.push_back(line);
+      }
+    }
+  }
+  if (state.files.empty()) {
+    po.PrintUsage();
+    exit(1);
+  }
+  num_threads = std::max(1, std::min<int>(num_threads, state.files.size()));
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::clock_t cpu_start = std::clock();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_threads; ++i) {
+    workers.push_back(std::thread(Worker, std::cref(options), &state));
+  }
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  double wall_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  double cpu_seconds = static_cast<double>(std::clock() - cpu_start) /
+      CLOCKS_PER_SEC;
+  double audio_seconds = state.audio_ms / 1000.0;
+
+  std::cerr << "Scanned " << state.files.size() - state.num_failed_files
+      << " files (" << state.num_failed_files << " skipped), "
+      << audio_seconds / 3600 << " hours of audio, " << state.num_hits
+      << " hits." << std::endl;
+  std::cerr << "Wall time " << wall_seconds << " s, CPU time " << cpu_seconds
+      << " s, " << num_threads << " threads: "
+      << audio_seconds / wall_seconds << "x realtime ("
+      << audio_seconds / wall_seconds / num_threads
+      << "x realtime per thread)." << std::endl;
+  return state.num_failed_files > 0 ? 1 : 0;
+}
@@ -2,172 +2,46 @@
 
 // Copyright 2016  KITT.AI (author: Guoguo Chen)
 
-#include <cassert>
+#include <chrono>
 #include <csignal>
+#include <cstdint>
 #include <iostream>
-#include <pa_ringbuffer.h>
-#include <pa_util.h>
-#include <portaudio.h>
+#include <memory>
 #include <string>
-#include <vector>
+#include <thread>
 
+#include "audio-converter.h"
+#include "detection-loop.h"
+#include "detector-metrics.h"
 #include "include/snowboy-detect.h"
+#include "mirrored-ring-buffer.h"
+#include "model-reloader.h"
+#include "portaudio-wrapper.h"
+#include "realtime-thread.h"
+#include "spsc-ring-buffer.h"
 
-int PortAudioCallback(const void* input,
-                      void* output,
-                      unsigned long frame_count,
-                      const PaStreamCallbackTimeInfo* time_info,
-                      PaStreamCallbackFlags status_flags,
-                      void* user_data);
-
-class PortAudioWrapper {
- public:
-  // Constructor.
-  PortAudioWrapper(int sample_rate, int num_channels, int bits_per_sample) {
-    num_lost_samples_ = 0;
-    min_read_samples_ = sample_rate * 0.1;
-    Init(sample_rate, num_channels, bits_per_sample);
-  }
-
-  // Reads data from ring buffer.
-  template<typename T>
-  void Read(std::vector<T>* data) {
-    assert(data != NULL);
-
-    // Checks ring buffer overflow.
-    if (num_lost_samples_ > 0) {
-      std::cerr << "Lost " << num_lost_samples_ << " samples due to ring"
-          << " buffer overflow." << std::endl;
-      num_lost_samples_ = 0;
-    }
-
-    ring_buffer_size_t num_available_samples = 0;
-    while (true) {
-      num_available_samples =
-          PaUtil_GetRingBufferReadAvailable(&pa_ringbuffer_);
-      if (num_available_samples >= min_read_samples_) {
-        break;
-      }
-      Pa_Sleep(5);
-    }
-
-    // Reads data.
-    num_available_samples = PaUtil_GetRingBufferReadAvailable(&pa_ringbuffer_);
-    data->resize(num_available_samples);
-    ring_buffer_size_t num_read_samples = PaUtil_ReadRingBuffer(
-        &pa_ringbuffer_, data->data(), num_available_samples);
-    if (num_read_samples != num_available_samples) {
-      std::cerr << num_available_samples << " samples were available,  but "
-          << "only " << num_read_samples << " samples were read." << std::endl;
-    }
-  }
+// The audio is captured as int16_t, since detector.BitsPerSample() returns 16.
+// On Linux the ring buffer is mirrored in virtual memory, so Peek() never
+// splits the data.
+#ifdef __linux__
+typedef PortAudioWrapper<int16_t, MirroredRingBuffer<int16_t> >
+    CaptureWrapper;
+#else
+typedef PortAudioWrapper<int16_t> CaptureWrapper;
+#endif
 
-  int Callback(const void* input, void* output,
-               unsigned long frame_count,
-               const PaStreamCallbackTimeInfo* time_info,
-               PaStreamCallbackFlags status_flags) {
-    // Input audio.
-    ring_buffer_size_t num_written_samples =
-        PaUtil_WriteRingBuffer(&pa_ringbuffer_, input, frame_count);
-    num_lost_samples_ += frame_count - num_written_samples;
-    return paContinue;
+// Stand-in for a streaming speech recognizer: receives the audio following a
+// hotword, straight from the ring buffer, as it is captured. The first call of
+// an utterance carries the pre-roll from before the detection point, and
+// <is_last> is set on the last one.
+void HandleCommandAudio(const int16_t* data, int64_t num_samples,
+                        bool is_last, int64_t* num_utterance_samples) {
+  *num_utterance_samples += num_samples;
+  if (is_last) {
+    std::cout << "Handed " << *num_utterance_samples << " samples of command "
+        << "audio to the recognizer." << std::endl;
+    *num_utterance_samples = 0;
   }
-
-  ~PortAudioWrapper() {
-    Pa_StopStream(pa_stream_);
-    Pa_CloseStream(pa_stream_);
-    Pa_Terminate();
-    PaUtil_FreeMemory(ringbuffer_);
-  }
-
- private:
-  // Initialization.
-  bool Init(int sample_rate, int num_channels, int bits_per_sample) {
-    // Allocates ring buffer memory.
-    int ringbuffer_size = 16384;
-    ringbuffer_ = static_cast<char*>(
-        PaUtil_AllocateMemory(bits_per_sample / 8 * ringbuffer_size));
-    if (ringbuffer_ == NULL) {
-      std::cerr << "Fail to allocate memory for ring buffer." << std::endl;
-      return false;
-    }
-
-    // Initializes PortAudio ring buffer.
-    ring_buffer_size_t rb_init_ans =
-        PaUtil_InitializeRingBuffer(&pa_ringbuffer_, bits_per_sample / 8,
-                                    ringbuffer_size, ringbuffer_);
-    if (rb_init_ans == -1) {
-      std::cerr << "Ring buffer size is not power of 2." << std::endl;
-      return false;
-    }
-
-    // Initializes PortAudio.
-    PaError pa_init_ans = Pa_Initialize();
-    if (pa_init_ans != paNoError) {
-      std::cerr << "Fail to initialize PortAudio, error message is \""
-          << Pa_GetErrorText(pa_init_ans) << "\"" << std::endl;
-      return false;
-    }
-
-    PaError pa_open_ans;
-    if (bits_per_sample == 8) {
-      pa_open_ans = Pa_OpenDefaultStream(
-          &pa_stream_, num_channels, 0, paUInt8, sample_rate,
-          paFramesPerBufferUnspecified, PortAudioCallback, this);
-    } else if (bits_per_sample == 16) {
-      pa_open_ans = Pa_OpenDefaultStream(
-          &pa_stream_, num_channels, 0, paInt16, sample_rate,
-          paFramesPerBufferUnspecified, PortAudioCallback, this);
-    } else if (bits_per_sample == 32) {
-      pa_open_ans = Pa_OpenDefaultStream(
-          &pa_stream_, num_channels, 0, paInt32, sample_rate,
-          paFramesPerBufferUnspecified, PortAudioCallback, this);
-    } else {
-      std::cerr << "Unsupported BitsPerSample: " << bits_per_sample
-          << std::endl;
-      return false;
-    }
-    if (pa_open_ans != paNoError) {
-      std::cerr << "Fail to open PortAudio stream, error message is \""
-          << Pa_GetErrorText(pa_open_ans) << "\"" << std::endl;
-      return false;
-    }
-
-    PaError pa_stream_start_ans = Pa_StartStream(pa_stream_);
-    if (pa_stream_start_ans != paNoError) {
-      std::cerr << "Fail to start PortAudio stream, error message is \""
-          << Pa_GetErrorText(pa_stream_start_ans) << "\"" << std::endl;
-      return false;
-    }
-    return true;
-  }
-
- private:
-  // Pointer to the ring buffer memory.
-  char* ringbuffer_;
-
-  // Ring buffer wrapper used in PortAudio.
-  PaUtilRingBuffer pa_ringbuffer_;
-
-  // Pointer to PortAudio stream.
-  PaStream* pa_stream_;
-
-  // Number of lost samples at each Read() due to ring buffer overflow.
-  int num_lost_samples_;
-
-  // Wait for this number of samples in each Read() call.
-  int min_read_samples_;
-};
-
-int PortAudioCallback(const void* input,
-                      void* output,
-                      unsigned long frame_count,
-                      const PaStreamCallbackTimeInfo* time_info,
-                      PaStreamCallbackFlags status_flags,
-                      void* user_data) {
-  PortAudioWrapper* pa_wrapper = reinterpret_cast<PortAudioWrapper*>(user_data);
-  pa_wrapper->Callback(input, output, frame_count, time_info, status_flags);
-  return paContinue;
 }
 
 void SignalHandler(int signal){
@@ -175,6 +49,13 @@ void SignalHandler(int signal){
   exit(0);
 }
 
+// Set by SIGUSR1, asks the detection loop to print the latency histograms.
+volatile sig_atomic_t latency_dump_requested = 0;
+
+void LatencyDumpHandler(int signal) {
+  latency_dump_requested = 1;
+}
+
 int main(int argc, char* argv[]) {
   std::string usage =
       "Example that shows how to use Snowboy in C++. Parameters are\n"
@@ -182,7 +63,9 @@ int main(int argc, char* argv[]) {
       "more details. Audio is captured by PortAudio.\n"
       "\n"
       "To run the example:\n"
-      "  ./demo\n";
+      "  ./demo\n"
+      "\n"
+      "Send SIGUSR1 (kill -USR1 <pid>) to print latency histograms.\n";
 
   // Checks the command.
   if (argc > 1) {
@@ -197,6 +80,12 @@ int main(int argc, char* argv[]) {
    sig_int_handler.sa_flags = 0;
    sigaction(SIGINT, &sig_int_handler, NULL);
 
+  struct sigaction sig_usr1_handler;
+  sig_usr1_handler.sa_handler = LatencyDumpHandler;
+  sigemptyset(&sig_usr1_handler.sa_mask);
+  sig_usr1_handler.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &sig_usr1_handler, NULL);
+
   // Parameter section.
   // If you have multiple hotword models (e.g., 2), you should set
   // <model_filename> and <sensitivity_str> as follows:
@@ -206,30 +95,199 @@ int main(int argc, char* argv[]) {
   std::string model_filename = "resources/snowboy.umdl";
   std::string sensitivity_str = "0.5";
   float audio_gain = 1;
+  // Set <event_wakeup> to false to use the 5 ms polling loop in Read() instead
+  // of waiting on an eventfd. The ring buffer holds <ring_buffer_seconds> of
+  // audio. Wakeup and ring buffer statistics are printed every
+  // <stats_interval_s> seconds; set it to 0 to disable them.
+  bool event_wakeup = true;
+  int read_timeout_ms = 1000;
+  float ring_buffer_seconds = 5;
+  int stats_interval_s = 0;
+  DetectionLoop<CaptureWrapper>::Options loop_options;
+  // While RunDetection() keeps returning -2 (silence), the amount of audio
+  // per call grows from <min_chunk_ms> up to <max_chunk_ms>, by
+  // <chunk_growth_factor> after every <silence_calls_to_grow> silent calls,
+  // and drops back as soon as there is sound. Set <max_chunk_ms> to
+  // <min_chunk_ms> to always use the same chunk size.
+  loop_options.chunk_options.min_chunk_ms = 100;
+  loop_options.chunk_options.max_chunk_ms = 500;
+  loop_options.chunk_options.silence_calls_to_grow = 3;
+  loop_options.chunk_options.growth_factor = 2;
+  // Set <energy_gate> to true to only pass audio to the detector while its
+  // energy is above the noise floor, see EnergyGate. With <compare_ungated>,
+  // a second detector also runs on all the audio, so that the hit counts with
+  // and without the gate can be compared in the report (at twice the CPU).
+  loop_options.energy_gate = false;
+  bool compare_ungated = false;
+  loop_options.gate_options.open_margin_db = 10;
+  loop_options.gate_options.close_margin_db = 6;
+  loop_options.gate_options.hangover_ms = 500;
+  loop_options.gate_options.pre_roll_ms = 500;
+  // After a hotword, the next <command_seconds> of audio, starting
+  // <command_pre_roll_ms> before the detection point, are passed to
+  // HandleCommandAudio() in place instead of to the detector, e.g., for a
+  // speech recognizer. Set it to 0 to keep detecting hotwords only.
+  loop_options.command_seconds = 0;
+  loop_options.command_pre_roll_ms = 300;
+  // Set <detection_thread> to true to run the detection loop on its own
+  // thread, restricted to <realtime_options.cpus> (e.g., "3" to keep a core
+  // of a Raspberry Pi away from TTS and ffmpeg), with the "fifo" or "rr"
+  // real-time policy and all memory locked if <lock_memory> is set. Without
+  // the privileges for a setting (CAP_SYS_NICE / CAP_IPC_LOCK or the rtprio /
+  // memlock limits), a warning is printed and the thread runs without it.
+  // Its CPU time and context switches are printed with the other reports.
+  bool detection_thread = false;
+  RealtimeOptions realtime_options;
+  realtime_options.cpus = "";
+  realtime_options.policy = "fifo";
+  realtime_options.priority = 10;
+  realtime_options.lock_memory = true;
+  // Many devices only capture at 44.1 or 48 kHz, in stereo or with more
+  // channels, or in 24-bit, 32-bit or float samples. Set <capture_rate> to
+  // the rate of such a device, with its channel count and sample format
+  // ("int16", "int24", "int32" or "float32"), to capture in that format and
+  // downmix and resample to the detector format with AudioConverter. Set it to
+  // 0 to capture in the detector format.
+  int capture_rate = 0;
+  int capture_channels = 2;
+  std::string capture_format = "int16";
+  // Set <reload_models> to true to watch <resource_filename> and
+  // <model_filename> and switch to a new detector when they change, e.g.,
+  // after retraining a personal model, without closing the audio device; see
+  // ModelReloader. The new detector is warmed with the last
+  // <reload_preroll_ms> of audio and gets <sensitivity_str>.
+  bool reload_models = false;
+  int reload_preroll_ms = 3000;
+  // Set <metrics_address> to, e.g., "unix:/tmp/snowboy-metrics.sock" to serve
+  // the detector and capture counters in the Prometheus text format (Linux
+  // only), see DetectorMetrics:
+  //   curl --unix-socket /tmp/snowboy-metrics.sock http://localhost/metrics
+  std::string metrics_address = "";
 
   // Initializes Snowboy detector.
-  snowboy::SnowboyDetect detector(resource_filename, model_filename);
-  detector.SetSensitivity(sensitivity_str);
-  detector.SetAudioGain(audio_gain);
+  std::unique_ptr<snowboy::SnowboyDetect> detector(
+      new snowboy::SnowboyDetect(resource_filename, model_filename));
+  detector->SetSensitivity(sensitivity_str);
+  detector->SetAudioGain(audio_gain);
+  std::unique_ptr<snowboy::SnowboyDetect> ungated_detector;
+  if (loop_options.energy_gate && compare_ungated) {
+    ungated_detector.reset(
+        new snowboy::SnowboyDetect(resource_filename, model_filename));
+    ungated_detector->SetSensitivity(sensitivity_str);
+    ungated_detector->SetAudioGain(audio_gain);
+  }
 
   // Initializes PortAudio. You may use other tools to capture the audio.
-  PortAudioWrapper pa_wrapper(detector.SampleRate(),
-                              detector.NumChannels(), detector.BitsPerSample());
-
-  // Runs the detection.
-  // Note: I hard-coded <int16_t> as data type because detector.BitsPerSample()
-  //       returns 16.
-  std::cout << "Listening... Press Ctrl+C to exit" << std::endl;
-  std::vector<int16_t> data;
-  while (true) {
-    pa_wrapper.Read(&data);
-    if (data.size() != 0) {
-      int result = detector.RunDetection(data.data(), data.size());
-      if (result > 0) {
-        std::cout << "Hotword " << result << " detected!" << std::endl;
+  AudioConverter::Options capture_options;
+  if (capture_rate > 0) {
+    capture_options.input_rate = capture_rate;
+    capture_options.input_channels = capture_channels;
+    capture_options.output_rate = detector->SampleRate();
+    if (!ParseSampleFormat(capture_format, &capture_options.input_format) ||
+        capture_channels <= 0 || detector->NumChannels() != 1) {
+      std::cerr << "Unsupported capture format " << capture_rate << " Hz, "
+          << capture_channels << " channels, " << capture_format << "."
+          << std::endl;
+      exit(1);
+    }
+  }
+  CaptureWrapper pa_wrapper(
+      detector->SampleRate(), detector->NumChannels(),
+      detector->BitsPerSample(), event_wakeup, read_timeout_ms,
+      ring_buffer_seconds,
+      loop_options.command_seconds > 0 ?
+          loop_options.command_pre_roll_ms / 1000.0f : 0,
+      capture_rate > 0 ? &capture_options : NULL);
+
+  std::unique_ptr<ModelReloader> reloader;
+  std::unique_ptr<ModelReloader> ungated_reloader;
+  if (reload_models) {
+    ModelReloader::Options reload_options;
+    reload_options.resource_filename = resource_filename;
+    reload_options.model_filename = model_filename;
+    reload_options.sensitivity_str = sensitivity_str;
+    reload_options.audio_gain = audio_gain;
+    reload_options.preroll_ms = reload_preroll_ms;
+    reloader.reset(new ModelReloader(
+        reload_options, detector->SampleRate() * detector->NumChannels()));
+    std::string error;
+    if (!reloader->Start(&error)) {
+      std::cerr << "Fail to watch the models: " << error << std::endl;
+      exit(1);
+    }
+    // The comparison detector sees the ungated audio, so it has its own
+    // history to be warmed with.
+    if (ungated_detector) {
+      ungated_reloader.reset(new ModelReloader(
+          reload_options, detector->SampleRate() * detector->NumChannels()));
+      if (!ungated_reloader->Start(&error)) {
+        std::cerr << "Fail to watch the models: " << error << std::endl;
+        exit(1);
       }
     }
   }
 
+  DetectorMetrics metrics(detector->NumHotwords());
+  const bool export_metrics = !metrics_address.empty();
+#ifdef __linux__
+  MetricsServer metrics_server(&metrics);
+  if (export_metrics) {
+    std::string error;
+    if (!metrics_server.Start(metrics_address, &error)) {
+      std::cerr << "Fail to serve metrics on " << metrics_address << ": "
+          << error << std::endl;
+      exit(1);
+    }
+    pa_wrapper.SetMetricsShard(metrics.AddShard());
+  }
+#else
+  if (export_metrics) {
+    std::cerr << "The metrics endpoint is only supported on Linux."
+        << std::endl;
+  }
+#endif
+
+  auto detection_loop = [&]() {
+    std::cout << "Listening... Press Ctrl+C to exit" << std::endl;
+    int64_t num_utterance_samples = 0;
+    DetectionLoop<CaptureWrapper> loop(
+        loop_options, &pa_wrapper, &detector, reloader.get(),
+        ungated_detector ? &ungated_detector : NULL, ungated_reloader.get(),
+        export_metrics ? &metrics : NULL,
+        [&](const int16_t* data, int64_t num_samples, bool is_last) {
+          HandleCommandAudio(data, num_samples, is_last,
+                             &num_utterance_samples);
+        });
+    std::chrono::steady_clock::time_point last_stats =
+        std::chrono::steady_clock::now();
+    while (true) {
+      loop.ProcessChunk();
+      if (latency_dump_requested) {
+        latency_dump_requested = 0;
+        loop.PrintReport(std::cerr);
+        PrintThreadUsage("Detection thread", std::cerr);
+      }
+      if (stats_interval_s > 0 && std::chrono::steady_clock::now() - last_stats
+          >= std::chrono::seconds(stats_interval_s)) {
+        pa_wrapper.PrintStats();
+        loop.Scheduler().PrintReport(std::cerr);
+        PrintThreadUsage("Detection thread", std::cerr);
+        last_stats = std::chrono::steady_clock::now();
+      }
+    }
+  };
+
+  if (detection_thread) {
+    // Main keeps the default scheduling; only the detection thread is pinned
+    // and, privileges permitting, real-time.
+    std::thread thread([&]() {
+      ApplyRealtimeOptions(realtime_options);
+      detection_loop();
+    });
+    thread.join();
+  } else {
+    detection_loop();
+  }
+
   return 0;
 }
@@ -0,0 +1,293 @@
+// examples/C++/detection-benchmark.cc
+
+// Measures how the chunk size passed to RunDetection() trades latency for CPU
+// usage. For every chunk size and every RunDetection() overload (int16_t*,
+// float* and std::string), a hotword recording and synthetic noise are
+// replayed through the detector, and one CSV line is printed per combination
+// so that results can be compared across library drops.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+enum Overload { kInt16, kFloat, kString };
+
+const char* OverloadName(Overload overload) {
+  switch (overload) {
+    case kInt16: return "int16";
+    case kFloat: return "float";
+    case kString: return "string";
+  }
+  return "";
+}
+
+// The same audio in the formats taken by the three RunDetection() overloads.
+struct Audio {
+  std::string name;
+  std::vector<int16_t> int16_data;
+  std::vector<float> float_data;
+  std::string string_data;
+
+  void SetSamples(const int16_t* samples, int64_t num_samples) {
+    int16_data.assign(samples, samples + num_samples);
+    float_data.assign(samples, samples + num_samples);
+    string_data.assign(reinterpret_cast<const char*>(samples),
+                       num_samples * sizeof(int16_t));
+  }
+};
+
+// Results of replaying one input with one chunk size and overload.
+struct Result {
+  std::vector<double> call_us;
+  double cpu_seconds;
+  double audio_seconds;
+  int num_detections;
+  // Sum over repetitions of the delay between the hotword end and the return
+  // of the RunDetection() call that reported it.
+  double detection_delay_sum_ms;
+  int num_delays;
+  // Sample position (within one repetition) of the first detection, or -1.
+  int64_t first_detection_sample;
+
+  Result() : cpu_seconds(0), audio_seconds(0), num_detections(0),
+             detection_delay_sum_ms(0), num_delays(0),
+             first_detection_sample(-1) {}
+};
+
+double ThreadCpuSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int RunChunk(snowboy::SnowboyDetect* detector, const Audio& audio,
+             Overload overload, int64_t offset, int64_t size) {
+  // Chunks are fed as live audio, i.e., without <is_end>. Besides, with the
+  // float overload, a single is_end call covering the whole utterance followed
+  // by Reset() crashes the ubuntu64 library.
+  const bool is_end = false;
+  switch (overload) {
+    case kInt16:
+      return detector->RunDetection(audio.int16_data.data() + offset, size,
+                                    is_end);
+    case kFloat:
+      return detector->RunDetection(audio.float_data.data() + offset, size,
+                                    is_end);
+    case kString:
+      return detector->RunDetection(
+          audio.string_data.substr(offset * sizeof(int16_t),
+                                   size * sizeof(int16_t)), is_end);
+  }
+  return -1;
+}
+
+// Replays <audio> <repeat> times, resetting the detector in between. If
+// <hotword_end_sample> is non-negative, the delay from that position to the
+// end of the first call reporting a hotword is recorded for each repetition.
+// The std::string overload includes the cost of building the string, since
+// that is what callers of that overload pay.
+Result Replay(snowboy::SnowboyDetect* detector, const Audio& audio,
+              Overload overload, int chunk_samples, int repeat,
+              int sample_rate, int64_t hotword_end_sample) {
+  Result result;
+  const int64_t num_samples = audio.int16_data.size();
+  result.audio_seconds = static_cast<double>(num_samples) * repeat /
+      sample_rate;
+  result.call_us.reserve((num_samples / chunk_samples + 1) * repeat);
+  double cpu_start = ThreadCpuSeconds();
+  for (int r = 0; r < repeat; ++r) {
+    detector->Reset();
+    bool detected = false;
+    for (int64_t offset = 0; offset < num_samples; offset += chunk_samples) {
+      int64_t size = std::min<int64_t>(chunk_samples, num_samples - offset);
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      int ans = RunChunk(detector, audio, overload, offset, size);
+      double us = std::chrono::duration<double, std::micro>(
+          std::chrono::steady_clock::now() - start).count();
+      result.call_us.push_back(us);
+      if (ans > 0) {
+        result.num_detections++;
+        if (!detected && hotword_end_sample >= 0) {
+          // The audio up to the end of this chunk had to be captured before
+          // the call could even start.
+          result.detection_delay_sum_ms +=
+              (offset + size - hotword_end_sample) * 1000.0 / sample_rate +
+              us / 1000;
+          result.num_delays++;
+        }
+        if (!detected && r == 0) {
+          result.first_detection_sample = offset + size;
+        }
+        detected = true;
+      }
+    }
+  }
+  result.cpu_seconds = ThreadCpuSeconds() - cpu_start;
+  return result;
+}
+
+double Percentile(std::vector<double>* values, double p) {
+  if (values->empty()) {
+    return 0;
+  }
+  size_t k = std::min(values->size() - 1,
+                      static_cast<size_t>(p / 100 * values->size()));
+  std::nth_element(values->begin(), values->begin() + k, values->end());
+  return (*values)[k];
+}
+
+std::vector<int> ParseIntList(const std::string& str) {
+  std::vector<int> values;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Benchmarks RunDetection() latency and CPU usage against chunk size.\n"
+      "Prints one CSV line per (input, overload, chunk size) to stdout:\n"
+      "  label,input,overload,chunk_ms,calls,p50_us,p90_us,p99_us,max_us,\n"
+      "  cpu_s_per_audio_hour,realtime_factor,detections,\n"
+      "  time_to_detection_ms\n"
+      "time_to_detection_ms is the mean delay between the end of the hotword\n"
+      "and the return of the call that detected it (empty for noise).\n"
+      "\n"
+      "Usage: ./detection-benchmark [options]\n"
+      "e.g.: ./detection-benchmark --label=rpi-1.2.0 > results.csv\n";
+
+  std::string resource_filename = "resources/common.res";
+  std::string model_filename = "resources/snowboy.umdl";
+  std::string sensitivity_str = "0.5";
+  std::string wave_filename = "resources/snowboy.wav";
+  std::string chunk_ms_str = "10,20,50,100,200,500,1000";
+  std::string label = "snowboy";
+  float hotword_end_seconds = -1;
+  float noise_seconds = 60;
+  float noise_level = 300;
+  int repeat = 20;
+
+  ParseOptions po(usage);
+  po.Register("resource", &resource_filename, "Resource file.");
+  po.Register("model", &model_filename, "Hotword model(s).");
+  po.Register("sensitivity", &sensitivity_str, "Sensitivity string.");
+  po.Register("wav", &wave_filename, "Recording containing the hotword.");
+  po.Register("chunk-ms", &chunk_ms_str,
+              "Comma separated chunk sizes in milliseconds.");
+  po.Register("label", &label,
+              "Label of the first CSV column, e.g., the library version.");
+  po.Register("hotword-end", &hotword_end_seconds,
+              "Position (seconds) where the hotword ends in --wav. If "
+              "negative, the detection position with the smallest chunk is "
+              "used.");
+  po.Register("noise-seconds", &noise_seconds, "Seconds of synthetic noise.");
+  po.Register("noise-level", &noise_level,
+              "Standard deviation of the synthetic noise, in int16 units.");
+  po.Register("repeat", &repeat, "Number of times --wav is replayed.");
+  po.Read(argc, argv);
+
+  std::vector<int> chunk_ms = ParseIntList(chunk_ms_str);
+  std::sort(chunk_ms.begin(), chunk_ms.end());
+  if (chunk_ms.empty() || chunk_ms[0] <= 0 || repeat <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  snowboy::SnowboyDetect detector(resource_filename, model_filename);
+  detector.SetSensitivity(sensitivity_str);
+  const int sample_rate = detector.SampleRate() * detector.NumChannels();
+
+  std::vector<Audio> inputs(2);
+  MappedWaveFile wave;
+  std::string error;
+  if (!wave.Open(wave_filename, &error)) {
+    std::cerr << "Fail to read " << wave_filename << ": " << error << std::endl;
+    exit(1);
+  }
+  if (wave.Info().sample_rate != detector.SampleRate() ||
+      wave.Info().num_channels != detector.NumChannels() ||
+      wave.Info().bits_per_sample != detector.BitsPerSample()) {
+    std::cerr << wave_filename << " does not match the detector format."
+        << std::endl;
+    exit(1);
+  }
+  std::vector<int16_t> samples(wave.Info().data_size / sizeof(int16_t));
+  memcpy(samples.data(), wave.Data(), samples.size() * sizeof(int16_t));
+  inputs[0].name = "hotword";
+  inputs[0].SetSamples(samples.data(), samples.size());
+
+  // Gaussian noise with a fixed seed, so that runs are comparable.
+  std::mt19937 generator(1234);
+  std::normal_distribution<float> distribution(0, noise_level);
+  samples.resize(static_cast<int64_t>(noise_seconds * sample_rate));
+  for (size_t i = 0; i < samples.size(); ++i) {
+    float x = std::max(-32768.0f, std::min(32767.0f, distribution(generator)));
+    samples[i] = static_cast<int16_t>(x);
+  }
+  inputs[1].name = "noise";
+  inputs[1].SetSamples(samples.data(), samples.size());
+
+  int64_t hotword_end_sample = hotword_end_seconds >= 0 ?
+      static_cast<int64_t>(hotword_end_seconds * sample_rate) : -1;
+  if (hotword_end_sample < 0) {
+    Result reference = Replay(&detector, inputs[0], kInt16,
+                              chunk_ms[0] * sample_rate / 1000, 1,
+                              sample_rate, -1);
+    hotword_end_sample = reference.first_detection_sample;
+    if (hotword_end_sample < 0) {
+      std::cerr << "No hotword detected in " << wave_filename
+          << ", time to detection will not be reported." << std::endl;
+    } else {
+      std::cerr << "Using " << hotword_end_sample * 1.0 / sample_rate
+          << " s as the hotword end position." << std::endl;
+    }
+  }
+
+  std::cout << "label,input,overload,chunk_ms,calls,p50_us,p90_us,p99_us,"
+      << "max_us,cpu_s_per_audio_hour,realtime_factor,detections,"
+      << "time_to_detection_ms" << std::endl;
+  const Overload overloads[] = {kInt16, kFloat, kString};
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    bool is_hotword = i == 0;
+    for (size_t o = 0; o < 3; ++o) {
+      for (size_t c = 0; c < chunk_ms.size(); ++c) {
+        Result result = Replay(
+            &detector, inputs[i], overloads[o],
+            std::max(1, chunk_ms[c] * sample_rate / 1000),
+            is_hotword ? repeat : 1, sample_rate,
+            is_hotword ? hotword_end_sample : -1);
+        size_t calls = result.call_us.size();
+        double max_us = *std::max_element(result.call_us.begin(),
+                                          result.call_us.end());
+        std::cout << label << "," << inputs[i].name << ","
+            << OverloadName(overloads[o]) << "," << chunk_ms[c] << ","
+            << calls << "," << Percentile(&result.call_us, 50) << ","
+            << Percentile(&result.call_us, 90) << ","
+            << Percentile(&result.call_us, 99) << "," << max_us << ","
+            << result.cpu_seconds / result.audio_seconds * 3600 << ","
+            << result.cpu_seconds / result.audio_seconds << ","
+            << result.num_detections << ",";
+        if (result.num_delays > 0) {
+          std::cout << result.detection_delay_sum_ms / result.num_delays;
+        }
+        std::cout << std::endl;
+      }
+    }
+  }
+  return 0;
+}
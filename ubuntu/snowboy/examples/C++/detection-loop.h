@@ -0,0 +1,310 @@
+// examples/C++/detection-loop.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_DETECTION_LOOP_H_
+#define SNOWBOY_EXAMPLES_CPP_DETECTION_LOOP_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <pa_util.h>
+#include <vector>
+
+#include "adaptive-chunk-scheduler.h"
+#include "detector-metrics.h"
+#include "energy-gate.h"
+#include "include/snowboy-detect.h"
+#include "latency-histogram.h"
+#include "model-reloader.h"
+#include "portaudio-wrapper.h"
+#include "realtime-thread.h"
+
+// Runs <detector> on <num_samples> samples, through <gate> if it is not NULL,
+// in which case the forwarded audio is copied to <gated>. The audio <detector>
+// sees is also recorded in <reloader>, if not NULL, so that a reloaded detector
+// is warmed with the same stream. Returns the first hotword found, otherwise
+// the result of the last RunDetection() call, or -2 if the gate forwarded
+// nothing.
+inline int RunGatedDetection(const int16_t* data, int64_t num_samples,
+                             EnergyGate* gate, std::vector<int16_t>* gated,
+                             ModelReloader* reloader,
+                             snowboy::SnowboyDetect* detector) {
+  if (gate == NULL) {
+    int result = detector->RunDetection(data, num_samples);
+    if (reloader) {
+      reloader->OnAudio(data, num_samples);
+    }
+    return result;
+  }
+  int result = -2;
+  while (num_samples > 0) {
+    bool closed = false;
+    int64_t num_used = gate->Process(data, num_samples, gated, &closed);
+    if (!gated->empty()) {
+      int ans = detector->RunDetection(gated->data(), gated->size());
+      if (reloader) {
+        reloader->OnAudio(gated->data(), gated->size());
+      }
+      if (result <= 0) {
+        result = ans;
+      }
+    }
+    if (closed) {
+      detector->Reset();
+    }
+    data += num_used;
+    num_samples -= num_used;
+  }
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// The detection loop of demo.cc, one chunk per ProcessChunk() call. It runs the
+// detector directly on the ring buffer memory of a PortAudioWrapper
+// <Capture>, with the chunk size of an AdaptiveChunkScheduler, through an
+// optional EnergyGate, and swaps in reloaded detectors between chunks. After a
+// hotword, the audio that follows is handed to a CommandHandler in place
+// instead of to the detector. Example:
+//
+//   DetectionLoop<PortAudioWrapper<int16_t> > loop(
+//       options, &pa_wrapper, &detector, NULL, NULL, NULL, NULL, handler);
+//   while (true) {
+//     loop.ProcessChunk();
+//   }
+//
+// The detector is streaming, so feeding a wrapped-around chunk as two calls
+// (only needed without a mirrored ring buffer) is equivalent to feeding it at
+// once.
+//
+// Latencies are measured on the PaUtil_GetTime() clock: the queueing delay
+// from each block entering the ring buffer to the loop picking it up, the
+// detection time (RunDetection() and the energy gate, without the model
+// swap), and the time from the ADC capturing the last sample of a chunk to its
+// result (for every chunk, and for the chunks that completed a hotword).
+//
+// Construct it on the thread that calls ProcessChunk(): it takes a metrics
+// shard for that thread.
+//
+////////////////////////////////////////////////////////////////////////////////
+template<typename Capture>
+class DetectionLoop {
+ public:
+  struct Options {
+    AdaptiveChunkScheduler::Options chunk_options;
+    // Only passes the audio to the detector while the gate is open.
+    bool energy_gate;
+    EnergyGate::Options gate_options;
+    // Audio handed to the CommandHandler after a hotword, starting
+    // <command_pre_roll_ms> before the detection point; 0 disables it. The
+    // Capture must keep at least <command_pre_roll_ms> of history.
+    float command_seconds;
+    int command_pre_roll_ms;
+
+    Options() : energy_gate(false), command_seconds(0),
+                command_pre_roll_ms(300) {}
+  };
+
+  // Receives the audio following a hotword as it is captured. The first call
+  // of an utterance carries the pre-roll, and <is_last> is set on the last
+  // one.
+  typedef std::function<void(const int16_t* data, int64_t num_samples,
+                             bool is_last)> CommandHandler;
+
+  // Runs <*detector>, which <reloader> replaces when its models change. With
+  // a non-NULL <ungated_detector>, that detector also runs on all the audio,
+  // with its own <ungated_reloader>, to count the hotwords the gate misses.
+  // <reloader>, <ungated_reloader> and <metrics> may be NULL.
+  DetectionLoop(const Options& options, Capture* capture,
+                std::unique_ptr<snowboy::SnowboyDetect>* detector,
+                ModelReloader* reloader,
+                std::unique_ptr<snowboy::SnowboyDetect>* ungated_detector,
+                ModelReloader* ungated_reloader, DetectorMetrics* metrics,
+                const CommandHandler& command_handler)
+      : options_(options), capture_(capture), detector_(detector),
+        reloader_(reloader), ungated_detector_(ungated_detector),
+        ungated_reloader_(ungated_reloader),
+        metrics_shard_(metrics != NULL ? metrics->AddShard() : NULL),
+        command_handler_(command_handler),
+        samples_per_second_((*detector)->SampleRate() *
+                            (*detector)->NumChannels()),
+        scheduler_(options.chunk_options, samples_per_second_),
+        detection_seconds_(0), num_hits_(0), num_ungated_hits_(0),
+        command_samples_left_(0) {
+    if (options_.energy_gate) {
+      gate_.reset(new EnergyGate(options_.gate_options, samples_per_second_));
+    }
+  }
+
+  // Waits for the next chunk and processes it.
+  void ProcessChunk() {
+    capture_->SetMinReadSamples(scheduler_.ChunkSamples());
+    const int16_t* data1 = NULL;
+    const int16_t* data2 = NULL;
+    int64_t size1 = 0, size2 = 0;
+    int64_t num_samples = capture_->Peek(&data1, &size1, &data2, &size2);
+    if (num_samples == 0) {
+      return;
+    }
+    if (command_samples_left_ > 0) {
+      ForwardCommand(num_samples, data1, size1, data2, size2);
+      return;
+    }
+
+    double start_time = PaUtil_GetTime();
+    capture_->GetPeekTiming(num_samples, &timing_);
+    for (size_t i = 0; i < timing_.blocks.size(); ++i) {
+      queueing_delay_.RecordSeconds(start_time -
+                                    timing_.blocks[i].callback_time);
+    }
+
+    // Between chunks, so that the new detector continues exactly where the
+    // old one stopped.
+    if (reloader_ != NULL && reloader_->MaybeSwap(detector_)) {
+      std::cerr << "Switched to the reloaded models." << std::endl;
+    }
+    double run_start_time = PaUtil_GetTime();
+    double start_cpu_time = metrics_shard_ ? ThreadCpuSeconds() : 0;
+    int result = RunGatedDetection(data1, size1, gate_.get(), &gated_,
+                                   reloader_, detector_->get());
+    if (size2 > 0) {
+      int result2 = RunGatedDetection(data2, size2, gate_.get(), &gated_,
+                                      reloader_, detector_->get());
+      if (result <= 0) {
+        result = result2;
+      }
+    }
+    double end_time = PaUtil_GetTime();
+    const double run_seconds = end_time - run_start_time;
+    detection_seconds_ += run_seconds;
+    run_detection_time_.RecordSeconds(run_seconds);
+    scheduler_.Update(result, num_samples, run_seconds);
+    if (metrics_shard_) {
+      metrics_shard_->RecordDetection(result, num_samples, run_seconds,
+                                      ThreadCpuSeconds() - start_cpu_time);
+      metrics_shard_->SetCpuLoad(capture_->CpuLoad());
+    }
+    if (timing_.end_adc_time > 0) {
+      adc_to_result_.RecordSeconds(end_time - timing_.end_adc_time);
+      if (result > 0) {
+        adc_to_hotword_.RecordSeconds(end_time - timing_.end_adc_time);
+      }
+    }
+
+    if (ungated_detector_ != NULL) {
+      RunUngatedDetection(data1, size1, data2, size2);
+    }
+
+    capture_->Commit(num_samples);
+    if (result > 0) {
+      num_hits_++;
+      std::cout << "Hotword " << result << " detected!" << std::endl;
+      if (options_.command_seconds > 0) {
+        // Hands over the pre-roll, then switches to live continuation.
+        capture_->PeekHistory(
+            options_.command_pre_roll_ms * samples_per_second_ / 1000,
+            &data1, &size1, &data2, &size2);
+        command_handler_(data1, size1, false);
+        command_handler_(data2, size2, false);
+        command_samples_left_ = static_cast<int64_t>(
+            options_.command_seconds * samples_per_second_);
+      }
+    }
+  }
+
+  // Prints the latency histograms and the scheduler, gate and reloader
+  // reports.
+  void PrintReport(std::ostream& os) const {
+    queueing_delay_.Print("Queueing delay", os);
+    run_detection_time_.Print("RunDetection() time", os);
+    adc_to_result_.Print("ADC to result latency", os);
+    adc_to_hotword_.Print("ADC to hotword latency", os);
+    scheduler_.PrintReport(os);
+    if (gate_) {
+      gate_->PrintReport(os, detection_seconds_);
+    }
+    if (ungated_detector_ != NULL) {
+      os << "Hits: " << num_hits_ << " with the energy gate, "
+          << num_ungated_hits_ << " without." << std::endl;
+    }
+    if (reloader_ != NULL) {
+      reloader_->PrintReport(os);
+    }
+  }
+
+  const AdaptiveChunkScheduler& Scheduler() const { return scheduler_; }
+
+ private:
+  DetectionLoop(const DetectionLoop&);
+  DetectionLoop& operator=(const DetectionLoop&);
+
+  // Live continuation of a command: the audio bypasses the detector.
+  void ForwardCommand(int64_t num_samples, const int16_t* data1, int64_t size1,
+                      const int16_t* data2, int64_t size2) {
+    num_samples = std::min(num_samples, command_samples_left_);
+    size1 = std::min(size1, num_samples);
+    size2 = num_samples - size1;
+    command_samples_left_ -= num_samples;
+    command_handler_(data1, size1, command_samples_left_ == 0 && size2 == 0);
+    if (size2 > 0) {
+      command_handler_(data2, size2, command_samples_left_ == 0);
+    }
+    capture_->Commit(num_samples);
+    if (command_samples_left_ == 0) {
+      (*detector_)->Reset();
+    }
+  }
+
+  void RunUngatedDetection(const int16_t* data1, int64_t size1,
+                           const int16_t* data2, int64_t size2) {
+    if (ungated_reloader_ != NULL &&
+        ungated_reloader_->MaybeSwap(ungated_detector_)) {
+      std::cerr << "Switched the ungated detector to the reloaded models."
+          << std::endl;
+    }
+    int result = RunGatedDetection(data1, size1, NULL, NULL, ungated_reloader_,
+                                   ungated_detector_->get());
+    if (size2 > 0) {
+      int result2 = RunGatedDetection(data2, size2, NULL, NULL,
+                                      ungated_reloader_,
+                                      ungated_detector_->get());
+      if (result <= 0) {
+        result = result2;
+      }
+    }
+    if (result > 0) {
+      num_ungated_hits_++;
+    }
+  }
+
+  const Options options_;
+  Capture* capture_;
+  std::unique_ptr<snowboy::SnowboyDetect>* detector_;
+  ModelReloader* reloader_;
+  std::unique_ptr<snowboy::SnowboyDetect>* ungated_detector_;
+  ModelReloader* ungated_reloader_;
+  DetectorMetrics::Shard* metrics_shard_;
+  CommandHandler command_handler_;
+  const int64_t samples_per_second_;
+
+  AdaptiveChunkScheduler scheduler_;
+  std::unique_ptr<EnergyGate> gate_;
+  // Audio forwarded by <gate_>, reused across chunks.
+  std::vector<int16_t> gated_;
+  PeekTiming timing_;
+
+  LatencyHistogram queueing_delay_;
+  LatencyHistogram run_detection_time_;
+  LatencyHistogram adc_to_result_;
+  LatencyHistogram adc_to_hotword_;
+  double detection_seconds_;
+  int64_t num_hits_;
+  int64_t num_ungated_hits_;
+
+  // Samples of the current command still to be handed over.
+  int64_t command_samples_left_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_DETECTION_LOOP_H_
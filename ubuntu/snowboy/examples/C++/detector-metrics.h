@@ -0,0 +1,349 @@
+// examples/C++/detector-metrics.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_DETECTOR_METRICS_H_
+#define SNOWBOY_EXAMPLES_CPP_DETECTOR_METRICS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+#include "stream-protocol.h"
+#endif
+
+// CPU time consumed by the calling thread, in seconds, or 0 if unknown.
+inline double ThreadCpuSeconds() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+#endif
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Counters and gauges of a detector and its capture path, exported in the
+// Prometheus text format (see MetricsServer):
+//
+//   snowboy_run_detection_calls_total{result="-2"|"-1"|"0"|"N"}
+//   snowboy_detection_seconds_total       wall time in RunDetection()
+//   snowboy_detection_cpu_seconds_total   CPU time in RunDetection()
+//   snowboy_processed_samples_total
+//   snowboy_ring_buffer_fill_samples
+//   snowboy_ring_buffer_capacity_samples
+//   snowboy_lost_samples_total
+//   snowboy_portaudio_cpu_load            Pa_GetStreamCpuLoad(), 0 to 1
+//
+// Every writing thread (e.g., the detection loop and the PortAudio callback)
+// gets its own Shard from AddShard() and is its only writer, so an update is
+// a relaxed load and store, without a lock or a read-modify-write on a cache
+// line shared with another thread. Format() sums the shards with relaxed
+// loads, so a scrape never blocks or slows down a writer; it may see the
+// fields of one shard at slightly different moments. A gauge is normally set
+// by one thread only, the others leave it at 0.
+//
+////////////////////////////////////////////////////////////////////////////////
+class DetectorMetrics {
+ public:
+  class Shard {
+   public:
+    // Counts one RunDetection() call on <num_samples> samples, which returned
+    // <result> in <seconds> of wall time and <cpu_seconds> of CPU time.
+    void RecordDetection(int result, int64_t num_samples, double seconds,
+                         double cpu_seconds) {
+      int index = std::max(0, std::min(result + 2, num_results_ - 1));
+      Add(&result_counts_[index], 1);
+      Add(&values_[kProcessedSamples], num_samples);
+      Add(&values_[kDetectionNanoseconds],
+          static_cast<int64_t>(seconds * 1e9));
+      Add(&values_[kDetectionCpuNanoseconds],
+          static_cast<int64_t>(cpu_seconds * 1e9));
+    }
+
+    // Sets the ring buffer gauges; <num_lost_samples> is cumulative.
+    void SetRingBuffer(int64_t fill_samples, int64_t capacity_samples,
+                       int64_t num_lost_samples) {
+      values_[kRingBufferFill].store(fill_samples, std::memory_order_relaxed);
+      values_[kRingBufferCapacity].store(capacity_samples,
+                                         std::memory_order_relaxed);
+      values_[kLostSamples].store(num_lost_samples, std::memory_order_relaxed);
+    }
+
+    void SetCpuLoad(double load) {
+      values_[kCpuLoadMicros].store(static_cast<int64_t>(load * 1e6),
+                                    std::memory_order_relaxed);
+    }
+
+   private:
+    friend class DetectorMetrics;
+
+    enum Value {
+      kProcessedSamples = 0,
+      kDetectionNanoseconds,
+      kDetectionCpuNanoseconds,
+      kRingBufferFill,
+      kRingBufferCapacity,
+      kLostSamples,
+      kCpuLoadMicros,
+      kNumValues
+    };
+
+    // Results -2 to <num_hotwords>; larger results, e.g., from reloaded models
+    // with more hotwords, are counted as the last one.
+    explicit Shard(int num_hotwords)
+        : num_results_(num_hotwords + 3),
+          result_counts_(new std::atomic<int64_t>[num_results_]()),
+          values_(new std::atomic<int64_t>[kNumValues]()) {}
+
+    // Only the owning thread writes, so no atomic read-modify-write is needed.
+    static void Add(std::atomic<int64_t>* value, int64_t delta) {
+      value->store(value->load(std::memory_order_relaxed) + delta,
+                   std::memory_order_relaxed);
+    }
+
+    int64_t Get(Value value) const {
+      return values_[value].load(std::memory_order_relaxed);
+    }
+
+    const int num_results_;
+    std::unique_ptr<std::atomic<int64_t>[]> result_counts_;
+    std::unique_ptr<std::atomic<int64_t>[]> values_;
+  };
+
+  explicit DetectorMetrics(int num_hotwords) : num_hotwords_(num_hotwords) {}
+
+  // Returns a new shard for the calling thread. Shards live as long as the
+  // DetectorMetrics.
+  Shard* AddShard() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shards_.push_back(std::unique_ptr<Shard>(new Shard(num_hotwords_)));
+    return shards_.back().get();
+  }
+
+  // Writes all metrics in the Prometheus text exposition format.
+  void Format(std::ostream& os) const {
+    std::vector<int64_t> results(num_hotwords_ + 3, 0);
+    int64_t values[Shard::kNumValues] = {0};
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t s = 0; s < shards_.size(); ++s) {
+        for (size_t i = 0; i < results.size(); ++i) {
+          results[i] +=
+              shards_[s]->result_counts_[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < Shard::kNumValues; ++i) {
+          values[i] += shards_[s]->Get(static_cast<Shard::Value>(i));
+        }
+      }
+    }
+    Header("snowboy_run_detection_calls_total", "counter",
+           "RunDetection() calls by result: -2 silence, -1 error, 0 sound, "
+           "N hotword N.", os);
+    for (size_t i = 0; i < results.size(); ++i) {
+      os << "snowboy_run_detection_calls_total{result=\""
+          << static_cast<int>(i) - 2 << "\"} " << results[i] << "\n";
+    }
+    Metric("snowboy_detection_seconds_total", "counter",
+           "Wall time spent in RunDetection().",
+           values[Shard::kDetectionNanoseconds] * 1e-9, os);
+    Metric("snowboy_detection_cpu_seconds_total", "counter",
+           "CPU time spent in RunDetection().",
+           values[Shard::kDetectionCpuNanoseconds] * 1e-9, os);
+    Metric("snowboy_processed_samples_total", "counter",
+           "Samples passed to RunDetection().",
+           values[Shard::kProcessedSamples], os);
+    Metric("snowboy_ring_buffer_fill_samples", "gauge",
+           "Captured samples waiting for the detector.",
+           values[Shard::kRingBufferFill], os);
+    Metric("snowboy_ring_buffer_capacity_samples", "gauge",
+           "Capacity of the capture ring buffer.",
+           values[Shard::kRingBufferCapacity], os);
+    Metric("snowboy_lost_samples_total", "counter",
+           "Captured samples dropped because the ring buffer was full.",
+           values[Shard::kLostSamples], os);
+    Metric("snowboy_portaudio_cpu_load", "gauge",
+           "PortAudio stream CPU load, from 0 to 1.",
+           values[Shard::kCpuLoadMicros] * 1e-6, os);
+  }
+
+  std::string Format() const {
+    std::ostringstream os;
+    Format(os);
+    return os.str();
+  }
+
+ private:
+  static void Header(const std::string& name, const std::string& type,
+                     const std::string& help, std::ostream& os) {
+    os << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+  }
+
+  template<typename V>
+  static void Metric(const std::string& name, const std::string& type,
+                     const std::string& help, V value, std::ostream& os) {
+    Header(name, type, help, os);
+    os << name << " " << value << "\n";
+  }
+
+  const int num_hotwords_;
+  // Only guards <shards_> itself; writers never take it.
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Shard> > shards_;
+};
+
+#ifdef __linux__
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Serves DetectorMetrics on a local socket, from its own thread, to one client
+// at a time. The address is "unix:<path>" (or "tcp:<address>:<port>", see
+// stream-protocol.h). An HTTP GET request gets an HTTP response, so that the
+// endpoint can be scraped through a proxy or checked with
+//
+//   curl --unix-socket /tmp/snowboy-metrics.sock http://localhost/metrics
+//
+// and a client that sends nothing for a second, e.g.,
+// "socat - UNIX-CONNECT:/tmp/snowboy-metrics.sock", gets the bare text.
+//
+// The thread only reads the metrics with relaxed loads; it never touches the
+// audio or detection threads.
+//
+////////////////////////////////////////////////////////////////////////////////
+class MetricsServer {
+ public:
+  explicit MetricsServer(const DetectorMetrics* metrics)
+      : metrics_(metrics), listen_fd_(-1) {
+    stop_pipe_[0] = stop_pipe_[1] = -1;
+  }
+
+  ~MetricsServer() {
+    if (thread_.joinable()) {
+      char byte = 0;
+      ssize_t ret = write(stop_pipe_[1], &byte, 1);
+      (void)ret;
+      thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+      if (address_.compare(0, 5, "unix:") == 0) {
+        unlink(address_.c_str() + 5);
+      }
+    }
+    for (int i = 0; i < 2; ++i) {
+      if (stop_pipe_[i] >= 0) {
+        close(stop_pipe_[i]);
+      }
+    }
+  }
+
+  // Starts listening on <address>. Returns false and fills <error> on failure.
+  bool Start(const std::string& address, std::string* error) {
+    listen_fd_ = ListenOn(address, error);
+    if (listen_fd_ < 0) {
+      return false;
+    }
+    address_ = address;
+    if (pipe(stop_pipe_) != 0) {
+      *error = strerror(errno);
+      return false;
+    }
+    thread_ = std::thread(&MetricsServer::Serve, this);
+    return true;
+  }
+
+ private:
+  // Time a client has to send its request.
+  static const int kRequestTimeoutMs = 1000;
+
+  void Serve() {
+    while (true) {
+      struct pollfd fds[2];
+      fds[0].fd = listen_fd_;
+      fds[0].events = POLLIN;
+      fds[1].fd = stop_pipe_[0];
+      fds[1].events = POLLIN;
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      if (fds[1].revents != 0) {
+        return;
+      }
+      int client_fd = accept4(listen_fd_, NULL, NULL, SOCK_CLOEXEC);
+      if (client_fd >= 0) {
+        Respond(client_fd);
+        close(client_fd);
+      }
+    }
+  }
+
+  void Respond(int fd) {
+    // Reads the request, if any, until the end of its headers.
+    std::string request;
+    char buffer[1024];
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < 8192 && poll(&pfd, 1, kRequestTimeoutMs) > 0) {
+      ssize_t ret = read(fd, buffer, sizeof(buffer));
+      if (ret <= 0) {
+        break;
+      }
+      request.append(buffer, ret);
+    }
+
+    std::string body = metrics_->Format();
+    std::string response;
+    if (request.compare(0, 4, "GET ") == 0) {
+      std::ostringstream header;
+      header << "HTTP/1.0 200 OK\r\n"
+          << "Content-Type: text/plain; version=0.0.4\r\n"
+          << "Content-Length: " << body.size() << "\r\n"
+          << "Connection: close\r\n\r\n";
+      response = header.str();
+    }
+    response += body;
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    size_t sent = 0;
+    while (sent < response.size()) {
+      ssize_t ret = send(fd, response.data() + sent, response.size() - sent,
+                         MSG_NOSIGNAL);
+      if (ret <= 0) {
+        break;
+      }
+      sent += ret;
+    }
+  }
+
+  const DetectorMetrics* metrics_;
+  std::string address_;
+  int listen_fd_;
+  int stop_pipe_[2];
+  std::thread thread_;
+};
+
+#endif  // __linux__
+
+#endif  // SNOWBOY_EXAMPLES_CPP_DETECTOR_METRICS_H_
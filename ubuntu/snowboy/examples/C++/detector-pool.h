@@ -0,0 +1,353 @@
+// examples/C++/detector-pool.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_DETECTOR_POOL_H_
+#define SNOWBOY_EXAMPLES_CPP_DETECTOR_POOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+#include "latency-histogram.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Pool of ready-to-use detectors, so that a new session does not pay for
+// parsing common.res and the models. Idle detectors are kept per
+// configuration; every time one is handed out, a background thread builds a
+// replacement. Detectors are handed out as leases, which return them to the
+// pool when they go out of scope. Example:
+//
+//   DetectorPool pool(DetectorPool::Options());
+//   DetectorPool::Config config;
+//   config.model_filename = "resources/snowboy.umdl";
+//   pool.Prewarm(config);
+//   ...
+//   DetectorPool::Lease detector = pool.Acquire(config);
+//   int result = detector->RunDetection(data, num_samples);
+//
+// On return, the detector is Reset() and its sensitivity, audio gain and
+// frontend setting are restored to <config>, so that a session that changed
+// them does not leak them to the next one. With an empty sensitivity_str, the
+// sensitivity is restored to the model defaults.
+//
+// Thread-safe. The pool must outlive its leases.
+//
+////////////////////////////////////////////////////////////////////////////////
+class DetectorPool {
+ private:
+  struct Entry;
+
+ public:
+  struct Options {
+    // Idle detectors kept per configuration.
+    int idle_per_config;
+    // Threads building detectors in the background.
+    int num_builder_threads;
+
+    Options() : idle_per_config(2), num_builder_threads(1) {}
+  };
+
+  // Everything a detector is constructed or configured with. Detectors are
+  // only shared between identical configurations.
+  struct Config {
+    std::string resource_filename;
+    std::string model_filename;
+    // Empty keeps the model defaults.
+    std::string sensitivity_str;
+    float audio_gain;
+    bool apply_frontend;
+
+    Config() : resource_filename("resources/common.res"),
+               model_filename("resources/snowboy.umdl"), audio_gain(1),
+               apply_frontend(false) {}
+
+    std::string Key() const {
+      std::ostringstream key;
+      key << resource_filename << '\n' << model_filename << '\n'
+          << sensitivity_str << '\n' << audio_gain << '\n' << apply_frontend;
+      return key.str();
+    }
+  };
+
+  struct Stats {
+    // Acquire() calls served from an idle detector, and the ones that had to
+    // construct one on the calling thread.
+    int64_t hits;
+    int64_t misses;
+    int64_t num_constructed;
+    int64_t num_idle;
+  };
+
+  class Lease;
+
+  explicit DetectorPool(const Options& options)
+      : options_(options), stopping_(false), hits_(0), misses_(0),
+        num_constructed_(0) {
+    for (int i = 0; i < options_.num_builder_threads; ++i) {
+      builders_.push_back(std::thread(&DetectorPool::BuilderLoop, this));
+    }
+  }
+
+  ~DetectorPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    build_cv_.notify_all();
+    for (size_t i = 0; i < builders_.size(); ++i) {
+      builders_[i].join();
+    }
+    for (std::map<std::string, std::unique_ptr<Entry> >::iterator it =
+         entries_.begin(); it != entries_.end(); ++it) {
+      for (size_t i = 0; i < it->second->idle.size(); ++i) {
+        delete it->second->idle[i];
+      }
+    }
+  }
+
+  // Starts building <idle_per_config> detectors for <config> in the
+  // background, if there are not that many yet.
+  void Prewarm(const Config& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ScheduleBuilds(GetEntry(config));
+  }
+
+  // Hands out an idle detector for <config>, or constructs one on the calling
+  // thread if there is none. Either way, a replacement is built in the
+  // background.
+  Lease Acquire(const Config& config) {
+    Entry* entry;
+    snowboy::SnowboyDetect* detector = NULL;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entry = GetEntry(config);
+      if (!entry->idle.empty()) {
+        detector = entry->idle.back();
+        entry->idle.pop_back();
+        hits_++;
+      } else {
+        misses_++;
+      }
+      ScheduleBuilds(entry);
+    }
+    if (detector == NULL) {
+      detector = Construct(entry);
+    }
+    return Lease(this, entry, detector);
+  }
+
+  Stats GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.num_constructed = num_constructed_;
+    stats.num_idle = 0;
+    for (std::map<std::string, std::unique_ptr<Entry> >::const_iterator it =
+         entries_.begin(); it != entries_.end(); ++it) {
+      stats.num_idle += it->second->idle.size();
+    }
+    return stats;
+  }
+
+  // Prints the counters and the construction time histogram.
+  void PrintReport(std::ostream& os) const {
+    Stats stats = GetStats();
+    os << "Detector pool: " << stats.hits << " hits, " << stats.misses
+        << " misses, " << stats.num_constructed << " detectors constructed, "
+        << stats.num_idle << " idle." << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    construction_time_.Print("Detector construction time", os);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  //
+  // Exclusive use of one pooled detector. Movable, not copyable; returns the
+  // detector to the pool when destroyed or on Release().
+  //
+  ////////////////////////////////////////////////////////////////////////////
+  class Lease {
+   public:
+    Lease() : pool_(NULL), entry_(NULL), detector_(NULL) {}
+
+    Lease(Lease&& other)
+        : pool_(other.pool_), entry_(other.entry_),
+          detector_(other.detector_) {
+      other.detector_ = NULL;
+    }
+
+    Lease& operator=(Lease&& other) {
+      if (this != &other) {
+        Release();
+        pool_ = other.pool_;
+        entry_ = other.entry_;
+        detector_ = other.detector_;
+        other.detector_ = NULL;
+      }
+      return *this;
+    }
+
+    ~Lease() { Release(); }
+
+    void Release() {
+      if (detector_ != NULL) {
+        pool_->Return(entry_, detector_);
+        detector_ = NULL;
+      }
+    }
+
+    snowboy::SnowboyDetect* get() const { return detector_; }
+    snowboy::SnowboyDetect* operator->() const { return detector_; }
+    explicit operator bool() const { return detector_ != NULL; }
+
+   private:
+    friend class DetectorPool;
+
+    Lease(DetectorPool* pool, Entry* entry, snowboy::SnowboyDetect* detector)
+        : pool_(pool), entry_(entry), detector_(detector) {}
+
+    Lease(const Lease&);
+    Lease& operator=(const Lease&);
+
+    DetectorPool* pool_;
+    Entry* entry_;
+    snowboy::SnowboyDetect* detector_;
+  };
+
+ private:
+  // Detectors of one configuration.
+  struct Entry {
+    Config config;
+    std::vector<snowboy::SnowboyDetect*> idle;
+    // Detectors being built or queued for building.
+    int num_pending;
+    // Sensitivity restored on return: config.sensitivity_str, or the model
+    // defaults, recorded by the first Construct() if that is empty.
+    std::string sensitivity_str;
+  };
+
+  DetectorPool(const DetectorPool&);
+  DetectorPool& operator=(const DetectorPool&);
+
+  // Called with <mutex_> held.
+  Entry* GetEntry(const Config& config) {
+    std::unique_ptr<Entry>& entry = entries_[config.Key()];
+    if (!entry) {
+      entry.reset(new Entry());
+      entry->config = config;
+      entry->num_pending = 0;
+      entry->sensitivity_str = config.sensitivity_str;
+    }
+    return entry.get();
+  }
+
+  // Queues builds until <entry> will have <idle_per_config> idle detectors.
+  // Called with <mutex_> held.
+  void ScheduleBuilds(Entry* entry) {
+    bool scheduled = false;
+    while (static_cast<int>(entry->idle.size()) + entry->num_pending <
+           options_.idle_per_config) {
+      entry->num_pending++;
+      build_queue_.push_back(entry);
+      scheduled = true;
+    }
+    if (scheduled) {
+      build_cv_.notify_all();
+    }
+  }
+
+  snowboy::SnowboyDetect* Construct(Entry* entry) {
+    const Config& config = entry->config;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    snowboy::SnowboyDetect* detector = new snowboy::SnowboyDetect(
+        config.resource_filename, config.model_filename);
+    const std::string default_sensitivity = detector->GetSensitivity();
+    Configure(config, config.sensitivity_str, detector);
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entry->sensitivity_str.empty()) {
+      entry->sensitivity_str = default_sensitivity;
+    }
+    num_constructed_++;
+    construction_time_.RecordSeconds(seconds);
+    return detector;
+  }
+
+  static void Configure(const Config& config,
+                        const std::string& sensitivity_str,
+                        snowboy::SnowboyDetect* detector) {
+    if (!sensitivity_str.empty()) {
+      detector->SetSensitivity(sensitivity_str);
+    }
+    detector->SetAudioGain(config.audio_gain);
+    detector->ApplyFrontend(config.apply_frontend);
+  }
+
+  void Return(Entry* entry, snowboy::SnowboyDetect* detector) {
+    std::string sensitivity_str;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // Set by the Construct() of <detector> at the latest.
+      sensitivity_str = entry->sensitivity_str;
+    }
+    detector->Reset();
+    Configure(entry->config, sensitivity_str, detector);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (static_cast<int>(entry->idle.size()) < options_.idle_per_config) {
+        entry->idle.push_back(detector);
+        return;
+      }
+    }
+    delete detector;
+  }
+
+  void BuilderLoop() {
+    while (true) {
+      Entry* entry;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_ && build_queue_.empty()) {
+          build_cv_.wait(lock);
+        }
+        if (stopping_) {
+          return;
+        }
+        entry = build_queue_.front();
+        build_queue_.pop_front();
+      }
+      snowboy::SnowboyDetect* detector = Construct(entry);
+      std::lock_guard<std::mutex> lock(mutex_);
+      entry->num_pending--;
+      entry->idle.push_back(detector);
+    }
+  }
+
+  const Options options_;
+  mutable std::mutex mutex_;
+  std::condition_variable build_cv_;
+  bool stopping_;
+  // Entries are never removed, so pointers to them stay valid.
+  std::map<std::string, std::unique_ptr<Entry> > entries_;
+  std::deque<Entry*> build_queue_;
+  std::vector<std::thread> builders_;
+
+  int64_t hits_;
+  int64_t misses_;
+  int64_t num_constructed_;
+  LatencyHistogram construction_time_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_DETECTOR_POOL_H_
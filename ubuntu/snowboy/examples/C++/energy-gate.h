@@ -0,0 +1,298 @@
+// examples/C++/energy-gate.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_ENERGY_GATE_H_
+#define SNOWBOY_EXAMPLES_CPP_ENERGY_GATE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SNOWBOY_ENERGY_GATE_NEON
+#endif
+
+// Computes the energy and the number of zero crossings of an int16 frame.
+// Samples are halved before squaring so that the SIMD multiply-adds cannot
+// overflow, i.e., <sum_squares> is a quarter of the true sum of squares. All
+// code paths return exactly the same values.
+inline void FrameEnergyAndZeroCrossings(const int16_t* data, int num_samples,
+                                        int64_t* sum_squares,
+                                        int* num_zero_crossings) {
+  int64_t energy = 0;
+  int crossings = 0;
+  // <i> walks the samples for the energy, <j> the pairs (j - 1, j) for the
+  // zero crossings.
+  int i = 0;
+  int j = 1;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i energy_acc = zero;    // 2 x int64.
+  __m128i crossing_acc = zero;  // 8 x int16.
+  for (; i + 8 <= num_samples; i += 8) {
+    __m128i half = _mm_srai_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), 1);
+    // Non-negative 32-bit sums, widened to 64 bits by unpacking with zeros.
+    __m128i squares = _mm_madd_epi16(half, half);
+    energy_acc = _mm_add_epi64(energy_acc, _mm_unpacklo_epi32(squares, zero));
+    energy_acc = _mm_add_epi64(energy_acc, _mm_unpackhi_epi32(squares, zero));
+  }
+  for (; j + 8 <= num_samples; j += 8) {
+    // The sign differs iff the xor of a sample and its predecessor is
+    // negative; the comparison yields -1 for each crossing.
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + j));
+    __m128i previous =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + j - 1));
+    crossing_acc = _mm_sub_epi16(
+        crossing_acc, _mm_cmplt_epi16(_mm_xor_si128(x, previous), zero));
+  }
+  int64_t energy_lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(energy_lanes), energy_acc);
+  energy = energy_lanes[0] + energy_lanes[1];
+  uint16_t crossing_lanes[8];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(crossing_lanes), crossing_acc);
+  for (int k = 0; k < 8; ++k) {
+    crossings += crossing_lanes[k];
+  }
+#elif defined(SNOWBOY_ENERGY_GATE_NEON)
+  int64x2_t energy_acc = vdupq_n_s64(0);
+  uint16x8_t crossing_acc = vdupq_n_u16(0);
+  for (; i + 8 <= num_samples; i += 8) {
+    int16x8_t half = vshrq_n_s16(vld1q_s16(data + i), 1);
+    int32x4_t squares = vmull_s16(vget_low_s16(half), vget_low_s16(half));
+    squares = vmlal_s16(squares, vget_high_s16(half), vget_high_s16(half));
+    energy_acc = vpadalq_s32(energy_acc, squares);
+  }
+  for (; j + 8 <= num_samples; j += 8) {
+    int16x8_t x = vld1q_s16(data + j);
+    int16x8_t previous = vld1q_s16(data + j - 1);
+    // All ones for each crossing.
+    uint16x8_t crossed = vcltq_s16(veorq_s16(x, previous), vdupq_n_s16(0));
+    crossing_acc = vsubq_u16(crossing_acc, crossed);
+  }
+  energy = vgetq_lane_s64(energy_acc, 0) + vgetq_lane_s64(energy_acc, 1);
+  uint16_t crossing_lanes[8];
+  vst1q_u16(crossing_lanes, crossing_acc);
+  for (int k = 0; k < 8; ++k) {
+    crossings += crossing_lanes[k];
+  }
+#endif
+  for (; i < num_samples; ++i) {
+    int32_t half = data[i] >> 1;
+    energy += half * half;
+  }
+  for (; j < num_samples; ++j) {
+    crossings += (data[j] ^ data[j - 1]) < 0;
+  }
+  *sum_squares = energy;
+  *num_zero_crossings = crossings;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Gate in front of SnowboyDetect::RunDetection() that only forwards audio
+// while there is sound. Audio is split into short frames; a frame opens the
+// gate if its energy is <open_margin_db> above an adaptive noise floor, or if
+// it has a high zero-crossing rate (e.g., the "s" of "snowboy") and is at
+// least <close_margin_db> above the floor. The gate stays open while frames
+// are <close_margin_db> above the floor, plus <hangover_ms>.
+//
+// While the gate is closed, the last <pre_roll_ms> of audio are kept, and they
+// are forwarded first when the gate opens so that onsets are not clipped.
+// When the gate closes, the detector should be Reset(), since the audio it
+// will see next is not contiguous with what it has seen. Example:
+//
+//   while (num_samples > 0) {
+//     int64_t used = gate.Process(data, num_samples, &gated, &closed);
+//     if (!gated.empty()) {
+//       result = detector.RunDetection(gated.data(), gated.size());
+//     }
+//     if (closed) {
+//       detector.Reset();
+//     }
+//     data += used;
+//     num_samples -= used;
+//   }
+//
+////////////////////////////////////////////////////////////////////////////////
+class EnergyGate {
+ public:
+  struct Options {
+    int frame_ms;
+    float open_margin_db;
+    float close_margin_db;
+    // Fraction of sample pairs with a sign change that opens the gate for
+    // frames above <close_margin_db>.
+    float zero_crossing_rate;
+    int hangover_ms;
+    int pre_roll_ms;
+    // The noise floor follows quieter frames immediately, and rises at most
+    // this fast towards louder ones.
+    float floor_rise_db_per_second;
+    // Lower bound of the noise floor, so that digital silence does not make
+    // the gate open on every click.
+    float min_floor_db;
+
+    Options() : frame_ms(10), open_margin_db(10), close_margin_db(6),
+                zero_crossing_rate(0.3f), hangover_ms(500), pre_roll_ms(500),
+                floor_rise_db_per_second(1), min_floor_db(20) {}
+  };
+
+  // <samples_per_second> is the sample rate times the number of channels.
+  EnergyGate(const Options& options, int samples_per_second)
+      : options_(options), samples_per_second_(samples_per_second) {
+    frame_samples_ = std::max(8, options_.frame_ms * samples_per_second / 1000);
+    pre_roll_samples_ = static_cast<int64_t>(options_.pre_roll_ms) *
+        samples_per_second / 1000;
+    hangover_frames_ = options_.hangover_ms / std::max(1, options_.frame_ms);
+    floor_rise_db_per_frame_ =
+        options_.floor_rise_db_per_second * options_.frame_ms / 1000;
+    frame_.reserve(frame_samples_);
+    pre_roll_.reserve(pre_roll_samples_ + frame_samples_);
+    noise_floor_db_ = -1;
+    open_ = false;
+    hangover_left_ = 0;
+    num_forwarded_samples_ = 0;
+    num_samples_ = 0;
+    num_openings_ = 0;
+    gate_seconds_ = 0;
+  }
+
+  // Consumes audio up to, and including, the frame that closes the gate, or
+  // all of <num_samples> if the gate does not close. Fills <output> with the
+  // audio to pass to RunDetection() (possibly empty), and sets <closed> if
+  // the detector should be reset after it. Returns the number of samples
+  // consumed.
+  int64_t Process(const int16_t* data, int64_t num_samples,
+                  std::vector<int16_t>* output, bool* closed) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    output->clear();
+    *closed = false;
+    int64_t consumed = 0;
+    while (consumed < num_samples && !*closed) {
+      int64_t size = std::min<int64_t>(frame_samples_ - frame_.size(),
+                                       num_samples - consumed);
+      frame_.insert(frame_.end(), data + consumed, data + consumed + size);
+      consumed += size;
+      if (static_cast<int>(frame_.size()) == frame_samples_) {
+        *closed = ProcessFrame(output);
+        frame_.clear();
+      }
+    }
+    num_samples_ += consumed;
+    num_forwarded_samples_ += output->size();
+    gate_seconds_ += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    return consumed;
+  }
+
+  bool IsOpen() const { return open_; }
+
+  double NoiseFloorDb() const { return noise_floor_db_; }
+
+  // Prints how much audio was forwarded and the CPU time saved per hour of
+  // audio. <total_seconds> is the time spent in Process() and in
+  // RunDetection() on the forwarded audio; skipped audio is assumed to cost
+  // the detector as much per sample as forwarded audio.
+  void PrintReport(std::ostream& os, double total_seconds) const {
+    if (num_samples_ == 0) {
+      return;
+    }
+    double forwarded = static_cast<double>(num_forwarded_samples_) /
+        num_samples_;
+    os << "Energy gate: forwarded " << forwarded * 100 << "% of the audio, "
+        << "opened " << num_openings_ << " times, noise floor "
+        << noise_floor_db_ << " dB, "
+        << gate_seconds_ / num_samples_ * 1e9 << " ns per sample in the gate."
+        << std::endl;
+    if (num_forwarded_samples_ > 0) {
+      double hours = static_cast<double>(num_samples_) / samples_per_second_ /
+          3600;
+      double ungated_seconds = (total_seconds - gate_seconds_) / forwarded;
+      os << "CPU per audio hour: " << total_seconds / hours << " s gated, "
+          << ungated_seconds / hours << " s ungated, saving "
+          << (ungated_seconds - total_seconds) / hours << " s per hour."
+          << std::endl;
+    }
+  }
+
+ private:
+  // Classifies frame_ and routes it to <output> or the pre-roll. Returns true
+  // if the gate closed.
+  bool ProcessFrame(std::vector<int16_t>* output) {
+    int64_t sum_squares = 0;
+    int num_zero_crossings = 0;
+    FrameEnergyAndZeroCrossings(frame_.data(), frame_samples_, &sum_squares,
+                                &num_zero_crossings);
+    // The kernel returns a quarter of the sum of squares.
+    float energy_db = 10 * std::log10(4.0 * sum_squares / frame_samples_ + 1);
+    float zero_crossing_rate =
+        static_cast<float>(num_zero_crossings) / (frame_samples_ - 1);
+
+    if (noise_floor_db_ < 0 || energy_db < noise_floor_db_) {
+      noise_floor_db_ = energy_db;
+    } else {
+      noise_floor_db_ = std::min(energy_db,
+                                 noise_floor_db_ + floor_rise_db_per_frame_);
+    }
+    noise_floor_db_ = std::max(noise_floor_db_, options_.min_floor_db);
+
+    bool above_close = energy_db > noise_floor_db_ + options_.close_margin_db;
+    bool sound = energy_db > noise_floor_db_ + options_.open_margin_db ||
+        (above_close && zero_crossing_rate > options_.zero_crossing_rate);
+
+    if (!open_) {
+      if (!sound) {
+        pre_roll_.insert(pre_roll_.end(), frame_.begin(), frame_.end());
+        if (static_cast<int64_t>(pre_roll_.size()) > pre_roll_samples_) {
+          pre_roll_.erase(pre_roll_.begin(), pre_roll_.end() -
+                          pre_roll_samples_);
+        }
+        return false;
+      }
+      open_ = true;
+      num_openings_++;
+      output->insert(output->end(), pre_roll_.begin(), pre_roll_.end());
+      pre_roll_.clear();
+    }
+
+    output->insert(output->end(), frame_.begin(), frame_.end());
+    if (sound || above_close) {
+      hangover_left_ = hangover_frames_;
+    } else if (--hangover_left_ < 0) {
+      open_ = false;
+      return true;
+    }
+    return false;
+  }
+
+  Options options_;
+  int samples_per_second_;
+  int frame_samples_;
+  int64_t pre_roll_samples_;
+  int hangover_frames_;
+  float floor_rise_db_per_frame_;
+
+  // Samples of the current, incomplete frame.
+  std::vector<int16_t> frame_;
+  // Most recent audio seen while the gate was closed.
+  std::vector<int16_t> pre_roll_;
+
+  float noise_floor_db_;
+  bool open_;
+  int hangover_left_;
+
+  // Report statistics.
+  int64_t num_forwarded_samples_;
+  int64_t num_samples_;
+  int64_t num_openings_;
+  double gate_seconds_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_ENERGY_GATE_H_
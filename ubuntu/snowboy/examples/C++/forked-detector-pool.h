@@ -0,0 +1,381 @@
+// examples/C++/forked-detector-pool.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_FORKED_DETECTOR_POOL_H_
+#define SNOWBOY_EXAMPLES_CPP_FORKED_DETECTOR_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <semaphore.h>
+#include <signal.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+
+// A hotword found by a pool worker.
+struct PoolDetection {
+  // Number of samples written to the worker since it was started or last
+  // released, up to the end of the chunk that completed the hotword.
+  int64_t position;
+  // Result of RunDetection(): the hotword index, or -1 on error.
+  int32_t hotword;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Pool of detector worker processes that share the model memory. The parent
+// constructs one template SnowboyDetect, which parses common.res and the
+// models, and then forks the workers: each one inherits the parsed models
+// copy-on-write, so the read-only weights stay physically shared and only the
+// pages a detector writes to (its streaming state) become private.
+//
+// Each worker serves one stream at a time. Audio goes to it through a ring
+// buffer in shared memory, and detections come back the same way. Once the
+// stream is over, Release() resets the worker for the next one, without
+// forking again. Example:
+//
+//   ForkedDetectorPool pool;
+//   if (!pool.Start(options, &error) || !pool.WaitReady(10)) { ... }
+//   pool.Write(stream, samples, num_samples);
+//   int stream;
+//   PoolDetection detection;
+//   if (pool.WaitDetection(0.1, &stream, &detection)) { ... }
+//   pool.Release(stream, 1);
+//
+// Start() forks, so it must be called before the process starts any thread.
+// The pool is Linux-only: workers get SIGKILL if the parent dies.
+//
+////////////////////////////////////////////////////////////////////////////////
+class ForkedDetectorPool {
+ public:
+  struct Options {
+    std::string resource_filename;
+    std::string model_filename;
+    std::string sensitivity_str;
+    float audio_gain;
+    bool apply_frontend;
+    int num_workers;
+    // If true, every worker constructs its own detector after the fork
+    // instead of inheriting the template, i.e., nothing is shared. Only
+    // useful to measure what the sharing saves.
+    bool construct_in_worker;
+
+    Options() : resource_filename("resources/common.res"),
+                model_filename("resources/snowboy.umdl"), audio_gain(1),
+                apply_frontend(false), num_workers(4),
+                construct_in_worker(false) {}
+  };
+
+  // Audio buffered per worker, in samples: about 4 seconds at 16 kHz.
+  static const int64_t kAudioCapacity = 1 << 16;
+  // Unread detections buffered per worker; more are dropped.
+  static const int kDetectionCapacity = 64;
+
+  ForkedDetectorPool() : shared_(NULL), shared_size_(0) {}
+
+  ~ForkedDetectorPool() { Stop(); }
+
+  // Builds the template detector (unless <construct_in_worker>) and forks the
+  // workers. Returns false and fills <error> on failure.
+  bool Start(const Options& options, std::string* error) {
+    Stop();
+    if (options.num_workers <= 0) {
+      *error = "no workers";
+      return false;
+    }
+    shared_size_ = sizeof(Shared) + options.num_workers * sizeof(Channel);
+    void* memory = mmap(NULL, shared_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      *error = "cannot map shared memory";
+      return false;
+    }
+    shared_ = new (memory) Shared();
+    sem_init(&shared_->detection_ready, 1, 0);
+    char* channel_memory = static_cast<char*>(memory) + sizeof(Shared);
+    for (int i = 0; i < options.num_workers; ++i) {
+      Channel* channel =
+          new (channel_memory + i * sizeof(Channel)) Channel();
+      sem_init(&channel->audio_ready, 1, 0);
+      channels_.push_back(channel);
+    }
+
+    if (!options.construct_in_worker) {
+      template_.reset(NewDetector(options));
+    }
+    const pid_t parent = getpid();
+    for (int i = 0; i < options.num_workers; ++i) {
+      pid_t pid = fork();
+      if (pid < 0) {
+        *error = std::string("fork() failed: ") + strerror(errno);
+        Stop();
+        return false;
+      }
+      if (pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) {
+          _exit(1);
+        }
+        snowboy::SnowboyDetect* detector = template_ ?
+            template_.get() : NewDetector(options);
+        RunWorker(detector, channels_[i], shared_);
+        _exit(0);
+      }
+      pids_.push_back(pid);
+    }
+    return true;
+  }
+
+  // Waits until every worker has its detector. Returns false if a worker died
+  // or on timeout.
+  bool WaitReady(double timeout_seconds) {
+    const double deadline = Now() + timeout_seconds;
+    for (size_t i = 0; i < channels_.size(); ++i) {
+      while (channels_[i]->ready.load(std::memory_order_acquire) == 0) {
+        int status;
+        if (Now() > deadline || waitpid(pids_[i], &status, WNOHANG) != 0) {
+          return false;
+        }
+        usleep(1000);
+      }
+    }
+    return true;
+  }
+
+  int NumWorkers() const { return pids_.size(); }
+
+  pid_t WorkerPid(int worker) const { return pids_[worker]; }
+
+  // Sample rate times number of channels of the detectors, once ready.
+  int SamplesPerSecond() const {
+    return channels_.empty() ? 0 : channels_[0]->samples_per_second;
+  }
+
+  // Queues audio for <worker>. Returns the number of samples queued, which is
+  // less than <num_samples> if the worker's buffer is full.
+  int64_t Write(int worker, const int16_t* data, int64_t num_samples) {
+    Channel* channel = channels_[worker];
+    int64_t written = channel->audio_written.load(std::memory_order_relaxed);
+    int64_t read = channel->audio_read.load(std::memory_order_acquire);
+    num_samples = std::min(num_samples, kAudioCapacity - (written - read));
+    for (int64_t done = 0; done < num_samples; ) {
+      int64_t offset = (written + done) & (kAudioCapacity - 1);
+      int64_t size = std::min(num_samples - done, kAudioCapacity - offset);
+      memcpy(channel->audio + offset, data + done, size * sizeof(int16_t));
+      done += size;
+    }
+    if (num_samples > 0) {
+      channel->audio_written.store(written + num_samples,
+                                   std::memory_order_release);
+      sem_post(&channel->audio_ready);
+    }
+    return num_samples;
+  }
+
+  // Ends the stream of <worker>: drops its unread audio and detections and
+  // resets its detector, so that the worker can serve a new stream. Must not
+  // be called concurrently with Write() to the same worker. Returns false if
+  // the worker died or did not answer within <timeout_seconds>.
+  bool Release(int worker, double timeout_seconds) {
+    Channel* channel = channels_[worker];
+    const int64_t request =
+        channel->reset_requested.load(std::memory_order_relaxed) + 1;
+    channel->reset_requested.store(request, std::memory_order_release);
+    sem_post(&channel->audio_ready);
+    const double deadline = Now() + timeout_seconds;
+    while (channel->reset_done.load(std::memory_order_acquire) != request) {
+      int status;
+      if (Now() > deadline || waitpid(pids_[worker], &status, WNOHANG) != 0) {
+        return false;
+      }
+      usleep(100);
+    }
+    // The worker is idle now, so all of its detections were posted; one post
+    // is taken back for every detection dropped.
+    int64_t read = channel->detections_read.load(std::memory_order_relaxed);
+    int64_t written =
+        channel->detections_written.load(std::memory_order_acquire);
+    for (; read < written; ++read) {
+      sem_trywait(&shared_->detection_ready);
+    }
+    channel->detections_read.store(written, std::memory_order_release);
+    return true;
+  }
+
+  // Waits up to <timeout_seconds> for a detection from any worker. Returns
+  // false on timeout.
+  bool WaitDetection(double timeout_seconds, int* worker,
+                     PoolDetection* detection) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    double end = deadline.tv_sec + deadline.tv_nsec * 1e-9 + timeout_seconds;
+    deadline.tv_sec = static_cast<time_t>(end);
+    deadline.tv_nsec = static_cast<long>((end - deadline.tv_sec) * 1e9);
+    while (sem_timedwait(&shared_->detection_ready, &deadline) != 0) {
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+    // Every post matches one queued detection, unless it was dropped.
+    for (size_t i = 0; i < channels_.size(); ++i) {
+      Channel* channel = channels_[i];
+      int64_t read = channel->detections_read.load(std::memory_order_relaxed);
+      if (read < channel->detections_written.load(std::memory_order_acquire)) {
+        *worker = i;
+        *detection = channel->detections[read % kDetectionCapacity];
+        channel->detections_read.store(read + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Stops the workers and releases the shared memory.
+  void Stop() {
+    for (size_t i = 0; i < pids_.size(); ++i) {
+      channels_[i]->stop.store(1, std::memory_order_release);
+      sem_post(&channels_[i]->audio_ready);
+    }
+    for (size_t i = 0; i < pids_.size(); ++i) {
+      int status;
+      waitpid(pids_[i], &status, 0);
+    }
+    pids_.clear();
+    for (size_t i = 0; i < channels_.size(); ++i) {
+      sem_destroy(&channels_[i]->audio_ready);
+      channels_[i]->~Channel();
+    }
+    channels_.clear();
+    if (shared_ != NULL) {
+      sem_destroy(&shared_->detection_ready);
+      shared_->~Shared();
+      munmap(shared_, shared_size_);
+      shared_ = NULL;
+    }
+    template_.reset();
+  }
+
+ private:
+  // Pool-wide state in shared memory.
+  struct Shared {
+    // Posted once per queued detection.
+    sem_t detection_ready;
+  };
+
+  // Shared memory between the parent and one worker. Counters only grow;
+  // positions in the rings are taken modulo their capacity.
+  struct Channel {
+    // Posted by the parent after every Write(), and by Release() and Stop().
+    sem_t audio_ready;
+    std::atomic<int64_t> audio_written;
+    std::atomic<int64_t> audio_read;
+    // Release() requests, and the last one the worker carried out.
+    std::atomic<int64_t> reset_requested;
+    std::atomic<int64_t> reset_done;
+    std::atomic<int64_t> detections_written;
+    std::atomic<int64_t> detections_read;
+    std::atomic<int> ready;
+    std::atomic<int> stop;
+    int samples_per_second;
+    PoolDetection detections[kDetectionCapacity];
+    int16_t audio[kAudioCapacity];
+
+    Channel() : audio_written(0), audio_read(0), reset_requested(0),
+                reset_done(0), detections_written(0), detections_read(0),
+                ready(0), stop(0), samples_per_second(0) {}
+  };
+
+  static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  static snowboy::SnowboyDetect* NewDetector(const Options& options) {
+    snowboy::SnowboyDetect* detector = new snowboy::SnowboyDetect(
+        options.resource_filename, options.model_filename);
+    if (!options.sensitivity_str.empty()) {
+      detector->SetSensitivity(options.sensitivity_str);
+    }
+    detector->SetAudioGain(options.audio_gain);
+    detector->ApplyFrontend(options.apply_frontend);
+    return detector;
+  }
+
+  // Main loop of a worker process: runs the detector on everything written
+  // to <channel> until stopped.
+  static void RunWorker(snowboy::SnowboyDetect* detector, Channel* channel,
+                        Shared* shared) {
+    // The template was never fed, but Reset() makes the stream start clean
+    // whatever the parent did with it.
+    detector->Reset();
+    // Samples written to the channel before the current stream.
+    int64_t stream_start = 0;
+    channel->samples_per_second =
+        detector->SampleRate() * detector->NumChannels();
+    channel->ready.store(1, std::memory_order_release);
+    while (true) {
+      while (sem_wait(&channel->audio_ready) != 0 && errno == EINTR) {}
+      if (channel->stop.load(std::memory_order_acquire)) {
+        return;
+      }
+      int64_t reset =
+          channel->reset_requested.load(std::memory_order_acquire);
+      if (reset != channel->reset_done.load(std::memory_order_relaxed)) {
+        // The parent does not write during Release(), so everything written
+        // so far belongs to the old stream.
+        stream_start = channel->audio_written.load(std::memory_order_acquire);
+        channel->audio_read.store(stream_start, std::memory_order_release);
+        detector->Reset();
+        channel->reset_done.store(reset, std::memory_order_release);
+        continue;
+      }
+      int64_t written = channel->audio_written.load(std::memory_order_acquire);
+      int64_t read = channel->audio_read.load(std::memory_order_relaxed);
+      while (read < written) {
+        int64_t offset = read & (kAudioCapacity - 1);
+        int64_t size = std::min(written - read, kAudioCapacity - offset);
+        int result = detector->RunDetection(channel->audio + offset, size);
+        read += size;
+        channel->audio_read.store(read, std::memory_order_release);
+        if (result > 0 || result == -1) {
+          PushDetection(read - stream_start, result, channel, shared);
+        }
+      }
+    }
+  }
+
+  static void PushDetection(int64_t position, int hotword, Channel* channel,
+                            Shared* shared) {
+    int64_t written =
+        channel->detections_written.load(std::memory_order_relaxed);
+    if (written - channel->detections_read.load(std::memory_order_acquire) >=
+        kDetectionCapacity) {
+      return;
+    }
+    PoolDetection& detection =
+        channel->detections[written % kDetectionCapacity];
+    detection.position = position;
+    detection.hotword = hotword;
+    channel->detections_written.store(written + 1, std::memory_order_release);
+    sem_post(&shared->detection_ready);
+  }
+
+  Shared* shared_;
+  size_t shared_size_;
+  std::vector<Channel*> channels_;
+  std::vector<pid_t> pids_;
+  std::unique_ptr<snowboy::SnowboyDetect> template_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_FORKED_DETECTOR_POOL_H_
@@ -0,0 +1,225 @@
+// examples/C++/forked-pool-benchmark.cc
+
+// Compares a ForkedDetectorPool whose workers inherit one template detector
+// copy-on-write with the same pool where every worker constructs its own
+// detector. For both, prints the start-up time, the time from Start() to the
+// first detection of every worker when each is fed the hotword recording, and
+// the proportional set size (PSS) of the workers, which splits shared pages
+// evenly between the processes mapping them.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "forked-detector-pool.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+// Memory usage of one process, in kB, from /proc/<pid>/smaps_rollup.
+struct MemoryUsage {
+  int64_t rss_kb;
+  int64_t pss_kb;
+  int64_t private_kb;
+
+  MemoryUsage() : rss_kb(0), pss_kb(0), private_kb(0) {}
+};
+
+bool ReadMemoryUsage(pid_t pid, MemoryUsage* usage) {
+  std::ostringstream path;
+  path << "/proc/" << pid << "/smaps_rollup";
+  FILE* file = fopen(path.str().c_str(), "r");
+  if (file == NULL) {
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    long long kb = 0;
+    if (sscanf(line, "Rss: %lld", &kb) == 1) {
+      usage->rss_kb = kb;
+    } else if (sscanf(line, "Pss: %lld", &kb) == 1) {
+      usage->pss_kb = kb;
+    } else if (sscanf(line, "Private_Clean: %lld", &kb) == 1 ||
+               sscanf(line, "Private_Dirty: %lld", &kb) == 1) {
+      usage->private_kb += kb;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Feeds <audio> to every worker of <pool> until each one detects the hotword,
+// and fills <first_detection> with the times of the detections, in seconds
+// since <start>. Returns false if some worker did not detect it in time.
+bool FeedUntilDetected(const std::string& name,
+                       const std::vector<int16_t>& audio,
+                       std::chrono::steady_clock::time_point start,
+                       double timeout_seconds, ForkedDetectorPool* pool,
+                       std::vector<double>* first_detection) {
+  const int num_workers = pool->NumWorkers();
+  std::vector<int64_t> num_written(num_workers, 0);
+  first_detection->assign(num_workers, -1);
+  int num_detected = 0;
+  while (num_detected < num_workers && SecondsSince(start) < timeout_seconds) {
+    for (int i = 0; i < num_workers; ++i) {
+      if ((*first_detection)[i] < 0) {
+        // Loops the recording until the worker detects it.
+        int64_t offset = num_written[i] % audio.size();
+        num_written[i] += pool->Write(i, audio.data() + offset,
+                                      audio.size() - offset);
+      }
+    }
+    int worker;
+    PoolDetection detection;
+    while (pool->WaitDetection(0.001, &worker, &detection)) {
+      if (detection.hotword > 0 && (*first_detection)[worker] < 0) {
+        (*first_detection)[worker] = SecondsSince(start);
+        num_detected++;
+      }
+    }
+  }
+  if (num_detected < num_workers) {
+    std::cerr << name << ": only " << num_detected << " of " << num_workers
+        << " workers detected the hotword." << std::endl;
+    return false;
+  }
+  std::sort(first_detection->begin(), first_detection->end());
+  return true;
+}
+
+// Starts a pool with <options>, feeds <audio> to every worker, then releases
+// the workers and feeds them again, and prints the timings and memory usage.
+// Returns false on failure.
+bool RunMode(const std::string& name,
+             const ForkedDetectorPool::Options& options,
+             const std::vector<int16_t>& audio, double timeout_seconds) {
+  ForkedDetectorPool pool;
+  std::string error;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  if (!pool.Start(options, &error) || !pool.WaitReady(timeout_seconds)) {
+    std::cerr << name << ": fail to start the pool"
+        << (error.empty() ? "" : ": ") << error << std::endl;
+    return false;
+  }
+  double ready_seconds = SecondsSince(start);
+
+  const int num_workers = pool.NumWorkers();
+  std::vector<double> first_detection;
+  if (!FeedUntilDetected(name, audio, start, timeout_seconds, &pool,
+                         &first_detection)) {
+    return false;
+  }
+
+  MemoryUsage parent;
+  ReadMemoryUsage(getpid(), &parent);
+  MemoryUsage total;
+  for (int i = 0; i < num_workers; ++i) {
+    MemoryUsage usage;
+    ReadMemoryUsage(pool.WorkerPid(i), &usage);
+    total.rss_kb += usage.rss_kb;
+    total.pss_kb += usage.pss_kb;
+    total.private_kb += usage.private_kb;
+  }
+
+  // Reuses the workers for new streams, as a server does when a client goes
+  // away, instead of forking again.
+  std::chrono::steady_clock::time_point release_start =
+      std::chrono::steady_clock::now();
+  for (int i = 0; i < num_workers; ++i) {
+    if (!pool.Release(i, timeout_seconds)) {
+      std::cerr << name << ": fail to release worker " << i << std::endl;
+      return false;
+    }
+  }
+  double release_seconds = SecondsSince(release_start);
+  std::vector<double> reused_detection;
+  if (!FeedUntilDetected(name, audio, std::chrono::steady_clock::now(),
+                         timeout_seconds, &pool, &reused_detection)) {
+    return false;
+  }
+
+  std::cout << std::fixed << std::setprecision(3) << name << ": "
+      << num_workers << " workers ready in " << ready_seconds
+      << " s, first detection after " << first_detection[0] << " s (median "
+      << first_detection[num_workers / 2] << ", last "
+      << first_detection[num_workers - 1] << ")." << std::endl;
+  std::cout << name << ": " << num_workers << " workers released in "
+      << release_seconds << " s, first detection on the new streams after "
+      << reused_detection[0] << " s (median "
+      << reused_detection[num_workers / 2] << ", last "
+      << reused_detection[num_workers - 1] << ")." << std::endl;
+  std::cout << std::setprecision(0) << name << ": per worker "
+      << total.pss_kb / num_workers << " kB PSS, "
+      << total.private_kb / num_workers << " kB private, "
+      << total.rss_kb / num_workers << " kB RSS; parent " << parent.pss_kb
+      << " kB PSS; all processes " << total.pss_kb + parent.pss_kb
+      << " kB PSS." << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Measures the memory and start-up time saved by forking detector\n"
+      "workers from one template detector, compared with constructing a\n"
+      "detector in every worker, and the time to release the workers for new\n"
+      "streams instead of forking again. Linux only.\n"
+      "\n"
+      "Usage: ./forked-pool-benchmark [options]\n"
+      "e.g.: ./forked-pool-benchmark --num-workers=32\n";
+
+  ForkedDetectorPool::Options options;
+  options.sensitivity_str = "0.5";
+  std::string wave_filename = "resources/snowboy.wav";
+  float timeout_seconds = 60;
+
+  ParseOptions po(usage);
+  po.Register("resource", &options.resource_filename, "Resource file.");
+  po.Register("model", &options.model_filename,
+              "Comma separated list of hotword models.");
+  po.Register("sensitivity", &options.sensitivity_str,
+              "Comma separated sensitivities; empty uses the model defaults.");
+  po.Register("num-workers", &options.num_workers,
+              "Number of worker processes.");
+  po.Register("wav", &wave_filename, "Recording containing the hotword.");
+  po.Register("timeout", &timeout_seconds,
+              "Seconds to wait for every worker to detect the hotword.");
+  po.Read(argc, argv);
+  if (po.NumArgs() != 0 || options.num_workers <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  MappedWaveFile wave;
+  std::string error;
+  if (!wave.Open(wave_filename, &error)) {
+    std::cerr << "Fail to read " << wave_filename << ": " << error << std::endl;
+    exit(1);
+  }
+  if (wave.Info().bits_per_sample != 16) {
+    std::cerr << wave_filename << " is not 16 bits per sample." << std::endl;
+    exit(1);
+  }
+  std::vector<int16_t> audio(wave.Info().data_size / sizeof(int16_t));
+  memcpy(audio.data(), wave.Data(), audio.size() * sizeof(int16_t));
+
+  // Independent construction runs first, while this process has never loaded
+  // a model, so that no inherited model pages blur its numbers.
+  options.construct_in_worker = true;
+  bool ok = RunMode("independent", options, audio, timeout_seconds);
+  options.construct_in_worker = false;
+  ok = RunMode("shared", options, audio, timeout_seconds) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,537 @@
+// examples/C++/hotword-server.cc
+
+// Serves hotword detection to many concurrent PCM streams from one process, so
+// that common.res and the models are only loaded once per box instead of once
+// per microphone process. Clients connect over a Unix domain socket or TCP and
+// use the framing of stream-protocol.h.
+//
+// The main thread multiplexes all connections with epoll: it reads audio
+// frames into a per-session buffer and, once a session has a full chunk,
+// queues it for a fixed pool of worker threads. Each session owns its own
+// SnowboyDetect (the detector is stateful), leased from a DetectorPool that
+// keeps prewarmed detectors, and is processed by at most one worker at a
+// time, so its audio is always fed in order. Hotword events are sent back on
+// the same connection by the worker that found them.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "detector-pool.h"
+#include "include/snowboy-detect.h"
+#include "latency-histogram.h"
+#include "parse-options.h"
+#include "stream-protocol.h"
+#include "swig/C/snowboy-detect-run.h"
+
+struct ServerOptions {
+  DetectorPool::Config detector;
+  int chunk_ms;
+  float max_pending_seconds;
+};
+
+// One client connection. Fields are owned by the main thread, by whichever
+// worker currently holds the session, or guarded by <mutex>, as marked.
+struct Session {
+  explicit Session(int fd_) : fd(fd_), stream_samples(0), scheduled(false),
+                              queued_time(0), num_dropped_samples(0),
+                              writing(false), ended(false), failed(false) {}
+
+  // The socket is closed only once the last reference to the session is gone,
+  // so that a worker never writes to a reused descriptor.
+  ~Session() { close(fd); }
+
+  const int fd;
+
+  // Main thread.
+  FrameReader reader;
+
+  // Guarded by <mutex>.
+  std::mutex mutex;
+  std::vector<int16_t> pending;
+  // Number of samples received on the stream so far, including dropped ones.
+  int64_t stream_samples;
+  // True while the session is queued or being processed by a worker.
+  bool scheduled;
+  double queued_time;
+  int64_t num_dropped_samples;
+  // Encoded frames that could not be sent without blocking.
+  std::string output;
+  // True while EPOLLOUT is registered for the unsent part of <output>.
+  bool writing;
+  // True once the client has closed its side of the connection. The worker
+  // then runs the rest of the stream with <is_end> set and drops the session.
+  bool ended;
+  // True once the connection or the detector failed; no more audio is run.
+  bool failed;
+
+  // Worker holding the session.
+  DetectorPool::Lease detector;
+  std::vector<int16_t> chunk;
+};
+
+// Shared state of the main thread and the workers.
+struct ServerState {
+  ServerOptions options;
+  DetectorPool* detector_pool;
+  int epoll_fd;
+  int samples_per_second;
+  int64_t chunk_samples;
+  int64_t max_pending_samples;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_cv;
+  std::deque<std::shared_ptr<Session> > queue;
+  // Time from a chunk being complete to a worker picking it up, guarded by
+  // <queue_mutex>.
+  LatencyHistogram queueing_delay;
+
+  std::atomic<int64_t> num_hits;
+  std::atomic<int64_t> num_processed_samples;
+  std::atomic<int64_t> num_dropped_samples;
+  std::atomic<int64_t> num_detector_errors;
+};
+
+double NowSeconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Updates the epoll registration of <session> to match whether it has unsent
+// output. Called with <session->mutex> held.
+void UpdateEpollEvents(int epoll_fd, Session* session, bool want_write) {
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+  event.data.fd = session->fd;
+  // Fails harmlessly if the main thread already dropped the session.
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session->fd, &event);
+}
+
+// Sends as much of <session->output> as the socket takes without blocking.
+// Called with <session->mutex> held. Returns false if the connection failed.
+bool FlushOutput(int epoll_fd, Session* session) {
+  while (!session->output.empty()) {
+    ssize_t num_sent = send(session->fd, session->output.data(),
+                            session->output.size(), MSG_NOSIGNAL);
+    if (num_sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        session->failed = true;
+        return false;
+      }
+      break;
+    }
+    session->output.erase(0, num_sent);
+  }
+  bool want_write = !session->output.empty();
+  if (want_write != session->writing) {
+    session->writing = want_write;
+    UpdateEpollEvents(epoll_fd, session, want_write);
+  }
+  return true;
+}
+
+void QueueSession(ServerState* state, const std::shared_ptr<Session>& session) {
+  {
+    std::lock_guard<std::mutex> lock(state->queue_mutex);
+    state->queue.push_back(session);
+  }
+  state->queue_cv.notify_one();
+}
+
+// Runs the detector of <session> on everything pending. Only one worker holds
+// a session at a time, see Session::scheduled. Returns true if a full chunk
+// arrived meanwhile, or the stream ended, and the session must be queued
+// again.
+bool ProcessSession(ServerState* state, Session* session) {
+  int64_t chunk_end = 0;
+  bool is_end = false;
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (session->failed) {
+      session->pending.clear();
+      session->scheduled = false;
+      return false;
+    }
+    session->chunk.swap(session->pending);
+    session->pending.clear();
+    chunk_end = session->stream_samples;
+    // No audio arrives once the stream has ended, so this is the last run.
+    is_end = session->ended;
+  }
+  if (!session->detector && !session->chunk.empty()) {
+    // Acquired here rather than on accept(), so that a pool miss, which
+    // loads the models, does not stall the event loop.
+    session->detector =
+        state->detector_pool->Acquire(state->options.detector);
+  }
+
+  int result = 0;
+  if (session->detector && (!session->chunk.empty() || is_end)) {
+    // The final run may be on an empty tail, see RunDetectionSized().
+    result = snowboy::RunDetectionSized(session->detector.get(),
+                                        session->chunk.data(),
+                                        session->chunk.size(), is_end);
+    state->num_processed_samples += session->chunk.size();
+  }
+
+  std::lock_guard<std::mutex> lock(session->mutex);
+  if (result > 0) {
+    state->num_hits++;
+    AppendHotwordFrame(result, chunk_end, &session->output);
+    FlushOutput(state->epoll_fd, session);
+  } else if (result == -1) {
+    state->num_detector_errors++;
+    session->failed = true;
+    const std::string message = "RunDetection() failed";
+    AppendFrame(kErrorFrame, message.data(), message.size(), &session->output);
+    FlushOutput(state->epoll_fd, session);
+    // The queued output is still sent before the FIN; the main thread sees
+    // the hang-up and drops the session.
+    shutdown(session->fd, SHUT_RDWR);
+  }
+  if (!session->failed && !is_end &&
+      (session->ended ||
+       static_cast<int64_t>(session->pending.size()) >= state->chunk_samples)) {
+    // More audio arrived or the stream ended meanwhile; the session goes to
+    // the back of the queue so that one busy stream cannot starve the others.
+    session->queued_time = NowSeconds();
+    return true;
+  }
+  session->scheduled = false;
+  return false;
+}
+
+void Worker(ServerState* state) {
+  while (true) {
+    std::shared_ptr<Session> session;
+    {
+      std::unique_lock<std::mutex> lock(state->queue_mutex);
+      while (state->queue.empty()) {
+        state->queue_cv.wait(lock);
+      }
+      session = state->queue.front();
+      state->queue.pop_front();
+      state->queueing_delay.RecordSeconds(NowSeconds() - session->queued_time);
+    }
+    if (ProcessSession(state, session.get())) {
+      QueueSession(state, session);
+    }
+  }
+}
+
+// Appends the samples of one audio frame to <session>, dropping the oldest
+// ones if the workers have fallen too far behind, and queues the session once
+// it has a full chunk.
+void AddAudio(ServerState* state, const std::shared_ptr<Session>& session,
+              const char* payload, uint32_t size) {
+  const int64_t num_samples = size / sizeof(int16_t);
+  bool queue = false;
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (session->failed) {
+      return;
+    }
+    std::vector<int16_t>& pending = session->pending;
+    size_t old_size = pending.size();
+    pending.resize(old_size + num_samples);
+    memcpy(pending.data() + old_size, payload, num_samples * sizeof(int16_t));
+    session->stream_samples += num_samples;
+    int64_t excess = pending.size() - state->max_pending_samples;
+    if (excess > 0) {
+      pending.erase(pending.begin(), pending.begin() + excess);
+      session->num_dropped_samples += excess;
+      state->num_dropped_samples += excess;
+    }
+    if (!session->scheduled &&
+        static_cast<int64_t>(pending.size()) >= state->chunk_samples) {
+      session->scheduled = true;
+      session->queued_time = NowSeconds();
+      queue = true;
+    }
+  }
+  if (queue) {
+    QueueSession(state, session);
+  }
+}
+
+// Ends the stream of <session> once the client has closed its side of the
+// connection: a worker runs the rest of it with <is_end> set and sends the last
+// hotword frame, if any, before the session, and with it the lease, is
+// dropped.
+void EndStream(ServerState* state, const std::shared_ptr<Session>& session) {
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->ended = true;
+    if (session->scheduled || session->failed) {
+      // The worker holding the session sees <ended> when it is done.
+      return;
+    }
+    session->scheduled = true;
+    session->queued_time = NowSeconds();
+  }
+  QueueSession(state, session);
+}
+
+// Reads what is available on <session> and handles the complete frames.
+// Returns false if the connection should be closed; <end_of_stream> then tells
+// whether the client closed it.
+bool ReadSession(ServerState* state, const std::shared_ptr<Session>& session,
+                 bool* end_of_stream) {
+  // One read per event, so that a fast client cannot monopolize the loop.
+  char buffer[65536];
+  ssize_t num_read = recv(session->fd, buffer, sizeof(buffer), 0);
+  if (num_read < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+  if (num_read == 0) {
+    *end_of_stream = true;
+    return false;
+  }
+  session->reader.Append(buffer, num_read);
+  FrameType type;
+  const char* payload;
+  uint32_t size;
+  while (session->reader.Next(&type, &payload, &size)) {
+    if (type != kAudioFrame || size % sizeof(int16_t) != 0) {
+      std::lock_guard<std::mutex> lock(session->mutex);
+      const std::string message = "expected audio frames of int16 samples";
+      AppendFrame(kErrorFrame, message.data(), message.size(),
+                  &session->output);
+      FlushOutput(state->epoll_fd, session.get());
+      return false;
+    }
+    AddAudio(state, session, payload, size);
+  }
+  return !session->reader.Failed();
+}
+
+double ProcessCpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+void SignalHandler(int signal) {
+  std::cerr << "Caught signal " << signal << ", terminating..." << std::endl;
+  exit(0);
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Hotword detection server for many concurrent PCM streams. Clients\n"
+      "send 16 kHz mono int16 audio frames and receive hotword frames, see\n"
+      "stream-protocol.h. Every session gets its own detector; detection runs\n"
+      "on a fixed pool of worker threads. Statistics are printed to stderr\n"
+      "every --stats-interval seconds.\n"
+      "\n"
+      "Usage: ./hotword-server [options]\n"
+      "e.g.: ./hotword-server --listen=tcp:127.0.0.1:9900 --num-workers=4\n";
+
+  ServerOptions options;
+  options.detector.resource_filename = "resources/common.res";
+  options.detector.model_filename = "resources/snowboy.umdl";
+  options.detector.sensitivity_str = "0.5";
+  options.detector.audio_gain = 1;
+  options.detector.apply_frontend = false;
+  options.chunk_ms = 100;
+  options.max_pending_seconds = 2;
+  std::string listen_address = "unix:/tmp/snowboy-hotword.sock";
+  int num_workers = std::thread::hardware_concurrency();
+  int stats_interval_s = 10;
+  DetectorPool::Options pool_options;
+  pool_options.idle_per_config = 4;
+  pool_options.num_builder_threads = 1;
+
+  ParseOptions po(usage);
+  po.Register("listen", &listen_address,
+              "Address to listen on: unix:<path> or tcp:<ipv4>:<port>.");
+  po.Register("resource", &options.detector.resource_filename,
+              "Resource file.");
+  po.Register("model", &options.detector.model_filename,
+              "Comma separated list of hotword models.");
+  po.Register("sensitivity", &options.detector.sensitivity_str,
+              "Comma separated sensitivities; empty uses the model defaults.");
+  po.Register("audio-gain", &options.detector.audio_gain, "Audio gain.");
+  po.Register("apply-frontend", &options.detector.apply_frontend,
+              "Apply frontend audio processing.");
+  po.Register("chunk-ms", &options.chunk_ms,
+              "Audio per RunDetection() call, in milliseconds.");
+  po.Register("max-pending-seconds", &options.max_pending_seconds,
+              "Audio buffered per session while waiting for a worker; older "
+              "audio is dropped and counted.");
+  po.Register("num-workers", &num_workers, "Number of detection threads.");
+  po.Register("idle-detectors", &pool_options.idle_per_config,
+              "Detectors kept constructed ahead of new sessions.");
+  po.Register("pool-threads", &pool_options.num_builder_threads,
+              "Threads constructing detectors in the background.");
+  po.Register("stats-interval", &stats_interval_s,
+              "Seconds between statistics; 0 disables them.");
+  po.Read(argc, argv);
+  if (po.NumArgs() != 0 || options.chunk_ms <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+  num_workers = std::max(1, num_workers);
+
+  struct sigaction sig_int_handler;
+  sig_int_handler.sa_handler = SignalHandler;
+  sigemptyset(&sig_int_handler.sa_mask);
+  sig_int_handler.sa_flags = 0;
+  sigaction(SIGINT, &sig_int_handler, NULL);
+  sigaction(SIGTERM, &sig_int_handler, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Checks the model files and the audio format up front. Returning the lease
+  // leaves the detector idle in the pool, which then builds the others.
+  DetectorPool detector_pool(pool_options);
+  ServerState state;
+  state.options = options;
+  state.detector_pool = &detector_pool;
+  {
+    DetectorPool::Lease lease = detector_pool.Acquire(options.detector);
+    const snowboy::SnowboyDetect& detector = *lease.get();
+    const int samples_per_second =
+        detector.SampleRate() * detector.NumChannels();
+    state.samples_per_second = samples_per_second;
+    state.chunk_samples = std::max<int64_t>(
+        1, static_cast<int64_t>(options.chunk_ms) * samples_per_second / 1000);
+    state.max_pending_samples = std::max<int64_t>(
+        state.chunk_samples,
+        static_cast<int64_t>(options.max_pending_seconds * samples_per_second));
+    if (detector.BitsPerSample() != 16) {
+      std::cerr << "The detector expects " << detector.BitsPerSample()
+          << " bits per sample, the protocol carries 16." << std::endl;
+      exit(1);
+    }
+  }
+  const int samples_per_second = state.samples_per_second;
+  state.num_hits = 0;
+  state.num_processed_samples = 0;
+  state.num_dropped_samples = 0;
+  state.num_detector_errors = 0;
+
+  std::string error;
+  int listen_fd = ListenOn(listen_address, &error);
+  if (listen_fd < 0) {
+    std::cerr << "Fail to listen on " << listen_address << ": " << error
+        << std::endl;
+    exit(1);
+  }
+  state.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = listen_fd;
+  epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_workers; ++i) {
+    workers.push_back(std::thread(Worker, &state));
+  }
+  std::cerr << "Listening on " << listen_address << " with " << num_workers
+      << " workers." << std::endl;
+
+  std::unordered_map<int, std::shared_ptr<Session> > sessions;
+  int64_t num_accepted = 0;
+  int64_t last_processed_samples = 0;
+  double last_stats_time = NowSeconds();
+  double last_cpu_seconds = ProcessCpuSeconds();
+  std::vector<struct epoll_event> events(256);
+  while (true) {
+    int num_events = epoll_wait(state.epoll_fd, events.data(), events.size(),
+                                1000);
+    if (num_events < 0 && errno != EINTR) {
+      std::cerr << "epoll_wait() failed: " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    for (int i = 0; i < num_events; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == listen_fd) {
+        int client_fd;
+        while ((client_fd = accept4(listen_fd, NULL, NULL,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          int one = 1;
+          setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          sessions[client_fd].reset(new Session(client_fd));
+          memset(&event, 0, sizeof(event));
+          event.events = EPOLLIN;
+          event.data.fd = client_fd;
+          epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, client_fd, &event);
+          num_accepted++;
+        }
+        continue;
+      }
+      std::unordered_map<int, std::shared_ptr<Session> >::iterator it =
+          sessions.find(fd);
+      if (it == sessions.end()) {
+        continue;
+      }
+      std::shared_ptr<Session> session = it->second;
+      bool ok = !(events[i].events & EPOLLERR);
+      bool end_of_stream = false;
+      if (ok && (events[i].events & EPOLLOUT)) {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        ok = FlushOutput(state.epoll_fd, session.get());
+      }
+      if (ok && (events[i].events & (EPOLLIN | EPOLLHUP))) {
+        ok = ReadSession(&state, session, &end_of_stream);
+      }
+      if (!ok) {
+        // A worker may still hold the session; it keeps the descriptor open
+        // until it is done.
+        epoll_ctl(state.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        if (end_of_stream) {
+          EndStream(&state, session);
+        } else {
+          shutdown(fd, SHUT_RDWR);
+        }
+        sessions.erase(it);
+      }
+    }
+
+    double now = NowSeconds();
+    if (stats_interval_s > 0 && now - last_stats_time >= stats_interval_s) {
+      int64_t processed_samples = state.num_processed_samples;
+      double cpu_seconds = ProcessCpuSeconds();
+      double audio_seconds =
+          static_cast<double>(processed_samples - last_processed_samples) /
+          samples_per_second;
+      double interval = now - last_stats_time;
+      std::cerr << "Sessions: " << sessions.size() << " open, "
+          << num_accepted << " accepted. Processed " << audio_seconds / interval
+          << " s of audio per second (" << audio_seconds /
+          std::max(1e-9, cpu_seconds - last_cpu_seconds)
+          << " streams per busy core), " << state.num_hits << " hits, "
+          << static_cast<double>(state.num_dropped_samples) /
+          samples_per_second << " s of audio dropped, "
+          << state.num_detector_errors << " detector errors." << std::endl;
+      {
+        std::lock_guard<std::mutex> lock(state.queue_mutex);
+        state.queueing_delay.Print("Queueing delay", std::cerr);
+        state.queueing_delay.Clear();
+      }
+      detector_pool.PrintReport(std::cerr);
+      last_processed_samples = processed_samples;
+      last_cpu_seconds = cpu_seconds;
+      last_stats_time = now;
+    }
+  }
+  return 0;
+}
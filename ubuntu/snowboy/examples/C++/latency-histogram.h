@@ -0,0 +1,126 @@
+// examples/C++/latency-histogram.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_LATENCY_HISTOGRAM_H_
+#define SNOWBOY_EXAMPLES_CPP_LATENCY_HISTOGRAM_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Log-linear histogram of latencies in microseconds. Every power of 2 is split
+// into kSubBuckets linear buckets, so that the relative error of a reported
+// percentile stays below 1/kSubBuckets (about 6%) from microseconds to hours,
+// with a fixed amount of memory and an O(1) Record().
+//
+// Not thread-safe: a histogram must be recorded and printed from one thread.
+//
+////////////////////////////////////////////////////////////////////////////////
+class LatencyHistogram {
+ public:
+  LatencyHistogram() : counts_(kNumBuckets, 0) { Clear(); }
+
+  // Records one latency. Negative values (e.g., from clock skew between the
+  // audio device and the host) are clamped to 0.
+  void Record(double microseconds) {
+    int64_t value = microseconds > 0 ? static_cast<int64_t>(microseconds) : 0;
+    counts_[BucketIndex(value)]++;
+    count_++;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  // Records a latency given in seconds.
+  void RecordSeconds(double seconds) { Record(seconds * 1e6); }
+
+  void Clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_ = 0;
+    min_ = INT64_MAX;
+    max_ = 0;
+  }
+
+  int64_t Count() const { return count_; }
+
+  // Returns an upper bound of the <p>-th percentile (0 < p <= 100), in
+  // microseconds, or 0 if nothing has been recorded.
+  int64_t Percentile(double p) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    int64_t rank = static_cast<int64_t>(p / 100 * count_ + 0.5);
+    rank = std::max<int64_t>(1, std::min(rank, count_));
+    int64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(BucketUpperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  // Prints one line with the count, mean, min, max and the usual percentiles,
+  // in milliseconds.
+  void Print(const std::string& name, std::ostream& os) const {
+    os << name << ": ";
+    if (count_ == 0) {
+      os << "no samples" << std::endl;
+      return;
+    }
+    os << std::fixed << std::setprecision(2)
+        << "count " << count_ << ", mean " << sum_ / 1e3 / count_
+        << " ms, min " << min_ / 1e3 << ", p50 " << Percentile(50) / 1e3
+        << ", p90 " << Percentile(90) / 1e3 << ", p99 "
+        << Percentile(99) / 1e3 << ", p99.9 " << Percentile(99.9) / 1e3
+        << ", max " << max_ / 1e3 << std::endl;
+    os.unsetf(std::ios::floatfield);
+    os << std::setprecision(6);
+  }
+
+ private:
+  static const int kSubBucketBits = 4;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  // Values below kSubBuckets get one bucket each; every power of 2 from there
+  // up to 2^40 us (about 12 days) gets kSubBuckets buckets.
+  static const int kMaxExponent = 40;
+  static const int kNumBuckets =
+      kSubBuckets + (kMaxExponent - kSubBucketBits) * kSubBuckets;
+
+  static int BucketIndex(int64_t value) {
+    if (value < kSubBuckets) {
+      return static_cast<int>(value);
+    }
+    int exponent = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    if (exponent >= kMaxExponent) {
+      return kNumBuckets - 1;
+    }
+    int shift = exponent - kSubBucketBits;
+    int sub_bucket = static_cast<int>(value >> shift) - kSubBuckets;
+    return kSubBuckets + shift * kSubBuckets + sub_bucket;
+  }
+
+  // Largest value that falls into bucket <index>.
+  static int64_t BucketUpperBound(int index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    int shift = (index - kSubBuckets) / kSubBuckets;
+    int64_t sub_bucket = (index - kSubBuckets) % kSubBuckets;
+    return ((kSubBuckets + sub_bucket + 1) << shift) - 1;
+  }
+
+  std::vector<int64_t> counts_;
+  int64_t count_;
+  int64_t sum_;
+  int64_t min_;
+  int64_t max_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_LATENCY_HISTOGRAM_H_
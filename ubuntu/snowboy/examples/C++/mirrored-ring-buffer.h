@@ -0,0 +1,114 @@
+// examples/C++/mirrored-ring-buffer.h
+
+// Linux port of the virtual memory mirroring technique used by TPCircularBuffer
+// (see examples/iOS/Obj-C/Pods/TPCircularBuffer), which relies on Mach's
+// vm_allocate()/vm_remap(). Here the same pages are mapped twice, back to back,
+// using memfd_create() and mmap(), so that a ring buffer can always hand out
+// its readable data as one contiguous span.
+
+#ifndef SNOWBOY_EXAMPLES_CPP_MIRRORED_RING_BUFFER_H_
+#define SNOWBOY_EXAMPLES_CPP_MIRRORED_RING_BUFFER_H_
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "spsc-ring-buffer.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+// Backing store for SpscRingBuffer whose second half is a virtual copy of its
+// first half: writing past the end of the array writes to its start, and
+// reading past the end reads from its start.
+template<typename T>
+class MirroredRingStorage {
+ public:
+  static const bool kMirrored = true;
+
+  // Both mappings must cover whole pages.
+  static int64_t MinCapacity() {
+    return sysconf(_SC_PAGESIZE) / sizeof(T);
+  }
+
+  // Throws std::runtime_error if the mirrored mapping cannot be set up.
+  explicit MirroredRingStorage(int64_t capacity)
+      : size_bytes_(capacity * sizeof(T)), data_(NULL) {
+    int fd = CreateMemoryFile();
+    if (fd < 0) {
+      throw std::runtime_error("Fail to create memory file for ring buffer.");
+    }
+    if (ftruncate(fd, size_bytes_) != 0) {
+      close(fd);
+      throw std::runtime_error("Fail to resize memory file for ring buffer.");
+    }
+
+    // Reserves twice the size of address space, then maps the file over both
+    // halves. MAP_FIXED only replaces our own reservation, so unlike the
+    // vm_remap() dance in TPCircularBufferInit() there is no race to retry.
+    void* address = mmap(NULL, 2 * size_bytes_, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (address == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Fail to reserve memory for ring buffer.");
+    }
+    char* base = static_cast<char*>(address);
+    if (mmap(base, size_bytes_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + size_bytes_, size_bytes_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      munmap(base, 2 * size_bytes_);
+      close(fd);
+      throw std::runtime_error("Fail to mirror memory for ring buffer.");
+    }
+
+    // The mappings keep the memory alive.
+    close(fd);
+    data_ = reinterpret_cast<T*>(base);
+  }
+
+  ~MirroredRingStorage() {
+    munmap(data_, 2 * size_bytes_);
+  }
+
+  T* Data() { return data_; }
+  const T* Data() const { return data_; }
+
+ private:
+  // Anonymous shared memory. Falls back to POSIX shared memory if the kernel
+  // or libc is too old for memfd_create().
+  static int CreateMemoryFile() {
+#ifdef SYS_memfd_create
+    int fd = syscall(SYS_memfd_create, "snowboy-ring-buffer", MFD_CLOEXEC);
+    if (fd >= 0) {
+      return fd;
+    }
+#endif
+    std::string name = "/snowboy-ring-buffer-" + std::to_string(getpid());
+    int shm_fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (shm_fd >= 0) {
+      shm_unlink(name.c_str());
+    }
+    return shm_fd;
+  }
+
+  MirroredRingStorage(const MirroredRingStorage&);
+  MirroredRingStorage& operator=(const MirroredRingStorage&);
+
+  size_t size_bytes_;
+  T* data_;
+};
+
+// Lock-free SPSC ring buffer whose Peek() always returns a single region.
+template<typename T>
+using MirroredRingBuffer = SpscRingBuffer<T, MirroredRingStorage<T> >;
+
+#endif  // __linux__
+
+#endif  // SNOWBOY_EXAMPLES_CPP_MIRRORED_RING_BUFFER_H_
@@ -0,0 +1,192 @@
+// examples/C++/model-reload-benchmark.cc
+
+// Checks that ModelReloader (model-reloader.h) swaps detectors without losing
+// audio or detections, and measures what a swap costs the detection loop. A
+// recording is replayed as a paced live stream twice: once without reloads,
+// as the reference, and once while the model file is touched every
+// --reload-interval seconds, which makes the reloader build, warm and swap in
+// a new detector. Both runs must feed every sample and report the same
+// number of hotwords, at positions at most --tolerance-ms apart: a new
+// detector that has not seen a hotword in its pre-roll can report the first
+// one after the swap a couple of chunks away (see model-reloader.h).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utime.h>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+#include "latency-histogram.h"
+#include "model-reloader.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+struct Run {
+  int64_t num_fed_samples;
+  // Sample positions of the chunks that reported a hotword.
+  std::vector<int64_t> detections;
+  LatencyHistogram chunk_time;
+};
+
+// Streams <samples> in <chunk_samples> chunks at <speed> times real time. With
+// a non-NULL <reloader>, <touch_filename> is touched every <reload_interval_s>
+// seconds of audio.
+Run Replay(const ModelReloader::Options& options,
+           const std::vector<int16_t>& samples, int chunk_samples,
+           int samples_per_second, float speed, float reload_interval_s,
+           const std::string& touch_filename, ModelReloader* reloader) {
+  Run run;
+  run.num_fed_samples = 0;
+  std::unique_ptr<snowboy::SnowboyDetect> detector(new snowboy::SnowboyDetect(
+      options.resource_filename, options.model_filename));
+  detector->SetSensitivity(options.sensitivity_str);
+
+  const int64_t num_samples = samples.size();
+  const int64_t reload_samples = static_cast<int64_t>(
+      reload_interval_s * samples_per_second);
+  int64_t next_reload = reload_samples;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int64_t offset = 0; offset < num_samples; offset += chunk_samples) {
+    // Waits until the chunk would have been captured.
+    std::this_thread::sleep_until(start + std::chrono::microseconds(
+        static_cast<int64_t>((offset + chunk_samples) * 1e6 /
+                             samples_per_second / speed)));
+    const int size = static_cast<int>(
+        std::min<int64_t>(chunk_samples, num_samples - offset));
+    std::chrono::steady_clock::time_point chunk_start =
+        std::chrono::steady_clock::now();
+    if (reloader != NULL) {
+      reloader->MaybeSwap(&detector);
+    }
+    int result = detector->RunDetection(samples.data() + offset, size);
+    if (reloader != NULL) {
+      reloader->OnAudio(samples.data() + offset, size);
+    }
+    run.chunk_time.Record(std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - chunk_start).count());
+    run.num_fed_samples += size;
+    if (result > 0) {
+      run.detections.push_back(offset + size);
+    }
+    if (reloader != NULL && offset + size >= next_reload) {
+      utime(touch_filename.c_str(), NULL);
+      next_reload += reload_samples;
+    }
+  }
+  return run;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Checks that ModelReloader swaps detectors without dropping audio, and\n"
+      "measures the swap cost. The model file is touched (its modification\n"
+      "time is updated) during the second run.\n"
+      "\n"
+      "Usage: ./model-reload-benchmark [options]\n"
+      "e.g.: ./model-reload-benchmark --wav=long.wav --speed=2\n";
+
+  ModelReloader::Options options;
+  options.sensitivity_str = "0.5";
+  std::string wave_filename = "resources/snowboy.wav";
+  int repeat = 10;
+  int chunk_ms = 100;
+  float speed = 4;
+  float reload_interval_s = 5;
+  int tolerance_ms = 300;
+
+  ParseOptions po(usage);
+  po.Register("resource", &options.resource_filename, "Resource file.");
+  po.Register("model", &options.model_filename,
+              "Hotword model(s); the first one is touched.");
+  po.Register("sensitivity", &options.sensitivity_str, "Sensitivity string.");
+  po.Register("wav", &wave_filename, "Recording to replay.");
+  po.Register("repeat", &repeat, "Number of times --wav is replayed.");
+  po.Register("chunk-ms", &chunk_ms, "Chunk size in milliseconds.");
+  po.Register("speed", &speed, "Replay speed, relative to real time.");
+  po.Register("reload-interval", &reload_interval_s,
+              "Seconds of audio between two touches of the model.");
+  po.Register("preroll-ms", &options.preroll_ms,
+              "Audio fed to a new detector before the swap.");
+  po.Register("tolerance-ms", &tolerance_ms,
+              "Largest accepted shift of a detection between the runs.");
+  po.Read(argc, argv);
+  if (repeat <= 0 || chunk_ms <= 0 || speed <= 0 || reload_interval_s <= 0 ||
+      tolerance_ms < 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  MappedWaveFile wave;
+  std::string error;
+  if (!wave.Open(wave_filename, &error)) {
+    std::cerr << "Fail to read " << wave_filename << ": " << error << std::endl;
+    exit(1);
+  }
+  std::vector<int16_t> samples;
+  std::vector<int16_t> aligned;
+  const int16_t* data = wave.Samples(&aligned);
+  const int64_t wave_samples = wave.NumSamples();
+  for (int i = 0; i < repeat; ++i) {
+    samples.insert(samples.end(), data, data + wave_samples);
+  }
+  const int samples_per_second =
+      wave.Info().sample_rate * wave.Info().num_channels;
+  const int chunk_samples = std::max(1, chunk_ms * samples_per_second / 1000);
+
+  const std::string touch_filename =
+      options.model_filename.substr(0, options.model_filename.find(','));
+  Run reference = Replay(options, samples, chunk_samples, samples_per_second,
+                         speed, reload_interval_s, touch_filename, NULL);
+
+  ModelReloader reloader(options, samples_per_second);
+  if (!reloader.Start(&error)) {
+    std::cerr << "Fail to watch the models: " << error << std::endl;
+    exit(1);
+  }
+  Run reloaded = Replay(options, samples, chunk_samples, samples_per_second,
+                        speed, reload_interval_s, touch_filename, &reloader);
+
+  std::cout << "Fed " << reference.num_fed_samples << " samples without "
+      << "reloads, " << reloaded.num_fed_samples << " with reloads, out of "
+      << samples.size() << "." << std::endl;
+  std::cout << "Detections: " << reference.detections.size()
+      << " without reloads, " << reloaded.detections.size()
+      << " with reloads." << std::endl;
+  int64_t max_shift = 0;
+  for (size_t i = 0; i < std::min(reference.detections.size(),
+                                  reloaded.detections.size()); ++i) {
+    max_shift = std::max(max_shift, std::abs(reference.detections[i] -
+                                             reloaded.detections[i]));
+  }
+  std::cout << "Largest shift of a detection: "
+      << max_shift * 1000.0 / samples_per_second << " ms." << std::endl;
+  bool same = reference.detections.size() == reloaded.detections.size() &&
+      max_shift * 1000 <= static_cast<int64_t>(tolerance_ms) *
+                          samples_per_second &&
+      reference.num_fed_samples == reloaded.num_fed_samples &&
+      reloaded.num_fed_samples == static_cast<int64_t>(samples.size());
+  if (!same) {
+    for (size_t i = 0; i < std::max(reference.detections.size(),
+                                    reloaded.detections.size()); ++i) {
+      std::cout << "  detection " << i << ": "
+          << (i < reference.detections.size() ?
+              reference.detections[i] * 1.0 / samples_per_second : -1)
+          << " s vs. "
+          << (i < reloaded.detections.size() ?
+              reloaded.detections[i] * 1.0 / samples_per_second : -1)
+          << " s" << std::endl;
+    }
+  }
+  reference.chunk_time.Print("Chunk time without reloads", std::cout);
+  reloaded.chunk_time.Print("Chunk time with reloads", std::cout);
+  reloader.PrintReport(std::cout);
+  std::cout << (same ? "OK: no audio or detection lost."
+                     : "MISMATCH between the runs.") << std::endl;
+  return same ? 0 : 1;
+}
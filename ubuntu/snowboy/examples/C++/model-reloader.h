@@ -0,0 +1,469 @@
+// examples/C++/model-reloader.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_MODEL_RELOADER_H_
+#define SNOWBOY_EXAMPLES_CPP_MODEL_RELOADER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "include/snowboy-detect.h"
+#include "latency-histogram.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Replaces the detector of a running detection loop when its resource or model
+// files change, without stopping the capture. A background thread watches the
+// files (inotify on Linux, modification times elsewhere), builds a new
+// SnowboyDetect when they change, and warms it with the last <preroll_ms> of
+// audio. The detection loop records the audio it feeds with OnAudio() and
+// calls MaybeSwap() between chunks; the swap feeds the new detector the few
+// samples that arrived during warm-up and exchanges the pointers, so that no
+// sample is skipped. The old detector is deleted later on the background
+// thread. Example:
+//
+//   ModelReloader reloader(options, detector->SampleRate());
+//   reloader.Start(&error);
+//   while (...) {
+//     reloader.MaybeSwap(&detector);
+//     int result = detector->RunDetection(data, num_samples);
+//     reloader.OnAudio(data, num_samples);
+//   }
+//
+// Detections of the new detector during warm-up are ignored: that audio was
+// already seen by the old one.
+//
+// The new detector does not start with exactly the state of the old one. The
+// results of RunDetection() depend on how the audio is split (one call reports
+// at most one hotword), so the warm-up and the catch-up are fed in chunks of
+// the size last passed to OnAudio(), starting on a chunk boundary of the
+// detection loop. Even so, the state after a hotword is only rebuilt once the
+// new detector has seen a hotword itself: when the pre-roll holds none, the
+// first detection after the swap can move by a couple of chunks (e.g., from
+// 6.4 s to 6.6 s with 100 ms chunks); later ones are not affected. Files are only reloaded once they have not
+// changed for <debounce_ms> and can be opened, since the library aborts the
+// process on a model it cannot read; write new models to a temporary file and
+// rename() them into place to avoid reading a partial file.
+//
+// OnAudio() and MaybeSwap() must be called from the detection thread.
+//
+////////////////////////////////////////////////////////////////////////////////
+class ModelReloader {
+ public:
+  struct Options {
+    std::string resource_filename;
+    // Comma separated, as for SnowboyDetect.
+    std::string model_filename;
+    // Empty keeps the model defaults, e.g., after UpdateModel().
+    std::string sensitivity_str;
+    float audio_gain;
+    bool apply_frontend;
+    // Audio fed to a new detector before it is swapped in.
+    int preroll_ms;
+    // Quiet period after the last change before a reload.
+    int debounce_ms;
+    // Interval of the modification time checks without inotify.
+    int poll_ms;
+
+    Options() : resource_filename("resources/common.res"),
+                model_filename("resources/snowboy.umdl"), audio_gain(1),
+                apply_frontend(false), preroll_ms(3000), debounce_ms(300),
+                poll_ms(1000) {}
+  };
+
+  // <samples_per_second> is the sample rate times the number of channels.
+  ModelReloader(const Options& options, int samples_per_second)
+      : options_(options), samples_per_second_(samples_per_second),
+        history_(static_cast<int64_t>(options.preroll_ms + kMarginMs) *
+                 samples_per_second / 1000),
+        num_recorded_(0), chunk_samples_(1), has_replacement_(false), stopping_(false),
+        reload_requested_(false), replacement_position_(0),
+        num_reloads_(0), num_failures_(0) {}
+
+  ~ModelReloader() {
+    stopping_ = true;
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // Starts watching the files. Returns false and fills <error> if they cannot
+  // be watched.
+  bool Start(std::string* error) {
+    std::vector<std::string> files = WatchedFiles();
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+      *error = std::string("inotify_init1: ") + strerror(errno);
+      return false;
+    }
+    // Directories are watched rather than the files, so that files replaced
+    // by rename(), as editors and atomic writers do, are still seen.
+    for (size_t i = 0; i < files.size(); ++i) {
+      std::string dir = ".";
+      size_t slash = files[i].rfind('/');
+      if (slash != std::string::npos) {
+        dir = slash == 0 ? "/" : files[i].substr(0, slash);
+      }
+      if (inotify_add_watch(inotify_fd_, dir.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                            IN_ATTRIB) < 0) {
+        *error = "cannot watch " + dir + ": " + strerror(errno);
+        close(inotify_fd_);
+        return false;
+      }
+    }
+#else
+    mtimes_.resize(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+      mtimes_[i] = ModificationTime(files[i]);
+    }
+#endif
+    thread_ = std::thread(&ModelReloader::WatchLoop, this);
+    return true;
+  }
+
+  // Asks for a reload even though the files did not change.
+  void RequestReload() { reload_requested_ = true; }
+
+  // Records <num_samples> samples that were just fed to the detector.
+  void OnAudio(const int16_t* data, int64_t num_samples) {
+    const int64_t size = history_.size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunk_samples_ = std::max<int64_t>(1, std::min(num_samples, size));
+    if (num_samples > size) {
+      data += num_samples - size;
+      num_recorded_ += num_samples - size;
+      num_samples = size;
+    }
+    int64_t pos = num_recorded_ % size;
+    int64_t first = std::min(num_samples, size - pos);
+    std::copy(data, data + first, history_.begin() + pos);
+    std::copy(data + first, data + num_samples, history_.begin());
+    num_recorded_ += num_samples;
+  }
+
+  // Replaces <*detector> if a new detector is ready. Returns true if it did.
+  // Cheap when there is none.
+  bool MaybeSwap(std::unique_ptr<snowboy::SnowboyDetect>* detector) {
+    if (!has_replacement_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<snowboy::SnowboyDetect> replacement =
+        std::move(replacement_);
+    has_replacement_ = false;
+    // Catches up on the audio recorded since the background thread stopped
+    // feeding it; <mutex_> is held, but only the background thread waits on
+    // it.
+    int64_t num_caught_up = FeedHistory(replacement_position_, num_recorded_,
+                                        chunk_samples_, replacement.get());
+    retired_.push_back(std::move(*detector));
+    *detector = std::move(replacement);
+    double swap_us = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+    swap_time_.Record(swap_us);
+    change_to_swap_.Record(std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - change_time_).count());
+    catch_up_audio_.Record(num_caught_up * 1e6 / samples_per_second_);
+    num_reloads_++;
+    return true;
+  }
+
+  void PrintReport(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    os << "Model reloader: " << num_reloads_ << " reloads, " << num_failures_
+        << " failed." << std::endl;
+    swap_time_.Print("Swap time on the detection thread", os);
+    change_to_swap_.Print("File change to swap", os);
+    warm_up_time_.Print("Build and warm-up time", os);
+    catch_up_audio_.Print("Audio caught up at swap", os);
+  }
+
+ private:
+  // History kept beyond the pre-roll, for the audio recorded while the
+  // background thread warms up the new detector.
+  static const int kMarginMs = 2000;
+  // The background thread keeps feeding the new detector until less than
+  // this much audio is left for the swap.
+  static const int kCatchUpMs = 50;
+  static const int kWakeUpMs = 100;
+
+  ModelReloader(const ModelReloader&);
+  ModelReloader& operator=(const ModelReloader&);
+
+  std::vector<std::string> WatchedFiles() const {
+    std::vector<std::string> files(1, options_.resource_filename);
+    std::stringstream ss(options_.model_filename);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      files.push_back(item);
+    }
+    return files;
+  }
+
+  static std::string BaseName(const std::string& filename) {
+    size_t slash = filename.rfind('/');
+    return slash == std::string::npos ? filename : filename.substr(slash + 1);
+  }
+
+  static int64_t ModificationTime(const std::string& filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+      return -1;
+    }
+    return static_cast<int64_t>(st.st_mtime) * 1000000000 +
+#ifdef __APPLE__
+        st.st_mtimespec.tv_nsec;
+#else
+        st.st_mtim.tv_nsec;
+#endif
+  }
+
+  // Returns the recorded samples [<begin>, <begin> + <n>), which must still be
+  // in the history. Points into the history unless they wrap around, in which
+  // case they are copied to <scratch>. Called with <mutex_> held.
+  const int16_t* HistoryData(int64_t begin, int64_t n,
+                             std::vector<int16_t>* scratch) const {
+    const int64_t size = history_.size();
+    int64_t pos = begin % size;
+    if (pos + n <= size) {
+      return history_.data() + pos;
+    }
+    scratch->assign(history_.begin() + pos, history_.end());
+    scratch->insert(scratch->end(), history_.begin(),
+                    history_.begin() + (pos + n - size));
+    return scratch->data();
+  }
+
+  // Feeds the recorded samples [<begin>, <end>) to <detector> in chunks of
+  // <chunk_samples>, skipping what is no longer in the history. Returns the
+  // number of samples fed. Called with <mutex_> held.
+  int64_t FeedHistory(int64_t begin, int64_t end, int64_t chunk_samples,
+                      snowboy::SnowboyDetect* detector) {
+    begin = std::max(begin, end - static_cast<int64_t>(history_.size()));
+    int64_t num_fed = 0;
+    while (begin < end) {
+      int64_t n = std::min(end - begin, chunk_samples);
+      detector->RunDetection(HistoryData(begin, n, &swap_scratch_),
+                             static_cast<int>(n));
+      begin += n;
+      num_fed += n;
+    }
+    return num_fed;
+  }
+
+  // Returns true if one of the watched files changed since the last call.
+  bool FilesChanged() {
+#ifdef __linux__
+    struct pollfd fd = {inotify_fd_, POLLIN, 0};
+    if (poll(&fd, 1, kWakeUpMs) <= 0) {
+      return false;
+    }
+    std::vector<std::string> files = WatchedFiles();
+    bool changed = false;
+    char buffer[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+      for (char* p = buffer; p < buffer + length;
+           p += sizeof(struct inotify_event) +
+                reinterpret_cast<struct inotify_event*>(p)->len) {
+        const struct inotify_event* event =
+            reinterpret_cast<struct inotify_event*>(p);
+        for (size_t i = 0; event->len > 0 && i < files.size(); ++i) {
+          changed = changed || BaseName(files[i]) == event->name;
+        }
+      }
+    }
+    return changed;
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(kWakeUpMs));
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (now - last_poll_ < std::chrono::milliseconds(options_.poll_ms)) {
+      return false;
+    }
+    last_poll_ = now;
+    std::vector<std::string> files = WatchedFiles();
+    bool changed = false;
+    for (size_t i = 0; i < files.size(); ++i) {
+      int64_t mtime = ModificationTime(files[i]);
+      changed = changed || mtime != mtimes_[i];
+      mtimes_[i] = mtime;
+    }
+    return changed;
+#endif
+  }
+
+  // Builds and warms a new detector, then hands it to MaybeSwap().
+  bool Reload() {
+    std::vector<std::string> files = WatchedFiles();
+    for (size_t i = 0; i < files.size(); ++i) {
+      FILE* file = fopen(files[i].c_str(), "rb");
+      if (file == NULL) {
+        std::cerr << "Not reloading: cannot open " << files[i] << std::endl;
+        return false;
+      }
+      fclose(file);
+    }
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::unique_ptr<snowboy::SnowboyDetect> detector(
+        new snowboy::SnowboyDetect(options_.resource_filename,
+                                   options_.model_filename));
+    if (!options_.sensitivity_str.empty()) {
+      detector->SetSensitivity(options_.sensitivity_str);
+    }
+    detector->SetAudioGain(options_.audio_gain);
+    detector->ApplyFrontend(options_.apply_frontend);
+
+    // Feeds the pre-roll, then whatever was recorded meanwhile, so that only
+    // a few milliseconds are left for the detection thread. The pre-roll
+    // starts a whole number of chunks back, so that the new detector sees the
+    // same chunk boundaries as the old one.
+    std::vector<int16_t> chunk;
+    std::vector<int16_t> scratch;
+    int64_t position;
+    int64_t chunk_samples;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      chunk_samples = chunk_samples_;
+      int64_t preroll =
+          static_cast<int64_t>(options_.preroll_ms) * samples_per_second_ /
+          1000;
+      preroll = (preroll + chunk_samples - 1) / chunk_samples * chunk_samples;
+      position = std::max<int64_t>(0, num_recorded_ - preroll);
+    }
+    while (!stopping_) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const int64_t size = history_.size();
+        if (position < num_recorded_ - size) {
+          int64_t lost = num_recorded_ - size - position;
+          position += (lost + chunk_samples - 1) / chunk_samples *
+              chunk_samples;
+        }
+        if (num_recorded_ - position <= std::max<int64_t>(
+                chunk_samples,
+                static_cast<int64_t>(kCatchUpMs) * samples_per_second_ /
+                1000)) {
+          replacement_ = std::move(detector);
+          replacement_position_ = position;
+          warm_up_time_.Record(std::chrono::duration<double, std::micro>(
+              std::chrono::steady_clock::now() - start).count());
+          has_replacement_.store(true, std::memory_order_release);
+          return true;
+        }
+        // Copies out the next piece so that the lock is not held while
+        // running the detector.
+        int64_t n = std::min(num_recorded_ - position, chunk_samples);
+        const int16_t* data = HistoryData(position, n, &scratch);
+        chunk.assign(data, data + n);
+      }
+      detector->RunDetection(chunk.data(), static_cast<int>(chunk.size()));
+      position += chunk.size();
+    }
+    return false;
+  }
+
+  void WatchLoop() {
+    std::chrono::steady_clock::time_point last_change;
+    bool pending = false;
+    while (!stopping_) {
+      if (FilesChanged()) {
+        last_change = std::chrono::steady_clock::now();
+        if (!pending) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          change_time_ = last_change;
+        }
+        pending = true;
+      }
+      if (reload_requested_.exchange(false) && !pending) {
+        pending = true;
+        last_change = std::chrono::steady_clock::now() -
+            std::chrono::milliseconds(options_.debounce_ms);
+        std::lock_guard<std::mutex> lock(mutex_);
+        change_time_ = std::chrono::steady_clock::now();
+      }
+      // A replacement that was not swapped in yet is replaced in turn.
+      if (pending && std::chrono::steady_clock::now() - last_change >=
+          std::chrono::milliseconds(options_.debounce_ms)) {
+        pending = false;
+        if (!Reload()) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          num_failures_++;
+        }
+      }
+      std::vector<std::unique_ptr<snowboy::SnowboyDetect> > retired;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired.swap(retired_);
+      }
+    }
+#ifdef __linux__
+    close(inotify_fd_);
+#endif
+  }
+
+  const Options options_;
+  const int samples_per_second_;
+
+  // Protects everything below, except the atomics.
+  mutable std::mutex mutex_;
+  // Audio fed to the current detector, as a circular buffer; <num_recorded_>
+  // samples were recorded in total.
+  std::vector<int16_t> history_;
+  int64_t num_recorded_;
+  // Size of the last chunk passed to OnAudio().
+  int64_t chunk_samples_;
+  // Copy of the wrapped around chunks fed by MaybeSwap().
+  std::vector<int16_t> swap_scratch_;
+  std::atomic<bool> has_replacement_;
+  std::atomic<bool> stopping_;
+  std::atomic<bool> reload_requested_;
+  std::unique_ptr<snowboy::SnowboyDetect> replacement_;
+  // Recorded samples already fed to <replacement_>.
+  int64_t replacement_position_;
+  // Swapped out detectors, deleted by the background thread.
+  std::vector<std::unique_ptr<snowboy::SnowboyDetect> > retired_;
+  std::chrono::steady_clock::time_point change_time_;
+
+  std::thread thread_;
+#ifdef __linux__
+  int inotify_fd_;
+#else
+  std::vector<int64_t> mtimes_;
+  std::chrono::steady_clock::time_point last_poll_;
+#endif
+
+  int64_t num_reloads_;
+  int64_t num_failures_;
+  LatencyHistogram swap_time_;
+  LatencyHistogram change_to_swap_;
+  LatencyHistogram warm_up_time_;
+  LatencyHistogram catch_up_audio_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_MODEL_RELOADER_H_
@@ -0,0 +1,360 @@
+// examples/C++/multichannel-benchmark.cc
+
+// Measures CPU usage and hit rate of MultichannelDetector against the number
+// of channels, the number of channels running a detector (top-K) and the
+// number of threads. A microphone array is simulated from a mono hotword
+// recording: every repetition of the hotword is closest to a different
+// microphone, and each channel is attenuated by <attenuation-db> per
+// microphone away from it, with independent noise. The hit rate is compared
+// with a single detector on channel 0, i.e., a device that ignores the array.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+#include "multichannel-detector.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+// Simulated array recording.
+struct ArrayAudio {
+  int num_channels;
+  // Interleaved samples.
+  std::vector<int16_t> samples;
+  // Frame range of every hotword repetition.
+  std::vector<int64_t> hotword_begin;
+  std::vector<int64_t> hotword_end;
+};
+
+// Places <repetitions> copies of <hotword>, separated by <gap_frames> of
+// noise, on <num_channels> channels. Repetition r is closest to microphone
+// r % <num_channels>, on a circular array.
+void SimulateArray(const std::vector<int16_t>& hotword, int num_channels,
+                   int repetitions, int64_t gap_frames, float attenuation_db,
+                   float noise_level, ArrayAudio* audio) {
+  const int64_t num_frames =
+      gap_frames + repetitions * (hotword.size() + gap_frames);
+  audio->num_channels = num_channels;
+  audio->samples.assign(num_frames * num_channels, 0);
+  audio->hotword_begin.clear();
+  audio->hotword_end.clear();
+
+  // Gaussian noise with a fixed seed, so that runs are comparable.
+  std::mt19937 generator(1234);
+  std::normal_distribution<float> distribution(0, noise_level);
+  std::vector<float> mix(num_frames * num_channels);
+  for (size_t i = 0; i < mix.size(); ++i) {
+    mix[i] = distribution(generator);
+  }
+  for (int r = 0; r < repetitions; ++r) {
+    const int64_t begin = gap_frames + r * (hotword.size() + gap_frames);
+    audio->hotword_begin.push_back(begin);
+    audio->hotword_end.push_back(begin + hotword.size());
+    for (int c = 0; c < num_channels; ++c) {
+      int distance = std::abs(c - r % num_channels);
+      distance = std::min(distance, num_channels - distance);
+      float gain = std::pow(10.0f, -attenuation_db * distance / 20);
+      for (size_t i = 0; i < hotword.size(); ++i) {
+        mix[(begin + i) * num_channels + c] += gain * hotword[i];
+      }
+    }
+  }
+  for (size_t i = 0; i < mix.size(); ++i) {
+    audio->samples[i] = static_cast<int16_t>(
+        std::max(-32768.0f, std::min(32767.0f, mix[i])));
+  }
+}
+
+// Checks that DeinterleaveInt16() returns the same data with and without
+// SIMD for the channel counts that have a SIMD path, on random samples over
+// the full int16 range and a frame count that leaves a scalar tail. Returns
+// false and prints the first difference to stderr otherwise.
+bool CheckDeinterleave() {
+  const int64_t num_frames = 1003;
+  std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> distribution(-32768, 32767);
+  const int channel_counts[] = {2, 4, 8};
+  for (int n = 0; n < 3; ++n) {
+    const int num_channels = channel_counts[n];
+    std::vector<int16_t> interleaved(num_frames * num_channels);
+    for (size_t i = 0; i < interleaved.size(); ++i) {
+      interleaved[i] = static_cast<int16_t>(distribution(generator));
+    }
+    interleaved[0] = -32768;
+    interleaved[1] = 32767;
+    std::vector<std::vector<int16_t> > simd(num_channels);
+    std::vector<std::vector<int16_t> > scalar(num_channels);
+    std::vector<int16_t*> simd_outputs(num_channels);
+    std::vector<int16_t*> scalar_outputs(num_channels);
+    for (int c = 0; c < num_channels; ++c) {
+      simd[c].assign(num_frames, 0);
+      scalar[c].assign(num_frames, 0);
+      simd_outputs[c] = simd[c].data();
+      scalar_outputs[c] = scalar[c].data();
+    }
+    DeinterleaveInt16(interleaved.data(), num_channels, num_frames,
+                      simd_outputs.data(), true);
+    DeinterleaveInt16(interleaved.data(), num_channels, num_frames,
+                      scalar_outputs.data(), false);
+    for (int c = 0; c < num_channels; ++c) {
+      for (int64_t i = 0; i < num_frames; ++i) {
+        if (simd[c][i] != scalar[c][i] ||
+            scalar[c][i] != interleaved[i * num_channels + c]) {
+          std::cerr << "DeinterleaveInt16() differs with " << num_channels
+              << " channels at channel " << c << ", frame " << i
+              << ": SIMD " << simd[c][i] << ", scalar " << scalar[c][i]
+              << ", input " << interleaved[i * num_channels + c] << "."
+              << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Hits and false detections of a list of detection positions (frames).
+struct Score {
+  int num_hits;
+  int num_false;
+};
+
+// A detection is a hit if it ends within the hotword or up to one second
+// after it; every repetition is counted at most once.
+Score ScoreDetections(const ArrayAudio& audio, int sample_rate,
+                      const std::vector<int64_t>& detections) {
+  Score score = {0, 0};
+  std::vector<bool> hit(audio.hotword_begin.size(), false);
+  for (size_t i = 0; i < detections.size(); ++i) {
+    bool matched = false;
+    for (size_t r = 0; r < hit.size(); ++r) {
+      if (detections[i] >= audio.hotword_begin[r] &&
+          detections[i] < audio.hotword_end[r] + sample_rate) {
+        if (!hit[r]) {
+          hit[r] = true;
+          score.num_hits++;
+        }
+        matched = true;
+        break;
+      }
+    }
+    if (!matched) {
+      score.num_false++;
+    }
+  }
+  return score;
+}
+
+// CPU time of the process (all threads), in seconds.
+double ProcessCpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+// Result of one pass over the array audio.
+struct Run {
+  Score score;
+  double cpu_seconds;
+  double wall_seconds;
+};
+
+// Runs a single detector on channel 0 only.
+Run RunBaseline(const MultichannelDetector::Options& options,
+                const ArrayAudio& audio, int64_t chunk_frames) {
+  snowboy::SnowboyDetect detector(options.resource_filename,
+                                  options.model_filename);
+  if (!options.sensitivity_str.empty()) {
+    detector.SetSensitivity(options.sensitivity_str);
+  }
+  detector.SetAudioGain(options.audio_gain);
+  detector.ApplyFrontend(options.apply_frontend);
+
+  const int64_t num_frames = audio.samples.size() / audio.num_channels;
+  std::vector<int16_t> channel(num_frames);
+  for (int64_t i = 0; i < num_frames; ++i) {
+    channel[i] = audio.samples[i * audio.num_channels];
+  }
+  std::vector<int64_t> detections;
+  Run run;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  double cpu_start = ProcessCpuSeconds();
+  for (int64_t offset = 0; offset < num_frames; offset += chunk_frames) {
+    int64_t size = std::min(chunk_frames, num_frames - offset);
+    if (detector.RunDetection(channel.data() + offset, size) > 0) {
+      detections.push_back(offset + size);
+    }
+  }
+  run.cpu_seconds = ProcessCpuSeconds() - cpu_start;
+  run.wall_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  run.score = ScoreDetections(audio, detector.SampleRate(), detections);
+  return run;
+}
+
+Run RunMultichannel(const MultichannelDetector::Options& options,
+                    const ArrayAudio& audio, int64_t chunk_frames) {
+  MultichannelDetector detector(options);
+  const int64_t num_frames = audio.samples.size() / audio.num_channels;
+  std::vector<int64_t> detections;
+  MultichannelDetector::Event event;
+  Run run;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  double cpu_start = ProcessCpuSeconds();
+  for (int64_t offset = 0; offset < num_frames; offset += chunk_frames) {
+    int64_t size = std::min(chunk_frames, num_frames - offset);
+    if (detector.RunDetection(
+            audio.samples.data() + offset * audio.num_channels, size,
+            &event) > 0) {
+      detections.push_back(event.end_frame);
+    }
+  }
+  run.cpu_seconds = ProcessCpuSeconds() - cpu_start;
+  run.wall_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  run.score = ScoreDetections(audio, detector.SampleRate(), detections);
+  return run;
+}
+
+std::vector<int> ParseIntList(const std::string& str) {
+  std::vector<int> values;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Benchmarks multichannel detection against channels, top-K and\n"
+      "threads. Prints one CSV line per configuration to stdout:\n"
+      "  channels,top_k,threads,repetitions,hit_rate,false_events,\n"
+      "  baseline_hit_rate,baseline_false,cpu_s_per_audio_hour,\n"
+      "  baseline_cpu_s_per_audio_hour,wall_realtime_factor\n"
+      "The baseline is one detector on channel 0. top_k 0 runs a detector\n"
+      "on every channel.\n"
+      "\n"
+      "Usage: ./multichannel-benchmark [options]\n"
+      "e.g.: ./multichannel-benchmark --channels=4,8 --top-k=0,1,2\n";
+
+  MultichannelDetector::Options options;
+  options.sensitivity_str = "0.5";
+  std::string wave_filename = "resources/snowboy.wav";
+  std::string channels_str = "1,2,4,8";
+  std::string top_k_str = "0,1,2";
+  std::string threads_str = "1";
+  int repetitions = 16;
+  float gap_seconds = 1;
+  float attenuation_db = 6;
+  float noise_level = 300;
+  int chunk_ms = 100;
+
+  ParseOptions po(usage);
+  po.Register("resource", &options.resource_filename, "Resource file.");
+  po.Register("model", &options.model_filename, "Hotword model(s).");
+  po.Register("sensitivity", &options.sensitivity_str, "Sensitivity string.");
+  po.Register("wav", &wave_filename, "Mono recording containing the hotword.");
+  po.Register("channels", &channels_str,
+              "Comma separated numbers of microphones.");
+  po.Register("top-k", &top_k_str,
+              "Comma separated numbers of channels to run detectors on; 0 "
+              "for all.");
+  po.Register("threads", &threads_str,
+              "Comma separated numbers of detection threads.");
+  po.Register("repetitions", &repetitions, "Number of hotword repetitions.");
+  po.Register("gap-seconds", &gap_seconds,
+              "Seconds of noise between repetitions.");
+  po.Register("attenuation-db", &attenuation_db,
+              "Attenuation of the hotword per microphone away from the "
+              "closest one.");
+  po.Register("noise-level", &noise_level,
+              "Standard deviation of the noise, in int16 units.");
+  po.Register("chunk-ms", &chunk_ms, "Milliseconds of audio per call.");
+  po.Register("dedup-ms", &options.dedup_ms,
+              "Detections within this time of an event are merged into it.");
+  po.Register("switch-margin-db", &options.switch_margin_db,
+              "SNR advantage a channel needs to replace a running one.");
+  po.Register("simd", &options.use_simd, "Deinterleave with SIMD.");
+  po.Read(argc, argv);
+
+  std::vector<int> channels = ParseIntList(channels_str);
+  std::vector<int> top_ks = ParseIntList(top_k_str);
+  std::vector<int> threads = ParseIntList(threads_str);
+  if (channels.empty() || top_ks.empty() || threads.empty() ||
+      repetitions <= 0 || chunk_ms <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  // A wrong SIMD transpose would show up as lost hits; catch it directly.
+  if (!CheckDeinterleave()) {
+    exit(1);
+  }
+
+  MappedWaveFile wave;
+  std::string error;
+  if (!wave.Open(wave_filename, &error)) {
+    std::cerr << "Fail to read " << wave_filename << ": " << error << std::endl;
+    exit(1);
+  }
+  if (wave.Info().bits_per_sample != 16 || wave.Info().num_channels != 1) {
+    std::cerr << wave_filename << " is not 16-bit mono." << std::endl;
+    exit(1);
+  }
+  std::vector<int16_t> hotword(wave.Info().data_size / sizeof(int16_t));
+  memcpy(hotword.data(), wave.Data(), hotword.size() * sizeof(int16_t));
+  const int sample_rate = wave.Info().sample_rate;
+  const int64_t chunk_frames =
+      static_cast<int64_t>(chunk_ms) * sample_rate / 1000;
+
+  std::cout << "channels,top_k,threads,repetitions,hit_rate,false_events,"
+      << "baseline_hit_rate,baseline_false,cpu_s_per_audio_hour,"
+      << "baseline_cpu_s_per_audio_hour,wall_realtime_factor" << std::endl;
+  for (size_t i = 0; i < channels.size(); ++i) {
+    if (channels[i] <= 0) {
+      continue;
+    }
+    ArrayAudio audio;
+    SimulateArray(hotword, channels[i], repetitions,
+                  static_cast<int64_t>(gap_seconds * sample_rate),
+                  attenuation_db, noise_level, &audio);
+    const double audio_hours = static_cast<double>(audio.samples.size()) /
+        channels[i] / sample_rate / 3600;
+    Run baseline = RunBaseline(options, audio, chunk_frames);
+    for (size_t k = 0; k < top_ks.size(); ++k) {
+      if (top_ks[k] < 0 || (top_ks[k] != 0 && top_ks[k] >= channels[i])) {
+        continue;
+      }
+      for (size_t t = 0; t < threads.size(); ++t) {
+        options.num_channels = channels[i];
+        options.top_k = top_ks[k];
+        options.num_threads = std::max(1, threads[t]);
+        Run run = RunMultichannel(options, audio, chunk_frames);
+        std::cout << channels[i] << "," << options.top_k << ","
+            << options.num_threads << "," << repetitions << ","
+            << static_cast<double>(run.score.num_hits) / repetitions << ","
+            << run.score.num_false << ","
+            << static_cast<double>(baseline.score.num_hits) / repetitions
+            << "," << baseline.score.num_false << ","
+            << run.cpu_seconds / audio_hours << ","
+            << baseline.cpu_seconds / audio_hours << ","
+            << audio_hours * 3600 / std::max(run.wall_seconds, 1e-9)
+            << std::endl;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,528 @@
+// examples/C++/multichannel-detector.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_MULTICHANNEL_DETECTOR_H_
+#define SNOWBOY_EXAMPLES_CPP_MULTICHANNEL_DETECTOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "energy-gate.h"
+#include "include/snowboy-detect.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SNOWBOY_MULTICHANNEL_NEON
+#endif
+
+// Splits <num_frames> interleaved frames of <num_channels> channels into one
+// buffer per channel, <outputs>[c] receiving channel c. 2, 4 and 8 channels
+// use SSE2 or NEON unless <use_simd> is false; all paths return the same data.
+inline void DeinterleaveInt16(const int16_t* data, int num_channels,
+                              int64_t num_frames, int16_t* const* outputs,
+                              bool use_simd) {
+  int64_t i = 0;
+  if (use_simd) {
+#if defined(__SSE2__)
+    if (num_channels == 2) {
+      for (; i + 8 <= num_frames; i += 8) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(data + i * 2);
+        __m128i a = _mm_loadu_si128(in);
+        __m128i b = _mm_loadu_si128(in + 1);
+        // The even (left) samples are the sign-extended low halves of the
+        // 32-bit lanes, the odd ones the high halves.
+        __m128i left = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+            _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        __m128i right = _mm_packs_epi32(_mm_srai_epi32(a, 16),
+                                        _mm_srai_epi32(b, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[0] + i), left);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[1] + i), right);
+      }
+    } else if (num_channels == 4) {
+      for (; i + 8 <= num_frames; i += 8) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(data + i * 4);
+        __m128i v0 = _mm_loadu_si128(in);
+        __m128i v1 = _mm_loadu_si128(in + 1);
+        __m128i v2 = _mm_loadu_si128(in + 2);
+        __m128i v3 = _mm_loadu_si128(in + 3);
+        // Two rounds of 16-bit unpacking leave 4 frames of channels (0, 1)
+        // or (2, 3) per register; the 64-bit unpack joins the frame halves.
+        __m128i a = _mm_unpacklo_epi16(v0, v1);
+        __m128i b = _mm_unpackhi_epi16(v0, v1);
+        __m128i c = _mm_unpacklo_epi16(v2, v3);
+        __m128i d = _mm_unpackhi_epi16(v2, v3);
+        __m128i e = _mm_unpacklo_epi16(a, b);
+        __m128i f = _mm_unpackhi_epi16(a, b);
+        __m128i g = _mm_unpacklo_epi16(c, d);
+        __m128i h = _mm_unpackhi_epi16(c, d);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[0] + i),
+                         _mm_unpacklo_epi64(e, g));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[1] + i),
+                         _mm_unpackhi_epi64(e, g));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[2] + i),
+                         _mm_unpacklo_epi64(f, h));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[3] + i),
+                         _mm_unpackhi_epi64(f, h));
+      }
+    } else if (num_channels == 8) {
+      for (; i + 8 <= num_frames; i += 8) {
+        // 8x8 transpose of 16-bit lanes in three unpack rounds.
+        const __m128i* in = reinterpret_cast<const __m128i*>(data + i * 8);
+        __m128i r[8], s[8];
+        for (int k = 0; k < 8; ++k) {
+          r[k] = _mm_loadu_si128(in + k);
+        }
+        for (int k = 0; k < 4; ++k) {
+          s[2 * k] = _mm_unpacklo_epi16(r[2 * k], r[2 * k + 1]);
+          s[2 * k + 1] = _mm_unpackhi_epi16(r[2 * k], r[2 * k + 1]);
+        }
+        for (int k = 0; k < 2; ++k) {
+          for (int l = 0; l < 2; ++l) {
+            r[4 * k + 2 * l] =
+                _mm_unpacklo_epi32(s[4 * k + l], s[4 * k + l + 2]);
+            r[4 * k + 2 * l + 1] =
+                _mm_unpackhi_epi32(s[4 * k + l], s[4 * k + l + 2]);
+          }
+        }
+        // r[k] and r[k + 4] now hold channels 2k and 2k + 1 of frames 0-3
+        // and 4-7; the 64-bit unpacks join the frame halves.
+        for (int k = 0; k < 4; ++k) {
+          int channel = 2 * k;
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs[channel] + i),
+                           _mm_unpacklo_epi64(r[k], r[k + 4]));
+          _mm_storeu_si128(
+              reinterpret_cast<__m128i*>(outputs[channel + 1] + i),
+              _mm_unpackhi_epi64(r[k], r[k + 4]));
+        }
+      }
+    }
+#elif defined(SNOWBOY_MULTICHANNEL_NEON)
+    if (num_channels == 2) {
+      for (; i + 8 <= num_frames; i += 8) {
+        int16x8x2_t v = vld2q_s16(data + i * 2);
+        vst1q_s16(outputs[0] + i, v.val[0]);
+        vst1q_s16(outputs[1] + i, v.val[1]);
+      }
+    } else if (num_channels == 4) {
+      for (; i + 8 <= num_frames; i += 8) {
+        int16x8x4_t v = vld4q_s16(data + i * 4);
+        for (int c = 0; c < 4; ++c) {
+          vst1q_s16(outputs[c] + i, v.val[c]);
+        }
+      }
+    }
+#endif
+  }
+  for (; i < num_frames; ++i) {
+    for (int c = 0; c < num_channels; ++c) {
+      outputs[c][i] = data[i * num_channels + c];
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Hotword detection on a microphone array. Interleaved multichannel audio is
+// deinterleaved, and one mono SnowboyDetect per channel runs on its channel,
+// spread over <num_threads> threads. The per-channel results are fused: the
+// first channel to detect a hotword raises one event, and further detections
+// within <dedup_ms> are counted into it instead of raising their own.
+//
+// With <top_k> > 0, only the detectors of the <top_k> channels with the best
+// short-term SNR run, which saves CPU on large arrays. The SNR is the level of
+// the last <snr_window_ms> of audio over an adaptive noise floor, as in
+// EnergyGate. A running channel is only replaced by one that is
+// <switch_margin_db> better, and a detector is Reset() when its channel is
+// selected again, since it missed the audio in between. Example:
+//
+//   MultichannelDetector::Options options;
+//   options.num_channels = 4;
+//   options.top_k = 2;
+//   MultichannelDetector detector(options);
+//   MultichannelDetector::Event event;
+//   int result = detector.RunDetection(data, num_frames, &event);
+//   if (result > 0) { ... event.best_channel ... }
+//
+// Not thread-safe; RunDetection() uses the thread pool internally.
+//
+////////////////////////////////////////////////////////////////////////////////
+class MultichannelDetector {
+ public:
+  struct Options {
+    std::string resource_filename;
+    // Mono models; every channel runs the same ones.
+    std::string model_filename;
+    // Empty keeps the model defaults.
+    std::string sensitivity_str;
+    float audio_gain;
+    bool apply_frontend;
+    int num_channels;
+    // Threads running detectors, including the one calling RunDetection().
+    int num_threads;
+    // Channels to run detectors on, by SNR; 0 runs all of them.
+    int top_k;
+    int snr_window_ms;
+    float switch_margin_db;
+    // Detections within this time after an event are merged into it.
+    int dedup_ms;
+    // Set to false to benchmark the scalar deinterleaving.
+    bool use_simd;
+
+    Options() : resource_filename("resources/common.res"),
+                model_filename("resources/snowboy.umdl"), audio_gain(1),
+                apply_frontend(false), num_channels(4), num_threads(1),
+                top_k(0), snr_window_ms(300), switch_margin_db(3),
+                dedup_ms(1000), use_simd(true) {}
+  };
+
+  // A fused detection.
+  struct Event {
+    // Hotword index, as returned by SnowboyDetect::RunDetection().
+    int hotword;
+    // Frames passed to RunDetection() up to the end of the chunk that raised
+    // the event.
+    int64_t end_frame;
+    // Detecting channel with the best SNR, and its SNR.
+    int best_channel;
+    float best_snr_db;
+    // Channels that detected the hotword in that chunk. Later detections
+    // merged into the event are only counted in the report.
+    int num_channels;
+  };
+
+  explicit MultichannelDetector(const Options& options)
+      : options_(options), num_channels_(std::max(1, options.num_channels)),
+        channels_(num_channels_), num_frames_(0), last_event_frame_(-1),
+        num_events_(0), num_merged_(0), stopping_(false), generation_(0),
+        next_task_(0), num_tasks_(0), num_tasks_left_(0),
+        num_busy_workers_(0) {
+    for (int c = 0; c < num_channels_; ++c) {
+      Channel& channel = channels_[c];
+      channel.detector.reset(new snowboy::SnowboyDetect(
+          options_.resource_filename, options_.model_filename));
+      if (!options_.sensitivity_str.empty()) {
+        channel.detector->SetSensitivity(options_.sensitivity_str);
+      }
+      channel.detector->SetAudioGain(options_.audio_gain);
+      channel.detector->ApplyFrontend(options_.apply_frontend);
+      channel.active = options_.top_k <= 0 || c < options_.top_k;
+      channel.result = -2;
+      channel.level = 0;
+      channel.noise_floor_db = -1;
+      channel.snr_db = 0;
+      channel.num_run_frames = 0;
+      channel.num_detections = 0;
+      outputs_.push_back(NULL);
+    }
+    sample_rate_ = channels_[0].detector->SampleRate();
+    frame_samples_ = std::max(8, sample_rate_ / 100);
+    dedup_frames_ = static_cast<int64_t>(options_.dedup_ms) * sample_rate_ /
+        1000;
+    for (int i = 1; i < options_.num_threads; ++i) {
+      workers_.push_back(
+          std::thread(&MultichannelDetector::WorkerLoop, this));
+    }
+  }
+
+  ~MultichannelDetector() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].join();
+    }
+  }
+
+  int NumChannels() const { return num_channels_; }
+
+  int SampleRate() const { return sample_rate_; }
+
+  // Runs detection on <num_frames> interleaved frames. Returns the hotword
+  // index and fills <event> if a new fused event was raised, -1 if a detector
+  // failed, -2 if every running detector saw silence, and 0 otherwise.
+  int RunDetection(const int16_t* data, int64_t num_frames, Event* event) {
+    if (num_frames <= 0) {
+      return 0;
+    }
+    for (int c = 0; c < num_channels_; ++c) {
+      channels_[c].samples.resize(num_frames);
+      outputs_[c] = channels_[c].samples.data();
+    }
+    DeinterleaveInt16(data, num_channels_, num_frames, outputs_.data(),
+                      options_.use_simd);
+    for (int c = 0; c < num_channels_; ++c) {
+      UpdateSnr(&channels_[c]);
+    }
+    if (options_.top_k > 0 && options_.top_k < num_channels_) {
+      SelectChannels();
+    }
+
+    tasks_.clear();
+    for (int c = 0; c < num_channels_; ++c) {
+      if (channels_[c].active) {
+        tasks_.push_back(c);
+      }
+    }
+    RunTasks();
+    num_frames_ += num_frames;
+    return Fuse(event);
+  }
+
+  // Resets every detector and the fusion state, e.g., between recordings.
+  void Reset() {
+    for (int c = 0; c < num_channels_; ++c) {
+      channels_[c].detector->Reset();
+      channels_[c].level = 0;
+      channels_[c].noise_floor_db = -1;
+      channels_[c].snr_db = 0;
+    }
+    last_event_frame_ = -1;
+  }
+
+  // Short-term SNR of <channel>, in dB.
+  float ChannelSnrDb(int channel) const { return channels_[channel].snr_db; }
+
+  bool IsChannelActive(int channel) const { return channels_[channel].active; }
+
+  // Prints the events, the merged detections and, per channel, the share of
+  // the audio its detector ran on and its number of detections.
+  void PrintReport(std::ostream& os) const {
+    os << "Multichannel detector: " << num_events_ << " events, "
+        << num_merged_ << " merged detections." << std::endl;
+    for (int c = 0; c < num_channels_; ++c) {
+      const Channel& channel = channels_[c];
+      os << "  channel " << c << ": detector ran on "
+          << (num_frames_ > 0 ?
+              100.0 * channel.num_run_frames / num_frames_ : 0)
+          << "% of the audio, " << channel.num_detections << " detections."
+          << std::endl;
+    }
+  }
+
+ private:
+  struct Channel {
+    std::unique_ptr<snowboy::SnowboyDetect> detector;
+    // Deinterleaved audio of the current chunk.
+    std::vector<int16_t> samples;
+    bool active;
+    // Result of the detector on the current chunk.
+    int result;
+    // Smoothed power, noise floor and SNR, for the top-K selection and the
+    // choice of the best detecting channel.
+    double level;
+    float noise_floor_db;
+    float snr_db;
+    int64_t num_run_frames;
+    int64_t num_detections;
+  };
+
+  MultichannelDetector(const MultichannelDetector&);
+  MultichannelDetector& operator=(const MultichannelDetector&);
+
+  // Updates the SNR of <channel> with its current chunk, in 10 ms frames.
+  void UpdateSnr(Channel* channel) {
+    const float frame_ms = 1000.0f * frame_samples_ / sample_rate_;
+    const double alpha = std::min(1.0f, frame_ms / options_.snr_window_ms);
+    const float floor_rise_db = frame_ms / 1000;  // 1 dB per second.
+    const int64_t num_samples = channel->samples.size();
+    for (int64_t i = 0; i < num_samples; i += frame_samples_) {
+      int size = static_cast<int>(
+          std::min<int64_t>(frame_samples_, num_samples - i));
+      int64_t sum_squares = 0;
+      int num_zero_crossings = 0;
+      FrameEnergyAndZeroCrossings(channel->samples.data() + i, size,
+                                  &sum_squares, &num_zero_crossings);
+      // The kernel returns a quarter of the sum of squares.
+      double power = 4.0 * sum_squares / size;
+      float energy_db = 10 * std::log10(power + 1);
+      if (channel->noise_floor_db < 0 || energy_db < channel->noise_floor_db) {
+        channel->noise_floor_db = energy_db;
+      } else {
+        channel->noise_floor_db = std::min(
+            energy_db, channel->noise_floor_db + floor_rise_db);
+      }
+      channel->level += alpha * (power - channel->level);
+    }
+    channel->snr_db = 10 * std::log10(channel->level + 1) -
+        channel->noise_floor_db;
+  }
+
+  // Makes the <top_k> channels with the best SNR active, favouring the
+  // running ones by <switch_margin_db>.
+  void SelectChannels() {
+    std::vector<std::pair<float, int> > ranking;
+    for (int c = 0; c < num_channels_; ++c) {
+      float score = channels_[c].snr_db +
+          (channels_[c].active ? options_.switch_margin_db : 0);
+      ranking.push_back(std::make_pair(-score, c));
+    }
+    std::sort(ranking.begin(), ranking.end());
+    for (int k = 0; k < num_channels_; ++k) {
+      Channel& channel = channels_[ranking[k].second];
+      bool active = k < options_.top_k;
+      if (active && !channel.active) {
+        channel.detector->Reset();
+      }
+      channel.active = active;
+    }
+  }
+
+  void RunChannel(int c) {
+    Channel& channel = channels_[c];
+    channel.result = channel.detector->RunDetection(channel.samples.data(),
+                                                    channel.samples.size());
+    channel.num_run_frames += channel.samples.size();
+  }
+
+  // Runs the detectors in <tasks_>, on the calling thread and the workers.
+  void RunTasks() {
+    if (workers_.empty() || tasks_.size() == 1) {
+      for (size_t i = 0; i < tasks_.size(); ++i) {
+        RunChannel(tasks_[i]);
+      }
+      return;
+    }
+    const int num_tasks = tasks_.size();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      next_task_ = 0;
+      num_tasks_ = num_tasks;
+      num_tasks_left_ = num_tasks;
+      generation_++;
+    }
+    work_cv_.notify_all();
+    RunPendingTasks(num_tasks);
+    // Also waits for the workers to leave RunPendingTasks(), so that none
+    // looks at <tasks_> while the next chunk is prepared.
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_tasks_left_ > 0 || num_busy_workers_ > 0) {
+      done_cv_.wait(lock);
+    }
+  }
+
+  // Takes tasks of the current chunk, which has <num_tasks> of them, until
+  // there are none left.
+  void RunPendingTasks(int num_tasks) {
+    while (true) {
+      int task = next_task_.fetch_add(1);
+      if (task >= num_tasks) {
+        return;
+      }
+      RunChannel(tasks_[task]);
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_tasks_left_--;
+    }
+  }
+
+  void WorkerLoop() {
+    int64_t seen_generation = 0;
+    while (true) {
+      int num_tasks = 0;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_ && generation_ == seen_generation) {
+          work_cv_.wait(lock);
+        }
+        if (stopping_) {
+          return;
+        }
+        seen_generation = generation_;
+        if (num_tasks_left_ == 0) {
+          // Woken too late: RunTasks() may already have returned, and the
+          // next chunk may be filling <tasks_> and resetting <next_task_>.
+          continue;
+        }
+        // Counted before the mutex is released, so that RunTasks() waits for
+        // this worker before it returns.
+        num_busy_workers_++;
+        num_tasks = num_tasks_;
+      }
+      RunPendingTasks(num_tasks);
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_busy_workers_--;
+      done_cv_.notify_one();
+    }
+  }
+
+  // Fuses the results of the current chunk, see RunDetection().
+  int Fuse(Event* event) {
+    bool error = false;
+    bool all_silence = true;
+    int best = -1;
+    int num_detecting = 0;
+    for (size_t i = 0; i < tasks_.size(); ++i) {
+      const int c = tasks_[i];
+      const Channel& channel = channels_[c];
+      error = error || channel.result == -1;
+      all_silence = all_silence && channel.result == -2;
+      if (channel.result > 0) {
+        channels_[c].num_detections++;
+        num_detecting++;
+        if (best < 0 || channel.snr_db > channels_[best].snr_db) {
+          best = c;
+        }
+      }
+    }
+    if (best >= 0) {
+      if (last_event_frame_ >= 0 &&
+          num_frames_ - last_event_frame_ < dedup_frames_) {
+        num_merged_ += num_detecting;
+      } else {
+        last_event_frame_ = num_frames_;
+        num_events_++;
+        event->hotword = channels_[best].result;
+        event->end_frame = num_frames_;
+        event->best_channel = best;
+        event->best_snr_db = channels_[best].snr_db;
+        event->num_channels = num_detecting;
+        return event->hotword;
+      }
+    }
+    if (error) {
+      return -1;
+    }
+    return all_silence ? -2 : 0;
+  }
+
+  const Options options_;
+  const int num_channels_;
+  std::vector<Channel> channels_;
+  std::vector<int16_t*> outputs_;
+  int sample_rate_;
+  int frame_samples_;
+  int64_t dedup_frames_;
+  int64_t num_frames_;
+  int64_t last_event_frame_;
+  int64_t num_events_;
+  int64_t num_merged_;
+
+  // Channels whose detectors run on the current chunk.
+  std::vector<int> tasks_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  bool stopping_;
+  // Incremented for every chunk handed to the workers.
+  int64_t generation_;
+  std::atomic<int> next_task_;
+  // Number of tasks in the current generation, set under <mutex_>.
+  int num_tasks_;
+  int num_tasks_left_;
+  int num_busy_workers_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_MULTICHANNEL_DETECTOR_H_
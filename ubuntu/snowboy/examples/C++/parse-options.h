@@ -0,0 +1,158 @@
+// examples/C++/parse-options.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_PARSE_OPTIONS_H_
+#define SNOWBOY_EXAMPLES_CPP_PARSE_OPTIONS_H_
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Minimal command line parser for the example tools. Options are given as
+// --name=value (or --name for booleans), everything else is a positional
+// argument. Example:
+//
+//   ParseOptions po(usage);
+//   int num_threads = 1;
+//   po.Register("num-threads", &num_threads, "Number of worker threads.");
+//   po.Read(argc, argv);
+//   std::string first_argument = po.GetArg(0);
+//
+////////////////////////////////////////////////////////////////////////////////
+class ParseOptions {
+ public:
+  explicit ParseOptions(const std::string& usage) : usage_(usage) {}
+
+  void Register(const std::string& name, std::string* value,
+                const std::string& help) {
+    AddOption(name, help, value->empty() ? "\"\"" : *value,
+              kString, value);
+  }
+  void Register(const std::string& name, int* value, const std::string& help) {
+    AddOption(name, help, ToString(*value), kInt, value);
+  }
+  void Register(const std::string& name, float* value,
+                const std::string& help) {
+    AddOption(name, help, ToString(*value), kFloat, value);
+  }
+  void Register(const std::string& name, bool* value,
+                const std::string& help) {
+    AddOption(name, help, *value ? "true" : "false", kBool, value);
+  }
+
+  // Parses the command line. Prints the usage and exits on --help or on
+  // unknown or malformed options.
+  void Read(int argc, const char* const argv[]) {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 2, "--") != 0 || arg == "--") {
+        args_.push_back(arg);
+        continue;
+      }
+      std::string name = arg.substr(2);
+      std::string value;
+      bool has_value = false;
+      size_t pos = name.find('=');
+      if (pos != std::string::npos) {
+        value = name.substr(pos + 1);
+        name = name.substr(0, pos);
+        has_value = true;
+      }
+      if (name == "help") {
+        PrintUsage();
+        exit(0);
+      }
+      if (!SetOption(name, value, has_value)) {
+        std::cerr << "Invalid option " << arg << std::endl;
+        PrintUsage();
+        exit(1);
+      }
+    }
+  }
+
+  int NumArgs() const { return args_.size(); }
+
+  // Returns the <i>-th positional argument, or "" if there are not that many.
+  std::string GetArg(int i) const {
+    return i < NumArgs() ? args_[i] : std::string();
+  }
+
+  void PrintUsage() const {
+    std::cerr << usage_ << "\nOptions:\n";
+    for (size_t i = 0; i < options_.size(); ++i) {
+      std::cerr << "  --" << options_[i].name << " : " << options_[i].help
+          << " (default: " << options_[i].default_value << ")\n";
+    }
+  }
+
+ private:
+  enum OptionType { kString, kInt, kFloat, kBool };
+
+  struct Option {
+    std::string name;
+    std::string help;
+    std::string default_value;
+    OptionType type;
+    void* value;
+  };
+
+  template<typename T>
+  static std::string ToString(const T& value) {
+    std::ostringstream os;
+    os << value;
+    return os.str();
+  }
+
+  void AddOption(const std::string& name, const std::string& help,
+                 const std::string& default_value, OptionType type,
+                 void* value) {
+    Option option;
+    option.name = name;
+    option.help = help;
+    option.default_value = default_value;
+    option.type = type;
+    option.value = value;
+    options_.push_back(option);
+  }
+
+  bool SetOption(const std::string& name, const std::string& value,
+                 bool has_value) {
+    for (size_t i = 0; i < options_.size(); ++i) {
+      if (options_[i].name != name) {
+        continue;
+      }
+      char* end = NULL;
+      switch (options_[i].type) {
+        case kString:
+          *static_cast<std::string*>(options_[i].value) = value;
+          return has_value;
+        case kInt:
+          *static_cast<int*>(options_[i].value) =
+              strtol(value.c_str(), &end, 10);
+          return has_value && !value.empty() && *end == '\0';
+        case kFloat:
+          *static_cast<float*>(options_[i].value) = strtof(value.c_str(), &end);
+          return has_value && !value.empty() && *end == '\0';
+        case kBool:
+          if (!has_value || value == "true" || value == "1") {
+            *static_cast<bool*>(options_[i].value) = true;
+          } else if (value == "false" || value == "0") {
+            *static_cast<bool*>(options_[i].value) = false;
+          } else {
+            return false;
+          }
+          return true;
+      }
+    }
+    return false;
+  }
+
+  std::string usage_;
+  std::vector<Option> options_;
+  std::vector<std::string> args_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_PARSE_OPTIONS_H_
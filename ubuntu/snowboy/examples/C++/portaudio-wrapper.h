@@ -0,0 +1,556 @@
+// examples/C++/portaudio-wrapper.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_PORTAUDIO_WRAPPER_H_
+#define SNOWBOY_EXAMPLES_CPP_PORTAUDIO_WRAPPER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <pa_util.h>
+#include <portaudio.h>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include "audio-converter.h"
+#include "detector-metrics.h"
+#include "spsc-ring-buffer.h"
+
+template<typename Wrapper>
+int PortAudioCallback(const void* input,
+                      void* output,
+                      unsigned long frame_count,
+                      const PaStreamCallbackTimeInfo* time_info,
+                      PaStreamCallbackFlags status_flags,
+                      void* user_data);
+
+// Capture time of one block of samples delivered by the PortAudio callback.
+// Times are on the PaUtil_GetTime() clock, in seconds.
+struct CaptureTimestamp {
+  // Number of samples written to the ring buffer up to the end of the block.
+  uint64_t end_sample;
+  // Time the last sample of the block was captured by the ADC.
+  double adc_time;
+  // Time the block was written to the ring buffer.
+  double callback_time;
+};
+
+// Capture timing of the samples returned by one Peek() call.
+struct PeekTiming {
+  // Blocks that end within the samples, oldest first.
+  std::vector<CaptureTimestamp> blocks;
+  // Estimated ADC time of the last sample, or 0 if unknown.
+  double end_adc_time;
+};
+
+// Captures audio of sample type <T> (uint8_t, int16_t or int32_t) into a
+// lock-free ring buffer of type <RingBuffer> (SpscRingBuffer<T> or, on Linux,
+// MirroredRingBuffer<T>).
+template<typename T, typename RingBuffer = SpscRingBuffer<T> >
+class PortAudioWrapper {
+ public:
+  // Constructor. If <event_wakeup> is true (and eventfd is available), Read()
+  // sleeps until the PortAudio callback signals that <min_read_samples_> are
+  // available, or until <read_timeout_ms> expires; otherwise Read() polls the
+  // ring buffer every 5 ms. The ring buffer holds at least
+  // <ring_buffer_seconds> of audio, which is how long detection may stall
+  // before samples are lost, plus <history_seconds> of already consumed audio
+  // for PeekHistory(). If <capture_format> is not NULL, the device is opened
+  // with its input rate, channels and sample format instead, and the callback
+  // converts the audio to <sample_rate> mono int16 (T must be int16_t).
+  PortAudioWrapper(int sample_rate, int num_channels, int bits_per_sample,
+                   bool event_wakeup = true, int read_timeout_ms = 1000,
+                   float ring_buffer_seconds = 5.0f,
+                   float history_seconds = 0.0f,
+                   const AudioConverter::Options* capture_format = NULL)
+      : ring_buffer_(RingBuffer::CapacityForSeconds(
+            sample_rate, num_channels, ring_buffer_seconds),
+                     RingBuffer::CapacityForSeconds(
+            sample_rate, num_channels, history_seconds)),
+        timestamp_ring_(ring_buffer_.Capacity() / kMinBlockSamples) {
+    sample_rate_ = sample_rate;
+    num_channels_ = num_channels;
+    num_written_samples_ = 0;
+    num_read_samples_ = 0;
+    last_timestamp_.end_sample = 0;
+    last_timestamp_.adc_time = 0;
+    last_timestamp_.callback_time = 0;
+    num_reported_lost_samples_ = 0;
+    min_read_samples_ = sample_rate * num_channels * 0.1;
+    read_timeout_ms_ = read_timeout_ms;
+    event_fd_ = -1;
+    consumer_waiting_ = false;
+    metrics_shard_ = NULL;
+    num_wakeups_ = 0;
+    num_timeouts_ = 0;
+    stats_start_ = std::chrono::steady_clock::now();
+#ifdef __linux__
+    if (event_wakeup) {
+      event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (event_fd_ < 0) {
+        std::cerr << "Fail to create eventfd, falling back to polling."
+            << std::endl;
+      }
+    }
+#endif
+    if (capture_format != NULL) {
+      converter_.reset(new AudioConverter(*capture_format));
+      converted_.resize(converter_->MaxOutputSamples(kConvertFrames));
+    }
+    Init(sample_rate, num_channels, bits_per_sample);
+  }
+
+  // Reads data from ring buffer.
+  void Read(std::vector<T>* data) {
+    assert(data != NULL);
+
+    WaitForMinSamples();
+
+    // Reads data.
+    int64_t num_available_samples = ring_buffer_.ReadAvailable();
+    data->resize(num_available_samples);
+    int64_t num_read_samples =
+        ring_buffer_.Read(data->data(), num_available_samples);
+    num_read_samples_ += num_read_samples;
+    DropTimestamps();
+    if (num_read_samples != num_available_samples) {
+      std::cerr << num_available_samples << " samples were available,  but "
+          << "only " << num_read_samples << " samples were read." << std::endl;
+    }
+  }
+
+  // Same as Read(), but returns the data in place as at most two contiguous
+  // regions of the ring buffer (the second one is only non-empty when the data
+  // wraps around, and always empty for a MirroredRingBuffer). Call Commit()
+  // with the total size once done with the data.
+  int64_t Peek(const T** data1, int64_t* size1,
+               const T** data2, int64_t* size2) {
+    WaitForMinSamples();
+    return ring_buffer_.Peek(data1, size1, data2, size2);
+  }
+
+  // Returns up to <num_samples> of the most recently consumed audio in place,
+  // in the same way as Peek(), e.g., the audio right before the point where a
+  // hotword was detected. The data must not be committed, and stays valid
+  // until the next Commit() or Read().
+  int64_t PeekHistory(int64_t num_samples, const T** data1, int64_t* size1,
+                      const T** data2, int64_t* size2) {
+    return ring_buffer_.PeekHistory(num_samples, data1, size1, data2, size2);
+  }
+
+  // Sets the number of samples Read() and Peek() wait for, e.g., from an
+  // AdaptiveChunkScheduler.
+  void SetMinReadSamples(int64_t num_samples) {
+    min_read_samples_ = static_cast<int>(
+        std::min<int64_t>(num_samples, ring_buffer_.Capacity()));
+  }
+
+  // Makes the callback publish the ring buffer fill level and lost samples to
+  // <shard>, which then belongs to the PortAudio callback thread.
+  void SetMetricsShard(DetectorMetrics::Shard* shard) {
+    metrics_shard_.store(shard, std::memory_order_release);
+  }
+
+  // Returns the PortAudio estimate of the CPU load of the stream, from 0 to 1.
+  double CpuLoad() const { return Pa_GetStreamCpuLoad(pa_stream_); }
+
+  // Releases <num_samples> samples returned by Peek().
+  void Commit(int64_t num_samples) {
+    ring_buffer_.Commit(num_samples);
+    num_read_samples_ += num_samples;
+    DropTimestamps();
+  }
+
+  // Fills <timing> for the first <num_samples> samples returned by Peek().
+  // Must be called before Commit().
+  void GetPeekTiming(int64_t num_samples, PeekTiming* timing) const {
+    assert(timing != NULL);
+    const uint64_t begin = num_read_samples_;
+    const uint64_t end = begin + num_samples;
+    timing->blocks.clear();
+
+    // The callback publishes a block's samples before its timestamp, so the
+    // newest block may have no timestamp yet. The ADC time of the last sample
+    // is then extrapolated from the newest timestamp we do have.
+    CaptureTimestamp reference = last_timestamp_;
+    const CaptureTimestamp* data1 = NULL;
+    const CaptureTimestamp* data2 = NULL;
+    int64_t size1 = 0, size2 = 0;
+    int64_t num_stamps = timestamp_ring_.Peek(&data1, &size1, &data2, &size2);
+    for (int64_t i = 0; i < num_stamps; ++i) {
+      const CaptureTimestamp& stamp = i < size1 ? data1[i] : data2[i - size1];
+      if (stamp.end_sample > end) {
+        break;
+      }
+      if (stamp.end_sample > begin) {
+        timing->blocks.push_back(stamp);
+      }
+      reference = stamp;
+    }
+    timing->end_adc_time = 0;
+    if (reference.adc_time > 0) {
+      timing->end_adc_time = reference.adc_time +
+          static_cast<double>(end - reference.end_sample) /
+          (static_cast<double>(sample_rate_) * num_channels_);
+    }
+  }
+
+  int Callback(const void* input, void* output,
+               unsigned long frame_count,
+               const PaStreamCallbackTimeInfo* time_info,
+               PaStreamCallbackFlags status_flags) {
+    // Input audio. Overflows are accounted for by the ring buffer. <end> is
+    // the offset in the block (in ring buffer samples) of the end of the last
+    // sample written: when the ring buffer is full, the samples that do not
+    // fit are dropped, so it is not the end of the block, nor necessarily
+    // <num_written> when the block is written in several slices.
+    const double now = PaUtil_GetTime();
+    int64_t num_written = 0;
+    int64_t end = 0;
+    if (converter_) {
+      num_written = ConvertAndWrite(input, frame_count, &end);
+    } else {
+      num_written = ring_buffer_.Write(
+          static_cast<const T*>(input),
+          static_cast<int64_t>(frame_count) * num_channels_);
+      end = num_written;
+    }
+
+    // Tags the block with its capture time. <inputBufferAdcTime> is the time
+    // of the first frame on the stream clock, which is not necessarily the
+    // PaUtil_GetTime() clock, so it is converted through <currentTime>. Some
+    // host APIs leave both at 0; the capture time is then unknown.
+    if (num_written > 0) {
+      num_written_samples_ += num_written;
+      CaptureTimestamp stamp;
+      stamp.end_sample = num_written_samples_;
+      stamp.callback_time = now;
+      stamp.adc_time = 0;
+      if (time_info != NULL && time_info->inputBufferAdcTime > 0 &&
+          time_info->currentTime > 0) {
+        stamp.adc_time = now -
+            (time_info->currentTime - time_info->inputBufferAdcTime) +
+            static_cast<double>(end) / num_channels_ / sample_rate_;
+      }
+      timestamp_ring_.Write(&stamp, 1);
+    }
+
+    DetectorMetrics::Shard* shard =
+        metrics_shard_.load(std::memory_order_acquire);
+    if (shard != NULL) {
+      shard->SetRingBuffer(ring_buffer_.ReadAvailable(),
+                           ring_buffer_.Capacity(),
+                           ring_buffer_.NumLostSamples());
+    }
+
+    // Wakes up the consumer only if it is actually blocked in Read(), and only
+    // once the threshold has been crossed. The sequentially consistent
+    // exchange pairs with the store in WaitForSamples(), so either we see the
+    // waiting flag or the consumer sees our samples.
+    if (event_fd_ >= 0 &&
+        ring_buffer_.ReadAvailable() >= min_read_samples_ &&
+        consumer_waiting_.exchange(false)) {
+#ifdef __linux__
+      uint64_t one = 1;
+      ssize_t ret = write(event_fd_, &one, sizeof(one));
+      (void)ret;
+#endif
+    }
+    return paContinue;
+  }
+
+  // Prints the number of times Read() woke up per second since the last call,
+  // so that the event-driven mode can be compared with the polling mode, and
+  // the ring buffer overflow telemetry.
+  void PrintStats() {
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - stats_start_).count();
+    if (seconds <= 0) {
+      return;
+    }
+    std::cerr << "Read() wakeups per second: " << num_wakeups_ / seconds
+        << " (" << (event_fd_ >= 0 ? "eventfd" : "polling") << " mode, "
+        << num_timeouts_ << " timeouts)" << std::endl;
+    std::cerr << "Ring buffer: capacity " << ring_buffer_.Capacity()
+        << " samples, high-water mark " << ring_buffer_.HighWaterMark()
+        << ", " << ring_buffer_.NumOverflows() << " overflows, "
+        << ring_buffer_.NumLostSamples() << " lost samples" << std::endl;
+    num_wakeups_ = 0;
+    num_timeouts_ = 0;
+    stats_start_ = now;
+  }
+
+  ~PortAudioWrapper() {
+    Pa_StopStream(pa_stream_);
+    Pa_CloseStream(pa_stream_);
+    Pa_Terminate();
+#ifdef __linux__
+    if (event_fd_ >= 0) {
+      close(event_fd_);
+    }
+#endif
+  }
+
+ private:
+  // Smallest block size the timestamp ring buffer is dimensioned for. With
+  // smaller callback blocks, the oldest timestamps are dropped.
+  static const int kMinBlockSamples = 32;
+
+  // Frames converted per AudioConverter::Convert() call in the callback, which
+  // bounds the size of <converted_>.
+  static const int kConvertFrames = 1024;
+
+  // Converts <num_frames> frames of the capture format in slices of
+  // <kConvertFrames>, without allocating, and writes the result to the ring
+  // buffer. Returns the number of samples written, and sets <*end> to the
+  // number of converted samples up to the end of the last one written. A slice
+  // that does not fit is cut short, but the next one may fit again once the
+  // consumer has read, so <*end> can exceed the returned count.
+  int64_t ConvertAndWrite(const void* input, int64_t num_frames,
+                          int64_t* end) {
+    const AudioConverter::Options& options = converter_->GetOptions();
+    const int frame_bytes =
+        BytesPerSample(options.input_format) * options.input_channels;
+    const char* data = static_cast<const char*>(input);
+    int64_t num_written = 0;
+    int64_t num_converted_total = 0;
+    *end = 0;
+    while (num_frames > 0) {
+      int64_t size = std::min<int64_t>(num_frames, kConvertFrames);
+      int64_t num_converted = converter_->Convert(data, size,
+                                                  converted_.data());
+      int64_t n = ring_buffer_.Write(converted_.data(), num_converted);
+      if (n > 0) {
+        *end = num_converted_total + n;
+      }
+      num_written += n;
+      num_converted_total += num_converted;
+      data += size * frame_bytes;
+      num_frames -= size;
+    }
+    return num_written;
+  }
+
+  // Drops the timestamps of the blocks that have been fully consumed, but
+  // remembers the newest one for GetPeekTiming().
+  void DropTimestamps() {
+    const CaptureTimestamp* data1 = NULL;
+    const CaptureTimestamp* data2 = NULL;
+    int64_t size1 = 0, size2 = 0;
+    int64_t num_stamps = timestamp_ring_.Peek(&data1, &size1, &data2, &size2);
+    int64_t num_consumed = 0;
+    while (num_consumed < num_stamps) {
+      const CaptureTimestamp& stamp = num_consumed < size1 ?
+          data1[num_consumed] : data2[num_consumed - size1];
+      if (stamp.end_sample > num_read_samples_) {
+        break;
+      }
+      last_timestamp_ = stamp;
+      num_consumed++;
+    }
+    timestamp_ring_.Commit(num_consumed);
+  }
+
+  // Blocks until <min_read_samples_> samples are available, or the read
+  // timeout expires.
+  void WaitForMinSamples() {
+    // Checks ring buffer overflow.
+    int64_t num_lost_samples = ring_buffer_.NumLostSamples();
+    if (num_lost_samples > num_reported_lost_samples_) {
+      std::cerr << "Lost " << num_lost_samples - num_reported_lost_samples_
+          << " samples due to ring buffer overflow." << std::endl;
+      num_reported_lost_samples_ = num_lost_samples;
+    }
+
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(read_timeout_ms_);
+    while (ring_buffer_.ReadAvailable() < min_read_samples_) {
+      if (event_fd_ >= 0) {
+        if (!WaitForSamples(deadline)) {
+          num_timeouts_++;
+          break;
+        }
+      } else {
+        Pa_Sleep(5);
+        num_wakeups_++;
+      }
+    }
+  }
+
+  // Blocks until the callback signals the eventfd or <deadline> passes.
+  // Returns false on timeout.
+  bool WaitForSamples(std::chrono::steady_clock::time_point deadline) {
+#ifdef __linux__
+    // Announces that we are about to sleep, then re-checks the ring buffer to
+    // close the race with a callback that ran just before the flag was set.
+    consumer_waiting_.store(true);
+    if (ring_buffer_.ReadAvailable() >= min_read_samples_) {
+      consumer_waiting_.store(false);
+      return true;
+    }
+
+    int timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (timeout_ms < 0) {
+      timeout_ms = 0;
+    }
+    struct pollfd pfd;
+    pfd.fd = event_fd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int poll_ans = poll(&pfd, 1, timeout_ms);
+    num_wakeups_++;
+    if (poll_ans > 0) {
+      // Drains the counter; stale signals only cost one extra loop.
+      uint64_t count = 0;
+      ssize_t ret = read(event_fd_, &count, sizeof(count));
+      (void)ret;
+      return true;
+    }
+    consumer_waiting_.store(false);
+    return poll_ans < 0 || std::chrono::steady_clock::now() < deadline;
+#else
+    return false;
+#endif
+  }
+
+  // Initialization.
+  bool Init(int sample_rate, int num_channels, int bits_per_sample) {
+    if (bits_per_sample != 8 * sizeof(T)) {
+      std::cerr << "BitsPerSample " << bits_per_sample << " does not match "
+          << "the sample type of the ring buffer." << std::endl;
+      return false;
+    }
+
+    // Initializes PortAudio.
+    PaError pa_init_ans = Pa_Initialize();
+    if (pa_init_ans != paNoError) {
+      std::cerr << "Fail to initialize PortAudio, error message is \""
+          << Pa_GetErrorText(pa_init_ans) << "\"" << std::endl;
+      return false;
+    }
+
+    PaError pa_open_ans;
+    if (converter_) {
+      const AudioConverter::Options& options = converter_->GetOptions();
+      static const PaSampleFormat kPaFormats[] = {
+          paInt16, paInt24, paInt32, paFloat32};
+      pa_open_ans = Pa_OpenDefaultStream(
+          &pa_stream_, options.input_channels, 0,
+          kPaFormats[options.input_format], options.input_rate,
+          paFramesPerBufferUnspecified, PortAudioCallback<PortAudioWrapper>,
+          this);
+    } else if (bits_per_sample == 8) {
+      pa_open_ans = Pa_OpenDefaultStream(
+          &pa_stream_, num_channels, 0, paUInt8, sample_rate,
+          paFramesPerBufferUnspecified, PortAudioCallback<PortAudioWrapper>,
+          this);
+    } else if (bits_per_sample == 16) {
+      pa_open_ans = Pa_OpenDefaultStream(
+          &pa_stream_, num_channels, 0, paInt16, sample_rate,
+          paFramesPerBufferUnspecified, PortAudioCallback<PortAudioWrapper>,
+          this);
+    } else if (bits_per_sample == 32) {
+      pa_open_ans = Pa_OpenDefaultStream(
+          &pa_stream_, num_channels, 0, paInt32, sample_rate,
+          paFramesPerBufferUnspecified, PortAudioCallback<PortAudioWrapper>,
+          this);
+    } else {
+      std::cerr << "Unsupported BitsPerSample: " << bits_per_sample
+          << std::endl;
+      return false;
+    }
+    if (pa_open_ans != paNoError) {
+      std::cerr << "Fail to open PortAudio stream, error message is \""
+          << Pa_GetErrorText(pa_open_ans) << "\"" << std::endl;
+      return false;
+    }
+
+    PaError pa_stream_start_ans = Pa_StartStream(pa_stream_);
+    if (pa_stream_start_ans != paNoError) {
+      std::cerr << "Fail to start PortAudio stream, error message is \""
+          << Pa_GetErrorText(pa_stream_start_ans) << "\"" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  // Lock-free ring buffer between the PortAudio callback and Read().
+  RingBuffer ring_buffer_;
+
+  // Capture timestamps of the blocks in <ring_buffer_>, written by the
+  // callback right after the samples.
+  SpscRingBuffer<CaptureTimestamp> timestamp_ring_;
+
+  // Pointer to PortAudio stream.
+  PaStream* pa_stream_;
+
+  int sample_rate_;
+
+  // Number of interleaved channels in each frame.
+  int num_channels_;
+
+  // Converts the capture format to the ring buffer format in the callback, if
+  // the device does not capture in the detector format. <converted_> is its
+  // preallocated output.
+  std::unique_ptr<AudioConverter> converter_;
+  std::vector<int16_t> converted_;
+
+  // Samples written by the callback and consumed by Read() or Commit(), since
+  // the stream started. They locate the blocks in the timestamp ring buffer.
+  uint64_t num_written_samples_;
+  uint64_t num_read_samples_;
+
+  // Newest timestamp dropped by DropTimestamps().
+  CaptureTimestamp last_timestamp_;
+
+  // Number of lost samples already reported by Read().
+  int64_t num_reported_lost_samples_;
+
+  // Wait for this number of samples in each Read() call. Also read by the
+  // callback.
+  std::atomic<int> min_read_samples_;
+
+  // Maximum time Read() blocks before returning whatever is available.
+  int read_timeout_ms_;
+
+  // eventfd signaled by the callback when enough samples are available, or -1
+  // if Read() falls back to polling.
+  int event_fd_;
+
+  // True while the consumer is (about to be) blocked in WaitForSamples().
+  std::atomic<bool> consumer_waiting_;
+
+  // Metrics written by the callback, or NULL.
+  std::atomic<DetectorMetrics::Shard*> metrics_shard_;
+
+  // Wakeup statistics since the last PrintStats() call.
+  int64_t num_wakeups_;
+  int64_t num_timeouts_;
+  std::chrono::steady_clock::time_point stats_start_;
+};
+
+template<typename Wrapper>
+int PortAudioCallback(const void* input,
+                      void* output,
+                      unsigned long frame_count,
+                      const PaStreamCallbackTimeInfo* time_info,
+                      PaStreamCallbackFlags status_flags,
+                      void* user_data) {
+  Wrapper* pa_wrapper = reinterpret_cast<Wrapper*>(user_data);
+  pa_wrapper->Callback(input, output, frame_count, time_info, status_flags);
+  return paContinue;
+}
+
+#endif  // SNOWBOY_EXAMPLES_CPP_PORTAUDIO_WRAPPER_H_
@@ -0,0 +1,176 @@
+// examples/C++/realtime-thread.h
+
+// Helpers to isolate a latency-sensitive thread, e.g., hotword detection, from
+// the rest of the system: CPU affinity, real-time scheduling and locked
+// memory, plus per-thread resource usage to check that the isolation holds.
+// Like BoostPriority() in PortAudio's pa_unix_util.c, missing privileges are
+// not fatal: the thread keeps running with whatever could be applied.
+
+#ifndef SNOWBOY_EXAMPLES_CPP_REALTIME_THREAD_H_
+#define SNOWBOY_EXAMPLES_CPP_REALTIME_THREAD_H_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+struct RealtimeOptions {
+  // CPUs the thread may run on, e.g., "3" or "0,2-3". Empty keeps the
+  // inherited mask.
+  std::string cpus;
+  // Scheduling policy: "other", "fifo" or "rr".
+  std::string policy;
+  // Real-time priority for "fifo" and "rr", from 1 to 99.
+  int priority;
+  // Locks all current and future pages of the process in memory, so that the
+  // thread never waits for a page fault.
+  bool lock_memory;
+
+  RealtimeOptions() : policy("other"), priority(10), lock_memory(false) {}
+};
+
+// Resource usage of the calling thread.
+struct ThreadUsage {
+  double cpu_seconds;
+  int64_t voluntary_switches;
+  int64_t involuntary_switches;
+  // CPU the thread last ran on, or -1.
+  int cpu;
+
+  ThreadUsage() : cpu_seconds(0), voluntary_switches(0),
+                  involuntary_switches(0), cpu(-1) {}
+};
+
+#ifdef __linux__
+
+// Parses a CPU list such as "0,2-3" into <set>. Returns false if malformed.
+inline bool ParseCpuList(const std::string& cpus, cpu_set_t* set) {
+  CPU_ZERO(set);
+  std::stringstream ss(cpus);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    char* end = NULL;
+    long first = strtol(item.c_str(), &end, 10);
+    long last = first;
+    if (*end == '-') {
+      last = strtol(end + 1, &end, 10);
+    }
+    if (item.empty() || *end != '\0' || first < 0 || last < first ||
+        last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      CPU_SET(cpu, set);
+    }
+  }
+  return true;
+}
+
+// Applies <options> to the calling thread. Whatever cannot be applied (e.g.,
+// SCHED_FIFO without CAP_SYS_NICE or an rtprio limit) is reported on
+// std::cerr and skipped; returns false in that case.
+inline bool ApplyRealtimeOptions(const RealtimeOptions& options) {
+  bool ok = true;
+  if (!options.cpus.empty()) {
+    cpu_set_t set;
+    if (!ParseCpuList(options.cpus, &set)) {
+      std::cerr << "Invalid CPU list \"" << options.cpus << "\", keeping the "
+          << "default affinity." << std::endl;
+      ok = false;
+    } else if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)
+               != 0) {
+      std::cerr << "Fail to set CPU affinity to \"" << options.cpus
+          << "\", keeping the default affinity." << std::endl;
+      ok = false;
+    }
+  }
+
+  if (options.policy == "fifo" || options.policy == "rr") {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = options.priority;
+    int policy = options.policy == "fifo" ? SCHED_FIFO : SCHED_RR;
+    int ret = pthread_setschedparam(pthread_self(), policy, &param);
+    if (ret != 0) {
+      std::cerr << "Fail to set " << options.policy << " priority "
+          << options.priority << " (" << strerror(ret) << ")"
+          << (ret == EPERM ? ", needs CAP_SYS_NICE or an rtprio limit" : "")
+          << "; keeping the default scheduler." << std::endl;
+      ok = false;
+    }
+  } else if (options.policy != "other") {
+    std::cerr << "Unknown scheduling policy \"" << options.policy
+        << "\", keeping the default scheduler." << std::endl;
+    ok = false;
+  }
+
+  if (options.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    std::cerr << "Fail to lock memory (" << strerror(errno) << ")"
+        << (errno == EPERM || errno == ENOMEM ?
+            ", needs CAP_IPC_LOCK or a memlock limit" : "")
+        << "; pages may be swapped out." << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+// Fills <usage> for the calling thread.
+inline bool GetThreadUsage(ThreadUsage* usage) {
+  struct rusage ru;
+  if (getrusage(RUSAGE_THREAD, &ru) != 0) {
+    return false;
+  }
+  usage->cpu_seconds = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+      (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+  usage->voluntary_switches = ru.ru_nvcsw;
+  usage->involuntary_switches = ru.ru_nivcsw;
+  usage->cpu = sched_getcpu();
+  return true;
+}
+
+// Prints the scheduling policy, CPU time and context switches of the calling
+// thread. Involuntary switches mean the thread was preempted, i.e., it was not
+// isolated from other work.
+inline void PrintThreadUsage(const std::string& name, std::ostream& os) {
+  ThreadUsage usage;
+  if (!GetThreadUsage(&usage)) {
+    return;
+  }
+  int policy = SCHED_OTHER;
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  pthread_getschedparam(pthread_self(), &policy, &param);
+  os << name << ": " << (policy == SCHED_FIFO ? "fifo" :
+                         policy == SCHED_RR ? "rr" : "other")
+      << " priority " << param.sched_priority << " on CPU " << usage.cpu
+      << ", CPU time " << usage.cpu_seconds << " s, "
+      << usage.involuntary_switches << " involuntary and "
+      << usage.voluntary_switches << " voluntary context switches."
+      << std::endl;
+}
+
+#else
+
+inline bool ApplyRealtimeOptions(const RealtimeOptions& options) {
+  std::cerr << "Real-time thread options are only supported on Linux."
+      << std::endl;
+  return false;
+}
+
+inline bool GetThreadUsage(ThreadUsage* usage) { return false; }
+
+inline void PrintThreadUsage(const std::string& name, std::ostream& os) {}
+
+#endif  // __linux__
+
+#endif  // SNOWBOY_EXAMPLES_CPP_REALTIME_THREAD_H_
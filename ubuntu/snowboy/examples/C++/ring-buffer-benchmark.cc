@@ -0,0 +1,195 @@
+// examples/C++/ring-buffer-benchmark.cc
+
+// Compares the throughput of PortAudio's PaUtilRingBuffer with SpscRingBuffer
+// and MirroredRingBuffer when one thread writes callback-sized blocks and
+// another thread drains them, which is what demo.cc does. The consumer needs
+// each chunk as one contiguous array, like RunDetection(), so the number of
+// bytes it has to copy out of the ring buffer is reported as well.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <pa_ringbuffer.h>
+#include <pa_util.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mirrored-ring-buffer.h"
+#include "spsc-ring-buffer.h"
+
+// Ring buffer adapter so that both implementations go through the same loop.
+class PaRingBufferAdapter {
+ public:
+  explicit PaRingBufferAdapter(int64_t capacity) {
+    memory_ = PaUtil_AllocateMemory(capacity * sizeof(int16_t));
+    PaUtil_InitializeRingBuffer(&ring_buffer_, sizeof(int16_t), capacity,
+                                memory_);
+  }
+  ~PaRingBufferAdapter() { PaUtil_FreeMemory(memory_); }
+
+  int64_t Write(const int16_t* data, int64_t num_samples) {
+    return PaUtil_WriteRingBuffer(&ring_buffer_, data, num_samples);
+  }
+  int64_t ConsumeCopy(int16_t* data, int64_t max_samples,
+                      int64_t* copied_bytes) {
+    int64_t num_samples =
+        PaUtil_ReadRingBuffer(&ring_buffer_, data, max_samples);
+    *copied_bytes += num_samples * sizeof(int16_t);
+    return num_samples;
+  }
+
+ private:
+  void* memory_;
+  PaUtilRingBuffer ring_buffer_;
+};
+
+template<typename RingBuffer>
+class SpscRingBufferAdapter {
+ public:
+  explicit SpscRingBufferAdapter(int64_t capacity) : ring_buffer_(capacity) {}
+
+  int64_t Write(const int16_t* data, int64_t num_samples) {
+    return ring_buffer_.Write(data, num_samples);
+  }
+  int64_t ConsumeCopy(int16_t* data, int64_t max_samples,
+                      int64_t* copied_bytes) {
+    int64_t num_samples = ring_buffer_.Read(data, max_samples);
+    *copied_bytes += num_samples * sizeof(int16_t);
+    return num_samples;
+  }
+  // Uses the data in place, and only copies it out if it wraps around.
+  int64_t ConsumeInPlace(int16_t* data, int64_t max_samples,
+                         int64_t* copied_bytes) {
+    const int16_t* data1 = NULL;
+    const int16_t* data2 = NULL;
+    int64_t size1 = 0, size2 = 0;
+    int64_t num_samples = ring_buffer_.Peek(&data1, &size1, &data2, &size2);
+    if (size2 > 0) {
+      memcpy(data, data1, size1 * sizeof(int16_t));
+      memcpy(data + size1, data2, size2 * sizeof(int16_t));
+      *copied_bytes += num_samples * sizeof(int16_t);
+      data1 = data;
+    }
+    if (num_samples > 0) {
+      checksum_ += data1[num_samples - 1];
+      ring_buffer_.Commit(num_samples);
+    }
+    return num_samples;
+  }
+
+  int64_t Checksum() const { return checksum_; }
+
+ private:
+  RingBuffer ring_buffer_;
+  int64_t checksum_ = 0;
+};
+
+// Prints the throughput in million samples per second and the bytes per
+// second the consumer copies. Both threads spin and only yield when they cannot
+// make progress, so the numbers reflect the ring buffer overhead rather than
+// scheduling. Returns the copied bytes per consumed sample.
+template<typename RingBuffer, typename Consume>
+double RunBenchmark(const std::string& name, RingBuffer* ring_buffer,
+                    int64_t total_samples, int block_size, Consume consume) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::thread producer([ring_buffer, total_samples, block_size]() {
+    std::vector<int16_t> block(block_size, 1);
+    int64_t num_written = 0;
+    while (num_written < total_samples) {
+      int64_t n = ring_buffer->Write(block.data(), block_size);
+      if (n == 0) {
+        std::this_thread::yield();
+      }
+      num_written += n;
+    }
+  });
+  int64_t num_read = 0;
+  int64_t copied_bytes = 0;
+  while (num_read < total_samples) {
+    int64_t n = consume(ring_buffer, &copied_bytes);
+    if (n == 0) {
+      std::this_thread::yield();
+    }
+    num_read += n;
+  }
+  producer.join();
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  std::cout << name << num_read / seconds / 1e6 << " Msamples/s, copied "
+      << copied_bytes / seconds / 1e6 << " MB/s ("
+      << static_cast<double>(copied_bytes) / num_read << " bytes/sample)"
+      << std::endl;
+  return static_cast<double>(copied_bytes) / num_read;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Measures ring buffer throughput (million samples per second).\n"
+      "\n"
+      "Usage: ./ring-buffer-benchmark [capacity [block_size [total_samples]]]\n"
+      "  capacity defaults to 16384 (demo.cc's original ring buffer size),\n"
+      "  block_size (samples per write) to 256, total_samples to 200000000.\n";
+  if (argc > 4) {
+    std::cerr << usage;
+    exit(1);
+  }
+  int64_t capacity = argc > 1 ? atoll(argv[1]) : 16384;
+  int block_size = argc > 2 ? atoi(argv[2]) : 256;
+  int64_t total_samples = argc > 3 ? atoll(argv[3]) : 200000000;
+  total_samples -= total_samples % block_size;
+  if (capacity <= 0 || (capacity & (capacity - 1)) != 0 || block_size <= 0 ||
+      block_size > capacity || total_samples <= 0) {
+    std::cerr << "capacity must be a power of 2 no smaller than block_size.\n"
+        << usage;
+    exit(1);
+  }
+
+  std::cout << "capacity=" << capacity << " block_size=" << block_size
+      << " total_samples=" << total_samples << std::endl;
+
+  std::vector<int16_t> out(capacity);
+  PaRingBufferAdapter pa_ring_buffer(capacity);
+  double pa_copy_per_sample = RunBenchmark(
+      "PaUtilRingBuffer read:            ", &pa_ring_buffer, total_samples,
+      block_size, [&out, capacity](PaRingBufferAdapter* r, int64_t* copied) {
+        return r->ConsumeCopy(out.data(), capacity, copied);
+      });
+
+  typedef SpscRingBufferAdapter<SpscRingBuffer<int16_t> > SpscAdapter;
+  SpscAdapter spsc_ring_buffer(capacity);
+  RunBenchmark(
+      "SpscRingBuffer read:              ", &spsc_ring_buffer, total_samples,
+      block_size, [&out, capacity](SpscAdapter* r, int64_t* copied) {
+        return r->ConsumeCopy(out.data(), capacity, copied);
+      });
+  double spsc_copy_per_sample = RunBenchmark(
+      "SpscRingBuffer peek/commit:       ", &spsc_ring_buffer, total_samples,
+      block_size, [&out, capacity](SpscAdapter* r, int64_t* copied) {
+        return r->ConsumeInPlace(out.data(), capacity, copied);
+      });
+
+#ifdef __linux__
+  typedef SpscRingBufferAdapter<MirroredRingBuffer<int16_t> > MirroredAdapter;
+  MirroredAdapter mirrored_ring_buffer(capacity);
+  double mirrored_copy_per_sample = RunBenchmark(
+      "MirroredRingBuffer peek/commit:   ", &mirrored_ring_buffer,
+      total_samples, block_size,
+      [&out, capacity](MirroredAdapter* r, int64_t* copied) {
+        return r->ConsumeInPlace(out.data(), capacity, copied);
+      });
+  // Detection runs in real time, so what matters is the copy traffic per
+  // second of captured audio.
+  const int kSampleRate = 16000;
+  std::cout << "Copy bytes per second of 16 kHz audio saved by "
+      << "MirroredRingBuffer: "
+      << (pa_copy_per_sample - mirrored_copy_per_sample) * kSampleRate
+      << " vs PaUtilRingBuffer, "
+      << (spsc_copy_per_sample - mirrored_copy_per_sample) * kSampleRate
+      << " vs SpscRingBuffer peek/commit (checksums "
+      << spsc_ring_buffer.Checksum() << ", "
+      << mirrored_ring_buffer.Checksum() << ")" << std::endl;
+#endif
+  return 0;
+}
@@ -0,0 +1,379 @@
+// examples/C++/sensitivity-sweep.cc
+
+// Evaluates hotword models over a labeled corpus for a grid of sensitivities,
+// to pick the sensitivity from data instead of by guesswork. Every (model,
+// sensitivity) combination is a job; worker threads pull jobs from a shared
+// queue and run each on their own detector over the whole corpus, which is
+// memory mapped once and shared. For every job, the miss rate on the positive
+// files and the false accepts per hour on the negative files are printed, so
+// that each model gets a ROC-style curve. Optionally, the best operating point
+// under a false accept budget is stored into the model with UpdateModel().
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/snowboy-detect.h"
+#include "parse-options.h"
+#include "wave-reader.h"
+
+// A corpus file, mapped once and read by all workers.
+struct CorpusFile {
+  std::string filename;
+  bool positive;
+  MappedWaveFile wave;
+};
+
+// One (model, sensitivity) combination and its outcome.
+struct Job {
+  std::string model_filename;
+  float sensitivity;
+
+  int num_positives;
+  // Positive files with at least one detection.
+  int num_hits;
+  double negative_seconds;
+  // Detections in the negative files.
+  int64_t num_false_accepts;
+  int num_errors;
+
+  double MissRate() const {
+    return num_positives > 0 ? 1.0 - num_hits * 1.0 / num_positives : 0;
+  }
+
+  double FalseAcceptsPerHour() const {
+    return negative_seconds > 0 ?
+        num_false_accepts * 3600.0 / negative_seconds : 0;
+  }
+};
+
+struct SweepOptions {
+  std::string resource_filename;
+  float audio_gain;
+  bool apply_frontend;
+  float chunk_seconds;
+};
+
+// Sensitivity string giving <sensitivity> to each of the <num_hotwords>
+// hotwords of a model.
+std::string SensitivityString(float sensitivity, int num_hotwords) {
+  std::ostringstream str;
+  for (int i = 0; i < num_hotwords; ++i) {
+    str << (i > 0 ? "," : "") << sensitivity;
+  }
+  return str.str();
+}
+
+// Returns the number of detections in <file>, or -1 on a detector error.
+int64_t CountDetections(const CorpusFile& file, int chunk_samples,
+                        snowboy::SnowboyDetect* detector) {
+  const int64_t num_samples = file.wave.NumSamples();
+  std::vector<int16_t> aligned;
+  const int16_t* samples = file.wave.Samples(&aligned);
+
+  detector->Reset();
+  int64_t num_detections = 0;
+  for (int64_t offset = 0; offset < num_samples; offset += chunk_samples) {
+    int64_t size = std::min<int64_t>(chunk_samples, num_samples - offset);
+    int result = detector->RunDetection(samples + offset, size,
+                                        offset + size == num_samples);
+    if (result == -1) {
+      return -1;
+    } else if (result > 0) {
+      num_detections++;
+    }
+  }
+  return num_detections;
+}
+
+void Worker(const SweepOptions& options,
+            const std::vector<std::unique_ptr<CorpusFile> >& corpus,
+            std::vector<Job>* jobs, std::atomic<size_t>* next_job) {
+  // Jobs are ordered by model, so a worker usually keeps its detector and
+  // only changes the sensitivity.
+  std::unique_ptr<snowboy::SnowboyDetect> detector;
+  std::string detector_model;
+  while (true) {
+    size_t index = (*next_job)++;
+    if (index >= jobs->size()) {
+      break;
+    }
+    Job& job = (*jobs)[index];
+    if (!detector || detector_model != job.model_filename) {
+      detector.reset(new snowboy::SnowboyDetect(options.resource_filename,
+                                                job.model_filename));
+      detector->SetAudioGain(options.audio_gain);
+      detector->ApplyFrontend(options.apply_frontend);
+      detector_model = job.model_filename;
+    }
+    detector->SetSensitivity(
+        SensitivityString(job.sensitivity, detector->NumHotwords()));
+    const int chunk_samples = std::max(1, static_cast<int>(
+        options.chunk_seconds * detector->SampleRate() *
+        detector->NumChannels()));
+
+    for (size_t i = 0; i < corpus.size(); ++i) {
+      const CorpusFile& file = *corpus[i];
+      int64_t num_detections = CountDetections(file, chunk_samples,
+                                               detector.get());
+      if (num_detections < 0) {
+        job.num_errors++;
+      } else if (file.positive) {
+        job.num_positives++;
+        job.num_hits += num_detections > 0;
+      } else {
+        job.negative_seconds += file.wave.Info().Seconds();
+        job.num_false_accepts += num_detections;
+      }
+    }
+  }
+}
+
+// Appends the non-empty lines of <list_filename> to <filenames>.
+bool ReadFileList(const std::string& list_filename,
+                  std::vector<std::string>* filenames) {
+  std::ifstream list(list_filename.c_str());
+  if (!list) {
+    std::cerr << "Fail to open file list " << list_filename << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(list, line)) {
+    if (!line.empty()) {
+      filenames->push_back(line);
+    }
+  }
+  return true;
+}
+
+// Parses "0.3,0.4,0.5" or a range "<first>:<last>:<step>".
+std::vector<float> ParseSensitivityGrid(const std::string& str) {
+  std::vector<float> grid;
+  float first, last, step;
+  char colon1, colon2;
+  std::istringstream range(str);
+  if (str.find(':') != std::string::npos) {
+    if ((range >> first >> colon1 >> last >> colon2 >> step) &&
+        colon1 == ':' && colon2 == ':' && step > 0) {
+      // Rounds to the step, so that 0.1:0.9:0.1 ends on 0.9 despite rounding
+      // errors.
+      int n = static_cast<int>((last - first) / step + 0.5);
+      for (int i = 0; i <= n; ++i) {
+        grid.push_back(first + i * step);
+      }
+    }
+    return grid;
+  }
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    grid.push_back(static_cast<float>(atof(item.c_str())));
+  }
+  return grid;
+}
+
+std::vector<std::string> SplitModels(const std::string& str) {
+  std::vector<std::string> models;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      models.push_back(item);
+    }
+  }
+  return models;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Sweeps the sensitivity of hotword models over a labeled corpus.\n"
+      "Positive files contain the hotword, negative files do not; all must\n"
+      "match the detector format (16 kHz, mono, 16 bits). Each model is\n"
+      "evaluated on its own, and one CSV line per (model, sensitivity) is\n"
+      "printed to stdout:\n"
+      "  model,sensitivity,positives,hits,miss_rate,negative_hours,\n"
+      "  false_accepts,fa_per_hour\n"
+      "For every model, the operating point with the lowest miss rate within\n"
+      "--max-fa-per-hour is reported to stderr, and stored into the model\n"
+      "file with --update-model.\n"
+      "\n"
+      "Usage: ./sensitivity-sweep [options]\n"
+      "e.g.: ./sensitivity-sweep --models=resources/snowboy.umdl \\\n"
+      "          --positive-list=pos.txt --negative-list=neg.txt \\\n"
+      "          --sensitivities=0.2:0.8:0.05 > roc.csv\n";
+
+  SweepOptions options;
+  options.resource_filename = "resources/common.res";
+  options.audio_gain = 1;
+  options.apply_frontend = false;
+  options.chunk_seconds = 0.1;
+  std::string models_str = "resources/snowboy.umdl";
+  std::string sensitivities_str = "0.1:0.9:0.1";
+  std::string positive_list;
+  std::string negative_list;
+  float max_fa_per_hour = 1;
+  bool update_model = false;
+  int num_threads = std::thread::hardware_concurrency();
+
+  ParseOptions po(usage);
+  po.Register("resource", &options.resource_filename, "Resource file.");
+  po.Register("models", &models_str,
+              "Comma separated models, each evaluated separately.");
+  po.Register("sensitivities", &sensitivities_str,
+              "Comma separated sensitivities, or <first>:<last>:<step>.");
+  po.Register("positive-list", &positive_list,
+              "File with one positive WAVE filename per line.");
+  po.Register("negative-list", &negative_list,
+              "File with one negative WAVE filename per line.");
+  po.Register("audio-gain", &options.audio_gain, "Audio gain.");
+  po.Register("apply-frontend", &options.apply_frontend,
+              "Apply frontend audio processing.");
+  po.Register("chunk-seconds", &options.chunk_seconds,
+              "Seconds of audio per RunDetection() call.");
+  po.Register("max-fa-per-hour", &max_fa_per_hour,
+              "False accepts per hour allowed for the chosen operating "
+              "point.");
+  po.Register("update-model", &update_model,
+              "Store the chosen sensitivity into each model file with "
+              "UpdateModel(). This overwrites the model files.");
+  po.Register("num-threads", &num_threads, "Number of worker threads.");
+  po.Read(argc, argv);
+
+  std::vector<std::string> models = SplitModels(models_str);
+  std::vector<float> grid = ParseSensitivityGrid(sensitivities_str);
+  std::vector<std::string> positives, negatives;
+  if (models.empty() || grid.empty() ||
+      (positive_list.empty() && negative_list.empty())) {
+    po.PrintUsage();
+    exit(1);
+  }
+  if ((!positive_list.empty() && !ReadFileList(positive_list, &positives)) ||
+      (!negative_list.empty() && !ReadFileList(negative_list, &negatives))) {
+    exit(1);
+  }
+
+  // The format is checked once against the first model; all models run on
+  // the same resource.
+  int sample_rate, num_channels, bits_per_sample;
+  {
+    snowboy::SnowboyDetect detector(options.resource_filename, models[0]);
+    sample_rate = detector.SampleRate();
+    num_channels = detector.NumChannels();
+    bits_per_sample = detector.BitsPerSample();
+  }
+  std::vector<std::unique_ptr<CorpusFile> > corpus;
+  int num_skipped = 0;
+  for (size_t i = 0; i < positives.size() + negatives.size(); ++i) {
+    bool positive = i < positives.size();
+    std::unique_ptr<CorpusFile> file(new CorpusFile());
+    file->filename = positive ? positives[i] : negatives[i - positives.size()];
+    file->positive = positive;
+    std::string error;
+    bool ok = file->wave.Open(file->filename, &error);
+    if (ok && (file->wave.Info().sample_rate != sample_rate ||
+               file->wave.Info().num_channels != num_channels ||
+               file->wave.Info().bits_per_sample != bits_per_sample)) {
+      error = "format does not match the detector";
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "Skipping " << file->filename << ": " << error << std::endl;
+      num_skipped++;
+      continue;
+    }
+    corpus.push_back(std::move(file));
+  }
+
+  std::vector<Job> jobs;
+  for (size_t m = 0; m < models.size(); ++m) {
+    for (size_t s = 0; s < grid.size(); ++s) {
+      Job job;
+      job.model_filename = models[m];
+      job.sensitivity = grid[s];
+      job.num_positives = 0;
+      job.num_hits = 0;
+      job.negative_seconds = 0;
+      job.num_false_accepts = 0;
+      job.num_errors = 0;
+      jobs.push_back(job);
+    }
+  }
+  num_threads = std::max(1, std::min<int>(num_threads, jobs.size()));
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::atomic<size_t> next_job(0);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_threads; ++i) {
+    workers.push_back(std::thread(Worker, std::cref(options),
+                                  std::cref(corpus), &jobs, &next_job));
+  }
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  double wall_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "model,sensitivity,positives,hits,miss_rate,negative_hours,"
+      << "false_accepts,fa_per_hour" << std::endl;
+  int num_errors = 0;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    const Job& job = jobs[i];
+    std::cout << job.model_filename << "," << job.sensitivity << ","
+        << job.num_positives << "," << job.num_hits << "," << job.MissRate()
+        << "," << job.negative_seconds / 3600 << ","
+        << job.num_false_accepts << "," << job.FalseAcceptsPerHour()
+        << std::endl;
+    num_errors += job.num_errors;
+  }
+  std::cerr << "Evaluated " << jobs.size() << " combinations on "
+      << corpus.size() << " files (" << num_skipped << " skipped) in "
+      << wall_seconds << " s with " << num_threads << " threads." << std::endl;
+  if (num_errors > 0) {
+    std::cerr << num_errors << " file runs returned a detector error and are "
+        << "not counted." << std::endl;
+  }
+
+  // Jobs of a model are contiguous and in grid order.
+  for (size_t begin = 0; begin < jobs.size(); begin += grid.size()) {
+    const Job* best = NULL;
+    for (size_t i = begin; i < begin + grid.size(); ++i) {
+      const Job& job = jobs[i];
+      if (job.FalseAcceptsPerHour() > max_fa_per_hour) {
+        continue;
+      }
+      if (best == NULL || job.MissRate() < best->MissRate() ||
+          (job.MissRate() == best->MissRate() &&
+           job.FalseAcceptsPerHour() < best->FalseAcceptsPerHour())) {
+        best = &job;
+      }
+    }
+    const std::string& model = jobs[begin].model_filename;
+    if (best == NULL) {
+      std::cerr << model << ": no sensitivity within " << max_fa_per_hour
+          << " false accepts per hour." << std::endl;
+      continue;
+    }
+    std::cerr << model << ": sensitivity " << best->sensitivity
+        << ", miss rate " << best->MissRate() << ", "
+        << best->FalseAcceptsPerHour() << " false accepts per hour."
+        << std::endl;
+    if (update_model) {
+      snowboy::SnowboyDetect detector(options.resource_filename, model);
+      detector.SetSensitivity(
+          SensitivityString(best->sensitivity, detector.NumHotwords()));
+      detector.UpdateModel();
+      std::cerr << "Updated " << model << "." << std::endl;
+    }
+  }
+  return num_errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+// examples/C++/spsc-ring-buffer.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_SPSC_RING_BUFFER_H_
+#define SNOWBOY_EXAMPLES_CPP_SPSC_RING_BUFFER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Default backing store of SpscRingBuffer: a plain heap array. Data that wraps
+// around the end of the array is returned by Peek() as two regions.
+template<typename T>
+class HeapRingStorage {
+ public:
+  // True if the memory right after the end of the array aliases its start.
+  static const bool kMirrored = false;
+
+  // Smallest supported capacity, in elements.
+  static int64_t MinCapacity() { return 1; }
+
+  explicit HeapRingStorage(int64_t capacity) : data_(capacity) {}
+
+  T* Data() { return data_.data(); }
+  const T* Data() const { return data_.data(); }
+
+ private:
+  std::vector<T> data_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Lock-free single-producer/single-consumer ring buffer for audio samples.
+//
+// Exactly one thread (e.g., the PortAudio callback) may call Write(), and
+// exactly one other thread (e.g., the detection loop) may call Peek(),
+// Commit() and Read(). The read and write indices live on separate cache lines
+// so the two threads do not invalidate each other's lines on every update.
+//
+// Indices increase monotonically and are masked on access, so the capacity is
+// always rounded up to a power of 2.
+//
+// <Storage> provides the memory, see HeapRingStorage. With a mirrored storage
+// (e.g., MirroredRingStorage in mirrored-ring-buffer.h) reads and writes never
+// have to be split at the wrap-around point.
+//
+// Optionally, the most recent consumed elements are kept as history: the
+// producer does not overwrite them, and PeekHistory() returns them in place,
+// e.g., to hand the audio just before a hotword to a speech recognizer.
+//
+////////////////////////////////////////////////////////////////////////////////
+template<typename T, typename Storage = HeapRingStorage<T> >
+class SpscRingBuffer {
+ public:
+  // Constructor that takes the minimum number of elements the buffer should
+  // hold, not counting the <history> most recent consumed elements it keeps.
+  // The actual capacity is rounded up to a power of 2.
+  explicit SpscRingBuffer(int64_t min_capacity, int64_t history = 0)
+      : capacity_(RoundUpCapacity(min_capacity + history)),
+        mask_(capacity_ - 1), history_(history), storage_(capacity_),
+        write_index_(0), high_water_mark_(0), num_overflows_(0),
+        num_lost_samples_(0), read_index_(0) {}
+
+  // Returns the number of elements needed to hold <seconds> of audio.
+  static int64_t CapacityForSeconds(int sample_rate, int num_channels,
+                                    float seconds) {
+    return static_cast<int64_t>(
+        static_cast<double>(sample_rate) * num_channels * seconds + 0.5);
+  }
+
+  // Producer side. Writes up to <num_elements> elements and returns the number
+  // actually written. Elements that do not fit are dropped and accounted for
+  // in NumOverflows() and NumLostSamples().
+  int64_t Write(const T* data, int64_t num_elements) {
+    const uint64_t write_index = write_index_.load(std::memory_order_relaxed);
+    const uint64_t read_index = read_index_.load(std::memory_order_acquire);
+    const uint64_t tail = read_index -
+        std::min<uint64_t>(read_index, history_);
+    const int64_t used = static_cast<int64_t>(write_index - tail);
+    const int64_t num_to_write =
+        std::min<int64_t>(num_elements, capacity_ - used);
+
+    if (num_to_write > 0) {
+      T* buffer = storage_.Data();
+      const int64_t offset = static_cast<int64_t>(write_index & mask_);
+      const int64_t first = Storage::kMirrored ?
+          num_to_write : std::min<int64_t>(num_to_write, capacity_ - offset);
+      memcpy(buffer + offset, data, first * sizeof(T));
+      if (num_to_write > first) {
+        memcpy(buffer, data + first, (num_to_write - first) * sizeof(T));
+      }
+      write_index_.store(write_index + num_to_write, std::memory_order_release);
+    }
+
+    // Statistics are only written by the producer, so relaxed stores suffice.
+    // The history is not counted in the fill level.
+    const int64_t fill = static_cast<int64_t>(write_index - read_index) +
+        num_to_write;
+    if (fill > high_water_mark_.load(std::memory_order_relaxed)) {
+      high_water_mark_.store(fill, std::memory_order_relaxed);
+    }
+    if (num_to_write < num_elements) {
+      num_overflows_.store(num_overflows_.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+      num_lost_samples_.store(
+          num_lost_samples_.load(std::memory_order_relaxed) +
+          num_elements - num_to_write, std::memory_order_relaxed);
+    }
+    return num_to_write;
+  }
+
+  // Consumer side. Returns the readable data as at most two contiguous regions
+  // without copying; <size2> is non-zero only if the data wraps around, which
+  // never happens with a mirrored storage. Call Commit() once the data has
+  // been consumed. Returns the total size.
+  int64_t Peek(const T** data1, int64_t* size1,
+               const T** data2, int64_t* size2) const {
+    const uint64_t read_index = read_index_.load(std::memory_order_relaxed);
+    const uint64_t write_index = write_index_.load(std::memory_order_acquire);
+    return Regions(read_index, static_cast<int64_t>(write_index - read_index),
+                   data1, size1, data2, size2);
+  }
+
+  // Consumer side. Returns up to <num_elements> of the most recently consumed
+  // elements, in the same way as Peek(). At most History() elements are kept.
+  // They must not be committed. Returns the total size.
+  int64_t PeekHistory(int64_t num_elements, const T** data1, int64_t* size1,
+                      const T** data2, int64_t* size2) const {
+    const uint64_t read_index = read_index_.load(std::memory_order_relaxed);
+    const int64_t size = std::min<int64_t>(
+        std::min<int64_t>(std::max<int64_t>(num_elements, 0), history_),
+        static_cast<int64_t>(read_index));
+    return Regions(read_index - size, size, data1, size1, data2, size2);
+  }
+
+  // Consumer side. Releases <num_elements> elements returned by Peek().
+  void Commit(int64_t num_elements) {
+    read_index_.store(read_index_.load(std::memory_order_relaxed) +
+                      num_elements, std::memory_order_release);
+  }
+
+  // Consumer side. Copies up to <num_elements> elements into <data> and
+  // returns the number of elements read.
+  int64_t Read(T* data, int64_t num_elements) {
+    const T* data1 = NULL;
+    const T* data2 = NULL;
+    int64_t size1 = 0, size2 = 0;
+    Peek(&data1, &size1, &data2, &size2);
+    size1 = std::min(size1, num_elements);
+    size2 = std::min(size2, num_elements - size1);
+    memcpy(data, data1, size1 * sizeof(T));
+    memcpy(data + size1, data2, size2 * sizeof(T));
+    Commit(size1 + size2);
+    return size1 + size2;
+  }
+
+  // Number of elements ready to be read. May be called from either side.
+  int64_t ReadAvailable() const {
+    return static_cast<int64_t>(write_index_.load(std::memory_order_acquire) -
+                                read_index_.load(std::memory_order_acquire));
+  }
+
+  int64_t Capacity() const { return capacity_; }
+
+  // Number of consumed elements kept for PeekHistory().
+  int64_t History() const { return history_; }
+
+  // Overflow telemetry, safe to read from any thread.
+  int64_t HighWaterMark() const {
+    return high_water_mark_.load(std::memory_order_relaxed);
+  }
+  int64_t NumOverflows() const {
+    return num_overflows_.load(std::memory_order_relaxed);
+  }
+  int64_t NumLostSamples() const {
+    return num_lost_samples_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static const int kCacheLineSize = 64;
+
+  // Splits <size> elements starting at index <start> into at most two
+  // contiguous regions.
+  int64_t Regions(uint64_t start, int64_t size, const T** data1,
+                  int64_t* size1, const T** data2, int64_t* size2) const {
+    const int64_t offset = static_cast<int64_t>(start & mask_);
+    *data1 = storage_.Data() + offset;
+    *size1 = Storage::kMirrored ?
+        size : std::min<int64_t>(size, capacity_ - offset);
+    *data2 = storage_.Data();
+    *size2 = size - *size1;
+    return size;
+  }
+
+  static int64_t RoundUpCapacity(int64_t min_capacity) {
+    int64_t capacity = 1;
+    while (capacity < min_capacity || capacity < Storage::MinCapacity()) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+  // Read-only after construction.
+  int64_t capacity_;
+  uint64_t mask_;
+  int64_t history_;
+  Storage storage_;
+  char pad0_[kCacheLineSize];
+
+  // Written by the producer.
+  std::atomic<uint64_t> write_index_;
+  std::atomic<int64_t> high_water_mark_;
+  std::atomic<int64_t> num_overflows_;
+  std::atomic<int64_t> num_lost_samples_;
+  char pad1_[kCacheLineSize];
+
+  // Written by the consumer.
+  std::atomic<uint64_t> read_index_;
+  char pad2_[kCacheLineSize - sizeof(std::atomic<uint64_t>)];
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_SPSC_RING_BUFFER_H_
@@ -0,0 +1,319 @@
+// examples/C++/stream-load-generator.cc
+
+// Load generator for hotword-server. Opens a number of concurrent sessions,
+// each streaming a looped hotword recording in real time, and reports the hits
+// and hotword latencies it gets back. Running it with increasing session
+// counts finds the number of streams a box can serve: past the ceiling, the
+// latency climbs and hits are lost as the server drops audio it cannot keep up
+// with. With --server-pid, the server CPU usage is also read from /proc to
+// report sessions per core.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/epoll.h>
+#include <vector>
+
+#include "latency-histogram.h"
+#include "parse-options.h"
+#include "stream-protocol.h"
+#include "wave-reader.h"
+
+// One client session.
+struct Stream {
+  int fd;
+  FrameReader reader;
+  // Time at which the first sample was due.
+  double start_time;
+  int64_t num_sent_samples;
+  int64_t num_hits;
+  bool failed;
+};
+
+// Results of one run with a given number of sessions.
+struct StepResult {
+  LatencyHistogram hotword_latency;
+  LatencyHistogram send_lag;
+  int64_t num_hits;
+  int64_t num_errors;
+  int64_t num_failed_sessions;
+  double audio_seconds;
+
+  StepResult() : num_hits(0), num_errors(0), num_failed_sessions(0),
+                 audio_seconds(0) {}
+};
+
+double NowSeconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the user plus system CPU time of process <pid>, or -1.
+double ProcessCpuSeconds(int pid) {
+  std::ostringstream path;
+  path << "/proc/" << pid << "/stat";
+  FILE* file = fopen(path.str().c_str(), "r");
+  if (file == NULL) {
+    return -1;
+  }
+  char buffer[1024];
+  size_t size = fread(buffer, 1, sizeof(buffer) - 1, file);
+  fclose(file);
+  buffer[size] = '\0';
+  // The command name may contain spaces; fields resume after its ')'.
+  const char* fields = strrchr(buffer, ')');
+  unsigned long utime = 0, stime = 0;
+  if (fields == NULL || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u "
+                               "%*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+    return -1;
+  }
+  return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+// Handles the frames available on <stream>.
+void ReadStream(Stream* stream, int samples_per_second, StepResult* result) {
+  char buffer[4096];
+  ssize_t num_read = recv(stream->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+  if (num_read < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (num_read <= 0) {
+    stream->failed = true;
+    return;
+  }
+  stream->reader.Append(buffer, num_read);
+  FrameType type;
+  const char* payload;
+  uint32_t size;
+  double now = NowSeconds();
+  while (stream->reader.Next(&type, &payload, &size)) {
+    if (type == kHotwordFrame && size == kHotwordPayloadSize) {
+      int32_t hotword;
+      int64_t position;
+      ParseHotwordPayload(payload, &hotword, &position);
+      // Latency from the moment the last sample of the detected chunk would
+      // have been captured by a live microphone.
+      result->hotword_latency.RecordSeconds(
+          now - stream->start_time -
+          static_cast<double>(position) / samples_per_second);
+      stream->num_hits++;
+      result->num_hits++;
+    } else if (type == kErrorFrame) {
+      std::cerr << "Server error: " << std::string(payload, size)
+          << std::endl;
+      result->num_errors++;
+    }
+  }
+  if (stream->reader.Failed()) {
+    stream->failed = true;
+  }
+}
+
+// Streams <audio> in a loop on <num_sessions> sessions for <seconds>.
+bool RunStep(const std::string& server, const std::vector<int16_t>& audio,
+             int samples_per_second, int num_sessions, float seconds,
+             int chunk_ms, StepResult* result) {
+  const int64_t chunk_samples = chunk_ms * samples_per_second / 1000;
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Stream> streams(num_sessions);
+  // Starts are spread over one chunk, as independent microphones would be.
+  double start = NowSeconds() + 0.1;
+  for (int i = 0; i < num_sessions; ++i) {
+    std::string error;
+    streams[i].fd = ConnectTo(server, &error);
+    if (streams[i].fd < 0) {
+      std::cerr << "Fail to connect to " << server << ": " << error
+          << std::endl;
+      for (int j = 0; j < i; ++j) {
+        close(streams[j].fd);
+      }
+      close(epoll_fd);
+      return false;
+    }
+    streams[i].start_time = start + chunk_ms / 1000.0 * i / num_sessions;
+    streams[i].num_sent_samples = 0;
+    streams[i].num_hits = 0;
+    streams[i].failed = false;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = i;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, streams[i].fd, &event);
+  }
+
+  const double end = start + seconds;
+  std::vector<struct epoll_event> events(256);
+  std::string frame;
+  // Keeps reading for a second after the last chunk, for late hotwords.
+  while (NowSeconds() < end + 1) {
+    double now = NowSeconds();
+    double next_due = end + 1;
+    for (int i = 0; i < num_sessions; ++i) {
+      Stream& stream = streams[i];
+      double due = stream.start_time + static_cast<double>(
+          stream.num_sent_samples + chunk_samples) / samples_per_second;
+      if (stream.failed || due > end) {
+        continue;
+      }
+      if (due > now) {
+        next_due = std::min(next_due, due);
+        continue;
+      }
+      result->send_lag.RecordSeconds(now - due);
+      frame.clear();
+      int64_t offset = stream.num_sent_samples % audio.size();
+      int64_t size = std::min<int64_t>(chunk_samples, audio.size() - offset);
+      AppendFrame(kAudioFrame, audio.data() + offset, size * sizeof(int16_t),
+                  &frame);
+      if (send(stream.fd, frame.data(), frame.size(), MSG_NOSIGNAL) !=
+          static_cast<ssize_t>(frame.size())) {
+        stream.failed = true;
+        continue;
+      }
+      stream.num_sent_samples += size;
+      result->audio_seconds += static_cast<double>(size) / samples_per_second;
+      next_due = std::min(next_due, stream.start_time + static_cast<double>(
+          stream.num_sent_samples + chunk_samples) / samples_per_second);
+    }
+    int timeout_ms = std::max(0, static_cast<int>(
+        std::ceil((next_due - NowSeconds()) * 1000)));
+    int num_events = epoll_wait(epoll_fd, events.data(), events.size(),
+                                timeout_ms);
+    for (int i = 0; i < num_events; ++i) {
+      Stream& stream = streams[events[i].data.u32];
+      ReadStream(&stream, samples_per_second, result);
+      if (stream.failed) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, stream.fd, NULL);
+      }
+    }
+  }
+
+  for (int i = 0; i < num_sessions; ++i) {
+    if (streams[i].failed) {
+      result->num_failed_sessions++;
+    }
+    close(streams[i].fd);
+  }
+  close(epoll_fd);
+  return true;
+}
+
+std::vector<int> ParseIntList(const std::string& str) {
+  std::vector<int> values;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage =
+      "Streams a looped hotword recording to hotword-server on many\n"
+      "concurrent sessions, in real time. For every session count, prints a\n"
+      "summary to stderr and one CSV line to stdout:\n"
+      "  sessions,hits_per_pass,p50_ms,p99_ms,max_ms,p99_send_lag_ms,\n"
+      "  failed_sessions,server_cores,sessions_per_core\n"
+      "Latencies run from the end of the detected chunk, as a live microphone\n"
+      "would have captured it, to the hotword frame arriving. The server\n"
+      "columns are empty without --server-pid.\n"
+      "\n"
+      "Usage: ./stream-load-generator [options]\n"
+      "e.g.: ./stream-load-generator --sessions=50,100,200,400 \\\n"
+      "          --server-pid=$(pidof hotword-server)\n";
+
+  std::string server = "unix:/tmp/snowboy-hotword.sock";
+  std::string wave_filename = "resources/snowboy.wav";
+  std::string sessions_str = "1,10,50,100";
+  float seconds = 30;
+  float silence_seconds = 2;
+  int chunk_ms = 20;
+  int server_pid = 0;
+
+  ParseOptions po(usage);
+  po.Register("server", &server,
+              "Server address: unix:<path> or tcp:<ipv4>:<port>.");
+  po.Register("wav", &wave_filename, "Recording containing the hotword.");
+  po.Register("sessions", &sessions_str,
+              "Comma separated session counts, run one after the other.");
+  po.Register("seconds", &seconds, "Seconds of streaming per session count.");
+  po.Register("silence-seconds", &silence_seconds,
+              "Silence appended to every pass of --wav.");
+  po.Register("chunk-ms", &chunk_ms,
+              "Audio per frame, in milliseconds, i.e., the capture period.");
+  po.Register("server-pid", &server_pid,
+              "Process id of the server, to report its CPU usage.");
+  po.Read(argc, argv);
+
+  std::vector<int> session_counts = ParseIntList(sessions_str);
+  if (po.NumArgs() != 0 || session_counts.empty() || chunk_ms <= 0 ||
+      seconds <= 0) {
+    po.PrintUsage();
+    exit(1);
+  }
+
+  MappedWaveFile wave;
+  std::string error;
+  if (!wave.Open(wave_filename, &error)) {
+    std::cerr << "Fail to read " << wave_filename << ": " << error << std::endl;
+    exit(1);
+  }
+  const WaveInfo& info = wave.Info();
+  if (info.bits_per_sample != 16) {
+    std::cerr << wave_filename << " is not 16 bits per sample." << std::endl;
+    exit(1);
+  }
+  const int samples_per_second = info.sample_rate * info.num_channels;
+  std::vector<int16_t> audio(info.data_size / sizeof(int16_t));
+  memcpy(audio.data(), wave.Data(), audio.size() * sizeof(int16_t));
+  audio.resize(audio.size() +
+               static_cast<int64_t>(silence_seconds * samples_per_second), 0);
+  const double pass_seconds = static_cast<double>(audio.size()) /
+      samples_per_second;
+
+  std::cout << "sessions,hits_per_pass,p50_ms,p99_ms,max_ms,p99_send_lag_ms,"
+      << "failed_sessions,server_cores,sessions_per_core" << std::endl;
+  for (size_t s = 0; s < session_counts.size(); ++s) {
+    const int num_sessions = std::max(1, session_counts[s]);
+    StepResult result;
+    double cpu_start = server_pid > 0 ? ProcessCpuSeconds(server_pid) : -1;
+    double wall_start = NowSeconds();
+    if (!RunStep(server, audio, samples_per_second, num_sessions, seconds,
+                 chunk_ms, &result)) {
+      exit(1);
+    }
+    double wall_seconds = NowSeconds() - wall_start;
+    double cpu_end = server_pid > 0 ? ProcessCpuSeconds(server_pid) : -1;
+
+    double passes = result.audio_seconds / pass_seconds;
+    std::cerr << num_sessions << " sessions: " << result.audio_seconds
+        << " s of audio sent, " << result.num_hits << " hits in " << passes
+        << " passes, " << result.num_errors << " server errors, "
+        << result.num_failed_sessions << " failed sessions." << std::endl;
+    result.hotword_latency.Print("  Hotword latency", std::cerr);
+    result.send_lag.Print("  Send lag", std::cerr);
+
+    std::cout << num_sessions << ","
+        << (passes > 0 ? result.num_hits / passes : 0) << ","
+        << result.hotword_latency.Percentile(50) / 1e3 << ","
+        << result.hotword_latency.Percentile(99) / 1e3 << ","
+        << result.hotword_latency.Percentile(100) / 1e3 << ","
+        << result.send_lag.Percentile(99) / 1e3 << ","
+        << result.num_failed_sessions << ",";
+    if (cpu_start >= 0 && cpu_end >= 0) {
+      double server_cores = (cpu_end - cpu_start) / wall_seconds;
+      std::cout << server_cores << ","
+          << (server_cores > 0 ? num_sessions / server_cores : 0);
+    } else {
+      std::cout << ",";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
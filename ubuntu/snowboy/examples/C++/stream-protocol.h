@@ -0,0 +1,252 @@
+// examples/C++/stream-protocol.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_STREAM_PROTOCOL_H_
+#define SNOWBOY_EXAMPLES_CPP_STREAM_PROTOCOL_H_
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Wire format between hotword-server and its clients, over a Unix domain
+// socket or TCP. Both directions are a sequence of frames:
+//
+//   uint32 payload size | uint8 frame type | payload
+//
+// with integers in little-endian order (the host order on x86 and ARM, which
+// is all the prebuilt libraries support). Frame types:
+//
+//   kAudioFrame    client -> server: PCM samples in the detector format
+//                  (16 kHz, mono, int16). A frame may hold any even number of
+//                  bytes; the server accumulates them into its own chunks.
+//   kHotwordFrame  server -> client: int32 hotword index (as returned by
+//                  RunDetection()), then int64 position in the stream, in
+//                  samples, of the end of the chunk that completed it.
+//   kErrorFrame    server -> client: error message; the server then closes
+//                  the connection.
+//
+// A stream ends when the client closes the connection. A client that shuts
+// down only its sending side still gets the hotword frames for the rest of the
+// stream, which the server runs with <is_end> set before it closes.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+enum FrameType {
+  kAudioFrame = 1,
+  kHotwordFrame = 2,
+  kErrorFrame = 3
+};
+
+const int kFrameHeaderSize = 5;
+// Larger frames are treated as a protocol error.
+const uint32_t kMaxFramePayload = 1 << 20;
+
+// Payload of a kHotwordFrame.
+const int kHotwordPayloadSize = 12;
+
+// Appends a frame to <output>.
+inline void AppendFrame(FrameType type, const void* payload, uint32_t size,
+                        std::string* output) {
+  char header[kFrameHeaderSize];
+  memcpy(header, &size, sizeof(size));
+  header[4] = static_cast<char>(type);
+  output->append(header, kFrameHeaderSize);
+  output->append(static_cast<const char*>(payload), size);
+}
+
+inline void AppendHotwordFrame(int32_t hotword, int64_t position,
+                               std::string* output) {
+  char payload[kHotwordPayloadSize];
+  memcpy(payload, &hotword, sizeof(hotword));
+  memcpy(payload + sizeof(hotword), &position, sizeof(position));
+  AppendFrame(kHotwordFrame, payload, kHotwordPayloadSize, output);
+}
+
+inline void ParseHotwordPayload(const char* payload, int32_t* hotword,
+                                int64_t* position) {
+  memcpy(hotword, payload, sizeof(*hotword));
+  memcpy(position, payload + sizeof(*hotword), sizeof(*position));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Reassembles frames from a byte stream. Bytes are appended as they are
+// received, and complete frames are taken out with Next(). The returned
+// payload points into the internal buffer and is only valid until the next
+// Append(). Example:
+//
+//   reader.Append(buffer, num_read);
+//   FrameType type;
+//   const char* payload;
+//   uint32_t size;
+//   while (reader.Next(&type, &payload, &size)) { ... }
+//   if (reader.Failed()) { ... close the connection ... }
+//
+////////////////////////////////////////////////////////////////////////////////
+class FrameReader {
+ public:
+  FrameReader() : offset_(0), failed_(false) {}
+
+  void Append(const char* data, size_t size) {
+    // Consumed bytes are dropped lazily, so that a burst of small frames does
+    // not shift the buffer once per frame.
+    if (offset_ > 0 && offset_ >= buffer_.size() / 2) {
+      buffer_.erase(0, offset_);
+      offset_ = 0;
+    }
+    buffer_.append(data, size);
+  }
+
+  // Takes the next complete frame, if any. Returns false if there is none yet
+  // or if the stream is malformed, see Failed().
+  bool Next(FrameType* type, const char** payload, uint32_t* size) {
+    if (failed_ || buffer_.size() - offset_ < kFrameHeaderSize) {
+      return false;
+    }
+    const char* header = buffer_.data() + offset_;
+    uint32_t payload_size;
+    memcpy(&payload_size, header, sizeof(payload_size));
+    int frame_type = static_cast<unsigned char>(header[4]);
+    if (payload_size > kMaxFramePayload || frame_type < kAudioFrame ||
+        frame_type > kErrorFrame) {
+      failed_ = true;
+      return false;
+    }
+    if (buffer_.size() - offset_ < kFrameHeaderSize + payload_size) {
+      return false;
+    }
+    *type = static_cast<FrameType>(frame_type);
+    *payload = header + kFrameHeaderSize;
+    *size = payload_size;
+    offset_ += kFrameHeaderSize + payload_size;
+    return true;
+  }
+
+  bool Failed() const { return failed_; }
+
+ private:
+  std::string buffer_;
+  size_t offset_;
+  bool failed_;
+};
+
+// Socket addresses are given as "unix:<path>" or "tcp:<ipv4 address>:<port>",
+// e.g., "unix:/tmp/snowboy.sock" or "tcp:127.0.0.1:9900".
+struct StreamAddress {
+  bool is_unix;
+  struct sockaddr_un unix_address;
+  struct sockaddr_in tcp_address;
+};
+
+inline bool ParseStreamAddress(const std::string& address,
+                               StreamAddress* parsed, std::string* error) {
+  memset(parsed, 0, sizeof(*parsed));
+  if (address.compare(0, 5, "unix:") == 0) {
+    std::string path = address.substr(5);
+    if (path.empty() || path.size() >= sizeof(parsed->unix_address.sun_path)) {
+      *error = "invalid socket path";
+      return false;
+    }
+    parsed->is_unix = true;
+    parsed->unix_address.sun_family = AF_UNIX;
+    strncpy(parsed->unix_address.sun_path, path.c_str(),
+            sizeof(parsed->unix_address.sun_path) - 1);
+    return true;
+  }
+  size_t colon = address.rfind(':');
+  if (address.compare(0, 4, "tcp:") == 0 && colon > 4) {
+    std::string host = address.substr(4, colon - 4);
+    char* end = NULL;
+    long port = strtol(address.c_str() + colon + 1, &end, 10);
+    parsed->is_unix = false;
+    parsed->tcp_address.sin_family = AF_INET;
+    parsed->tcp_address.sin_port = htons(static_cast<uint16_t>(port));
+    if (*end == '\0' && port > 0 && port < 65536 &&
+        inet_pton(AF_INET, host.c_str(), &parsed->tcp_address.sin_addr) == 1) {
+      return true;
+    }
+  }
+  *error = "expected unix:<path> or tcp:<ipv4 address>:<port>";
+  return false;
+}
+
+inline bool SetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Creates a non-blocking listening socket on <address>. A stale Unix socket
+// file is removed first. Returns -1 and fills <error> on failure.
+inline int ListenOn(const std::string& address, std::string* error) {
+  StreamAddress parsed;
+  if (!ParseStreamAddress(address, &parsed, error)) {
+    return -1;
+  }
+  int fd = socket(parsed.is_unix ? AF_UNIX : AF_INET,
+                  SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return -1;
+  }
+  int ret;
+  if (parsed.is_unix) {
+    unlink(parsed.unix_address.sun_path);
+    ret = bind(fd, reinterpret_cast<struct sockaddr*>(&parsed.unix_address),
+               sizeof(parsed.unix_address));
+  } else {
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    ret = bind(fd, reinterpret_cast<struct sockaddr*>(&parsed.tcp_address),
+               sizeof(parsed.tcp_address));
+  }
+  if (ret != 0 || listen(fd, SOMAXCONN) != 0 || !SetNonBlocking(fd)) {
+    *error = strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Connects to <address>. Returns a blocking socket, or -1 and fills <error>.
+inline int ConnectTo(const std::string& address, std::string* error) {
+  StreamAddress parsed;
+  if (!ParseStreamAddress(address, &parsed, error)) {
+    return -1;
+  }
+  int fd = socket(parsed.is_unix ? AF_UNIX : AF_INET,
+                  SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return -1;
+  }
+  int ret;
+  if (parsed.is_unix) {
+    ret = connect(fd,
+                  reinterpret_cast<struct sockaddr*>(&parsed.unix_address),
+                  sizeof(parsed.unix_address));
+  } else {
+    // Hotword events are tiny and latency matters more than packet count.
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ret = connect(fd, reinterpret_cast<struct sockaddr*>(&parsed.tcp_address),
+                  sizeof(parsed.tcp_address));
+  }
+  if (ret != 0) {
+    *error = strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+#endif  // SNOWBOY_EXAMPLES_CPP_STREAM_PROTOCOL_H_
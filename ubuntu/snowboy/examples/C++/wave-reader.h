@@ -0,0 +1,185 @@
+// examples/C++/wave-reader.h
+
+#ifndef SNOWBOY_EXAMPLES_CPP_WAVE_READER_H_
+#define SNOWBOY_EXAMPLES_CPP_WAVE_READER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Format of the PCM data in a WAVE file.
+struct WaveInfo {
+  int sample_rate;
+  int num_channels;
+  int bits_per_sample;
+
+  // Byte offset of the PCM data in the file, and its size in bytes.
+  int64_t data_offset;
+  int64_t data_size;
+
+  WaveInfo() : sample_rate(0), num_channels(0), bits_per_sample(0),
+               data_offset(0), data_size(0) {}
+
+  // Duration of the PCM data in seconds.
+  double Seconds() const {
+    int64_t bytes_per_second =
+        static_cast<int64_t>(sample_rate) * num_channels * bits_per_sample / 8;
+    return bytes_per_second > 0 ?
+        static_cast<double>(data_size) / bytes_per_second : 0;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Read-only memory mapping of a linear PCM WAVE file. The header is parsed on
+// Open(), and the PCM data can then be fed to SnowboyDetect::RunDetection()
+// directly from the mapping, without the header and without copying.
+//
+////////////////////////////////////////////////////////////////////////////////
+class MappedWaveFile {
+ public:
+  MappedWaveFile() : file_data_(NULL), file_size_(0) {}
+
+  ~MappedWaveFile() { Close(); }
+
+  // Maps <filename> and parses its header. Returns false and fills <error> if
+  // the file cannot be mapped or is not a linear PCM WAVE file.
+  bool Open(const std::string& filename, std::string* error) {
+    Close();
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      *error = "cannot open file";
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      *error = "cannot stat file or file is empty";
+      return false;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      *error = "cannot map file";
+      return false;
+    }
+    // Audio is streamed front to back exactly once.
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    file_data_ = static_cast<const char*>(data);
+    file_size_ = st.st_size;
+
+    if (!ParseHeader(error)) {
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  void Close() {
+    if (file_data_ != NULL) {
+      munmap(const_cast<char*>(file_data_), file_size_);
+      file_data_ = NULL;
+      file_size_ = 0;
+    }
+  }
+
+  const WaveInfo& Info() const { return info_; }
+
+  // Start of the PCM data.
+  const char* Data() const { return file_data_ + info_.data_offset; }
+
+  // Number of 16-bit samples in the PCM data.
+  int64_t NumSamples() const { return info_.data_size / sizeof(int16_t); }
+
+  // Returns the PCM data as 16-bit samples. RIFF chunks are 2-byte aligned,
+  // so the data is used in place unless the file was written by something
+  // non-conforming; it is then copied to <aligned>, which must outlive the
+  // use of the samples.
+  const int16_t* Samples(std::vector<int16_t>* aligned) const {
+    if (reinterpret_cast<uintptr_t>(Data()) % sizeof(int16_t) == 0) {
+      return reinterpret_cast<const int16_t*>(Data());
+    }
+    aligned->resize(NumSamples());
+    memcpy(aligned->data(), Data(), NumSamples() * sizeof(int16_t));
+    return aligned->data();
+  }
+
+ private:
+  static uint32_t ReadUint32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | (u[1] << 8) | (u[2] << 16) |
+        (static_cast<uint32_t>(u[3]) << 24);
+  }
+
+  static uint16_t ReadUint16(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | (u[1] << 8);
+  }
+
+  // Walks the RIFF chunks looking for "fmt " and "data". Other chunks (e.g.,
+  // "LIST") are skipped.
+  bool ParseHeader(std::string* error) {
+    if (file_size_ < 12 || memcmp(file_data_, "RIFF", 4) != 0 ||
+        memcmp(file_data_ + 8, "WAVE", 4) != 0) {
+      *error = "not a RIFF/WAVE file";
+      return false;
+    }
+    bool found_format = false;
+    int64_t offset = 12;
+    while (offset + 8 <= file_size_) {
+      const char* chunk = file_data_ + offset;
+      int64_t chunk_size = ReadUint32(chunk + 4);
+      if (memcmp(chunk, "fmt ", 4) == 0) {
+        if (chunk_size < 16 || offset + 8 + 16 > file_size_) {
+          *error = "truncated fmt chunk";
+          return false;
+        }
+        uint16_t format_tag = ReadUint16(chunk + 8);
+        // 1 is WAVE_FORMAT_PCM, 0xFFFE is WAVE_FORMAT_EXTENSIBLE.
+        if (format_tag != 1 && format_tag != 0xFFFE) {
+          *error = "not linear PCM";
+          return false;
+        }
+        info_.num_channels = ReadUint16(chunk + 10);
+        info_.sample_rate = ReadUint32(chunk + 12);
+        info_.bits_per_sample = ReadUint16(chunk + 22);
+        found_format = true;
+      } else if (memcmp(chunk, "data", 4) == 0) {
+        if (!found_format) {
+          *error = "data chunk before fmt chunk";
+          return false;
+        }
+        info_.data_offset = offset + 8;
+        // Streaming writers often leave the size at 0 or 0xFFFFFFFF, so the
+        // data is clipped to whatever is actually in the file.
+        info_.data_size = chunk_size;
+        if (chunk_size == 0 || info_.data_offset + chunk_size > file_size_) {
+          info_.data_size = file_size_ - info_.data_offset;
+        }
+        int block_align = info_.num_channels * info_.bits_per_sample / 8;
+        if (block_align > 0) {
+          info_.data_size -= info_.data_size % block_align;
+        }
+        return true;
+      }
+      // Chunks are padded to an even size.
+      offset += 8 + chunk_size + (chunk_size & 1);
+    }
+    *error = found_format ? "no data chunk" : "no fmt chunk";
+    return false;
+  }
+
+  MappedWaveFile(const MappedWaveFile&);
+  MappedWaveFile& operator=(const MappedWaveFile&);
+
+  const char* file_data_;
+  int64_t file_size_;
+  WaveInfo info_;
+};
+
+#endif  // SNOWBOY_EXAMPLES_CPP_WAVE_READER_H_
@@ -0,0 +1,92 @@
+// Measures the per-call cost of SnowboyDetect.RunDetection() from JavaScript,
+// for each kind of input the addon accepts:
+//   aligned:   Buffers that start on a 2-byte boundary, read in place;
+//   unaligned: odd Buffer slices, copied once into an aligned scratch buffer;
+//   int16:     Int16Array views, read in place;
+//   float32:   Float32Array views on the int16 scale, read in place.
+// Run it against builds before and after a binding change to compare. The
+// native allocations per call are measured by examples/C++/c-api-benchmark.
+//
+// Prints one CSV line per (input, chunk size), in nanoseconds, with the
+// hotwords found over all repetitions, which must match between the inputs:
+//   input,chunk_ms,calls,mean_ns,p50_ns,p99_ns,hotwords
+//
+// Usage: node benchmark.js [wav] [chunk_ms,...]
+const fs = require('fs');
+const path = require('path');
+const binary = require('node-pre-gyp');
+
+const bindingPath = binary.find(path.resolve(path.join(__dirname, '../../package.json')));
+const SnowboyDetect = require(bindingPath).SnowboyDetect;
+
+const wavFile = process.argv[2] || 'resources/snowboy.wav';
+const chunkMs = (process.argv[3] || '1,10,20,100').split(',').map(Number);
+const repeat = 20;
+
+// Skips the 44-byte header of a canonical 16 kHz, 16-bit mono wav file.
+const audio = fs.readFileSync(wavFile).slice(44);
+const detector = new SnowboyDetect('resources/common.res', 'resources/snowboy.umdl');
+detector.SetSensitivity('0.5');
+const sampleRate = detector.SampleRate();
+
+function percentile(sorted, p) {
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p / 100))];
+}
+
+// The audio in each input type; chunks are views of it, made outside of the
+// timed calls.
+function inputData(input) {
+  const numSamples = Math.floor(audio.length / 2);
+  if (input === 'unaligned') {
+    // A copy of the audio one byte into a larger Buffer, so that every chunk
+    // starts on an odd address.
+    const data = Buffer.alloc(audio.length + 1);
+    audio.copy(data, 1);
+    return data.slice(1);
+  } else if (input === 'int16') {
+    const data = new Int16Array(numSamples);
+    for (let i = 0; i < numSamples; ++i) {
+      data[i] = audio.readInt16LE(i * 2);
+    }
+    return data;
+  } else if (input === 'float32') {
+    const data = new Float32Array(numSamples);
+    for (let i = 0; i < numSamples; ++i) {
+      data[i] = audio.readInt16LE(i * 2);
+    }
+    return data;
+  }
+  return audio;
+}
+
+console.log('input,chunk_ms,calls,mean_ns,p50_ns,p99_ns,hotwords');
+for (const input of ['aligned', 'unaligned', 'int16', 'float32']) {
+  const data = inputData(input);
+  // Buffers are sliced in bytes, typed arrays in samples.
+  const unit = Buffer.isBuffer(data) ? 2 : 1;
+  for (const ms of chunkMs) {
+    const chunkSize = Math.max(1, Math.floor(ms * sampleRate / 1000)) * unit;
+    const times = [];
+    let hotwords = 0;
+    for (let r = 0; r < repeat; ++r) {
+      detector.Reset();
+      for (let offset = 0; offset < data.length; offset += chunkSize) {
+        const chunk = Buffer.isBuffer(data) ?
+          data.slice(offset, offset + chunkSize) :
+          data.subarray(offset, offset + chunkSize);
+        const start = process.hrtime();
+        const index = detector.RunDetection(chunk);
+        const elapsed = process.hrtime(start);
+        times.push(elapsed[0] * 1e9 + elapsed[1]);
+        if (index > 0) {
+          hotwords++;
+        }
+      }
+    }
+    const mean = times.reduce((a, b) => a + b, 0) / times.length;
+    times.sort((a, b) => a - b);
+    console.log([input, ms, times.length, mean.toFixed(0),
+                 percentile(times, 50).toFixed(0),
+                 percentile(times, 99).toFixed(0), hotwords].join(','));
+  }
+}
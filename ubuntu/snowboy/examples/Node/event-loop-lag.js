@@ -0,0 +1,117 @@
+// Measures how much the detection delays the event loop of a gateway that
+// serves many microphone streams. Every stream replays the same recording in
+// real time, one chunk every chunk_ms, into its own detector:
+//   sync:  RunDetection() on the event loop, as _write() used to do;
+//   async: the Detector stream, whose _write() uses RunDetectionAsync() on
+//          the libuv threadpool (size it with UV_THREADPOOL_SIZE).
+// The event loop delay is sampled by a timer that should fire every 10 ms.
+// Both modes must report the same number of hotwords.
+//
+// Prints one CSV line per mode:
+//   mode,streams,chunks,lag_p50_ms,lag_p99_ms,lag_max_ms,hotwords
+//
+// Usage: node event-loop-lag.js [streams] [seconds] [chunk_ms] [wav]
+const fs = require('fs');
+const path = require('path');
+const stream = require('stream');
+const binary = require('node-pre-gyp');
+const Detector = require('../../').Detector;
+const Models = require('../../').Models;
+
+const bindingPath = binary.find(path.resolve(path.join(__dirname, '../../package.json')));
+const SnowboyDetect = require(bindingPath).SnowboyDetect;
+
+const numStreams = Number(process.argv[2] || 32);
+const seconds = Number(process.argv[3] || 20);
+const chunkMs = Number(process.argv[4] || 100);
+const wavFile = process.argv[5] || 'resources/snowboy.wav';
+
+// Skips the 44-byte header of a canonical 16 kHz, 16-bit mono wav file.
+const audio = fs.readFileSync(wavFile).slice(44);
+const chunkBytes = 16000 * chunkMs / 1000 * 2;
+
+// Milliseconds on a monotonic clock, with sub-millisecond resolution.
+function nowMs() {
+  const t = process.hrtime();
+  return t[0] * 1e3 + t[1] / 1e6;
+}
+
+function percentile(sorted, p) {
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p / 100))];
+}
+
+// Writable that runs the detection synchronously in _write().
+function syncStream(onHotword) {
+  const detector = new SnowboyDetect('resources/common.res', 'resources/snowboy.umdl');
+  detector.SetSensitivity('0.5');
+  return new stream.Writable({
+    write(chunk, encoding, callback) {
+      if (detector.RunDetection(chunk) > 0) {
+        onHotword();
+      }
+      callback();
+    }
+  });
+}
+
+function asyncStream(onHotword) {
+  const models = new Models();
+  models.add({file: 'resources/snowboy.umdl', sensitivity: '0.5', hotwords: 'snowboy'});
+  const detector = new Detector({resource: 'resources/common.res', models: models});
+  detector.on('hotword', onHotword);
+  return detector;
+}
+
+function run(mode, done) {
+  let hotwords = 0;
+  let chunks = 0;
+  const onHotword = () => { hotwords++; };
+  const streams = [];
+  for (let i = 0; i < numStreams; ++i) {
+    streams.push(mode === 'sync' ? syncStream(onHotword) : asyncStream(onHotword));
+  }
+
+  // Event loop delay: how late a 10 ms timer fires. Date.now() would round
+  // the delays to whole milliseconds.
+  const lags = [];
+  let expected = nowMs() + 10;
+  const probe = setInterval(() => {
+    const now = nowMs();
+    lags.push(Math.max(0, now - expected));
+    expected = now + 10;
+  }, 10);
+
+  // Streams are started at staggered offsets within a chunk, as independent
+  // microphones would be.
+  const totalChunks = Math.floor(seconds * 1000 / chunkMs);
+  let finished = 0;
+  streams.forEach((s, i) => {
+    let n = 0;
+    const start = Date.now() + i * chunkMs / numStreams;
+    const feed = () => {
+      const offset = (n * chunkBytes) % (audio.length - audio.length % chunkBytes);
+      s.write(audio.slice(offset, offset + chunkBytes));
+      chunks++;
+      if (++n === totalChunks) {
+        s.end();
+        return;
+      }
+      setTimeout(feed, Math.max(0, start + n * chunkMs - Date.now()));
+    };
+    s.on('finish', () => {
+      if (++finished === numStreams) {
+        clearInterval(probe);
+        lags.sort((a, b) => a - b);
+        console.log([mode, numStreams, chunks,
+                     percentile(lags, 50).toFixed(2),
+                     percentile(lags, 99).toFixed(2),
+                     lags[lags.length - 1].toFixed(2), hotwords].join(','));
+        done();
+      }
+    });
+    setTimeout(feed, Math.max(0, start - Date.now()));
+  });
+}
+
+console.log('mode,streams,chunks,lag_p50_ms,lag_p99_ms,lag_max_ms,hotwords');
+run('sync', () => run('async', () => {}));
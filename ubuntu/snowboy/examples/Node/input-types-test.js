@@ -0,0 +1,108 @@
+// Checks that every kind of audio input the addon accepts detects the hotword
+// in resources/snowboy.wav, fed in 100 ms chunks:
+//   buffer:    a Buffer of int16 samples;
+//   unaligned: a Buffer that starts on an odd byte;
+//   int16:     an Int16Array;
+//   float32:   a Float32Array on the int16 scale.
+// Each one goes through SnowboyDetect.runDetection(), runDetectionAsync(),
+// and a PooledDetector where worker threads are available.
+//
+// Usage (from the snowboy directory): node examples/Node/input-types-test.js
+const fs = require('fs');
+const Detector = require('../../').Detector;
+const Models = require('../../').Models;
+const Pool = require('../../').Pool;
+
+// Skips the 44-byte header of a canonical 16 kHz, 16-bit mono wav file.
+const audio = fs.readFileSync('resources/snowboy.wav').slice(44);
+const numSamples = Math.floor(audio.length / 2);
+const chunkSamples = 1600;
+
+function models() {
+  const m = new Models();
+  m.add({file: 'resources/snowboy.umdl', sensitivity: '0.5', hotwords: 'snowboy'});
+  return m;
+}
+
+function inputData(input) {
+  if (input === 'unaligned') {
+    const data = Buffer.alloc(audio.length + 1);
+    audio.copy(data, 1);
+    return data.slice(1);
+  } else if (input === 'int16' || input === 'float32') {
+    const data = input === 'int16' ? new Int16Array(numSamples) :
+      new Float32Array(numSamples);
+    for (let i = 0; i < numSamples; ++i) {
+      data[i] = audio.readInt16LE(i * 2);
+    }
+    return data;
+  }
+  return audio;
+}
+
+function chunks(data) {
+  const result = [];
+  for (let i = 0; i < numSamples; i += chunkSamples) {
+    const end = Math.min(numSamples, i + chunkSamples);
+    result.push(Buffer.isBuffer(data) ? data.slice(i * 2, end * 2) : data.subarray(i, end));
+  }
+  return result;
+}
+
+// Resolves to the highest result over all chunks.
+function runSync(data) {
+  const detector = new Detector({resource: 'resources/common.res', models: models()});
+  return Promise.resolve(Math.max.apply(null, chunks(data).map((c) => detector.runDetection(c))));
+}
+
+function runSequence(detector, data) {
+  let best = -2;
+  return chunks(data).reduce((previous, chunk) => previous.then(() => {
+    return detector.runDetectionAsync(chunk).then((index) => { best = Math.max(best, index); });
+  }), Promise.resolve()).then(() => best);
+}
+
+function runAsync(data) {
+  return runSequence(new Detector({resource: 'resources/common.res', models: models()}), data);
+}
+
+function runPooled(data) {
+  const pool = new Pool({resource: 'resources/common.res', models: models(), threads: 1});
+  const detector = pool.createDetector();
+  return runSequence(detector, data).then((best) => new Promise((resolve) => {
+    detector.on('finish', () => pool.close().then(() => resolve(best)));
+    detector.end();
+  }));
+}
+
+let hasWorkers = true;
+try {
+  require('worker_threads');
+} catch (e) {
+  hasWorkers = false;
+}
+
+const cases = [];
+['buffer', 'unaligned', 'int16', 'float32'].forEach((input) => {
+  cases.push([input, 'sync', runSync]);
+  cases.push([input, 'async', runAsync]);
+  if (hasWorkers) {
+    cases.push([input, 'pooled', runPooled]);
+  }
+});
+
+let failed = 0;
+cases.reduce((previous, c) => previous.then(() => {
+  return c[2](inputData(c[0])).then((best) => {
+    const ok = best > 0;
+    failed += ok ? 0 : 1;
+    console.log(`${c[0]} ${c[1]}: ${ok ? 'detected' : 'NOT detected'} (${best})`);
+  });
+}), Promise.resolve()).then(() => {
+  if (failed === 0) {
+    console.log('Unit test passed!');
+  } else {
+    console.log('Unit test failed!');
+    process.exitCode = 1;
+  }
+});
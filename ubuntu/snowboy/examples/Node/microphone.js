@@ -13,7 +13,10 @@ models.add({
 const detector = new Detector({
   resource: "resources/common.res",
   models: models,
-  audioGain: 2.0
+  audioGain: 2.0,
+  // The small chunks of the recorder are run through the detection 100 ms at
+  // a time.
+  chunkDuration: 100
 });
 
 detector.on('silence', function () {
@@ -28,8 +31,9 @@ detector.on('error', function () {
   console.log('error');
 });
 
-detector.on('hotword', function (index, hotword) {
-  console.log('hotword', index, hotword);
+detector.on('hotword', function (index, hotword, start, end) {
+  // <start> and <end> are offsets in samples, at 16 kHz.
+  console.log('hotword', index, hotword, 'at', end / 16000, 's');
 });
 
 const mic = record.start({
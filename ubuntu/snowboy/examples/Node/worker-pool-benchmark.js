@@ -0,0 +1,67 @@
+// Measures how the detection throughput of a DetectorPool grows with its
+// number of worker threads. Every stream writes the same recording into its
+// own pooled detector as fast as the pool takes it; the throughput is the
+// audio processed per second of wall time, over all streams. Every run must
+// report the same number of hotwords.
+//
+// Prints one CSV line per thread count:
+//   threads,streams,audio_s,wall_s,realtime_factor,hotwords
+//
+// Usage: node worker-pool-benchmark.js [threads,...] [streams] [wav]
+const fs = require('fs');
+const os = require('os');
+const Models = require('../../').Models;
+const Pool = require('../../').Pool;
+
+const threadCounts = (process.argv[2] || [1, 2, 4, os.cpus().length].join(',')).split(',').map(Number);
+const numStreams = Number(process.argv[3] || 32);
+const wavFile = process.argv[4] || 'resources/snowboy.wav';
+const chunkBytes = 3200;
+
+// Skips the 44-byte header of a canonical 16 kHz, 16-bit mono wav file.
+const audio = fs.readFileSync(wavFile).slice(44);
+
+function run(threads, done) {
+  const models = new Models();
+  models.add({file: 'resources/snowboy.umdl', sensitivity: '0.5', hotwords: 'snowboy'});
+  const pool = new Pool({resource: 'resources/common.res', models: models, threads: threads});
+  let hotwords = 0;
+  let finished = 0;
+  const start = process.hrtime();
+  for (let i = 0; i < numStreams; ++i) {
+    const detector = pool.createDetector();
+    detector.on('hotword', () => { hotwords++; });
+    detector.on('finish', () => {
+      if (++finished < numStreams) {
+        return;
+      }
+      const elapsed = process.hrtime(start);
+      const wallSeconds = elapsed[0] + elapsed[1] / 1e9;
+      const audioSeconds = numStreams * audio.length / 2 / 16000;
+      console.log([threads, numStreams, audioSeconds.toFixed(1), wallSeconds.toFixed(3),
+                   (audioSeconds / wallSeconds).toFixed(1), hotwords].join(','));
+      pool.close().then(done);
+    });
+    // Writes the chunks as the stream drains.
+    let offset = 0;
+    const feed = () => {
+      while (offset < audio.length) {
+        const chunk = audio.slice(offset, offset + chunkBytes);
+        offset += chunkBytes;
+        if (!detector.write(chunk)) {
+          detector.once('drain', feed);
+          return;
+        }
+      }
+      detector.end();
+    };
+    feed();
+  }
+}
+
+console.log('threads,streams,audio_s,wall_s,realtime_factor,hotwords');
+(function next(i) {
+  if (i < threadCounts.length) {
+    run(threadCounts[i], () => next(i + 1));
+  }
+})(0);
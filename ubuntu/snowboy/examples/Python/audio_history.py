@@ -0,0 +1,107 @@
+"""
+Recent captured audio and the utterances read from it, shared by the
+HotwordDetector of snowboydecoder.py and its copy in jian_voice.
+"""
+
+import Queue
+
+
+class AudioHistory(object):
+    """
+    Most recent `size` bytes of captured audio, kept in a preallocated
+    bytearray so that views of it can be handed out without copying.
+    Positions are absolute byte counts since the capture started.
+    """
+    def __init__(self, size):
+        self._buf = bytearray(size)
+        self._size = size
+        self.total = 0
+
+    def extend(self, data):
+        """Adds data to the end of the history, overwriting the oldest bytes"""
+        skipped = max(0, len(data) - self._size)
+        self.total += skipped
+        data = data[skipped:]
+        pos = self.total % self._size
+        first = min(len(data), self._size - pos)
+        self._buf[pos:pos + first] = data[:first]
+        self._buf[:len(data) - first] = data[first:]
+        self.total += len(data)
+
+    @property
+    def first(self):
+        """Position of the oldest byte still in the history"""
+        return max(0, self.total - self._size)
+
+    def view(self, start, end=None):
+        """
+        Returns at most two memoryviews of the bytes between the positions
+        `start` and `end` (by default, everything written so far). Bytes that
+        are no longer in the history, i.e. before `first`, are left out. The
+        views are only valid until the history wraps around: copy them before
+        releasing the lock that protects the history.
+        """
+        if end is None:
+            end = self.total
+        start = max(start, self.first)
+        if start >= end:
+            return []
+        buf = memoryview(self._buf)
+        begin = start % self._size
+        stop = begin + end - start
+        if stop <= self._size:
+            return [buf[begin:stop]]
+        return [buf[begin:], buf[:stop - self._size]]
+
+
+class UtteranceStream(object):
+    """
+    Audio of the utterance that follows a hotword, see
+    HotwordDetector.open_utterance(). Iterating over it yields the audio in
+    chunks: first what was already captured, then live data as it is
+    captured, until the requested duration is reached or no audio arrives
+    for `timeout` seconds. `start` and `end` are positions in the
+    AudioHistory; `start` must not be older than its `first` byte.
+    """
+    def __init__(self, start, end, timeout=2):
+        self._queue = Queue.Queue()
+        self._position = start
+        self._end = end
+        self._timeout = timeout
+
+    def feed(self, data):
+        """
+        Adds captured audio. Returns False once the utterance is complete.
+        Memoryviews, e.g. from AudioHistory.view(), are copied, since the
+        history is overwritten while the chunks wait to be read.
+        """
+        if self._position >= self._end:
+            return False
+        data = data[:self._end - self._position]
+        if isinstance(data, memoryview):
+            data = data.tobytes()
+        self._position += len(data)
+        self._queue.put(data)
+        if self._position >= self._end:
+            self._queue.put(None)
+            return False
+        return True
+
+    def close(self):
+        """Ends the utterance early"""
+        self._end = self._position
+        self._queue.put(None)
+
+    def __iter__(self):
+        while True:
+            try:
+                chunk = self._queue.get(True, self._timeout)
+            except Queue.Empty:
+                return
+            if chunk is None:
+                return
+            yield chunk
+
+    def read_all(self):
+        """Waits for the whole utterance and returns it as one string"""
+        return ''.join(self)
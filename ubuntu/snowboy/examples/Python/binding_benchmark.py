@@ -0,0 +1,150 @@
+#!/usr/bin/env python
+
+"""Measures the per-call cost of passing audio from Python to the detector.
+
+  swig-string:     SnowboyDetect.RunDetection() on bytes, copied into a
+                   std::string by modules built before the buffer typemaps of
+                   snowboy-detect-swig.i, read in place by current ones;
+  swig-memoryview: the same on memoryviews of one bytearray, as
+                   snowboydecoder.RingBuffer passes them;
+  swig-int16:      the same on numpy int16 arrays;
+  swig-float32:    the same on numpy float32 arrays;
+  swig-c:          snowboy_detect_run_int16() of the same SWIG module, which
+                   reads the bytes object in place;
+  ctypes:          snowboy_detect_run_int16() of swig/C/libsnowboy-detect-c.so.
+The buffer paths need a module built from the current snowboy-detect-swig.i,
+and numpy for the arrays.
+
+Prints one CSV line per (path, chunk size):
+  path,chunk_ms,calls,mean_us,p50_us,p99_us
+
+Usage: python binding_benchmark.py [wav] [chunk_ms,...]
+"""
+
+import ctypes
+import os
+import sys
+import time
+import wave
+
+TOP_DIR = os.path.dirname(os.path.abspath(__file__))
+RESOURCE_FILE = os.path.join(TOP_DIR, "resources/common.res")
+MODEL_FILE = os.path.join(TOP_DIR, "resources/snowboy.umdl")
+C_LIBRARY = os.path.join(TOP_DIR, "../../swig/C/libsnowboy-detect-c.so")
+REPEAT = 20
+
+try:
+    import snowboydetect
+except ImportError:
+    snowboydetect = None
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+
+def swig_string_path():
+    detector = snowboydetect.SnowboyDetect(
+        resource_filename=RESOURCE_FILE.encode(), model_str=MODEL_FILE.encode())
+    return detector.Reset, lambda data: detector.RunDetection(data)
+
+
+def swig_buffer_path():
+    if not hasattr(snowboydetect, "snowboy_detect_run_float"):
+        return None
+    return swig_string_path()
+
+
+def swig_numpy_path():
+    if numpy is None:
+        return None
+    return swig_buffer_path()
+
+
+def to_memoryviews(chunks):
+    buf = memoryview(bytearray(b"".join(chunks)))
+    views = []
+    offset = 0
+    for chunk in chunks:
+        views.append(buf[offset:offset + len(chunk)])
+        offset += len(chunk)
+    return views
+
+
+def swig_c_path():
+    if not hasattr(snowboydetect, "snowboy_detect_new"):
+        return None
+    handle = snowboydetect.snowboy_detect_new(RESOURCE_FILE.encode(),
+                                              MODEL_FILE.encode())
+    run = snowboydetect.snowboy_detect_run_int16
+    return (lambda: snowboydetect.snowboy_detect_reset(handle),
+            lambda data: run(handle, data, 0))
+
+
+def ctypes_path():
+    if not os.path.exists(C_LIBRARY):
+        return None
+    lib = ctypes.CDLL(C_LIBRARY)
+    lib.snowboy_detect_run_int16.argtypes = [
+        ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int]
+    handle = ctypes.c_void_p()
+    if lib.snowboy_detect_create(RESOURCE_FILE.encode(), MODEL_FILE.encode(),
+                                 ctypes.byref(handle)) != 0:
+        return None
+    run = lib.snowboy_detect_run_int16
+    return (lambda: lib.snowboy_detect_reset(handle),
+            lambda data: run(handle, data, len(data) // 2, 0))
+
+
+def main():
+    wav_file = sys.argv[1] if len(sys.argv) > 1 else \
+        os.path.join(TOP_DIR, "resources/snowboy.wav")
+    chunk_ms = [int(x) for x in
+                (sys.argv[2] if len(sys.argv) > 2 else "1,10,20,100").split(",")]
+    reader = wave.open(wav_file, "rb")
+    frame_bytes = reader.getsampwidth() * reader.getnchannels()
+    rate = reader.getframerate()
+    audio = reader.readframes(reader.getnframes())
+
+    # (name, path, conversion of the list of bytes chunks)
+    paths = []
+    if snowboydetect is not None:
+        paths.append(("swig-string", swig_string_path(), None))
+        paths.append(("swig-memoryview", swig_buffer_path(), to_memoryviews))
+        paths.append(("swig-int16", swig_numpy_path(), lambda chunks: [
+            numpy.frombuffer(chunk, dtype=numpy.int16) for chunk in chunks]))
+        paths.append(("swig-float32", swig_numpy_path(), lambda chunks: [
+            numpy.frombuffer(chunk, dtype=numpy.int16).astype(numpy.float32)
+            for chunk in chunks]))
+        paths.append(("swig-c", swig_c_path(), None))
+    paths.append(("ctypes", ctypes_path(), None))
+
+    print("path,chunk_ms,calls,mean_us,p50_us,p99_us")
+    for name, path, convert in paths:
+        if path is None:
+            sys.stderr.write("Skipping %s: not available.\n" % name)
+            continue
+        reset, run = path
+        for ms in chunk_ms:
+            chunk_bytes = max(1, ms * rate // 1000) * frame_bytes
+            chunks = [audio[i:i + chunk_bytes]
+                      for i in range(0, len(audio), chunk_bytes)]
+            if convert is not None:
+                chunks = convert(chunks)
+            times = []
+            for _ in range(REPEAT):
+                reset()
+                for chunk in chunks:
+                    start = time.time()
+                    run(chunk)
+                    times.append((time.time() - start) * 1e6)
+            mean = sum(times) / len(times)
+            times.sort()
+            print("%s,%d,%d,%.2f,%.2f,%.2f" % (
+                name, ms, len(times), mean, times[len(times) // 2],
+                times[min(len(times) - 1, len(times) * 99 // 100)]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,166 @@
+#!/usr/bin/env python
+
+"""Checks the audio inputs that the buffer typemaps of
+swig/Python/snowboy-detect-swig.i accept. resources/snowboy.wav is fed in
+100 ms chunks, as:
+  bytes:     the reference, which modules built before the typemaps copied
+             into a std::string;
+  bytearray, memoryview, array.array('h');
+  numpy int16 and numpy float32 (on the int16 scale), if numpy is installed;
+  snowboy_detect_run_int16() and snowboy_detect_run_float() of the C
+             interface.
+Every input must give the same result as bytes on every chunk, and the
+hotword must be detected. Float input goes through RunDetection(const float*)
+of the library, which reports some silent chunks as 0 instead of -2; silence
+and no event are not told apart for it. Inputs of the wrong type must be rejected: with a
+TypeError, or a NotImplementedError from the overload dispatch of SWIG 3.
+
+Usage (after `make clean && make` in swig/Python):
+  python input_types_test.py
+"""
+
+import array
+import os
+import sys
+import wave
+
+import snowboydetect
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+TOP_DIR = os.path.dirname(os.path.abspath(__file__))
+RESOURCE_FILE = os.path.join(TOP_DIR, "resources/common.res")
+MODEL_FILE = os.path.join(TOP_DIR, "resources/snowboy.umdl")
+WAVE_FILE = os.path.join(TOP_DIR, "resources/snowboy.wav")
+CHUNK_MS = 100
+
+
+def read_chunks():
+    reader = wave.open(WAVE_FILE, "rb")
+    chunk_bytes = reader.getframerate() * CHUNK_MS // 1000 * \
+        reader.getsampwidth() * reader.getnchannels()
+    audio = reader.readframes(reader.getnframes())
+    return [audio[i:i + chunk_bytes]
+            for i in range(0, len(audio), chunk_bytes)]
+
+
+def to_int16_array(chunk):
+    samples = array.array("h")
+    if hasattr(samples, "frombytes"):
+        samples.frombytes(chunk)
+    else:
+        samples.fromstring(chunk)
+    if sys.byteorder == "big":
+        samples.byteswap()
+    return samples
+
+
+def run_class(chunks, convert):
+    detector = snowboydetect.SnowboyDetect(
+        resource_filename=RESOURCE_FILE.encode(),
+        model_str=MODEL_FILE.encode())
+    detector.SetSensitivity(b"0.5")
+    return [detector.RunDetection(convert(chunk)) for chunk in chunks]
+
+
+def run_c(chunks, function, convert):
+    detector = snowboydetect.snowboy_detect_new(RESOURCE_FILE.encode(),
+                                                MODEL_FILE.encode())
+    snowboydetect.snowboy_detect_set_sensitivity(detector, b"0.5")
+    results = [function(detector, convert(chunk), 0) for chunk in chunks]
+    snowboydetect.snowboy_detect_destroy(detector)
+    return results
+
+
+def without_silence(results):
+    return [0 if result == -2 else result for result in results]
+
+
+def is_rejected(function, data):
+    try:
+        function(data)
+    except (TypeError, NotImplementedError):
+        return True
+    return False
+
+
+def main():
+    chunks = read_chunks()
+    cases = [
+        ("bytearray", False, lambda: run_class(chunks, bytearray)),
+        ("memoryview", False, lambda: run_class(
+            chunks, lambda c: memoryview(bytearray(c)))),
+        ("array int16", False, lambda: run_class(chunks, to_int16_array)),
+        ("array float32", True, lambda: run_class(
+            chunks, lambda c: array.array("f", to_int16_array(c)))),
+        ("C int16", False, lambda: run_c(
+            chunks, snowboydetect.snowboy_detect_run_int16, bytes)),
+        ("C float32", True, lambda: run_c(
+            chunks, snowboydetect.snowboy_detect_run_float,
+            lambda c: array.array("f", to_int16_array(c)))),
+    ]
+    if numpy is not None:
+        cases += [
+            ("numpy int16", False, lambda: run_class(
+                chunks, lambda c: numpy.frombuffer(c, dtype="<i2"))),
+            ("numpy float32", True, lambda: run_class(
+                chunks,
+                lambda c: numpy.frombuffer(c, dtype="<i2").astype(
+                    numpy.float32))),
+        ]
+    else:
+        sys.stderr.write("numpy is not installed, skipping its cases.\n")
+
+    failed = 0
+    reference = run_class(chunks, bytes)
+    if max(reference) > 0:
+        print("bytes: detected (%d)" % max(reference))
+    else:
+        print("bytes: NOT detected")
+        failed += 1
+    for name, is_float, run in cases:
+        results = run()
+        if results == reference or (is_float and without_silence(results) ==
+                                    without_silence(reference)):
+            print("%s: same as bytes" % name)
+        else:
+            print("%s: DIFFERENT from bytes: %s" % (name, results))
+            failed += 1
+
+    detector = snowboydetect.SnowboyDetect(
+        resource_filename=RESOURCE_FILE.encode(),
+        model_str=MODEL_FILE.encode())
+    handle = snowboydetect.snowboy_detect_new(RESOURCE_FILE.encode(),
+                                              MODEL_FILE.encode())
+    run_int16 = lambda data: snowboydetect.snowboy_detect_run_int16(
+        handle, data, 0)
+    rejected = [
+        ("array float64", detector.RunDetection, array.array("d", [0.0] * 160)),
+        ("C int16 on float32", run_int16, array.array("f", [0.0] * 160)),
+    ]
+    if numpy is not None:
+        rejected += [
+            ("numpy float64", detector.RunDetection, numpy.zeros(160)),
+            ("numpy int16 strided", detector.RunDetection,
+             numpy.zeros(320, dtype=numpy.int16)[::2]),
+        ]
+    for name, function, data in rejected:
+        if is_rejected(function, data):
+            print("%s: rejected" % name)
+        else:
+            print("%s: NOT rejected" % name)
+            failed += 1
+    snowboydetect.snowboy_detect_destroy(handle)
+
+    if failed == 0:
+        print("Unit test passed!")
+    else:
+        print("Unit test failed!")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -2,12 +2,16 @@
 
 import collections
 import pyaudio
+import socket
+import threading
 import snowboydetect
 import time
 import wave
 import os
 import logging
 
+from audio_history import AudioHistory, UtteranceStream
+
 logging.basicConfig()
 logger = logging.getLogger("snowboy")
 logger.setLevel(logging.INFO)
@@ -18,20 +22,436 @@ DETECT_DING = os.path.join(TOP_DIR, "resources/ding.wav")
 DETECT_DONG = os.path.join(TOP_DIR, "resources/dong.wav")
 
 
+# Whether SnowboyDetect.RunDetection() reads objects with the buffer protocol,
+# such as memoryviews, in place (see swig/Python/snowboy-detect-swig.i).
+_RUN_DETECTION_TAKES_BUFFERS = hasattr(snowboydetect, "snowboy_detect_run_float")
+
+
 class RingBuffer(object):
-    """Ring buffer to hold audio from PortAudio"""
+    """
+    Ring buffer to hold audio from PortAudio, in a preallocated bytearray.
+    When it is full, the oldest bytes are dropped and counted in `num_lost`.
+    """
     def __init__(self, size = 4096):
-        self._buf = collections.deque(maxlen=size)
+        self._buf = bytearray(size)
+        self._out = bytearray(size)
+        self._start = 0
+        self._len = 0
+        self.capacity = size
+        self.num_lost = 0
 
     def extend(self, data):
         """Adds data to the end of buffer"""
-        self._buf.extend(data)
+        size = self.capacity
+        self.num_lost += max(0, self._len + len(data) - size)
+        if len(data) > size:
+            data = data[len(data) - size:]
+        dropped = max(0, self._len + len(data) - size)
+        self._start = (self._start + dropped) % size
+        self._len -= dropped
+        buf = memoryview(self._buf)
+        pos = (self._start + self._len) % size
+        first = min(len(data), size - pos)
+        buf[pos:pos + first] = data[:first]
+        buf[:len(data) - first] = data[first:]
+        self._len += len(data)
+
+    def __len__(self):
+        """Number of bytes in the buffer"""
+        return self._len
 
     def get(self):
-        """Retrieves data from the beginning of buffer and clears it"""
-        tmp = bytes(bytearray(self._buf))
-        self._buf.clear()
-        return tmp
+        """
+        Retrieves data from the beginning of buffer and clears it. The data
+        is copied once into a second preallocated bytearray, and returned as a
+        memoryview of it that remains valid until the next call. Modules built
+        from a snowboy-detect-swig.i without the buffer typemaps (they lack
+        snowboy_detect_run_float) only take bytes, which are returned instead.
+        """
+        buf = memoryview(self._buf)
+        out = memoryview(self._out)
+        first = min(self._len, self.capacity - self._start)
+        out[:first] = buf[self._start:self._start + first]
+        out[first:self._len] = buf[:self._len - first]
+        data = out[:self._len]
+        self._start = 0
+        self._len = 0
+        if not _RUN_DETECTION_TAKES_BUFFERS:
+            return data.tobytes()
+        return data
+
+
+class AdaptiveChunkScheduler(object):
+    """
+    Chooses how much audio to accumulate before the next RunDetection() call.
+    While the detector keeps returning -2 (silence), the chunk grows by
+    `growth_factor` after every `silence_calls_to_grow` silent calls, up to
+    `max_chunk_time`, which cuts the per-call overhead. It drops back to
+    `min_chunk_time` as soon as the detector returns anything else.
+
+    :param float min_chunk_time: chunk duration in seconds when there is sound.
+    :param float max_chunk_time: largest chunk duration in seconds.
+    :param int silence_calls_to_grow: consecutive silent calls before growing.
+    :param float growth_factor: factor applied every time the chunk grows.
+    """
+    def __init__(self, min_chunk_time, max_chunk_time,
+                 silence_calls_to_grow=3, growth_factor=2.0):
+        self.min_chunk_time = min_chunk_time
+        self.max_chunk_time = max(max_chunk_time, min_chunk_time)
+        self.silence_calls_to_grow = silence_calls_to_grow
+        self.growth_factor = max(growth_factor, 1.01)
+        self.chunk_time = min_chunk_time
+        self._num_silent_calls = 0
+        self._num_calls = 0
+        self._num_grown_calls = 0
+        self._audio_time = 0.0
+        self._run_time = 0.0
+        self._min_chunk_audio_time = 0.0
+        self._min_chunk_run_time = 0.0
+
+    def update(self, ans, audio_time, run_time):
+        """Reports the result `ans` of RunDetection() on `audio_time` seconds
+        of audio, which took `run_time` seconds, and updates the chunk size."""
+        self._num_calls += 1
+        self._audio_time += audio_time
+        self._run_time += run_time
+        if self.chunk_time == self.min_chunk_time:
+            self._min_chunk_audio_time += audio_time
+            self._min_chunk_run_time += run_time
+        else:
+            self._num_grown_calls += 1
+
+        if ans != -2:
+            self._num_silent_calls = 0
+            self.chunk_time = self.min_chunk_time
+        else:
+            self._num_silent_calls += 1
+            if self._num_silent_calls >= self.silence_calls_to_grow:
+                self._num_silent_calls = 0
+                self.chunk_time = min(self.max_chunk_time,
+                                      self.chunk_time * self.growth_factor)
+
+    def report(self):
+        """Returns the CPU time saved per hour of audio compared with always
+        using `min_chunk_time`, and the worst-case latency this adds."""
+        message = "Adaptive chunk: %d RunDetection() calls, %d with a " \
+            "grown chunk." % (self._num_calls, self._num_grown_calls)
+        if self._audio_time > 0 and self._min_chunk_audio_time > 0:
+            hours = self._audio_time / 3600
+            fixed_run_time = self._min_chunk_run_time / \
+                self._min_chunk_audio_time * self._audio_time
+            message += " CPU per audio hour: %.2f s adaptive, %.2f s fixed, " \
+                "saving %.2f s per hour, for up to %d ms added worst-case " \
+                "latency." % (self._run_time / hours, fixed_run_time / hours,
+                              (fixed_run_time - self._run_time) / hours,
+                              (self.max_chunk_time - self.min_chunk_time) * 1000)
+        return message
+
+
+class ModelReloader(object):
+    """
+    Rebuilds the detector of a HotwordDetector in the background when one of
+    `filenames` changes, or when request() is called, and hands it over
+    between two RunDetection() calls so that no audio is dropped. The new
+    detector is warmed up with `preroll_time` seconds of the audio in
+    `history`, then caught up with the audio processed meanwhile. The audio
+    is fed in pieces of `chunk_time` seconds, close to what the detection
+    loop passes, since one RunDetection() call reports at most one hotword.
+    The new detector only reaches the state of the old one once it has seen a
+    hotword: if the pre-roll holds none, the first detection after the swap
+    can come a little earlier or later (see examples/C++/model-reloader.h).
+
+    The detection loop reports the audio it has processed through `consumed`
+    and calls swap() before every RunDetection().
+
+    The build and the warm-up only run alongside the audio capture if the
+    snowboydetect module releases the GIL, i.e., if it was generated with
+    `swig -threads` as swig/Python/Makefile does. With a module built without
+    it, they hold the GIL for their whole duration (tens of milliseconds for
+    resources/snowboy.umdl, more with larger models or a longer pre-roll)
+    and the PyAudio callback waits meanwhile; `frames_per_buffer` and the
+    ring buffer must be large enough to absorb that.
+
+    :param build_detector: function returning a new, configured detector.
+    :param filenames: files whose modification time is polled.
+    :param history: the AudioHistory the detection loop reads from.
+    :param lock: the lock protecting `history`.
+    :param int bytes_per_second: audio bytes per second.
+    :param int bytes_per_frame: audio bytes per frame.
+    :param float preroll_time: seconds of audio fed to a new detector.
+    :param float chunk_time: seconds of audio per RunDetection() call while
+                             warming up a new detector.
+    :param float poll_time: seconds between two checks of the files.
+    :param float debounce_time: seconds the files must stay unchanged before
+                                they are loaded.
+    """
+    def __init__(self, build_detector, filenames, history, lock,
+                 bytes_per_second, bytes_per_frame, preroll_time=3,
+                 poll_time=1, debounce_time=0.3, chunk_time=0.03):
+        self._build_detector = build_detector
+        self._filenames = filenames
+        self._history = history
+        self._lock = lock
+        self._bytes_per_second = bytes_per_second
+        self._preroll_bytes = \
+            int(preroll_time * bytes_per_second) // bytes_per_frame * \
+            bytes_per_frame
+        self._chunk_bytes = max(
+            bytes_per_frame,
+            int(chunk_time * bytes_per_second) // bytes_per_frame *
+            bytes_per_frame)
+        # Audio left for the detection loop to feed at swap time.
+        self._catch_up_bytes = bytes_per_second // 20
+        self._poll_time = poll_time
+        self._debounce_time = debounce_time
+        self._requested = threading.Event()
+        self._stopped = False
+        # (detector, position it has processed up to, change time)
+        self._replacement = None
+        self.consumed = 0
+        self.num_reloads = 0
+        self.num_failed = 0
+        self._thread = threading.Thread(target=self._watch)
+        self._thread.daemon = True
+        self._thread.start()
+
+    def request(self):
+        """Reloads the models even if the files did not change"""
+        self._requested.set()
+
+    def stop(self):
+        self._stopped = True
+        self._requested.set()
+        self._thread.join()
+
+    def swap(self, detector):
+        """
+        Returns the detector to run the next chunk on: `detector`, or its
+        warmed-up replacement once one is ready. Call it from the detection
+        loop, with `consumed` up to date.
+        """
+        replacement = self._replacement
+        if replacement is None:
+            return detector
+        self._replacement = None
+        new_detector, position, changed_at = replacement
+        start_time = time.time()
+        num_bytes = self._feed(new_detector, position, self.consumed)
+        self.num_reloads += 1
+        logger.info("Switched to the reloaded models: %.1f ms on the "
+                    "detection loop to catch up %d ms of audio, %.0f ms "
+                    "after the change." % (
+                        (time.time() - start_time) * 1000,
+                        num_bytes * 1000 // self._bytes_per_second,
+                        (time.time() - changed_at) * 1000))
+        return new_detector
+
+    def _mtimes(self):
+        mtimes = []
+        for filename in self._filenames:
+            try:
+                mtimes.append(os.path.getmtime(filename))
+            except OSError:
+                mtimes.append(None)
+        return mtimes
+
+    def _read(self, start, end):
+        with self._lock:
+            return b''.join(v.tobytes()
+                            for v in self._history.view(start, end))
+
+    def _feed(self, detector, start, end):
+        """Runs `detector` on the history from `start` to `end`, in pieces of
+        `chunk_time`, and returns the number of bytes fed."""
+        data = self._read(start, end)
+        for offset in range(0, len(data), self._chunk_bytes):
+            detector.RunDetection(data[offset:offset + self._chunk_bytes])
+        return len(data)
+
+    def _watch(self):
+        mtimes = self._mtimes()
+        while True:
+            self._requested.wait(self._poll_time)
+            if self._stopped:
+                return
+            requested = self._requested.is_set()
+            current = self._mtimes()
+            if not requested and current == mtimes:
+                continue
+            # Waits until the files stop changing, since they are often
+            # written in several steps.
+            changed_at = time.time()
+            while True:
+                time.sleep(self._debounce_time)
+                latest = self._mtimes()
+                if latest == current:
+                    break
+                current = latest
+            self._requested.clear()
+            mtimes = current
+            self._reload(changed_at)
+
+    def _reload(self, changed_at):
+        # The library aborts on files it cannot read.
+        for filename in self._filenames:
+            if not os.access(filename, os.R_OK):
+                logger.warning("Cannot read %s, keeping the current models."
+                               % filename)
+                self.num_failed += 1
+                return
+        start_time = time.time()
+        try:
+            detector = self._build_detector()
+        except Exception as e:
+            logger.warning("Fail to reload the models: %s" % e)
+            self.num_failed += 1
+            return
+        position = self.consumed
+        self._feed(detector, max(0, position - self._preroll_bytes), position)
+        while self.consumed - position > self._catch_up_bytes:
+            end = self.consumed
+            self._feed(detector, position, end)
+            position = end
+        logger.debug("Reloaded models in %.1f ms."
+                     % ((time.time() - start_time) * 1000))
+        self._replacement = (detector, position, changed_at)
+
+
+class DetectorMetrics(object):
+    """
+    Counters and gauges of a HotwordDetector, in the Prometheus text format,
+    with the same names as examples/C++/detector-metrics.h. Every thread that
+    records counts into its own shard, so recording never takes a lock.
+    Gauges are functions evaluated when the metrics are formatted; they must
+    not block the audio thread.
+
+    :param int num_hotwords: number of hotwords of the detector.
+    """
+    def __init__(self, num_hotwords):
+        self._num_results = num_hotwords + 3
+        self._local = threading.local()
+        self._shards = []
+        self._shards_lock = threading.Lock()
+        self._gauges = []
+
+    def _shard(self):
+        shard = getattr(self._local, "shard", None)
+        if shard is None:
+            shard = {"results": [0] * self._num_results, "seconds": 0.0,
+                     "samples": 0}
+            self._local.shard = shard
+            with self._shards_lock:
+                self._shards.append(shard)
+        return shard
+
+    def record_detection(self, ans, num_samples, seconds):
+        """Counts one RunDetection() call on `num_samples` samples, which
+        returned `ans` in `seconds`."""
+        shard = self._shard()
+        index = max(0, min(ans + 2, self._num_results - 1))
+        shard["results"][index] += 1
+        shard["samples"] += num_samples
+        shard["seconds"] += seconds
+
+    def add_gauge(self, name, metric_type, help_text, function):
+        """Exports the value returned by `function` at every scrape"""
+        self._gauges.append((name, metric_type, help_text, function))
+
+    def format(self):
+        """Returns all metrics in the Prometheus text exposition format"""
+        with self._shards_lock:
+            shards = list(self._shards)
+        results = [sum(s["results"][i] for s in shards)
+                   for i in range(self._num_results)]
+        lines = ["# HELP snowboy_run_detection_calls_total RunDetection() "
+                 "calls by result: -2 silence, -1 error, 0 sound, N hotword "
+                 "N.",
+                 "# TYPE snowboy_run_detection_calls_total counter"]
+        for i, count in enumerate(results):
+            lines.append('snowboy_run_detection_calls_total{result="%d"} %d'
+                         % (i - 2, count))
+        metrics = [("snowboy_detection_seconds_total", "counter",
+                    "Wall time spent in RunDetection().",
+                    sum(s["seconds"] for s in shards)),
+                   ("snowboy_processed_samples_total", "counter",
+                    "Samples passed to RunDetection().",
+                    sum(s["samples"] for s in shards))]
+        for name, metric_type, help_text, function in self._gauges:
+            try:
+                value = function()
+            except Exception:
+                continue
+            metrics.append((name, metric_type, help_text, value))
+        for name, metric_type, help_text, value in metrics:
+            lines.append("# HELP %s %s" % (name, help_text))
+            lines.append("# TYPE %s %s" % (name, metric_type))
+            lines.append("%s %s" % (name, repr(value)))
+        return "\n".join(lines) + "\n"
+
+
+class MetricsServer(object):
+    """
+    Serves DetectorMetrics on the Unix socket `path` from its own thread. An
+    HTTP GET request gets an HTTP response, e.g., from
+    `curl --unix-socket <path> http://localhost/metrics`; a client that sends
+    nothing for a second gets the bare text.
+    """
+    def __init__(self, metrics, path):
+        self._metrics = metrics
+        self._path = path
+        if os.path.exists(path):
+            os.unlink(path)
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.bind(path)
+        self._socket.listen(5)
+        self._stopped = False
+        self._thread = threading.Thread(target=self._serve)
+        self._thread.daemon = True
+        self._thread.start()
+
+    def _serve(self):
+        while not self._stopped:
+            try:
+                client, _ = self._socket.accept()
+            except socket.error:
+                return
+            try:
+                self._respond(client)
+            except socket.error:
+                pass
+            finally:
+                client.close()
+
+    def _respond(self, client):
+        client.settimeout(1)
+        request = b""
+        try:
+            while b"\r\n\r\n" not in request and len(request) < 8192:
+                data = client.recv(1024)
+                if not data:
+                    break
+                request += data
+        except socket.timeout:
+            pass
+        body = self._metrics.format().encode()
+        if request.startswith(b"GET "):
+            body = ("HTTP/1.0 200 OK\r\n"
+                    "Content-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: %d\r\n"
+                    "Connection: close\r\n\r\n" % len(body)).encode() + body
+        client.sendall(body)
+
+    def stop(self):
+        self._stopped = True
+        # Wakes up accept().
+        try:
+            self._socket.shutdown(socket.SHUT_RDWR)
+        except socket.error:
+            pass
+        self._socket.close()
+        self._thread.join()
+        if os.path.exists(self._path):
+            os.unlink(self._path)
 
 
 def play_audio_file(fname=DETECT_DING):
@@ -68,14 +488,31 @@ class HotwordDetector(object):
                               decoder. If an empty list is provided, then the
                               default sensitivity in the model will be used.
     :param audio_gain: multiply input volume by this factor.
+    :param history_time: seconds of recent audio kept for open_utterance().
+    :param watch_models: if True, the models are reloaded without stopping
+                         the detection when the model or resource files
+                         change. See ModelReloader.
+    :param reload_preroll_time: seconds of audio a reloaded detector is
+                                warmed up with.
+    :param metrics_socket: if set, path of a Unix socket on which the
+                           detection and capture counters are served in the
+                           Prometheus text format. See DetectorMetrics.
     """
     def __init__(self, decoder_model,
                  resource=RESOURCE_FILE,
                  sensitivity=[],
-                 audio_gain=1):
+                 audio_gain=1,
+                 history_time=5,
+                 watch_models=False,
+                 reload_preroll_time=3,
+                 metrics_socket=None):
 
         def audio_callback(in_data, frame_count, time_info, status):
-            self.ring_buffer.extend(in_data)
+            with self._lock:
+                self.history.extend(in_data)
+                self.ring_buffer.extend(in_data)
+                self._utterances = [u for u in self._utterances
+                                    if u.feed(in_data)]
             play_data = chr(0) * len(in_data)
             return play_data, pyaudio.paContinue
 
@@ -87,9 +524,11 @@ class HotwordDetector(object):
             sensitivity = [sensitivity]
         model_str = ",".join(decoder_model)
 
-        self.detector = snowboydetect.SnowboyDetect(
-            resource_filename=resource.encode(), model_str=model_str.encode())
-        self.detector.SetAudioGain(audio_gain)
+        self._resource = resource
+        self._model_str = model_str
+        self._audio_gain = audio_gain
+        self._sensitivity_str = ""
+        self.detector = self._build_detector()
         self.num_hotwords = self.detector.NumHotwords()
 
         if len(decoder_model) > 1 and len(sensitivity) == 1:
@@ -98,12 +537,31 @@ class HotwordDetector(object):
             assert self.num_hotwords == len(sensitivity), \
                 "number of hotwords in decoder_model (%d) and sensitivity " \
                 "(%d) does not match" % (self.num_hotwords, len(sensitivity))
-        sensitivity_str = ",".join([str(t) for t in sensitivity])
+        self._sensitivity_str = ",".join([str(t) for t in sensitivity])
         if len(sensitivity) != 0:
-            self.detector.SetSensitivity(sensitivity_str.encode())
+            self.detector.SetSensitivity(self._sensitivity_str.encode())
 
         self.ring_buffer = RingBuffer(
             self.detector.NumChannels() * self.detector.SampleRate() * 5)
+        self._bytes_per_frame = \
+            self.detector.NumChannels() * self.detector.BitsPerSample() / 8
+        self._bytes_per_second = \
+            self.detector.SampleRate() * self._bytes_per_frame
+        if watch_models:
+            # The pre-roll and the audio processed while the new detector
+            # warms up must still be in the history.
+            history_time = max(history_time, reload_preroll_time + 2)
+        self.history = AudioHistory(
+            int(self._bytes_per_second * history_time))
+        self.trigger_position = 0
+        self._utterances = []
+        self._lock = threading.Lock()
+        self.reloader = None
+        if watch_models:
+            self.reloader = ModelReloader(
+                self._build_detector, [resource] + decoder_model,
+                self.history, self._lock, self._bytes_per_second,
+                self._bytes_per_frame, reload_preroll_time)
         self.audio = pyaudio.PyAudio()
         self.stream_in = self.audio.open(
             input=True, output=False,
@@ -114,10 +572,54 @@ class HotwordDetector(object):
             frames_per_buffer=2048,
             stream_callback=audio_callback)
 
+        self.metrics = DetectorMetrics(self.num_hotwords)
+        self.metrics_server = None
+        if metrics_socket is not None:
+            # Read without the lock, so that a scrape never delays the audio
+            # callback.
+            bytes_per_sample = self.detector.BitsPerSample() / 8
+            self.metrics.add_gauge(
+                "snowboy_ring_buffer_fill_samples", "gauge",
+                "Captured samples waiting for the detector.",
+                lambda: len(self.ring_buffer) / bytes_per_sample)
+            self.metrics.add_gauge(
+                "snowboy_ring_buffer_capacity_samples", "gauge",
+                "Capacity of the capture ring buffer.",
+                lambda: self.ring_buffer.capacity / bytes_per_sample)
+            self.metrics.add_gauge(
+                "snowboy_lost_samples_total", "counter",
+                "Captured samples dropped because the ring buffer was full.",
+                lambda: self.ring_buffer.num_lost / bytes_per_sample)
+            self.metrics.add_gauge(
+                "snowboy_portaudio_cpu_load", "gauge",
+                "PortAudio stream CPU load, from 0 to 1.",
+                self.stream_in.get_cpu_load)
+            self.metrics_server = MetricsServer(self.metrics, metrics_socket)
+
+    def _build_detector(self):
+        detector = snowboydetect.SnowboyDetect(
+            resource_filename=self._resource.encode(),
+            model_str=self._model_str.encode())
+        detector.SetAudioGain(self._audio_gain)
+        if len(self._sensitivity_str) != 0:
+            detector.SetSensitivity(self._sensitivity_str.encode())
+        return detector
+
+    def reload(self):
+        """
+        Reloads the model files in the background; the detection switches to
+        the new models without dropping audio. Requires `watch_models`.
+        :return: None
+        """
+        assert self.reloader is not None, \
+            "reload() requires watch_models=True"
+        self.reloader.request()
 
     def start(self, detected_callback=play_audio_file,
               interrupt_check=lambda: False,
-              sleep_time=0.03):
+              sleep_time=0.03,
+              max_chunk_time=0,
+              silence_calls_to_grow=3):
         """
         Start the voice detector. For every `sleep_time` second it checks the
         audio buffer for triggering keywords. If detected, then call
@@ -132,6 +634,14 @@ class HotwordDetector(object):
         :param interrupt_check: a function that returns True if the main loop
                                 needs to stop.
         :param float sleep_time: how much time in second every loop waits.
+        :param float max_chunk_time: if larger than `sleep_time`, the audio
+                                     passed to each RunDetection() call grows
+                                     up to this many seconds while the
+                                     detector reports silence, and drops back
+                                     to `sleep_time` on sound. See
+                                     AdaptiveChunkScheduler.
+        :param int silence_calls_to_grow: number of silent calls in a row
+                                          before the chunk grows.
         :return: None
         """
 	print "In start"
@@ -150,6 +660,13 @@ class HotwordDetector(object):
             "Error: hotwords in your models (%d) do not match the number of " \
             "callbacks (%d)" % (self.num_hotwords, len(detected_callback))
 
+        scheduler = None
+        if max_chunk_time > sleep_time:
+            scheduler = AdaptiveChunkScheduler(
+                sleep_time, max_chunk_time, silence_calls_to_grow)
+        bytes_per_second = self.detector.SampleRate() * \
+            self.detector.NumChannels() * self.detector.BitsPerSample() / 8
+
         logger.debug("detecting...")
 
         while True:
@@ -157,15 +674,35 @@ class HotwordDetector(object):
 		print "detect voice break"
                 logger.debug("detect voice break")
                 break
-            data = self.ring_buffer.get()
+            if scheduler is not None and len(self.ring_buffer) < \
+                    scheduler.chunk_time * bytes_per_second:
+                time.sleep(sleep_time)
+                continue
+            with self._lock:
+                data = self.ring_buffer.get()
+                position = self.history.total
             if len(data) == 0:
                 time.sleep(sleep_time)
                 continue
 
+            start_time = time.time()
+            if self.reloader is not None:
+                self.detector = self.reloader.swap(self.detector)
             ans = self.detector.RunDetection(data)
+            if self.reloader is not None:
+                self.reloader.consumed = position
+            run_time = time.time() - start_time
+            if scheduler is not None:
+                scheduler.update(ans, float(len(data)) / bytes_per_second,
+                                 run_time)
+            if self.metrics_server is not None:
+                self.metrics.record_detection(
+                    ans, len(data) * 8 / self.detector.BitsPerSample(),
+                    run_time)
             if ans == -1:
                 logger.warning("Error initializing streams or reading audio data")
             elif ans > 0:
+                self.trigger_position = position
                 message = "Keyword " + str(ans) + " detected at time: "
                 message += time.strftime("%Y-%m-%d %H:%M:%S",
                                          time.localtime(time.time()))
@@ -175,8 +712,40 @@ class HotwordDetector(object):
                     callback()
 	print 'OO finished!'
 
+        if scheduler is not None:
+            logger.info(scheduler.report())
         logger.debug("finished.")
 
+    def open_utterance(self, seconds=4, pre_roll=0.3):
+        """
+        Returns an UtteranceStream with the audio from `pre_roll` seconds
+        before the point where the last hotword was detected, up to `seconds`
+        after it. Call it from `detected_callback` to hand the command that
+        follows the hotword to a speech recognizer, without opening the
+        microphone again.
+
+        :param float seconds: duration of the utterance after the hotword.
+        :param float pre_roll: seconds of audio before the detection point.
+        :return: an UtteranceStream.
+        """
+        def to_bytes(t):
+            return int(t * self._bytes_per_second) // \
+                self._bytes_per_frame * self._bytes_per_frame
+
+        with self._lock:
+            # The pre-roll may reach back further than the history.
+            start = max(self.history.first,
+                        self.trigger_position - to_bytes(pre_roll))
+            stream = UtteranceStream(
+                start, self.trigger_position + to_bytes(seconds),
+                timeout=max(2, seconds))
+            complete = False
+            for view in self.history.view(start):
+                complete = not stream.feed(view)
+            if not complete:
+                self._utterances.append(stream)
+        return stream
+
     def terminate(self):
         """
         Terminate audio stream. Users cannot call start() again to detect.
@@ -185,3 +754,11 @@ class HotwordDetector(object):
         self.stream_in.stop_stream()
         self.stream_in.close()
         self.audio.terminate()
+        if self.reloader is not None:
+            self.reloader.stop()
+        if self.metrics_server is not None:
+            self.metrics_server.stop()
+        with self._lock:
+            for utterance in self._utterances:
+                utterance.close()
+            self._utterances = []
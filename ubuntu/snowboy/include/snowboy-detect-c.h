@@ -0,0 +1,124 @@
+// include/snowboy-detect-c.h
+
+#ifndef SNOWBOY_INCLUDE_SNOWBOY_DETECT_C_H_
+#define SNOWBOY_INCLUDE_SNOWBOY_DETECT_C_H_
+
+// Plain C interface to snowboy::SnowboyDetect, for bindings that go through a
+// foreign function interface (ctypes, cgo, JNI, N-API, ...) rather than C++.
+//
+// The detector is an opaque handle. Functions never throw: exceptions from
+// the C++ library are caught and turned into SNOWBOY_ERROR_EXCEPTION, with
+// the message available from snowboy_detect_last_error(). Audio is read in
+// place from the caller's buffer and never copied or retained after the call
+// returns.
+//
+// The snowboy_detect_run_*() functions return the result of
+// SnowboyDetect::RunDetection(): -2 for silence, -1 for an error in the
+// detector, 0 for sound and the index of the hotword (1, 2, ...) otherwise.
+// Errors of the C interface itself are the SNOWBOY_ERROR_* values below, all
+// smaller than -2, so that bindings can tell them apart. Example:
+//
+//   snowboy_detect_t* detector = NULL;
+//   if (snowboy_detect_create("resources/common.res",
+//                             "resources/snowboy.umdl", &detector) !=
+//       SNOWBOY_OK) { ... }
+//   snowboy_detect_set_sensitivity(detector, "0.5");
+//   int result = snowboy_detect_run_int16(detector, data, num_samples, 0);
+//   snowboy_detect_destroy(detector);
+//
+// A handle may be used by one thread at a time.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Opaque detector handle.
+typedef struct snowboy_detect snowboy_detect_t;
+
+// Status codes.
+enum {
+  SNOWBOY_OK = 0,
+  // A NULL handle or pointer.
+  SNOWBOY_ERROR_INVALID_ARGUMENT = -100,
+  // The C++ library threw; see snowboy_detect_last_error().
+  SNOWBOY_ERROR_EXCEPTION = -101,
+  // snowboy_detect_get_sensitivity(): <size> is too small.
+  SNOWBOY_ERROR_BUFFER_TOO_SMALL = -102,
+  // snowboy_detect_create(): the resource or a model file cannot be read.
+  SNOWBOY_ERROR_CANNOT_OPEN_FILE = -103
+};
+
+// Version of this interface, incremented on incompatible changes.
+#define SNOWBOY_DETECT_C_API_VERSION 1
+
+int snowboy_detect_api_version(void);
+
+// Constructs a detector from the resource file and a comma separated list of
+// models, as snowboy::SnowboyDetect does. On success, stores the handle in
+// <*detector>. On failure, stores NULL, and, if <error> is not NULL, copies
+// the NUL-terminated message into <error> (truncated to <error_size>).
+int snowboy_detect_create_with_error(const char* resource_filename,
+                                     const char* model_str,
+                                     snowboy_detect_t** detector,
+                                     char* error, size_t error_size);
+
+// Same as snowboy_detect_create_with_error() without the message.
+int snowboy_detect_create(const char* resource_filename,
+                          const char* model_str,
+                          snowboy_detect_t** detector);
+
+// Destroys the detector. NULL is ignored.
+void snowboy_detect_destroy(snowboy_detect_t* detector);
+
+// Message of the last SNOWBOY_ERROR_EXCEPTION returned for <detector>, or an
+// empty string. Valid until the next call on the handle.
+const char* snowboy_detect_last_error(const snowboy_detect_t* detector);
+
+// Runs detection on <num_samples> samples of <data>, in the format given by
+// snowboy_detect_sample_rate(), snowboy_detect_num_channels() (interleaved)
+// and snowboy_detect_bits_per_sample(). Float samples are on the int16
+// scale. Set <is_end> to non-zero on the last chunk of a stream. Arrays of
+// more than INT_MAX samples are fed in several calls, and the first hotword
+// found is returned.
+int snowboy_detect_run_int16(snowboy_detect_t* detector, const int16_t* data,
+                             size_t num_samples, int is_end);
+int snowboy_detect_run_float(snowboy_detect_t* detector, const float* data,
+                             size_t num_samples, int is_end);
+int snowboy_detect_run_int32(snowboy_detect_t* detector, const int32_t* data,
+                             size_t num_samples, int is_end);
+
+// Returns SNOWBOY_OK, or -1 if the detector could not be reset.
+int snowboy_detect_reset(snowboy_detect_t* detector);
+
+int snowboy_detect_set_sensitivity(snowboy_detect_t* detector,
+                                   const char* sensitivity_str);
+
+// Copies the NUL-terminated sensitivity string into the caller's <buffer>.
+// If <required_size> is not NULL, it receives the size needed, including the
+// NUL, also when SNOWBOY_ERROR_BUFFER_TOO_SMALL is returned.
+int snowboy_detect_get_sensitivity(const snowboy_detect_t* detector,
+                                   char* buffer, size_t size,
+                                   size_t* required_size);
+
+int snowboy_detect_set_audio_gain(snowboy_detect_t* detector,
+                                  float audio_gain);
+
+int snowboy_detect_update_model(const snowboy_detect_t* detector);
+
+int snowboy_detect_apply_frontend(snowboy_detect_t* detector,
+                                  int apply_frontend);
+
+// The following return the value, or a SNOWBOY_ERROR_* code.
+int snowboy_detect_num_hotwords(const snowboy_detect_t* detector);
+int snowboy_detect_sample_rate(const snowboy_detect_t* detector);
+int snowboy_detect_num_channels(const snowboy_detect_t* detector);
+int snowboy_detect_bits_per_sample(const snowboy_detect_t* detector);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // SNOWBOY_INCLUDE_SNOWBOY_DETECT_C_H_
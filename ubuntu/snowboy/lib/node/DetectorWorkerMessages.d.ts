@@ -0,0 +1,26 @@
+// Messages between DetectorPool (index.ts) and detector-worker.ts. Every
+// message names the stream it is about; the worker handles them in the order
+// they were posted, and replies to 'open' (on failure only) and to 'run'.
+interface DetectorWorkerRequest {
+  type: 'open' | 'run' | 'reset' | 'close';
+  id: number;
+  // 'open'
+  resource?: string;
+  models?: string;
+  sensitivity?: string;
+  numHotwords?: number;
+  audioGain?: number;
+  // 'run': the samples, transferred to the worker.
+  data?: ArrayBuffer;
+  format?: 'int16' | 'float32';
+  isEnd?: boolean;
+}
+
+interface DetectorWorkerReply {
+  type: 'open' | 'run';
+  id: number;
+  // Result of a successful 'run'.
+  index?: number;
+  // Message of the error thrown by an 'open' or a 'run'.
+  error?: string;
+}
@@ -1,7 +1,11 @@
 interface SnowboyDetectNativeInterface {
   new (resource: string, models: string): SnowboyDetectNativeInterface;
   Reset(): boolean;
-  RunDetection(audioData: Buffer): number;
+  RunDetection(audioData: Buffer | Int16Array | Float32Array | ArrayBuffer,
+               isEnd?: boolean): number;
+  RunDetectionAsync(audioData: Buffer | Int16Array | Float32Array | ArrayBuffer,
+                    isEnd: boolean,
+                    callback: (error: Error, index?: number) => void): void;
   SetSensitivity(sensitivity: string): void;
   GetSensitivity(): string;
   SetAudioGain(audioGain: number): void;
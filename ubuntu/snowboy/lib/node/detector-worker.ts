@@ -0,0 +1,64 @@
+import * as path from 'path';
+import * as binary from 'node-pre-gyp';
+
+// Worker thread of DetectorPool (index.ts). Owns the native detectors of the
+// streams assigned to it, and runs their detection synchronously: the thread
+// has nothing else to do, and the requests of each stream arrive in order.
+const parentPort = require('worker_threads').parentPort;
+const bindingPath: string = binary.find(path.resolve(path.join(__dirname, '../../package.json')));
+const SnowboyDetectNative: SnowboyDetectNativeInterface = require(bindingPath).SnowboyDetect;
+
+const detectors: {[id: number]: SnowboyDetectNativeInterface} = {};
+
+function open(request: DetectorWorkerRequest): void {
+  const detector = new SnowboyDetectNative(request.resource, request.models);
+  if (detector.NumHotwords() !== request.numHotwords) {
+    throw new Error('Loaded hotwords count does not match number of hotwords defined.');
+  }
+  detector.SetSensitivity(request.sensitivity);
+  if (request.audioGain) {
+    detector.SetAudioGain(request.audioGain);
+  }
+  detectors[request.id] = detector;
+}
+
+function lookup(id: number): SnowboyDetectNativeInterface {
+  const detector = detectors[id];
+  if (!detector) {
+    throw new Error('Detector is not open.');
+  }
+  return detector;
+}
+
+parentPort.on('message', (request: DetectorWorkerRequest) => {
+  try {
+    switch (request.type) {
+      case 'open':
+        open(request);
+        break;
+
+      case 'run':
+        const data = request.format === 'float32' ?
+          new Float32Array(request.data) : new Int16Array(request.data);
+        const reply: DetectorWorkerReply = {
+          type: 'run', id: request.id, index: lookup(request.id).RunDetection(data, request.isEnd)
+        };
+        parentPort.postMessage(reply);
+        break;
+
+      case 'reset':
+        lookup(request.id).Reset();
+        break;
+
+      case 'close':
+        // The native detector is freed when it is garbage collected.
+        delete detectors[request.id];
+        break;
+    }
+  } catch (error) {
+    if (request.type === 'open' || request.type === 'run') {
+      const reply: DetectorWorkerReply = {type: request.type, id: request.id, error: error.message};
+      parentPort.postMessage(reply);
+    }
+  }
+});
@@ -1,6 +1,7 @@
 import * as stream from 'stream';
 import * as path from 'path';
 import * as fs from 'fs';
+import * as os from 'os';
 import * as binary from 'node-pre-gyp';
 
 const bindingPath: string = binary.find(path.resolve(path.join(__dirname, '../../package.json')));
@@ -33,11 +34,24 @@ interface DetectorOptions {
   resource: string;
   models: HotwordModels;
   audioGain?: number;
+  // Duration in milliseconds of the audio the stream runs the detection on at
+  // once; written chunks are coalesced up to it. Defaults to 100.
+  chunkDuration?: number;
 }
 
+interface DetectorPoolOptions extends DetectorOptions {
+  // Number of worker threads; defaults to the number of CPUs.
+  threads?: number;
+}
+
+// Int16 samples, or float samples on the int16 scale. Buffers and typed
+// arrays are read in place by the native code.
+type AudioData = Buffer | Int16Array | Float32Array;
+
 interface SnowboyDetectInterface {
   reset(): boolean;
-  runDetection(buffer: Buffer): number;
+  runDetection(buffer: AudioData, isEnd?: boolean): number;
+  runDetectionAsync(buffer: AudioData, isEnd?: boolean): Promise<number>;
   setSensitivity(sensitivity: string): void;
   getSensitivity(): string;
   setAudioGain(gain: number): void;
@@ -97,14 +111,102 @@ export class HotwordModels implements HotwordModels {
   }
 }
 
-export class SnowboyDetect extends stream.Writable implements SnowboyDetectInterface {
+const DEFAULT_CHUNK_DURATION = 100;
+
+// Snowboy models take 16 kHz mono audio.
+const SAMPLES_PER_SECOND = 16000;
+
+// Writable of int16 samples that coalesces the written chunks, whatever their
+// size, into a preallocated block of the chunk duration, and runs the
+// detection once per block, through runBlock(). The last block is run with
+// isEnd set when the stream ends. A write is acknowledged once the blocks it
+// completed are processed.
+//
+// The events carry the position of the block in the stream, as the offsets in
+// samples of its first sample and of the sample after its last:
+//   'silence' (start, end), 'sound' (start, end),
+//   'hotword' (index, hotword, start, end).
+abstract class CoalescingDetector extends stream.Writable {
+  protected models: HotwordModels;
+  private block: Buffer;
+  // Bytes of <block> filled so far.
+  private blockBytes = 0;
+  // Offset in samples of the first sample of <block>.
+  private blockOffset = 0;
+
+  constructor(models: HotwordModels, chunkDuration?: number) {
+    super();
+    this.models = models;
+    const samples = Math.max(1, Math.round(
+        SAMPLES_PER_SECOND * (chunkDuration || DEFAULT_CHUNK_DURATION) / 1000));
+    this.block = Buffer.alloc(samples * 2);
+  }
+
+  // Number of samples written to the stream so far.
+  get samplesWritten(): number {
+    return this.blockOffset + Math.floor(this.blockBytes / 2);
+  }
+
+  // Runs the detection on <block>, which is not modified until the returned
+  // promise settles.
+  protected abstract runBlock(block: Buffer, isEnd: boolean): Promise<number>;
+
+  _write(chunk: Buffer, encoding: string, callback: Function) {
+    this.append([chunk], callback);
+  }
+
+  _writev(chunks: Array<{chunk: Buffer, encoding: string}>, callback: Function) {
+    this.append(chunks.map((entry) => entry.chunk), callback);
+  }
+
+  _final(callback: Function) {
+    // A trailing odd byte is not a sample and is dropped.
+    this.blockBytes -= this.blockBytes % 2;
+    this.flush(true).then(() => callback(), (error) => callback(error));
+  }
+
+  // Copies <chunks> into the block, running the detection each time it is
+  // full.
+  private append(chunks: Array<Buffer>, callback: Function): void {
+    let chunkIndex = 0;
+    let chunkOffset = 0;
+    const next = (): void => {
+      while (chunkIndex < chunks.length) {
+        const chunk = chunks[chunkIndex];
+        const copied = chunk.copy(this.block, this.blockBytes, chunkOffset);
+        this.blockBytes += copied;
+        chunkOffset += copied;
+        if (chunkOffset === chunk.length) {
+          chunkIndex++;
+          chunkOffset = 0;
+        }
+        if (this.blockBytes === this.block.length) {
+          this.flush(false).then(next, (error) => callback(error));
+          return;
+        }
+      }
+      callback();
+    };
+    next();
+  }
+
+  private flush(isEnd: boolean): Promise<void> {
+    const start = this.blockOffset;
+    const end = start + this.blockBytes / 2;
+    return this.runBlock(this.block.slice(0, this.blockBytes), isEnd).then((index) => {
+      this.blockBytes = 0;
+      this.blockOffset = end;
+      emitDetectionResult(this, this.models, index, start, end);
+    });
+  }
+}
+
+export class SnowboyDetect extends CoalescingDetector implements SnowboyDetectInterface {
   nativeInstance: SnowboyDetectNativeInterface;
-  private models: HotwordModels;
 
   constructor(options: DetectorOptions) {
-    super();
+    super(options.models, options.chunkDuration);
 
-    this.models = options.models;
     this.nativeInstance = new SnowboyDetectNative(options.resource, options.models.modelString);
 
     if (this.nativeInstance.NumHotwords() !== options.models.numHotwords()) {
@@ -122,12 +224,22 @@ export class SnowboyDetect extends stream.Writable implements SnowboyDetectInter
     return this.nativeInstance.Reset();
   }
 
-  runDetection(buffer: Buffer): number {
-    const index = this.nativeInstance.RunDetection(buffer);
+  runDetection(buffer: AudioData, isEnd?: boolean): number {
+    const index = this.nativeInstance.RunDetection(buffer, !!isEnd);
     this.processDetectionResult(index);
     return index;
   }
 
+  // Runs the detection on the libuv threadpool instead of the event loop.
+  // Calls on one detector complete in order; the buffer must not be modified
+  // until the returned promise settles.
+  runDetectionAsync(buffer: AudioData, isEnd?: boolean): Promise<number> {
+    return this.runNative(buffer, !!isEnd).then((index) => {
+      this.processDetectionResult(index);
+      return index;
+    });
+  }
+
   setSensitivity(sensitivity: string): void {
     this.nativeInstance.SetSensitivity(sensitivity);
   }
@@ -160,34 +272,283 @@ export class SnowboyDetect extends stream.Writable implements SnowboyDetectInter
     return this.nativeInstance.BitsPerSample();
   }
 
-  // Stream implementation
-  _write(chunk: Buffer, encoding: string, callback: Function) {
-    const index = this.nativeInstance.RunDetection(chunk);
-    this.processDetectionResult(index);
-    return callback();
+  // Stream implementation. The detection runs on the threadpool, so
+  // backpressure follows the detection rather than the event loop.
+  protected runBlock(block: Buffer, isEnd: boolean): Promise<number> {
+    return this.runNative(block, isEnd);
+  }
+
+  private runNative(buffer: AudioData, isEnd: boolean): Promise<number> {
+    return new Promise<number>((resolve, reject) => {
+      this.nativeInstance.RunDetectionAsync(buffer, isEnd, (error, index) => {
+        if (error) {
+          reject(error);
+          return;
+        }
+        resolve(index);
+      });
+    });
   }
 
   private processDetectionResult(index: number): void {
-    switch (index) {
-      case DetectionResult.ERROR:
-        this.emit('error');
-        break;
+    emitDetectionResult(this, this.models, index);
+  }
+}
+
+// Emits the event of <index>. The stream offsets <start> and <end> of the
+// audio are passed on when known.
+function emitDetectionResult(detector: stream.Writable, models: HotwordModels, index: number,
+                             start?: number, end?: number): void {
+  switch (index) {
+    case DetectionResult.ERROR:
+      detector.emit('error');
+      break;
+
+    case DetectionResult.SILENCE:
+      detector.emit('silence', start, end);
+      break;
+
+    case DetectionResult.SOUND:
+      detector.emit('sound', start, end);
+      break;
+
+    default:
+      const hotword = models.lookup(index);
+      detector.emit('hotword', index, hotword, start, end);
+      break;
+  }
+}
+
+interface PoolWorker {
+  thread: any;
+  // Streams assigned to the thread.
+  numStreams: number;
+  // 'run' requests waiting for a reply. The thread only keeps the process
+  // alive while there are some.
+  numPending: number;
+  // Set once the thread has failed or exited.
+  dead: boolean;
+}
+
+interface PendingRun {
+  resolve: (index: number) => void;
+  reject: (error: Error) => void;
+}
+
+// Runs the detection of many streams on a pool of worker threads, so that the
+// throughput grows with the number of cores. Every detector created by
+// createDetector() lives in one thread, the one with the fewest streams at
+// the time, and its chunks are processed there in order.
+//
+// A thread that fails or exits fails its detectors and is replaced.
+//
+// Worker threads need Node 10.5 or later (with --experimental-worker before
+// Node 11.7); SnowboyDetect works on any version.
+export class DetectorPool {
+  private options: DetectorPoolOptions;
+  private workers: Array<PoolWorker> = [];
+  private detectors: {[id: number]: PooledDetector} = {};
+  private nextId = 0;
+  private closed = false;
+
+  constructor(options: DetectorPoolOptions) {
+    this.options = options;
+    const threads = options.threads || os.cpus().length;
+    for (let i = 0; i < threads; ++i) {
+      this.startWorker();
+    }
+  }
+
+  createDetector(): PooledDetector {
+    if (this.closed) {
+      throw new Error('Detector pool is closed.');
+    }
+    const worker = this.workers.reduce((best, worker) => {
+      return worker.numStreams < best.numStreams ? worker : best;
+    });
+    const detector = new PooledDetector(this, worker, this.nextId++, this.options);
+    this.detectors[detector.id] = detector;
+    worker.numStreams++;
+    this.post(worker, {
+      type: 'open',
+      id: detector.id,
+      resource: this.options.resource,
+      models: this.options.models.modelString,
+      sensitivity: this.options.models.sensitivityString,
+      numHotwords: this.options.models.numHotwords(),
+      audioGain: this.options.audioGain
+    });
+    return detector;
+  }
+
+  // Stops the threads. Detectors that are still open fail: their pending and
+  // later runs are rejected.
+  close(): Promise<void> {
+    this.closed = true;
+    this.failDetectors(null, new Error('Detector pool is closed.'), false);
+    const workers = this.workers;
+    this.workers = [];
+    return Promise.all(workers.map((worker) => {
+      worker.dead = true;
+      return worker.thread.terminate();
+    })).then(() => {});
+  }
+
+  post(worker: PoolWorker, request: DetectorWorkerRequest, transfer?: Array<ArrayBuffer>): void {
+    if (worker.dead) {
+      return;
+    }
+    if (request.type === 'run' && worker.numPending++ === 0) {
+      worker.thread.ref();
+    }
+    worker.thread.postMessage(request, transfer);
+  }
 
-      case DetectionResult.SILENCE:
-        this.emit('silence');
-        break;
+  release(worker: PoolWorker, detector: PooledDetector): void {
+    if (this.detectors[detector.id] === detector) {
+      delete this.detectors[detector.id];
+      worker.numStreams--;
+      this.post(worker, {type: 'close', id: detector.id});
+    }
+  }
+
+  private onReply(worker: PoolWorker, reply: DetectorWorkerReply): void {
+    if (reply.type === 'run' && --worker.numPending === 0) {
+      worker.thread.unref();
+    }
+    const detector = this.detectors[reply.id];
+    if (detector) {
+      detector.onReply(reply);
+    }
+  }
+
+  private startWorker(): void {
+    // Loaded here so that the module still loads where worker threads are not
+    // available.
+    const Worker = require('worker_threads').Worker;
+    const worker: PoolWorker = {
+      thread: new Worker(path.join(__dirname, 'detector-worker.js')),
+      numStreams: 0,
+      numPending: 0,
+      dead: false
+    };
+    worker.thread.on('message', (reply: DetectorWorkerReply) => this.onReply(worker, reply));
+    worker.thread.on('error', (error: Error) => this.onWorkerExit(worker, error));
+    worker.thread.on('exit', (code: number) => {
+      this.onWorkerExit(worker, new Error(`Detector thread exited with code ${code}.`));
+    });
+    worker.thread.unref();
+    this.workers.push(worker);
+  }
 
-      case DetectionResult.SOUND:
-        this.emit('sound');
-        break;
+  // Fails the detectors of a thread that failed or exited, and replaces it.
+  // Called for both its 'error' and its 'exit' event.
+  private onWorkerExit(worker: PoolWorker, error: Error): void {
+    if (worker.dead) {
+      return;
+    }
+    worker.dead = true;
+    this.workers = this.workers.filter((other) => other !== worker);
+    this.failDetectors(worker, error, true);
+    if (!this.closed) {
+      this.startWorker();
+    }
+  }
+
+  // Fails the open detectors of <worker>, or of every thread if null.
+  private failDetectors(worker: PoolWorker, error: Error, emitIfIdle: boolean): void {
+    Object.keys(this.detectors).forEach((id) => {
+      const detector = this.detectors[Number(id)];
+      if (worker === null || detector.worker === worker) {
+        detector.fail(error, emitIfIdle);
+      }
+    });
+  }
+}
+
+// Detector stream of a DetectorPool. It coalesces and emits like
+// SnowboyDetect.
+export class PooledDetector extends CoalescingDetector {
+  readonly id: number;
+  readonly worker: PoolWorker;
+  private pool: DetectorPool;
+  // Runs posted to the worker, oldest first.
+  private pendingRuns: Array<PendingRun> = [];
+  // Set once the detector failed.
+  private error: Error = null;
+
+  constructor(pool: DetectorPool, worker: PoolWorker, id: number, options: DetectorOptions) {
+    super(options.models, options.chunkDuration);
+    this.pool = pool;
+    this.worker = worker;
+    this.id = id;
+    this.on('finish', () => this.pool.release(this.worker, this));
+  }
+
+  // Runs the detection in the worker thread. The samples are copied once
+  // into an ArrayBuffer that is transferred, not copied again, to the thread,
+  // so <buffer> can be reused as soon as the call returns.
+  runDetectionAsync(buffer: AudioData, isEnd?: boolean): Promise<number> {
+    return this.run(buffer, !!isEnd).then((index) => {
+      emitDetectionResult(this, this.models, index);
+      return index;
+    });
+  }
+
+  // Resets the detector once the chunks written so far are processed.
+  reset(): void {
+    this.pool.post(this.worker, {type: 'reset', id: this.id});
+  }
+
+  protected runBlock(block: Buffer, isEnd: boolean): Promise<number> {
+    return this.run(block, isEnd);
+  }
+
+  private run(buffer: AudioData, isEnd: boolean): Promise<number> {
+    if (this.error) {
+      return Promise.reject(this.error);
+    }
+    const copy = new Uint8Array(buffer.byteLength);
+    copy.set(new Uint8Array(buffer.buffer, buffer.byteOffset, buffer.byteLength));
+    return new Promise<number>((resolve, reject) => {
+      this.pendingRuns.push({resolve: resolve, reject: reject});
+      this.pool.post(this.worker, {
+        type: 'run',
+        id: this.id,
+        data: copy.buffer,
+        format: buffer instanceof Float32Array ? 'float32' : 'int16',
+        isEnd: isEnd
+      }, [copy.buffer]);
+    });
+  }
+
+  onReply(reply: DetectorWorkerReply): void {
+    if (reply.type === 'open') {
+      this.fail(new Error(reply.error));
+      return;
+    }
+    const run = this.pendingRuns.shift();
+    if (reply.error) {
+      run.reject(new Error(reply.error));
+      return;
+    }
+    run.resolve(reply.index);
+  }
 
-      default:
-        const hotword = this.models.lookup(index);
-        this.emit('hotword', index, hotword);
-        break;
+  // Rejects the pending and later runs with <error>. With <emitIfIdle>, it
+  // is emitted as well unless a pending write reports it.
+  fail(error: Error, emitIfIdle = true): void {
+    this.pool.release(this.worker, this);
+    this.error = error;
+    const pendingRuns = this.pendingRuns;
+    this.pendingRuns = [];
+    pendingRuns.forEach((run) => run.reject(error));
+    if (pendingRuns.length === 0 && emitIfIdle) {
+      this.emit('error', error);
     }
   }
 }
 
 export const Detector = SnowboyDetect;
 export const Models = HotwordModels;
+export const Pool = DetectorPool;
@@ -0,0 +1,299 @@
+// swig/C/snowboy-detect-c.cc
+
+// Implementation of the C interface in include/snowboy-detect-c.h. Every
+// entry point catches all exceptions, since none may cross the C boundary.
+
+#include "include/snowboy-detect-c.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+
+#include "include/snowboy-detect.h"
+#include "swig/C/snowboy-detect-run.h"
+
+struct snowboy_detect {
+  snowboy::SnowboyDetect* detector;
+  // Message of the last exception; mutable so that const entry points can
+  // report theirs too.
+  mutable std::string last_error;
+};
+
+namespace {
+
+// Copies <message> into the caller's <buffer> of <size> bytes, truncating and
+// always NUL-terminating it.
+void CopyString(const std::string& message, char* buffer, size_t size) {
+  if (buffer == NULL || size == 0) {
+    return;
+  }
+  size_t length = std::min(message.size(), size - 1);
+  memcpy(buffer, message.data(), length);
+  buffer[length] = '\0';
+}
+
+// Stores the message of the exception being handled in <handle> and returns
+// SNOWBOY_ERROR_EXCEPTION. Must be called from a catch block.
+int HandleException(const snowboy_detect_t* handle) {
+  try {
+    throw;
+  } catch (const std::exception& e) {
+    handle->last_error = e.what();
+  } catch (...) {
+    handle->last_error = "unknown exception";
+  }
+  return SNOWBOY_ERROR_EXCEPTION;
+}
+
+// Returns false and fills <error> if one of the comma separated <filenames>
+// cannot be opened for reading. The library reports this through an exception
+// thrown from a destructor, which aborts the process instead of reaching our
+// handlers, so it is checked up front.
+bool CanOpenFiles(const std::string& filenames, std::string* error) {
+  size_t begin = 0;
+  while (begin <= filenames.size()) {
+    size_t end = filenames.find(',', begin);
+    if (end == std::string::npos) {
+      end = filenames.size();
+    }
+    std::string filename = filenames.substr(begin, end - begin);
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+      *error = "cannot open \"" + filename + "\"";
+      return false;
+    }
+    fclose(file);
+    begin = end + 1;
+  }
+  return true;
+}
+
+// Checks the arguments of the run entry points and passes the call on to
+// RunDetectionSized().
+template<typename T>
+int RunDetection(snowboy_detect_t* handle, const T* data, size_t num_samples,
+                 int is_end) {
+  if (handle == NULL || (data == NULL && num_samples > 0)) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    return snowboy::RunDetectionSized(handle->detector, data, num_samples,
+                                      is_end != 0);
+  } catch (...) {
+    return HandleException(handle);
+  }
+}
+
+}  // namespace
+
+extern "C" {
+
+int snowboy_detect_api_version(void) {
+  return SNOWBOY_DETECT_C_API_VERSION;
+}
+
+int snowboy_detect_create_with_error(const char* resource_filename,
+                                     const char* model_str,
+                                     snowboy_detect_t** detector,
+                                     char* error, size_t error_size) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  *detector = NULL;
+  if (resource_filename == NULL || model_str == NULL) {
+    CopyString("resource_filename and model_str must not be NULL", error,
+               error_size);
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  std::string message;
+  if (!CanOpenFiles(resource_filename, &message) ||
+      !CanOpenFiles(model_str, &message)) {
+    CopyString(message, error, error_size);
+    return SNOWBOY_ERROR_CANNOT_OPEN_FILE;
+  }
+  snowboy_detect_t* handle = NULL;
+  try {
+    handle = new snowboy_detect_t();
+    handle->detector = NULL;
+    handle->detector =
+        new snowboy::SnowboyDetect(resource_filename, model_str);
+  } catch (const std::exception& e) {
+    CopyString(e.what(), error, error_size);
+    delete handle;
+    return SNOWBOY_ERROR_EXCEPTION;
+  } catch (...) {
+    CopyString("unknown exception", error, error_size);
+    delete handle;
+    return SNOWBOY_ERROR_EXCEPTION;
+  }
+  *detector = handle;
+  return SNOWBOY_OK;
+}
+
+int snowboy_detect_create(const char* resource_filename,
+                          const char* model_str,
+                          snowboy_detect_t** detector) {
+  return snowboy_detect_create_with_error(resource_filename, model_str,
+                                          detector, NULL, 0);
+}
+
+void snowboy_detect_destroy(snowboy_detect_t* detector) {
+  if (detector == NULL) {
+    return;
+  }
+  try {
+    delete detector->detector;
+  } catch (...) {
+  }
+  delete detector;
+}
+
+const char* snowboy_detect_last_error(const snowboy_detect_t* detector) {
+  return detector == NULL ? "" : detector->last_error.c_str();
+}
+
+int snowboy_detect_run_int16(snowboy_detect_t* detector, const int16_t* data,
+                             size_t num_samples, int is_end) {
+  return RunDetection(detector, data, num_samples, is_end);
+}
+
+int snowboy_detect_run_float(snowboy_detect_t* detector, const float* data,
+                             size_t num_samples, int is_end) {
+  return RunDetection(detector, data, num_samples, is_end);
+}
+
+int snowboy_detect_run_int32(snowboy_detect_t* detector, const int32_t* data,
+                             size_t num_samples, int is_end) {
+  return RunDetection(detector, data, num_samples, is_end);
+}
+
+int snowboy_detect_reset(snowboy_detect_t* detector) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    return detector->detector->Reset() ? SNOWBOY_OK : -1;
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_set_sensitivity(snowboy_detect_t* detector,
+                                   const char* sensitivity_str) {
+  if (detector == NULL || sensitivity_str == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    detector->detector->SetSensitivity(sensitivity_str);
+    return SNOWBOY_OK;
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_get_sensitivity(const snowboy_detect_t* detector,
+                                   char* buffer, size_t size,
+                                   size_t* required_size) {
+  if (detector == NULL || (buffer == NULL && size > 0)) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    std::string sensitivity = detector->detector->GetSensitivity();
+    if (required_size != NULL) {
+      *required_size = sensitivity.size() + 1;
+    }
+    if (size < sensitivity.size() + 1) {
+      return SNOWBOY_ERROR_BUFFER_TOO_SMALL;
+    }
+    CopyString(sensitivity, buffer, size);
+    return SNOWBOY_OK;
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_set_audio_gain(snowboy_detect_t* detector,
+                                  float audio_gain) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    detector->detector->SetAudioGain(audio_gain);
+    return SNOWBOY_OK;
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_update_model(const snowboy_detect_t* detector) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    detector->detector->UpdateModel();
+    return SNOWBOY_OK;
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_apply_frontend(snowboy_detect_t* detector,
+                                  int apply_frontend) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    detector->detector->ApplyFrontend(apply_frontend != 0);
+    return SNOWBOY_OK;
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_num_hotwords(const snowboy_detect_t* detector) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    return detector->detector->NumHotwords();
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_sample_rate(const snowboy_detect_t* detector) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    return detector->detector->SampleRate();
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_num_channels(const snowboy_detect_t* detector) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    return detector->detector->NumChannels();
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+int snowboy_detect_bits_per_sample(const snowboy_detect_t* detector) {
+  if (detector == NULL) {
+    return SNOWBOY_ERROR_INVALID_ARGUMENT;
+  }
+  try {
+    return detector->detector->BitsPerSample();
+  } catch (...) {
+    return HandleException(detector);
+  }
+}
+
+}  // extern "C"
@@ -0,0 +1,47 @@
+// swig/C/snowboy-detect-run.h
+
+// RunDetection() with a size_t length, shared by the C interface in
+// swig/C/snowboy-detect-c.cc and the C++ examples that feed SnowboyDetect
+// directly, e.g., examples/C++/hotword-server.cc.
+
+#ifndef SNOWBOY_SWIG_C_SNOWBOY_DETECT_RUN_H_
+#define SNOWBOY_SWIG_C_SNOWBOY_DETECT_RUN_H_
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+
+#include "include/snowboy-detect.h"
+
+namespace snowboy {
+
+// Feeds <num_samples> of <data> to <detector> in pieces of at most INT_MAX
+// samples, since RunDetection() takes an int length. The detector is
+// streaming, so this is the same as one call. Returns the first hotword found,
+// otherwise the last result. <data> may be NULL when <num_samples> is 0, e.g.,
+// for a final call that only sets <is_end>; SnowboyDetect itself rejects NULL
+// data even when there is none. Exceptions of the detector are passed on.
+template<typename T>
+int RunDetectionSized(SnowboyDetect* detector, const T* data,
+                      size_t num_samples, bool is_end) {
+  const T empty = 0;
+  if (num_samples == 0) {
+    data = &empty;
+  }
+  int result = -2;
+  do {
+    size_t size = std::min<size_t>(num_samples, INT_MAX);
+    int ans = detector->RunDetection(data, static_cast<int>(size),
+                                     is_end && size == num_samples);
+    if (result <= 0) {
+      result = ans;
+    }
+    data += size;
+    num_samples -= size;
+  } while (num_samples > 0);
+  return result;
+}
+
+}  // namespace snowboy
+
+#endif  // SNOWBOY_SWIG_C_SNOWBOY_DETECT_RUN_H_
@@ -0,0 +1,5 @@
+// swig/Go/snowboy-detect-c.cc
+
+// cgo only compiles the sources of the package directory; this pulls in the
+// C interface used by snowboy_c.go.
+#include "swig/C/snowboy-detect-c.cc"
@@ -0,0 +1,163 @@
+package snowboydetect
+
+// Detector calls the C interface of include/snowboy-detect-c.h directly.
+// Unlike the SWIG wrapper, whose RunDetection takes a string and so copies
+// every chunk, the sample slices are handed to the detector in place.
+
+/*
+#include <stdlib.h>
+#include "include/snowboy-detect-c.h"
+*/
+import "C"
+
+import (
+	"errors"
+	"fmt"
+	"unsafe"
+)
+
+// Detector is a hotword detector. It may be used by one goroutine at a time.
+type Detector struct {
+	handle *C.snowboy_detect_t
+}
+
+// NewDetector constructs a detector from the resource file and a comma
+// separated list of models.
+func NewDetector(resource, model string) (*Detector, error) {
+	cResource := C.CString(resource)
+	defer C.free(unsafe.Pointer(cResource))
+	cModel := C.CString(model)
+	defer C.free(unsafe.Pointer(cModel))
+
+	var message [512]C.char
+	d := &Detector{}
+	if C.snowboy_detect_create_with_error(cResource, cModel, &d.handle,
+		&message[0], C.size_t(len(message))) != C.SNOWBOY_OK {
+		return nil, errors.New(C.GoString(&message[0]))
+	}
+	return d, nil
+}
+
+// Close releases the detector.
+func (d *Detector) Close() {
+	C.snowboy_detect_destroy(d.handle)
+	d.handle = nil
+}
+
+func (d *Detector) check(status C.int) (int, error) {
+	switch status {
+	case C.SNOWBOY_ERROR_INVALID_ARGUMENT:
+		return int(status), errors.New("snowboy: invalid argument")
+	case C.SNOWBOY_ERROR_EXCEPTION:
+		return int(status), errors.New(C.GoString(C.snowboy_detect_last_error(d.handle)))
+	case C.SNOWBOY_ERROR_BUFFER_TOO_SMALL, C.SNOWBOY_ERROR_CANNOT_OPEN_FILE:
+		return int(status), fmt.Errorf("snowboy: error %d", int(status))
+	}
+	return int(status), nil
+}
+
+func cBool(b bool) C.int {
+	if b {
+		return 1
+	}
+	return 0
+}
+
+// RunInt16 runs detection on interleaved 16-bit samples. The result is -2 for
+// silence, -1 for an error in the detector, 0 for sound and the index of the
+// hotword otherwise.
+func (d *Detector) RunInt16(samples []int16, isEnd bool) (int, error) {
+	var data *C.int16_t
+	if len(samples) > 0 {
+		data = (*C.int16_t)(unsafe.Pointer(&samples[0]))
+	}
+	return d.check(C.snowboy_detect_run_int16(d.handle, data,
+		C.size_t(len(samples)), cBool(isEnd)))
+}
+
+// RunFloat32 is RunInt16 for float samples on the int16 scale.
+func (d *Detector) RunFloat32(samples []float32, isEnd bool) (int, error) {
+	var data *C.float
+	if len(samples) > 0 {
+		data = (*C.float)(unsafe.Pointer(&samples[0]))
+	}
+	return d.check(C.snowboy_detect_run_float(d.handle, data,
+		C.size_t(len(samples)), cBool(isEnd)))
+}
+
+// RunInt32 is RunInt16 for 32-bit samples.
+func (d *Detector) RunInt32(samples []int32, isEnd bool) (int, error) {
+	var data *C.int32_t
+	if len(samples) > 0 {
+		data = (*C.int32_t)(unsafe.Pointer(&samples[0]))
+	}
+	return d.check(C.snowboy_detect_run_int32(d.handle, data,
+		C.size_t(len(samples)), cBool(isEnd)))
+}
+
+// Reset resets the detector, e.g., between two streams.
+func (d *Detector) Reset() error {
+	status := C.snowboy_detect_reset(d.handle)
+	if status == -1 {
+		return errors.New("snowboy: cannot reset the detector")
+	}
+	_, err := d.check(status)
+	return err
+}
+
+// SetSensitivity sets the comma separated sensitivities, one per hotword.
+func (d *Detector) SetSensitivity(sensitivity string) error {
+	cSensitivity := C.CString(sensitivity)
+	defer C.free(unsafe.Pointer(cSensitivity))
+	_, err := d.check(C.snowboy_detect_set_sensitivity(d.handle, cSensitivity))
+	return err
+}
+
+// Sensitivity returns the comma separated sensitivities.
+func (d *Detector) Sensitivity() (string, error) {
+	var size C.size_t
+	status := C.snowboy_detect_get_sensitivity(d.handle, nil, 0, &size)
+	if status != C.SNOWBOY_ERROR_BUFFER_TOO_SMALL {
+		if _, err := d.check(status); err != nil {
+			return "", err
+		}
+	}
+	buffer := make([]C.char, size)
+	if _, err := d.check(C.snowboy_detect_get_sensitivity(d.handle,
+		&buffer[0], size, nil)); err != nil {
+		return "", err
+	}
+	return C.GoString(&buffer[0]), nil
+}
+
+// SetAudioGain sets the gain applied to the audio.
+func (d *Detector) SetAudioGain(gain float32) error {
+	_, err := d.check(C.snowboy_detect_set_audio_gain(d.handle, C.float(gain)))
+	return err
+}
+
+// ApplyFrontend turns the audio frontend on or off.
+func (d *Detector) ApplyFrontend(apply bool) error {
+	_, err := d.check(C.snowboy_detect_apply_frontend(d.handle, cBool(apply)))
+	return err
+}
+
+// NumHotwords returns the number of hotwords of the loaded models.
+func (d *Detector) NumHotwords() (int, error) {
+	return d.check(C.snowboy_detect_num_hotwords(d.handle))
+}
+
+// SampleRate returns the sample rate the detector expects.
+func (d *Detector) SampleRate() (int, error) {
+	return d.check(C.snowboy_detect_sample_rate(d.handle))
+}
+
+// NumChannels returns the number of channels the detector expects.
+func (d *Detector) NumChannels() (int, error) {
+	return d.check(C.snowboy_detect_num_channels(d.handle))
+}
+
+// BitsPerSample returns the sample size the detector expects.
+func (d *Detector) BitsPerSample() (int, error) {
+	return d.check(C.snowboy_detect_bits_per_sample(d.handle))
+}
@@ -0,0 +1,86 @@
+// swig/Java/snowboy-detect-c-java.i
+
+// The C interface of include/snowboy-detect-c.h for the Java and Android
+// modules, which both %include this file. Audio is read in place from a direct
+// java.nio.ShortBuffer in native byte order, e.g.,
+// ByteBuffer.allocateDirect(n).order(ByteOrder.nativeOrder()).asShortBuffer();
+// the samples are those between its position() and its limit(), as for a
+// buffer that was filled and then flip()ped. The short[] overloads of
+// SnowboyDetect copy the array on every call. The detector comes from
+// snowboy.snowboy_detect_new(resource, model) and is released with
+// snowboy.snowboy_detect_destroy().
+
+%{
+// Reads the position() and limit() of the java.nio.Buffer <buffer>. Returns
+// false, with a Java exception pending, if they cannot be read.
+static bool GetBufferBounds(JNIEnv* jenv, jobject buffer, jint* position,
+                            jint* limit) {
+  // java.nio.Buffer is loaded by the bootstrap class loader and never
+  // unloaded, so its method IDs stay valid.
+  static jmethodID position_method = NULL;
+  static jmethodID limit_method = NULL;
+  if (position_method == NULL || limit_method == NULL) {
+    jclass buffer_class = jenv->FindClass("java/nio/Buffer");
+    if (buffer_class == NULL) {
+      return false;
+    }
+    position_method = jenv->GetMethodID(buffer_class, "position", "()I");
+    limit_method = jenv->GetMethodID(buffer_class, "limit", "()I");
+    jenv->DeleteLocalRef(buffer_class);
+    if (position_method == NULL || limit_method == NULL) {
+      return false;
+    }
+  }
+  *position = jenv->CallIntMethod(buffer, position_method);
+  if (jenv->ExceptionCheck()) {
+    return false;
+  }
+  *limit = jenv->CallIntMethod(buffer, limit_method);
+  return !jenv->ExceptionCheck();
+}
+%}
+
+%typemap(jni) (const int16_t* data, size_t num_samples) "jobject"
+%typemap(jtype) (const int16_t* data, size_t num_samples)
+    "java.nio.ShortBuffer"
+%typemap(jstype) (const int16_t* data, size_t num_samples)
+    "java.nio.ShortBuffer"
+%typemap(javain) (const int16_t* data, size_t num_samples) "$javainput"
+%typemap(in) (const int16_t* data, size_t num_samples) {
+  // GetDirectBufferAddress() does not check for null on every JVM.
+  if ($input == NULL) {
+    SWIG_JavaThrowException(jenv, SWIG_JavaNullPointerException,
+                            "data is null");
+    return $null;
+  }
+  const int16_t* base =
+      static_cast<const int16_t*>(jenv->GetDirectBufferAddress($input));
+  if (base == NULL) {
+    SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException,
+                            "data must be a direct ShortBuffer");
+    return $null;
+  }
+  jint position = 0;
+  jint limit = 0;
+  if (!GetBufferBounds(jenv, $input, &position, &limit)) {
+    return $null;
+  }
+  $1 = base + position;
+  $2 = static_cast<size_t>(limit - position);
+}
+%ignore snowboy_detect_create;
+%ignore snowboy_detect_create_with_error;
+%ignore snowboy_detect_get_sensitivity;
+%ignore snowboy_detect_run_float;
+%ignore snowboy_detect_run_int32;
+%include "include/snowboy-detect-c.h"
+
+%inline %{
+// Returns a new detector, or null if it cannot be constructed.
+snowboy_detect_t* snowboy_detect_new(const char* resource_filename,
+                                     const char* model_str) {
+  snowboy_detect_t* detector = NULL;
+  snowboy_detect_create(resource_filename, model_str, &detector);
+  return detector;
+}
+%}
@@ -15,6 +15,9 @@
 
 %{
 #include "include/snowboy-detect.h"
+#include "include/snowboy-detect-c.h"
 %}
 
 %include "include/snowboy-detect.h"
+
+%include "swig/Java/snowboy-detect-c-java.i"
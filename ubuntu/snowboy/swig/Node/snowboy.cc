@@ -1,173 +1,636 @@
-#include <nan.h>
-#include <snowboy-detect.h>
-#include <iostream>
+#include <node_api.h>
+#include <snowboy-detect-c.h>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
 
-class SnowboyDetect : public Nan::ObjectWrap {
+// Node binding of the C interface of snowboy-detect-c.h, on N-API, so that the
+// same binary loads in any Node version with N-API 6 and in any number of
+// worker_threads: the module is initialized once per environment and keeps
+// no state outside of it (see AddonData) or of the detector objects.
+//
+// Audio is read straight from the JavaScript Buffer, typed array or
+// ArrayBuffer (see GetAudioData()), and failures come back as status codes
+// that are rethrown as JavaScript errors. RunDetection(data, isEnd) and
+// RunDetectionAsync(data, isEnd, callback) flush the detector when isEnd is
+// true, at the end of a stream.
+//
+// RunDetectionAsync() runs the detection on the libuv threadpool. Calls on one
+// detector are queued and run one at a time, in order, so that the streaming
+// state sees the chunks in sequence; different detectors run in parallel.
+// While calls are pending, the methods that use the detector throw.
+
+// Per-environment state, owned by the environment through
+// napi_set_instance_data().
+struct AddonData {
+  // The SnowboyDetect class of this environment.
+  napi_ref constructor;
+};
+
+// Audio passed to RunDetection(): a Buffer or ArrayBuffer of int16 samples, an
+// Int16Array or a Float32Array (on the int16 scale). The samples are read in
+// place from the backing store; only Buffer slices that start on an odd byte,
+// which the int16_t interface cannot read, are copied into <scratch>. Typed
+// arrays are always aligned to their element size, and ArrayBuffers start on
+// an allocation boundary.
+struct AudioData {
+  const int16_t* int16Samples;
+  const float* floatSamples;
+  size_t numSamples;
+};
+
+class SnowboyDetect;
+
+// One RunDetectionAsync() call. The audio object and the detector object are
+// referenced until the callback has run; the samples are read in place, so the
+// audio must not be modified before then.
+struct RunRequest {
+  SnowboyDetect* owner;
+  napi_ref holder;
+  napi_ref audioObject;
+  napi_ref callback;
+  napi_async_work work;
+  AudioData audio;
+  bool isEnd;
+  // Copy of an unaligned Buffer, which <audio> points to.
+  std::vector<int16_t> unaligned;
+  int result;
+  std::string error;
+};
+
+class SnowboyDetect {
   public:
-    static NAN_MODULE_INIT(Init);
+    static napi_value Init(napi_env env, napi_value exports);
 
   private:
-    explicit SnowboyDetect(const std::string& resource_filename,
-                           const std::string& model_str);
+    explicit SnowboyDetect(snowboy_detect_t* detector);
     ~SnowboyDetect();
 
-    static NAN_METHOD(New);
-    static NAN_METHOD(Reset);
-    static NAN_METHOD(RunDetection);
-    static NAN_METHOD(SetSensitivity);
-    static NAN_METHOD(GetSensitivity);
-    static NAN_METHOD(SetAudioGain);
-    static NAN_METHOD(UpdateModel);
-    static NAN_METHOD(NumHotwords);
-    static NAN_METHOD(SampleRate);
-    static NAN_METHOD(NumChannels);
-    static NAN_METHOD(BitsPerSample);
-
-    static Nan::Persistent<v8::Function> constructor;
-
-    snowboy::SnowboyDetect* detector;
+    static void Finalize(napi_env env, void* data, void* hint);
+
+    static napi_value New(napi_env env, napi_callback_info info);
+    static napi_value Reset(napi_env env, napi_callback_info info);
+    static napi_value RunDetection(napi_env env, napi_callback_info info);
+    static napi_value RunDetectionAsync(napi_env env,
+                                        napi_callback_info info);
+    static napi_value SetSensitivity(napi_env env, napi_callback_info info);
+    static napi_value GetSensitivity(napi_env env, napi_callback_info info);
+    static napi_value SetAudioGain(napi_env env, napi_callback_info info);
+    static napi_value UpdateModel(napi_env env, napi_callback_info info);
+    static napi_value NumHotwords(napi_env env, napi_callback_info info);
+    static napi_value SampleRate(napi_env env, napi_callback_info info);
+    static napi_value NumChannels(napi_env env, napi_callback_info info);
+    static napi_value BitsPerSample(napi_env env, napi_callback_info info);
+
+    // Runs on the threadpool.
+    static void ExecuteRun(napi_env env, void* data);
+    // Runs on the main thread once ExecuteRun() is done.
+    static void CompleteRun(napi_env env, napi_status status, void* data);
+
+    // Returns the detector wrapped by <this> of <info>, and up to <argc>
+    // arguments in <argv>. Throws and returns NULL if <this> is not a
+    // SnowboyDetect of this environment.
+    static SnowboyDetect* Unwrap(napi_env env, napi_callback_info info,
+                                 size_t argc, napi_value* argv,
+                                 napi_value* holder = NULL);
+
+    // Message for a SNOWBOY_ERROR_* <status>, or NULL if <status> is not an
+    // error.
+    const char* ErrorMessage(int status) const;
+
+    // Throws a JavaScript error for a SNOWBOY_ERROR_* <status>. Returns true
+    // if it did.
+    bool ThrowIfError(napi_env env, int status) const;
+
+    // Throws if RunDetectionAsync() calls are pending, since the detector may
+    // be in use on the threadpool. Returns true if it did.
+    bool ThrowIfBusy(napi_env env) const;
+
+    // Queues <request>, and starts it if no other call is running.
+    void QueueRun(napi_env env, RunRequest* request);
+
+    // Starts the next queued call, if any. Called on the main thread when a
+    // call completes.
+    void StartNextRun(napi_env env);
+
+    snowboy_detect_t* detector;
+
+    // RunDetectionAsync() calls waiting for the running one. Only touched on
+    // the main thread.
+    std::deque<RunRequest*> pendingRuns;
+    bool runInFlight;
+
+    // Copy of the samples for Buffers that are not 2-byte aligned, which the
+    // int16_t interface cannot read in place. Reused across calls.
+    std::vector<int16_t> unaligned;
 };
 
-Nan::Persistent<v8::Function> SnowboyDetect::constructor;
+// Fills <audio> from <value>. Throws a TypeError and returns false if <value>
+// is not one of the accepted types.
+bool GetAudioData(napi_env env, napi_value value,
+                  std::vector<int16_t>* scratch, AudioData* audio) {
+  audio->int16Samples = NULL;
+  audio->floatSamples = NULL;
+  audio->numSamples = 0;
+
+  // Typed arrays come first: napi_is_buffer() is true for every
+  // ArrayBufferView, so a Float32Array would otherwise be read as int16 bytes.
+  bool isType = false;
+  napi_is_typedarray(env, value, &isType);
+  if (isType) {
+    napi_typedarray_type type;
+    size_t length = 0;
+    void* data = NULL;
+    napi_get_typedarray_info(env, value, &type, &length, &data, NULL, NULL);
+    if (type == napi_int16_array) {
+      audio->int16Samples = static_cast<const int16_t*>(data);
+      audio->numSamples = length;
+      return true;
+    } else if (type == napi_float32_array) {
+      audio->floatSamples = static_cast<const float*>(data);
+      audio->numSamples = length;
+      return true;
+    }
+  }
+
+  // Buffers, and any other view, are read as bytes of int16 samples.
+  napi_is_buffer(env, value, &isType);
+  if (isType) {
+    void* data = NULL;
+    size_t length = 0;
+    napi_get_buffer_info(env, value, &data, &length);
+    audio->numSamples = length / sizeof(int16_t);
+    audio->int16Samples = static_cast<const int16_t*>(data);
+    if (reinterpret_cast<uintptr_t>(data) % sizeof(int16_t) != 0) {
+      // Slices of a Buffer can start at any byte.
+      scratch->resize(audio->numSamples);
+      memcpy(scratch->data(), data, audio->numSamples * sizeof(int16_t));
+      audio->int16Samples = scratch->data();
+    }
+    return true;
+  }
+
+  napi_is_arraybuffer(env, value, &isType);
+  if (isType) {
+    void* data = NULL;
+    size_t length = 0;
+    napi_get_arraybuffer_info(env, value, &data, &length);
+    audio->int16Samples = static_cast<const int16_t*>(data);
+    audio->numSamples = length / sizeof(int16_t);
+    return true;
+  }
+
+  napi_throw_type_error(env, NULL, "data must be a Buffer, an Int16Array, a "
+                        "Float32Array or an ArrayBuffer");
+  return false;
+}
+
+// Runs the detection on <audio>; <isEnd> flushes the detector at the end of
+// the stream.
+int RunDetectionOn(snowboy_detect_t* detector, const AudioData& audio,
+                   bool isEnd) {
+  if (audio.floatSamples != NULL) {
+    return snowboy_detect_run_float(detector, audio.floatSamples,
+                                    audio.numSamples, isEnd);
+  }
+  return snowboy_detect_run_int16(detector, audio.int16Samples,
+                                  audio.numSamples, isEnd);
+}
+
+// Reads the optional boolean <value> into <isEnd>, false if undefined. Throws
+// a TypeError and returns false if it is neither.
+bool GetIsEnd(napi_env env, napi_value value, bool* isEnd) {
+  napi_valuetype type;
+  napi_typeof(env, value, &type);
+  *isEnd = false;
+  if (type == napi_undefined) {
+    return true;
+  }
+  if (napi_get_value_bool(env, value, isEnd) != napi_ok) {
+    napi_throw_type_error(env, NULL, "isEnd must be a boolean");
+    return false;
+  }
+  return true;
+}
 
-SnowboyDetect::SnowboyDetect(const std::string& resource_filename,
-                             const std::string& model_str) {
-  try {
-    this->detector = new snowboy::SnowboyDetect(resource_filename, model_str);
-  } catch (std::runtime_error e) {
-    Nan::ThrowError(e.what());
+// Returns the UTF-8 string <value>, or throws a TypeError with <message> and
+// returns false.
+bool GetString(napi_env env, napi_value value, const char* message,
+               std::string* str) {
+  size_t length = 0;
+  if (napi_get_value_string_utf8(env, value, NULL, 0, &length) != napi_ok) {
+    napi_throw_type_error(env, NULL, message);
+    return false;
   }
+  std::vector<char> buffer(length + 1);
+  napi_get_value_string_utf8(env, value, buffer.data(), buffer.size(),
+                             &length);
+  str->assign(buffer.data(), length);
+  return true;
 }
+
+napi_value MakeInt(napi_env env, int value) {
+  napi_value result;
+  napi_create_int32(env, value, &result);
+  return result;
+}
+
+SnowboyDetect::SnowboyDetect(snowboy_detect_t* detector)
+    : detector(detector), runInFlight(false) {
+}
+
 SnowboyDetect::~SnowboyDetect() {
-  if (this->detector) {
-    delete this->detector;
+  snowboy_detect_destroy(this->detector);
+}
+
+void SnowboyDetect::Finalize(napi_env env, void* data, void* hint) {
+  delete static_cast<SnowboyDetect*>(data);
+}
+
+const char* SnowboyDetect::ErrorMessage(int status) const {
+  switch (status) {
+    case SNOWBOY_ERROR_INVALID_ARGUMENT:
+      return "invalid argument";
+    case SNOWBOY_ERROR_EXCEPTION:
+      return snowboy_detect_last_error(this->detector);
+    case SNOWBOY_ERROR_BUFFER_TOO_SMALL:
+    case SNOWBOY_ERROR_CANNOT_OPEN_FILE:
+      return "snowboy error";
+  }
+  return NULL;
+}
+
+bool SnowboyDetect::ThrowIfError(napi_env env, int status) const {
+  const char* message = ErrorMessage(status);
+  if (message == NULL) {
+    return false;
   }
+  napi_throw_error(env, NULL, message);
+  return true;
 }
 
-NAN_MODULE_INIT(SnowboyDetect::Init) {
-  v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
-  tpl->SetClassName(Nan::New("SnowboyDetect").ToLocalChecked());
-  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+bool SnowboyDetect::ThrowIfBusy(napi_env env) const {
+  if (!this->runInFlight) {
+    return false;
+  }
+  napi_throw_error(env, NULL,
+                   "detector is busy with RunDetectionAsync() calls");
+  return true;
+}
 
-  SetPrototypeMethod(tpl, "Reset", Reset);
-  SetPrototypeMethod(tpl, "RunDetection", RunDetection);
-  SetPrototypeMethod(tpl, "SetSensitivity", SetSensitivity);
-  SetPrototypeMethod(tpl, "GetSensitivity", GetSensitivity);
-  SetPrototypeMethod(tpl, "SetAudioGain", SetAudioGain);
-  SetPrototypeMethod(tpl, "UpdateModel", UpdateModel);
-  SetPrototypeMethod(tpl, "NumHotwords", NumHotwords);
-  SetPrototypeMethod(tpl, "SampleRate", SampleRate);
-  SetPrototypeMethod(tpl, "NumChannels", NumChannels);
-  SetPrototypeMethod(tpl, "BitsPerSample", BitsPerSample);
+SnowboyDetect* SnowboyDetect::Unwrap(napi_env env, napi_callback_info info,
+                                     size_t argc, napi_value* argv,
+                                     napi_value* holder) {
+  napi_value self;
+  size_t numArgs = argc;
+  napi_get_cb_info(env, info, &numArgs, argv, &self, NULL);
+  for (size_t i = numArgs; i < argc; ++i) {
+    napi_get_undefined(env, &argv[i]);
+  }
 
-  constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
-  Nan::Set(target, Nan::New("SnowboyDetect").ToLocalChecked(),
-    Nan::GetFunction(tpl).ToLocalChecked());
+  AddonData* addonData = NULL;
+  napi_value constructor;
+  bool isInstance = false;
+  napi_get_instance_data(env, reinterpret_cast<void**>(&addonData));
+  napi_get_reference_value(env, addonData->constructor, &constructor);
+  napi_instanceof(env, self, constructor, &isInstance);
+  SnowboyDetect* ptr = NULL;
+  if (!isInstance ||
+      napi_unwrap(env, self, reinterpret_cast<void**>(&ptr)) != napi_ok) {
+    napi_throw_type_error(env, NULL, "not a SnowboyDetect object");
+    return NULL;
+  }
+  if (holder != NULL) {
+    *holder = self;
+  }
+  return ptr;
 }
 
-NAN_METHOD(SnowboyDetect::New) {
-  if (!info.IsConstructCall()) {
-    Nan::ThrowError("Cannot call constructor as function, you need to use "
-                    "'new' keyword");
-    return;
-  } else if (!info[0]->IsString()) {
-    Nan::ThrowTypeError("resource must be a string");
-    return;
-  } else if (!info[1]->IsString()) {
-    Nan::ThrowTypeError("model must be a string");
-    return;
+void SnowboyDetect::QueueRun(napi_env env, RunRequest* request) {
+  this->pendingRuns.push_back(request);
+  if (!this->runInFlight) {
+    StartNextRun(env);
   }
+}
 
-  Nan::MaybeLocal<v8::Object> resource = Nan::To<v8::Object>(info[0]);
-  Nan::MaybeLocal<v8::Object> model = Nan::To<v8::Object>(info[1]);
-  Nan::Utf8String resourceString(resource.ToLocalChecked());
-  Nan::Utf8String modelString(model.ToLocalChecked());
-  SnowboyDetect* obj = new SnowboyDetect(*resourceString, *modelString);
-  obj->Wrap(info.This());
-  info.GetReturnValue().Set(info.This());
+void SnowboyDetect::StartNextRun(napi_env env) {
+  this->runInFlight = !this->pendingRuns.empty();
+  if (this->runInFlight) {
+    RunRequest* request = this->pendingRuns.front();
+    this->pendingRuns.pop_front();
+    napi_queue_async_work(env, request->work);
+  }
 }
 
-NAN_METHOD(SnowboyDetect::Reset) {
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  bool ret = ptr->detector->Reset();
-  info.GetReturnValue().Set(Nan::New(ret));
+void SnowboyDetect::ExecuteRun(napi_env env, void* data) {
+  RunRequest* request = static_cast<RunRequest*>(data);
+  request->result = RunDetectionOn(request->owner->detector, request->audio,
+                                   request->isEnd);
+  const char* message = request->owner->ErrorMessage(request->result);
+  if (message != NULL) {
+    request->error = message;
+  }
 }
 
-NAN_METHOD(SnowboyDetect::RunDetection) {
-  if (!info[0]->IsObject()) {
-    Nan::ThrowTypeError("data must be a buffer");
-    return;
+void SnowboyDetect::CompleteRun(napi_env env, napi_status status,
+                                void* data) {
+  RunRequest* request = static_cast<RunRequest*>(data);
+  // The next call is started before the callback runs, so that the
+  // threadpool works on it meanwhile.
+  request->owner->StartNextRun(env);
+
+  napi_value callback, global, argv[2];
+  napi_get_reference_value(env, request->callback, &callback);
+  napi_get_global(env, &global);
+  size_t argc = 2;
+  if (status != napi_ok || !request->error.empty()) {
+    napi_value message;
+    const std::string error =
+        request->error.empty() ? "detection cancelled" : request->error;
+    napi_create_string_utf8(env, error.c_str(), error.size(), &message);
+    napi_create_error(env, NULL, message, &argv[0]);
+    argc = 1;
+  } else {
+    napi_get_null(env, &argv[0]);
+    argv[1] = MakeInt(env, request->result);
   }
 
-  Nan::MaybeLocal<v8::Object> buffer = Nan::To<v8::Object>(info[0]);
-  char* bufferData = node::Buffer::Data(buffer.ToLocalChecked());
-  size_t bufferLength = node::Buffer::Length(buffer.ToLocalChecked());
+  napi_delete_reference(env, request->callback);
+  napi_delete_reference(env, request->audioObject);
+  napi_delete_reference(env, request->holder);
+  napi_delete_async_work(env, request->work);
+  delete request;
 
-  std::string data(bufferData, bufferLength);
+  napi_value ignored;
+  napi_call_function(env, global, callback, argc, argv, &ignored);
+}
+
+napi_value SnowboyDetect::Init(napi_env env, napi_value exports) {
+  napi_property_descriptor methods[] = {
+    {"Reset", NULL, Reset, NULL, NULL, NULL, napi_default, NULL},
+    {"RunDetection", NULL, RunDetection, NULL, NULL, NULL, napi_default,
+     NULL},
+    {"RunDetectionAsync", NULL, RunDetectionAsync, NULL, NULL, NULL,
+     napi_default, NULL},
+    {"SetSensitivity", NULL, SetSensitivity, NULL, NULL, NULL, napi_default,
+     NULL},
+    {"GetSensitivity", NULL, GetSensitivity, NULL, NULL, NULL, napi_default,
+     NULL},
+    {"SetAudioGain", NULL, SetAudioGain, NULL, NULL, NULL, napi_default,
+     NULL},
+    {"UpdateModel", NULL, UpdateModel, NULL, NULL, NULL, napi_default, NULL},
+    {"NumHotwords", NULL, NumHotwords, NULL, NULL, NULL, napi_default, NULL},
+    {"SampleRate", NULL, SampleRate, NULL, NULL, NULL, napi_default, NULL},
+    {"NumChannels", NULL, NumChannels, NULL, NULL, NULL, napi_default, NULL},
+    {"BitsPerSample", NULL, BitsPerSample, NULL, NULL, NULL, napi_default,
+     NULL},
+  };
+  napi_value constructor;
+  if (napi_define_class(env, "SnowboyDetect", NAPI_AUTO_LENGTH, New, NULL,
+                        sizeof(methods) / sizeof(methods[0]), methods,
+                        &constructor) != napi_ok) {
+    return NULL;
+  }
 
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  int ret = ptr->detector->RunDetection(data);
-  info.GetReturnValue().Set(Nan::New(ret));
+  AddonData* addonData = new AddonData();
+  napi_create_reference(env, constructor, 1, &addonData->constructor);
+  napi_set_instance_data(
+      env, addonData,
+      [](napi_env env, void* data, void* hint) {
+        AddonData* addonData = static_cast<AddonData*>(data);
+        napi_delete_reference(env, addonData->constructor);
+        delete addonData;
+      },
+      NULL);
+
+  napi_set_named_property(env, exports, "SnowboyDetect", constructor);
+  return exports;
 }
 
-NAN_METHOD(SnowboyDetect::SetSensitivity) {
-  if (!info[0]->IsString()) {
-    Nan::ThrowTypeError("sensitivity must be a string");
-    return;
+napi_value SnowboyDetect::New(napi_env env, napi_callback_info info) {
+  napi_value argv[2], self, newTarget;
+  size_t argc = 2;
+  napi_get_cb_info(env, info, &argc, argv, &self, NULL);
+  napi_get_new_target(env, info, &newTarget);
+  if (newTarget == NULL) {
+    napi_throw_error(env, NULL, "Cannot call constructor as function, you "
+                     "need to use 'new' keyword");
+    return NULL;
+  }
+  std::string resource, model;
+  if (argc < 2 ||
+      !GetString(env, argv[0], "resource must be a string", &resource) ||
+      !GetString(env, argv[1], "model must be a string", &model)) {
+    if (argc < 2) {
+      napi_throw_type_error(env, NULL, "resource and model are required");
+    }
+    return NULL;
   }
 
-  Nan::MaybeLocal<v8::Object> sensitivity = Nan::To<v8::Object>(info[0]);
-  Nan::Utf8String sensitivityString(sensitivity.ToLocalChecked());
+  snowboy_detect_t* detector = NULL;
+  char error[512];
+  if (snowboy_detect_create_with_error(resource.c_str(), model.c_str(),
+                                       &detector, error,
+                                       sizeof(error)) != SNOWBOY_OK) {
+    napi_throw_error(env, NULL, error);
+    return NULL;
+  }
+  SnowboyDetect* obj = new SnowboyDetect(detector);
+  if (napi_wrap(env, self, obj, Finalize, NULL, NULL) != napi_ok) {
+    delete obj;
+    napi_throw_error(env, NULL, "cannot wrap the detector");
+    return NULL;
+  }
+  return self;
+}
 
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  ptr->detector->SetSensitivity(*sensitivityString);
+napi_value SnowboyDetect::Reset(napi_env env, napi_callback_info info) {
+  SnowboyDetect* ptr = Unwrap(env, info, 0, NULL);
+  if (ptr == NULL || ptr->ThrowIfBusy(env)) {
+    return NULL;
+  }
+  int ret = snowboy_detect_reset(ptr->detector);
+  if (ptr->ThrowIfError(env, ret)) {
+    return NULL;
+  }
+  napi_value result;
+  napi_get_boolean(env, ret == SNOWBOY_OK, &result);
+  return result;
+}
+
+napi_value SnowboyDetect::RunDetection(napi_env env,
+                                       napi_callback_info info) {
+  napi_value argv[2];
+  SnowboyDetect* ptr = Unwrap(env, info, 2, argv);
+  if (ptr == NULL || ptr->ThrowIfBusy(env)) {
+    return NULL;
+  }
+  AudioData audio;
+  bool isEnd = false;
+  if (!GetAudioData(env, argv[0], &ptr->unaligned, &audio) ||
+      !GetIsEnd(env, argv[1], &isEnd)) {
+    return NULL;
+  }
+  int ret = RunDetectionOn(ptr->detector, audio, isEnd);
+  if (ptr->ThrowIfError(env, ret)) {
+    return NULL;
+  }
+  return MakeInt(env, ret);
 }
 
-NAN_METHOD(SnowboyDetect::GetSensitivity) {
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  std::string sensitivity = ptr->detector->GetSensitivity();
-  info.GetReturnValue().Set(Nan::New(sensitivity).ToLocalChecked());
+napi_value SnowboyDetect::RunDetectionAsync(napi_env env,
+                                            napi_callback_info info) {
+  napi_value argv[3], holder;
+  SnowboyDetect* ptr = Unwrap(env, info, 3, argv, &holder);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  napi_valuetype type;
+  napi_typeof(env, argv[2], &type);
+  if (type != napi_function) {
+    napi_throw_type_error(env, NULL, "callback must be a function");
+    return NULL;
+  }
+
+  RunRequest* request = new RunRequest();
+  if (!GetAudioData(env, argv[0], &request->unaligned, &request->audio) ||
+      !GetIsEnd(env, argv[1], &request->isEnd)) {
+    delete request;
+    return NULL;
+  }
+  request->owner = ptr;
+  request->result = 0;
+  napi_create_reference(env, holder, 1, &request->holder);
+  napi_create_reference(env, argv[0], 1, &request->audioObject);
+  napi_create_reference(env, argv[2], 1, &request->callback);
+  napi_value resourceName;
+  napi_create_string_utf8(env, "snowboy:RunDetectionAsync", NAPI_AUTO_LENGTH,
+                          &resourceName);
+  napi_create_async_work(env, NULL, resourceName, ExecuteRun, CompleteRun,
+                         request, &request->work);
+  ptr->QueueRun(env, request);
+  return NULL;
 }
 
-NAN_METHOD(SnowboyDetect::SetAudioGain) {
-  if (!info[0]->IsNumber()) {
-    Nan::ThrowTypeError("gain must be a number");
-    return;
+napi_value SnowboyDetect::SetSensitivity(napi_env env,
+                                         napi_callback_info info) {
+  napi_value argv[1];
+  SnowboyDetect* ptr = Unwrap(env, info, 1, argv);
+  std::string sensitivity;
+  if (ptr == NULL ||
+      !GetString(env, argv[0], "sensitivity must be a string",
+                 &sensitivity) ||
+      ptr->ThrowIfBusy(env)) {
+    return NULL;
   }
+  ptr->ThrowIfError(
+      env, snowboy_detect_set_sensitivity(ptr->detector, sensitivity.c_str()));
+  return NULL;
+}
 
-  Nan::MaybeLocal<v8::Number> gain = Nan::To<v8::Number>(info[0]);
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  ptr->detector->SetAudioGain(gain.ToLocalChecked()->Value());
+napi_value SnowboyDetect::GetSensitivity(napi_env env,
+                                         napi_callback_info info) {
+  SnowboyDetect* ptr = Unwrap(env, info, 0, NULL);
+  if (ptr == NULL || ptr->ThrowIfBusy(env)) {
+    return NULL;
+  }
+  size_t size = 0;
+  int ret = snowboy_detect_get_sensitivity(ptr->detector, NULL, 0, &size);
+  if (ret != SNOWBOY_ERROR_BUFFER_TOO_SMALL && ptr->ThrowIfError(env, ret)) {
+    return NULL;
+  }
+  std::vector<char> sensitivity(size);
+  ret = snowboy_detect_get_sensitivity(ptr->detector, sensitivity.data(),
+                                       size, NULL);
+  if (ptr->ThrowIfError(env, ret)) {
+    return NULL;
+  }
+  napi_value result;
+  napi_create_string_utf8(env, sensitivity.data(), NAPI_AUTO_LENGTH, &result);
+  return result;
 }
 
-NAN_METHOD(SnowboyDetect::UpdateModel) {
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  ptr->detector->UpdateModel();
+napi_value SnowboyDetect::SetAudioGain(napi_env env,
+                                       napi_callback_info info) {
+  napi_value argv[1];
+  SnowboyDetect* ptr = Unwrap(env, info, 1, argv);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  double gain = 0;
+  if (napi_get_value_double(env, argv[0], &gain) != napi_ok) {
+    napi_throw_type_error(env, NULL, "gain must be a number");
+    return NULL;
+  }
+  if (ptr->ThrowIfBusy(env)) {
+    return NULL;
+  }
+  ptr->ThrowIfError(env, snowboy_detect_set_audio_gain(ptr->detector, gain));
+  return NULL;
 }
 
-NAN_METHOD(SnowboyDetect::NumHotwords) {
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  int numHotwords = ptr->detector->NumHotwords();
-  info.GetReturnValue().Set(Nan::New(numHotwords));
+napi_value SnowboyDetect::UpdateModel(napi_env env, napi_callback_info info) {
+  SnowboyDetect* ptr = Unwrap(env, info, 0, NULL);
+  if (ptr == NULL || ptr->ThrowIfBusy(env)) {
+    return NULL;
+  }
+  ptr->ThrowIfError(env, snowboy_detect_update_model(ptr->detector));
+  return NULL;
 }
 
-NAN_METHOD(SnowboyDetect::SampleRate) {
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  int sampleRate = ptr->detector->SampleRate();
-  info.GetReturnValue().Set(Nan::New(sampleRate));
+napi_value SnowboyDetect::NumHotwords(napi_env env, napi_callback_info info) {
+  SnowboyDetect* ptr = Unwrap(env, info, 0, NULL);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  int numHotwords = snowboy_detect_num_hotwords(ptr->detector);
+  if (ptr->ThrowIfError(env, numHotwords)) {
+    return NULL;
+  }
+  return MakeInt(env, numHotwords);
 }
 
-NAN_METHOD(SnowboyDetect::NumChannels) {
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  int numChannels = ptr->detector->NumChannels();
-  info.GetReturnValue().Set(Nan::New(numChannels));
+napi_value SnowboyDetect::SampleRate(napi_env env, napi_callback_info info) {
+  SnowboyDetect* ptr = Unwrap(env, info, 0, NULL);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  int sampleRate = snowboy_detect_sample_rate(ptr->detector);
+  if (ptr->ThrowIfError(env, sampleRate)) {
+    return NULL;
+  }
+  return MakeInt(env, sampleRate);
 }
 
-NAN_METHOD(SnowboyDetect::BitsPerSample) {
-  SnowboyDetect* ptr = Nan::ObjectWrap::Unwrap<SnowboyDetect>(info.Holder());
-  int bitsPerSample = ptr->detector->BitsPerSample();
-  info.GetReturnValue().Set(Nan::New(bitsPerSample));
+napi_value SnowboyDetect::NumChannels(napi_env env, napi_callback_info info) {
+  SnowboyDetect* ptr = Unwrap(env, info, 0, NULL);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  int numChannels = snowboy_detect_num_channels(ptr->detector);
+  if (ptr->ThrowIfError(env, numChannels)) {
+    return NULL;
+  }
+  return MakeInt(env, numChannels);
 }
 
+napi_value SnowboyDetect::BitsPerSample(napi_env env,
+                                        napi_callback_info info) {
+  SnowboyDetect* ptr = Unwrap(env, info, 0, NULL);
+  if (ptr == NULL) {
+    return NULL;
+  }
+  int bitsPerSample = snowboy_detect_bits_per_sample(ptr->detector);
+  if (ptr->ThrowIfError(env, bitsPerSample)) {
+    return NULL;
+  }
+  return MakeInt(env, bitsPerSample);
+}
 
-NODE_MODULE(SnowboyDetect, SnowboyDetect::Init)
+// Context-aware: called once for every environment (main thread or worker)
+// that loads the addon.
+NAPI_MODULE_INIT() {
+  return SnowboyDetect::Init(env, exports);
+}
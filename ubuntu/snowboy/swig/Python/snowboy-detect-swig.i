@@ -9,11 +9,129 @@
 %include "std_string.i"
 
 %{
+#include <climits>
+#include <cstring>
+
 #include "include/snowboy-detect.h"
+#include "include/snowboy-detect-c.h"
+
+// Samples of an object that supports the buffer protocol (bytes, bytearray,
+// memoryview, array.array, numpy arrays), read in place. The buffer is
+// released when the object goes out of scope, i.e. when the wrapper returns.
+class AudioBuffer {
+ public:
+  AudioBuffer() : item_size_(1) { view_.obj = NULL; }
+  ~AudioBuffer() {
+    if (view_.obj != NULL) {
+      PyBuffer_Release(&view_);
+    }
+  }
+
+  // Acquires <obj> if it is C-contiguous, with <item_size>-byte items in one
+  // of the struct <formats> (e.g. "h" for int16_t) in native byte order. With
+  // <raw_bytes>, unformatted byte buffers such as bytes qualify as well; a
+  // trailing partial item is ignored. Otherwise returns false with a Python
+  // exception set.
+  bool Acquire(PyObject* obj, const char* formats, Py_ssize_t item_size,
+               bool raw_bytes) {
+    item_size_ = item_size;
+    if (PyObject_GetBuffer(obj, &view_,
+                           PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+      view_.obj = NULL;
+      return false;
+    }
+    const char* format = view_.format != NULL ? view_.format : "B";
+    const uint16_t one = 1;
+    const bool little_endian = *reinterpret_cast<const char*>(&one) == 1;
+    if (*format == '@' || *format == '=' ||
+        (*format == '<' && little_endian) ||
+        ((*format == '>' || *format == '!') && !little_endian)) {
+      ++format;
+    }
+    if (*format != '\0' && format[1] == '\0') {
+      if (raw_bytes && view_.itemsize == 1 && strchr("Bbc", *format) != NULL) {
+        return true;
+      }
+      if (view_.itemsize == item_size && strchr(formats, *format) != NULL) {
+        return true;
+      }
+    }
+    PyBuffer_Release(&view_);
+    view_.obj = NULL;
+    PyErr_Format(PyExc_TypeError, "expected a contiguous buffer of "
+                 "'%s' items", formats);
+    return false;
+  }
+
+  const void* data() const { return view_.buf; }
+  Py_ssize_t num_items() const { return view_.len / item_size_; }
+
+ private:
+  Py_buffer view_;
+  Py_ssize_t item_size_;
+};
 %}
 
+// RunDetection() and the C interface read audio from any object with the
+// buffer protocol without copying it: int16 samples from bytes, bytearray,
+// memoryview or an int16 array, float samples (on the int16 scale) from a
+// float32 array and int32 samples from an int32 array, e.g.
+//   detector.RunDetection(numpy.zeros(1600, dtype=numpy.int16))
+// They are checked before std::string, so that bytes no longer go through a
+// string copy; RunDetection(const std::string&) remains for str on Python 2.
+%define %snowboy_audio_typemaps(TYPE, FORMATS, RAW_BYTES, PRECEDENCE)
+%typemap(typecheck, precedence=PRECEDENCE)
+    (const TYPE* const data, const int array_length),
+    (const TYPE* data, size_t num_samples) {
+  AudioBuffer buffer;
+  $1 = buffer.Acquire($input, FORMATS, sizeof(TYPE), RAW_BYTES) ? 1 : 0;
+  PyErr_Clear();
+}
+%typemap(in) (const TYPE* const data, const int array_length)
+    (AudioBuffer buffer) {
+  if (!buffer.Acquire($input, FORMATS, sizeof(TYPE), RAW_BYTES)) {
+    SWIG_fail;
+  }
+  if (buffer.num_items() > INT_MAX) {
+    PyErr_SetString(PyExc_OverflowError, "too many samples");
+    SWIG_fail;
+  }
+  $1 = static_cast<const TYPE*>(buffer.data());
+  $2 = static_cast<int>(buffer.num_items());
+}
+%typemap(in) (const TYPE* data, size_t num_samples) (AudioBuffer buffer) {
+  if (!buffer.Acquire($input, FORMATS, sizeof(TYPE), RAW_BYTES)) {
+    SWIG_fail;
+  }
+  $1 = static_cast<const TYPE*>(buffer.data());
+  $2 = static_cast<size_t>(buffer.num_items());
+}
+%enddef
+
+%snowboy_audio_typemaps(int16_t, "h", true, 10)
+%snowboy_audio_typemaps(float, "f", false, 11)
+%snowboy_audio_typemaps(int32_t, "il", false, 12)
+
 %include "include/snowboy-detect.h"
 
+// The C interface of include/snowboy-detect-c.h.
+//   detector = snowboydetect.snowboy_detect_new(resource, model)
+//   result = snowboydetect.snowboy_detect_run_int16(detector, data, 0)
+%ignore snowboy_detect_create;
+%ignore snowboy_detect_create_with_error;
+%ignore snowboy_detect_get_sensitivity;
+%include "include/snowboy-detect-c.h"
+
+%inline %{
+// Returns a new detector, or None if it cannot be constructed.
+snowboy_detect_t* snowboy_detect_new(const char* resource_filename,
+                                     const char* model_str) {
+  snowboy_detect_t* detector = NULL;
+  snowboy_detect_create(resource_filename, model_str, &detector);
+  return detector;
+}
+%}
+
 // below is Python 3 support, however,
 // adding it will generate wrong .so file
 // for Fedora 25 on ARMv7. So be sure to 